@@ -0,0 +1,162 @@
+/*
+ * Copyright (c) 2013 Joseph Gaeddert
+ *
+ * This file is part of liquid.
+ *
+ * liquid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * liquid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with liquid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+//
+// amc.h
+//
+// closed-loop adaptive modulation and coding (AMC) controller with
+// link-quality feedback
+//
+
+#ifndef __AMC_H__
+#define __AMC_H__
+
+#include <liquid/liquid.h>
+
+// modulation and coding option; tables are ordered by increasing
+// spectral efficiency
+struct amc_entry_s {
+    modulation_scheme ms;           // modulation scheme
+    fec_scheme        fec0;         // inner forward error-correction scheme
+    fec_scheme        fec1;         // outer forward error-correction scheme
+    float             evm_max;      // highest (worst) EVM supporting this entry [dB]
+};
+
+// 
+// amc object interface declarations
+//
+// The controller tracks a smoothed EVM and the packet error rate over
+// a sliding window of recent packets on one link. It steps up to the
+// next entry once the EVM is below that entry's threshold by the
+// hysteresis margin and the PER is low, and steps down as soon as the
+// EVM exceeds the current entry's threshold (plus hysteresis) or the
+// PER is high. After each change the window restarts so that decisions
+// are based only on packets sent with the new entry.
+//
+// The controller is driven by how the peer received this end's frames.
+// Each end measures the frames it receives with amc_observe() and
+// returns the result to its peer in a short report carried with its
+// own frames (amc_report_write()); amc_report_read() feeds the outcomes
+// the peer reported into the controller. amc_update() feeds outcomes
+// directly, e.g. when sender and receiver are the same program.
+//
+// Report layout (AMC_REPORT_LEN bytes):
+//  [0]     : AMC_REPORT_ID
+//  [1]     : table entry of the frames counted (0xff: none yet)
+//  [2]     : frames received intact with that entry (modulo 256)
+//  [3]     : frames received in error with that entry (modulo 256)
+//  [4]     : smoothed EVM of those frames, -0.25 dB steps (0xff: none)
+//
+// Counts restart whenever the received entry changes, so a report only
+// describes frames sent with the entry it names. Both ends must use the
+// same table.
+//
+
+#define AMC_REPORT_LEN  (5)
+#define AMC_REPORT_ID   (0xac)
+
+typedef struct amc_s * amc;
+
+// create AMC controller
+//  _table          :   modulation/coding table (NULL: default table)
+//  _num_entries    :   number of table entries
+amc amc_create(const struct amc_entry_s * _table,
+               unsigned int               _num_entries);
+
+// destroy AMC controller
+void amc_destroy(amc _q);
+
+// print controller state and table
+void amc_print(amc _q);
+
+// reset history and return to the most robust entry
+void amc_reset(amc _q);
+
+// set hysteresis margin [dB], default: 1 dB
+void amc_set_hysteresis(amc   _q,
+                        float _hysteresis);
+
+// set PER thresholds for stepping up (default: 0.02) and down (default: 0.1)
+void amc_set_per_thresholds(amc   _q,
+                            float _per_up,
+                            float _per_down);
+
+// set number of packets required after a change before stepping up
+// (default: 16) and down (default: 4)
+void amc_set_hold(amc          _q,
+                  unsigned int _hold_up,
+                  unsigned int _hold_down);
+
+// select table entry explicitly (restarts history)
+void amc_set_index(amc          _q,
+                   unsigned int _index);
+
+// update with outcome of a packet on the link
+//  _q              :   AMC controller
+//  _valid          :   packet was received intact?
+//  _evm            :   error vector magnitude reported for it [dB]
+void amc_update(amc   _q,
+                int   _valid,
+                float _evm);
+
+// update with a packet that was lost altogether (no EVM available)
+void amc_update_lost(amc _q);
+
+// measure a frame received from the peer, typically from within the
+// framesync callback
+//  _q              :   AMC controller
+//  _header_valid   :   header was received intact?
+//  _payload_valid  :   payload was received intact?
+//  _stats          :   frame statistics (EVM, scheme)
+void amc_observe(amc              _q,
+                 int              _header_valid,
+                 int              _payload_valid,
+                 framesyncstats_s _stats);
+
+// write report of frames received from the peer
+//  _q              :   AMC controller
+//  _report         :   output report [size: AMC_REPORT_LEN x 1]
+void amc_report_write(amc             _q,
+                      unsigned char * _report);
+
+// update with a report from the peer on frames this end sent; returns
+// the number of packet outcomes applied, or -1 if the report is invalid
+int amc_report_read(amc                   _q,
+                    const unsigned char * _report);
+
+// get currently selected scheme
+void amc_get_scheme(amc                 _q,
+                    modulation_scheme * _ms,
+                    fec_scheme *        _fec0,
+                    fec_scheme *        _fec1);
+
+// accessor methods
+unsigned int amc_get_num_entries(amc _q);   // number of table entries
+unsigned int amc_get_index(amc _q);         // selected table entry
+unsigned int amc_get_num_changes(amc _q);   // number of scheme changes
+float        amc_get_evm(amc _q);           // smoothed EVM [dB]
+float        amc_get_per(amc _q);           // packet error rate over window
+float        amc_get_efficiency(amc _q);    // selected entry [bits/symbol]
+float        amc_get_goodput(amc _q);       // efficiency x (1 - PER) [bits/symbol]
+
+// spectral efficiency of a modulation and coding option [bits/symbol]
+float amc_entry_efficiency(const struct amc_entry_s * _entry);
+
+#endif // __AMC_H__
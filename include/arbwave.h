@@ -0,0 +1,85 @@
+/*
+ * Copyright (c) 2013 Joseph Gaeddert
+ *
+ * This file is part of liquid.
+ *
+ * liquid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * liquid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with liquid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+//
+// arbwave.h
+//
+// arbitrary waveform playback: a transmit waveform rendered once (or
+// loaded from file) at the device rate and streamed in a loop
+//
+// A rendered waveform is one period of a periodic baseband signal run
+// through the transmit resampler twice, keeping the second pass: the
+// filter states at its start are those left by its own end, so the
+// loop wraps without a seam. This is exact when the resampler consists
+// of halfband stages only (device rate a power-of-two multiple of the
+// baseband rate); a fractional stage may leave a sub-sample jump.
+//
+// Files hold interleaved 32-bit float I/Q samples at the device rate.
+//
+
+#ifndef __ARBWAVE_H__
+#define __ARBWAVE_H__
+
+#include <complex>
+#include "resampchain.h"
+
+typedef struct arbwave_s * arbwave;
+
+// render waveform from one period of a periodic baseband signal
+//  _resamp     :   interpolating resampler to the device rate (reset
+//                  and run by this function)
+//  _x          :   baseband period [size: _nx x 1]
+//  _nx         :   baseband period length; must render to a whole
+//                  number of device samples (see resampchain_is_periodic())
+arbwave arbwave_create_periodic(resampchain           _resamp,
+                                std::complex<float> * _x,
+                                unsigned int          _nx);
+
+// load waveform from file; returns NULL if it cannot be read or is empty
+arbwave arbwave_create_from_file(const char * _filename);
+
+// destroy waveform
+void arbwave_destroy(arbwave _q);
+
+// print waveform properties and playback state
+void arbwave_print(arbwave _q);
+
+// save waveform to file; returns 0 on success
+int arbwave_save(arbwave      _q,
+                 const char * _filename);
+
+// set playback gain: loop k is scaled by _gain_dB + (k mod _num_steps)
+// times _step_dB (_num_steps: 1 for a constant gain)
+void arbwave_set_gain(arbwave      _q,
+                      float        _gain_dB,
+                      float        _step_dB,
+                      unsigned int _num_steps);
+
+// read up to _n samples of playback, stopping at the end of the loop
+// so that one call never spans two loops; returns number of samples
+unsigned int arbwave_read(arbwave               _q,
+                          std::complex<float> * _y,
+                          unsigned int          _n);
+
+// get waveform length [samples] and number of completed loops
+unsigned int           arbwave_get_num_samples(arbwave _q);
+unsigned long long int arbwave_get_num_loops(arbwave _q);
+
+#endif // __ARBWAVE_H__
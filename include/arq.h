@@ -0,0 +1,149 @@
+/*
+ * Copyright (c) 2013 Joseph Gaeddert
+ *
+ * This file is part of liquid.
+ *
+ * liquid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * liquid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with liquid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+//
+// arq.h
+//
+// selective-repeat automatic repeat request (ARQ) with block
+// acknowledgements and adaptive retransmission timeout
+//
+
+#ifndef __ARQ_H__
+#define __ARQ_H__
+
+//
+// Frame header layout (8 bytes):
+//  [0..1]  : data sequence number, big endian (valid with ARQ_FLAG_DATA)
+//  [2]     : flags
+//  [3]     : ARQ_HEADER_ID
+//  [4..5]  : ack base: next sequence number expected in order, big
+//            endian (valid with ARQ_FLAG_ACK)
+//  [6..7]  : ack bitmap: bit i set if sequence number base+1+i has been
+//            received, big endian (valid with ARQ_FLAG_ACK)
+//
+// Every frame carries the latest block ack for the reverse direction,
+// so both ends may send data. Ack-only frames carry a one-byte pad
+// payload. ARQ_FLAG_POLL marks the last frame of a burst and asks the
+// peer to respond.
+//
+// Frames are sent in order, so a frame that is still unacknowledged
+// when one transmitted after it has been acknowledged is retransmitted
+// immediately rather than waiting for its timer, including a frame
+// lost within a burst sent at a single time instant. The retransmission timeout tracks
+// a smoothed round-trip time and its deviation, sampled only from
+// frames acknowledged on their first transmission, and doubles on
+// each expiry. Both ends must use the same window size.
+//
+
+#define ARQ_HEADER_ID   (0xa7)
+#define ARQ_FLAG_DATA   (0x01)
+#define ARQ_FLAG_ACK    (0x02)
+#define ARQ_FLAG_POLL   (0x04)
+#define ARQ_MAX_WINDOW  (16)
+
+// in-order delivery callback
+typedef void (*arq_callback)(unsigned char * _payload,
+                             unsigned int    _payload_len,
+                             void *          _userdata);
+
+// 
+// arq object interface declarations
+//
+// Times are in seconds on any monotonic clock supplied by the caller.
+// The object is not thread-safe.
+//
+
+typedef struct arq_s * arq;
+
+// create ARQ endpoint
+//  _window         :   window size [frames], in [1,ARQ_MAX_WINDOW]
+//  _max_payload_len:   maximum payload length [bytes]
+//  _callback       :   delivery callback
+//  _userdata       :   user-defined data passed to callback
+arq arq_create(unsigned int _window,
+               unsigned int _max_payload_len,
+               arq_callback _callback,
+               void *       _userdata);
+
+// destroy ARQ endpoint
+void arq_destroy(arq _q);
+
+// print statistics
+void arq_print(arq _q);
+
+// reset sequence numbers, window contents and statistics
+void arq_reset(arq _q);
+
+// set retransmission timeout initial value and limits [s]
+void arq_set_rto(arq   _q,
+                 float _rto_init,
+                 float _rto_min,
+                 float _rto_max);
+
+// queue payload for reliable delivery (copied); returns 0 on success,
+// -1 if the window is full
+int arq_tx_push(arq             _q,
+                unsigned char * _payload,
+                unsigned int    _payload_len);
+
+// get next frame to send: due retransmissions first, then new data,
+// then an ack-only frame if one is owed; returns 1 if a frame was
+// written, 0 if there is nothing to send
+//  _q          :   ARQ endpoint
+//  _now        :   current time [s]
+//  _header     :   output header [size: 8 x 1]
+//  _payload    :   output payload [size: max_payload_len x 1]
+//  _payload_len:   output payload length [bytes]
+int arq_tx_pop(arq             _q,
+               double          _now,
+               unsigned char * _header,
+               unsigned char * _payload,
+               unsigned int *  _payload_len);
+
+// time until the next frame is due [s]: 0 if a frame is due now, -1 if
+// nothing is outstanding
+float arq_tx_next_timeout(arq    _q,
+                          double _now);
+
+// process received frame (typically from within framesync callback);
+// returns frame flags, or -1 if the header is invalid or does not
+// belong to ARQ
+int arq_rx_execute(arq             _q,
+                   double          _now,
+                   unsigned char * _header,
+                   int             _header_valid,
+                   unsigned char * _payload,
+                   unsigned int    _payload_len,
+                   int             _payload_valid);
+
+// window state
+unsigned int arq_tx_space(arq _q);          // free window slots
+unsigned int arq_tx_outstanding(arq _q);    // frames awaiting ack
+int          arq_ack_pending(arq _q);       // is an ack owed to the peer?
+
+// accessor methods
+float        arq_get_rto(arq _q);               // retransmission timeout [s]
+float        arq_get_srtt(arq _q);              // smoothed round-trip time [s]
+unsigned int arq_get_num_transmissions(arq _q); // data frames sent
+unsigned int arq_get_num_retransmissions(arq _q);// data frames resent
+unsigned int arq_get_num_acked(arq _q);         // data frames acknowledged
+unsigned int arq_get_num_delivered(arq _q);     // payloads delivered in order
+unsigned int arq_get_num_duplicates(arq _q);    // duplicate data frames received
+
+#endif // __ARQ_H__
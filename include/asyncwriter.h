@@ -0,0 +1,80 @@
+/*
+ * Copyright (c) 2013 Joseph Gaeddert
+ *
+ * This file is part of liquid.
+ *
+ * liquid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * liquid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with liquid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+//
+// asyncwriter.h
+//
+// buffered file writer with background (disk) thread
+//
+
+#ifndef __ASYNCWRITER_H__
+#define __ASYNCWRITER_H__
+
+// 
+// asyncwriter object interface declarations
+//
+// Data are copied into one of two internal buffers; a background
+// thread writes full buffers to disk so that the caller (e.g. a
+// frame synchronizer callback) never blocks on file i/o.  If the
+// disk cannot keep up, blocks are dropped rather than stalling the
+// caller, and counted.
+//
+
+typedef struct asyncwriter_s * asyncwriter;
+
+// create asyncwriter object
+//  _filename   :   output filename (truncated if it exists)
+//  _buffer_len :   size of each internal buffer [bytes]
+asyncwriter asyncwriter_create(const char * _filename,
+                               unsigned int _buffer_len);
+
+// destroy asyncwriter object, writing all pending data to disk
+void asyncwriter_destroy(asyncwriter _q);
+
+// write block of data; the block is either written in its entirety
+// or dropped altogether (never split)
+//  _q          :   asyncwriter object
+//  _data       :   data block [size: _n x 1]
+//  _n          :   block size [bytes]
+//  returns file offset of the block, or -1 if the block was dropped
+long long int asyncwriter_write(asyncwriter  _q,
+                                const void * _data,
+                                unsigned int _n);
+
+// write block of data, blocking until the background thread has
+// made enough room; use this for file headers and trailers and never
+// from within a time-critical (e.g. receiver) thread
+//  _q          :   asyncwriter object
+//  _data       :   data block [size: _n x 1]
+//  _n          :   block size [bytes]
+//  returns file offset of the block
+long long int asyncwriter_write_wait(asyncwriter  _q,
+                                     const void * _data,
+                                     unsigned int _n);
+
+// get total number of bytes accepted so far (file offset of next block)
+long long int asyncwriter_get_offset(asyncwriter _q);
+
+// get number of blocks/bytes dropped because the disk was too slow
+unsigned int       asyncwriter_get_num_dropped(asyncwriter _q);
+unsigned long long asyncwriter_get_num_bytes_dropped(asyncwriter _q);
+
+#endif // __ASYNCWRITER_H__
+
@@ -0,0 +1,111 @@
+/*
+ * Copyright (c) 2013 Joseph Gaeddert
+ *
+ * This file is part of liquid.
+ *
+ * liquid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * liquid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with liquid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+//
+// bufpool.h
+//
+// fixed-size pool of reference-counted receive buffers
+//
+
+#ifndef __BUFPOOL_H__
+#define __BUFPOOL_H__
+
+#include <liquid/liquid.h>
+
+// maximum header length stored per buffer [bytes]
+#define BUFPOOL_MAX_HEADER_LEN  (16)
+
+// 
+// bufpool object interface declarations
+//
+// All buffers are allocated when the pool is created; acquiring and
+// releasing them uses a lock-free free list, so that received frames
+// can be handed out without any heap allocation in steady state. When
+// every buffer is in use, acquisition fails and is counted.
+//
+
+typedef struct bufpool_s * bufpool;
+typedef struct rxbuf_s *   rxbuf;
+
+// received frame held in a pool buffer; a handle starts with one
+// reference and returns to its pool when the last one is released
+struct rxbuf_s {
+    unsigned char header[BUFPOOL_MAX_HEADER_LEN];
+    int header_valid;
+    unsigned char * payload;        // [size: buffer_len x 1]
+    unsigned int payload_len;
+    int payload_valid;
+    framesyncstats_s stats;         // framesyms is always NULL
+    double time;                    // device time of first sample [s] (-1: unknown)
+
+    // internal
+    bufpool pool;
+    unsigned int index;
+    unsigned int refcount;
+};
+
+// received buffer callback; the handle remains valid after returning
+// only if the callee takes a reference with rxbuf_retain()
+typedef int (*rxbuf_callback)(rxbuf  _buf,
+                              void * _userdata);
+
+// create buffer pool
+//  _num_buffers    :   number of buffers
+//  _buffer_len     :   payload capacity of each buffer [bytes]
+bufpool bufpool_create(unsigned int _num_buffers,
+                       unsigned int _buffer_len);
+
+// destroy buffer pool; all handles must have been released
+void bufpool_destroy(bufpool _q);
+
+// print pool statistics
+void bufpool_print(bufpool _q);
+
+// acquire empty buffer (one reference); returns NULL if the pool is
+// exhausted
+rxbuf bufpool_acquire(bufpool _q);
+
+// acquire buffer and copy received frame into it (typically from
+// within a framesync callback); returns NULL if the pool is exhausted
+// or the payload does not fit
+rxbuf bufpool_acquire_frame(bufpool          _q,
+                            unsigned char *  _header,
+                            unsigned int     _header_len,
+                            int              _header_valid,
+                            unsigned char *  _payload,
+                            unsigned int     _payload_len,
+                            int              _payload_valid,
+                            framesyncstats_s _stats);
+
+// add reference to buffer
+void rxbuf_retain(rxbuf _buf);
+
+// drop reference to buffer, returning it to its pool on the last one
+void rxbuf_release(rxbuf _buf);
+
+// accessor methods
+unsigned int bufpool_get_buffer_len(bufpool _q);    // payload capacity [bytes]
+unsigned int bufpool_get_num_free(bufpool _q);      // buffers available
+unsigned int bufpool_get_min_free(bufpool _q);      // low-water mark of available buffers
+unsigned int bufpool_get_num_acquired(bufpool _q);  // successful acquisitions
+unsigned int bufpool_get_num_exhausted(bufpool _q); // failed acquisitions (pool empty)
+unsigned int bufpool_get_num_oversized(bufpool _q); // frames too long for a buffer
+
+#endif // __BUFPOOL_H__
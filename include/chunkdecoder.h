@@ -0,0 +1,137 @@
+/*
+ * Copyright (c) 2013 Joseph Gaeddert
+ *
+ * This file is part of liquid.
+ *
+ * liquid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * liquid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with liquid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+//
+// chunkdecoder.h
+//
+// parallel frame decoder: splits a sample stream into overlapping
+// chunks and runs independent synchronizer instances on each
+//
+
+#ifndef __CHUNKDECODER_H__
+#define __CHUNKDECODER_H__
+
+#include <complex>
+#include <liquid/liquid.h>
+
+// 
+// chunkdecoder object interface declarations
+//
+// Samples pushed into the object are cut into chunks of _chunk_len
+// samples.  Each chunk is handed to a worker thread together with the
+// preceding _overlap_len samples (lead-in) so that the synchronizer can
+// acquire frames which straddle the chunk boundary.  A frame belongs to
+// the chunk in which its callback fires outside of the lead-in; frames
+// detected during the lead-in were already reported by the previous
+// chunk and are discarded, as are duplicate detections with identical
+// headers close to a chunk boundary.  The overlap length must therefore
+// be at least as long as the longest frame.
+//
+// Frames are delivered to the user callback in time order, one at a
+// time (never concurrently), from whichever worker thread completes the
+// oldest outstanding chunk.  The framesyms field of the statistics
+// structure is not available (set to NULL).
+//
+// At most two chunks per worker are outstanding; when all are busy,
+// pushing samples blocks.  In a live stream the added latency is thus
+// bounded by the chunk duration times the number of outstanding chunks.
+//
+
+typedef struct chunkdecoder_s * chunkdecoder;
+
+// synchronizer hooks; each worker thread owns one synchronizer instance
+//  create  :   create synchronizer invoking _callback with _userdata[i]
+//              for channel i (_context is passed through untouched)
+//  reset   :   reset synchronizer before each chunk
+//  execute :   push block of samples through synchronizer
+//  destroy :   destroy synchronizer
+typedef void * (*chunkdecoder_create_hook) (framesync_callback _callback,
+                                            void **            _userdata,
+                                            void *             _context);
+typedef void   (*chunkdecoder_reset_hook)  (void * _sync);
+typedef void   (*chunkdecoder_execute_hook)(void *                _sync,
+                                            std::complex<float> * _x,
+                                            unsigned int          _n);
+typedef void   (*chunkdecoder_destroy_hook)(void * _sync);
+
+// create chunkdecoder object
+//  _num_threads    :   number of worker threads (0: number of cores)
+//  _chunk_len      :   chunk length [samples]
+//  _overlap_len    :   lead-in overlap between chunks [samples]
+//  _header_len     :   frame header length [bytes]
+//  _num_channels   :   number of channels per synchronizer instance
+//  _create         :   synchronizer create hook
+//  _reset          :   synchronizer reset hook
+//  _execute        :   synchronizer execute hook
+//  _destroy        :   synchronizer destroy hook
+//  _context        :   context passed to create hook
+//  _callback       :   user callback
+//  _userdata       :   user data, one per channel [size: _num_channels x 1]
+chunkdecoder chunkdecoder_create(unsigned int              _num_threads,
+                                 unsigned int              _chunk_len,
+                                 unsigned int              _overlap_len,
+                                 unsigned int              _header_len,
+                                 unsigned int              _num_channels,
+                                 chunkdecoder_create_hook  _create,
+                                 chunkdecoder_reset_hook   _reset,
+                                 chunkdecoder_execute_hook _execute,
+                                 chunkdecoder_destroy_hook _destroy,
+                                 void *                    _context,
+                                 framesync_callback        _callback,
+                                 void **                   _userdata);
+
+// destroy chunkdecoder object (flushes pending samples first)
+void chunkdecoder_destroy(chunkdecoder _q);
+
+// print chunkdecoder object properties and counters
+void chunkdecoder_print(chunkdecoder _q);
+
+// push samples into decoder; blocks while all workers are busy
+void chunkdecoder_execute(chunkdecoder          _q,
+                          std::complex<float> * _x,
+                          unsigned int          _n);
+
+// decode remaining samples and wait until all frames have been delivered
+void chunkdecoder_flush(chunkdecoder _q);
+
+// flush and restart stream: the next sample pushed is treated as
+// discontinuous with the last (no lead-in), e.g. after a receiver stop
+void chunkdecoder_reset(chunkdecoder _q);
+
+// decode entire file of interleaved 32-bit float I/Q samples and flush;
+// returns number of samples read, or -1 if the file could not be opened
+long long int chunkdecoder_execute_file(chunkdecoder _q,
+                                        const char * _filename);
+
+// get sample index at which the frame currently being delivered was
+// detected; only meaningful from within the user callback
+unsigned long long int chunkdecoder_get_frame_index(chunkdecoder _q);
+
+// get number of threads and counters
+unsigned int chunkdecoder_get_num_threads(chunkdecoder _q);
+unsigned long long int chunkdecoder_get_num_samples(chunkdecoder _q);
+unsigned int chunkdecoder_get_num_duplicates(chunkdecoder _q);
+
+// get maximum time between handing a chunk to the workers and having
+// delivered all of its frames [s]
+float chunkdecoder_get_max_latency(chunkdecoder _q);
+
+#endif // __CHUNKDECODER_H__
+
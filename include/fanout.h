@@ -0,0 +1,88 @@
+/*
+ * Copyright (c) 2013 Joseph Gaeddert
+ *
+ * This file is part of liquid.
+ *
+ * liquid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * liquid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with liquid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+//
+// fanout.h
+//
+// fan one sample stream out to several processing branches, each
+// running on its own thread
+//
+
+#ifndef __FANOUT_H__
+#define __FANOUT_H__
+
+#include <complex>
+
+// maximum number of samples handed to a branch callback at once
+#define FANOUT_MAX_BLOCK_LEN    (4096)
+
+// 
+// fanout object interface declarations
+//
+// The receiver copies samples into one shared ring buffer (never
+// blocking); every branch reads the ring independently at its own
+// pace and processes blocks on its own thread. A branch falling
+// behind by more than the ring buffer skips the oldest samples, and
+// counts them, without affecting the receiver or the other branches.
+//
+
+typedef struct fanout_s * fanout;
+
+// branch callback, invoked on the branch's thread
+//  _x          :   samples [size: _n x 1], _n <= FANOUT_MAX_BLOCK_LEN
+//  _n          :   number of samples
+//  _userdata   :   user data given to fanout_add_branch()
+typedef void (*fanout_callback)(std::complex<float> * _x,
+                                unsigned int          _n,
+                                void *                _userdata);
+
+// create fanout object
+//  _ring_len   :   ring buffer length [samples] (0: default of 2^20)
+fanout fanout_create(unsigned int _ring_len);
+
+// destroy fanout object; branches process all samples written so far
+// before their threads are joined
+void fanout_destroy(fanout _q);
+
+// print fanout statistics
+void fanout_print(fanout _q);
+
+// add branch (before fanout_start()); returns branch index
+unsigned int fanout_add_branch(fanout          _q,
+                               fanout_callback _callback,
+                               void *          _userdata);
+
+// start branch threads
+void fanout_start(fanout _q);
+
+// push samples to all branches (never blocks)
+void fanout_write(fanout                _q,
+                  std::complex<float> * _x,
+                  unsigned int          _n);
+
+// accessor methods
+unsigned int           fanout_get_num_branches(fanout _q);
+unsigned long long int fanout_get_num_samples(fanout _q);           // samples written
+unsigned long long int fanout_get_num_processed(fanout       _q,    // samples processed by branch
+                                                unsigned int _branch);
+unsigned long long int fanout_get_num_dropped(fanout       _q,      // samples skipped by branch
+                                              unsigned int _branch);
+
+#endif // __FANOUT_H__
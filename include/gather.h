@@ -0,0 +1,51 @@
+/*
+ * Copyright (c) 2013 Joseph Gaeddert
+ *
+ * This file is part of liquid.
+ *
+ * liquid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * liquid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with liquid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+//
+// gather.h
+//
+// scatter-gather (iovec) payload support for the transmitters
+//
+
+#ifndef __GATHER_H__
+#define __GATHER_H__
+
+#include <sys/uio.h>
+
+// total length of payload segments [bytes]
+unsigned int gather_length(const struct iovec * _iov,
+                           unsigned int         _iovcnt);
+
+// present payload segments as one contiguous block; a single segment
+// is returned as-is, several are copied into *_buffer, which is grown
+// (realloc) only when a payload exceeds every previous one. Returns a
+// pointer to the contiguous payload.
+//  _iov        :   payload segments [size: _iovcnt x 1]
+//  _iovcnt     :   number of segments
+//  _buffer     :   scratch buffer owned by the caller (may start NULL)
+//  _buffer_len :   scratch buffer size [bytes]
+//  _len        :   output payload length [bytes]
+unsigned char * gather_iovec(const struct iovec * _iov,
+                             unsigned int         _iovcnt,
+                             unsigned char **     _buffer,
+                             unsigned int *       _buffer_len,
+                             unsigned int *       _len);
+
+#endif // __GATHER_H__
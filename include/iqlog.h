@@ -0,0 +1,140 @@
+/*
+ * Copyright (c) 2013 Joseph Gaeddert
+ *
+ * This file is part of liquid.
+ *
+ * liquid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * liquid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with liquid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+//
+// iqlog.h
+//
+// streaming binary log of received samples and/or a decimated RSSI
+// track, written during the run by a background thread
+//
+// File layout (host byte order):
+//
+//   file header    iqlog_fileheader_s
+//   blocks         iqlog_blockheader_s followed by num_values values:
+//                  IQLOG_BLOCK_IQ   : complex float samples
+//                  IQLOG_BLOCK_RSSI : float RSSI [dB], each the mean
+//                                     power of rssi_decim samples
+//
+// Blocks carry the index of their first input sample so that blocks
+// dropped by a slow disk appear as gaps; the file needs no index or
+// trailer and is readable up to the last complete block.
+//
+
+#ifndef __IQLOG_H__
+#define __IQLOG_H__
+
+#include <stdint.h>
+#include <complex>
+
+#define IQLOG_MAGIC             "LQIQRLOG"  // file header magic
+#define IQLOG_VERSION           (1)
+
+// block types
+#define IQLOG_BLOCK_IQ          (1)         // complex samples
+#define IQLOG_BLOCK_RSSI        (2)         // decimated RSSI track
+
+// on-disk file header
+struct iqlog_fileheader_s {
+    char     magic[8];          // IQLOG_MAGIC
+    uint32_t version;           // IQLOG_VERSION
+    uint32_t save_iq;           // are samples saved?
+    uint32_t rssi_decim;        // samples per RSSI value (0: no track)
+    uint32_t reserved;
+    double   sample_rate;       // sample rate [Hz]
+    double   frequency;         // center frequency [Hz]
+    double   time_start;        // log creation time [s since epoch]
+};
+
+// on-disk block header
+struct iqlog_blockheader_s {
+    uint32_t type;              // IQLOG_BLOCK_* type
+    uint32_t num_values;        // number of values in block
+    uint64_t sample_index;      // index of first input sample
+};
+
+// 
+// iqlog object interface declarations (writer)
+//
+
+typedef struct iqlog_s * iqlog;
+
+// create iqlog object
+//  _filename       :   output filename
+//  _sample_rate    :   sample rate [Hz]
+//  _frequency      :   center frequency [Hz]
+//  _save_iq        :   save samples?
+//  _rssi_decim     :   samples per RSSI value (0: no RSSI track)
+iqlog iqlog_create(const char * _filename,
+                   double       _sample_rate,
+                   double       _frequency,
+                   int          _save_iq,
+                   unsigned int _rssi_decim);
+
+// destroy iqlog object, writing partial blocks to file
+void iqlog_destroy(iqlog _q);
+
+// print iqlog statistics
+void iqlog_print(iqlog _q);
+
+// log samples (never blocks on file i/o)
+void iqlog_write(iqlog                 _q,
+                 std::complex<float> * _x,
+                 unsigned int          _n);
+
+// get number of samples logged and number of blocks dropped
+unsigned long long int iqlog_get_num_samples(iqlog _q);
+unsigned int           iqlog_get_num_dropped(iqlog _q);
+
+// 
+// iqlogreader object interface declarations (memory-mapped reader)
+//
+
+typedef struct iqlogreader_s * iqlogreader;
+
+// block; values reference the memory-mapped file and are valid until
+// the reader is closed
+struct iqlog_block_s {
+    unsigned int          type;         // IQLOG_BLOCK_* type
+    unsigned long long    sample_index; // index of first input sample
+    unsigned int          num_values;   // number of values
+    std::complex<float> * iq;           // samples (IQLOG_BLOCK_IQ)
+    float *               rssi;         // RSSI [dB] (IQLOG_BLOCK_RSSI)
+};
+
+// open log file for reading; returns NULL on error
+iqlogreader iqlogreader_open(const char * _filename);
+
+// close log file
+void iqlogreader_close(iqlogreader _q);
+
+// accessor methods
+double       iqlogreader_get_sample_rate(iqlogreader _q);
+double       iqlogreader_get_frequency(iqlogreader _q);
+double       iqlogreader_get_time_start(iqlogreader _q);
+unsigned int iqlogreader_get_rssi_decim(iqlogreader _q);
+
+// rewind to first block
+void iqlogreader_rewind(iqlogreader _q);
+
+// read next block; returns 0 on success, -1 at end of file
+int iqlogreader_next(iqlogreader            _q,
+                     struct iqlog_block_s * _block);
+
+#endif // __IQLOG_H__
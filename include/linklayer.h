@@ -0,0 +1,140 @@
+/*
+ * Copyright (c) 2013 Joseph Gaeddert
+ *
+ * This file is part of liquid.
+ *
+ * liquid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * liquid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with liquid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+//
+// linklayer.h
+//
+// aggregation and segmentation of service data units (SDUs) into
+// frame payloads, amortizing the per-frame preamble and header
+//
+
+#ifndef __LINKLAYER_H__
+#define __LINKLAYER_H__
+
+#include <liquid/liquid.h>
+
+//
+// Frame payload layout: a sequence of records, each starting with a
+// one-byte flags field; a zero flags byte (or the end of the payload)
+// terminates the frame.
+//
+//  complete SDU    : [flags=FIRST|LAST][length:2][data]
+//  SDU segment     : [flags=SEGMENT|...][length:2][sdu id:2][offset:2][data]
+//
+// Segments of an SDU are sent in order; the receiver discards a partial
+// SDU as soon as a segment is missing. Transmit and receive state are
+// independent, so one thread may push/pop while another unpacks.
+//
+
+#define LINKLAYER_FLAG_FIRST    (0x01)
+#define LINKLAYER_FLAG_LAST     (0x02)
+#define LINKLAYER_FLAG_SEGMENT  (0x04)
+#define LINKLAYER_MAX_SDU_LEN   (65535)
+
+// received SDU callback
+typedef void (*linklayer_callback)(unsigned char * _sdu,
+                                   unsigned int    _sdu_len,
+                                   void *          _userdata);
+
+// compute frame payload length maximizing expected goodput for an
+// ofdmflexframegen configuration, i.e. the length that fills the last
+// OFDM symbol and balances preamble/header overhead against the
+// probability of losing long frames
+//  _M          :   number of subcarriers
+//  _cp_len     :   cyclic prefix length
+//  _taper_len  :   taper length
+//  _p          :   subcarrier allocation (NULL for default)
+//  _ms         :   modulation scheme
+//  _fec0       :   inner forward error-correction scheme
+//  _fec1       :   outer forward error-correction scheme
+//  _ber        :   expected post-FEC bit error rate (0 for none)
+//  _max_len    :   maximum frame payload length [bytes]
+unsigned int linklayer_plan_frame_len(unsigned int      _M,
+                                      unsigned int      _cp_len,
+                                      unsigned int      _taper_len,
+                                      unsigned char *   _p,
+                                      modulation_scheme _ms,
+                                      fec_scheme        _fec0,
+                                      fec_scheme        _fec1,
+                                      float             _ber,
+                                      unsigned int      _max_len);
+
+// 
+// linklayer object interface declarations
+//
+
+typedef struct linklayer_s * linklayer;
+
+// create link layer
+//  _frame_len  :   frame payload length [bytes], at least 16
+//  _queue_len  :   maximum number of queued transmit SDUs
+//  _callback   :   received SDU callback
+//  _userdata   :   user-defined data passed to callback
+linklayer linklayer_create(unsigned int       _frame_len,
+                           unsigned int       _queue_len,
+                           linklayer_callback _callback,
+                           void *             _userdata);
+
+// destroy link layer, discarding queued SDUs
+void linklayer_destroy(linklayer _q);
+
+// print link layer statistics
+void linklayer_print(linklayer _q);
+
+// reset transmit queue, receive reassembly state and counters
+void linklayer_reset(linklayer _q);
+
+// set frame payload length [bytes], e.g. from linklayer_plan_frame_len()
+void linklayer_set_frame_len(linklayer    _q,
+                             unsigned int _frame_len);
+
+// get frame payload length [bytes]
+unsigned int linklayer_get_frame_len(linklayer _q);
+
+// queue SDU for transmission; returns 0 on success, -1 if the queue is
+// full or the SDU is too long
+int linklayer_tx_push(linklayer       _q,
+                      unsigned char * _sdu,
+                      unsigned int    _sdu_len);
+
+// pack next frame payload from queued SDUs; returns payload length,
+// or 0 if nothing was produced. Unless _flush is set, a frame is only
+// produced once enough data is queued to fill it.
+//  _q          :   link layer
+//  _frame      :   output frame payload [size: frame_len x 1]
+//  _flush      :   produce partially-filled frames
+unsigned int linklayer_tx_pop(linklayer       _q,
+                              unsigned char * _frame,
+                              int             _flush);
+
+// number of queued bytes awaiting transmission
+unsigned int linklayer_tx_pending(linklayer _q);
+
+// unpack received frame payload, invoking callback for each complete
+// SDU; returns number of SDUs delivered, or -1 if the frame is malformed
+int linklayer_rx_execute(linklayer       _q,
+                         unsigned char * _frame,
+                         unsigned int    _frame_len);
+
+// note that a frame was lost (e.g. failed payload check) so that
+// partial SDUs are discarded
+void linklayer_rx_lost(linklayer _q);
+
+#endif // __LINKLAYER_H__
@@ -26,6 +26,26 @@
 
 #include <liquid/liquid.h>
 
+#include "rxclock.h"
+
+class multichannelrx;
+
+// per-channel callback context
+struct multichannelrx_context_s {
+    multichannelrx * rx;            // receiver
+    unsigned int channel;           // channel index
+};
+
+// frame synchronizer callback: tags frame with its time and invokes
+// the channel's user callback
+int multichannelrx_callback(unsigned char *  _header,
+                            int              _header_valid,
+                            unsigned char *  _payload,
+                            unsigned int     _payload_len,
+                            int              _payload_valid,
+                            framesyncstats_s _stats,
+                            void *           _userdata);
+
 class multichannelrx {
 public:
     // default constructor
@@ -57,6 +77,25 @@ public:
     void Execute(std::complex<float> * _x,
                  unsigned int          _num_samples);
 
+    // set input sample rate [samples/s]
+    void SetSampleRate(double _rate);
+
+    // set device time [s] of the next sample passed to Execute()
+    void SetTime(double _time);
+
+    // get device time [s] of the first sample of the frame being
+    // delivered, or -1 if unknown; only meaningful from within a
+    // channel callback
+    double GetFrameTime() { return frame_time; }
+
+    friend int multichannelrx_callback(unsigned char *  _header,
+                                       int              _header_valid,
+                                       unsigned char *  _payload,
+                                       unsigned int     _payload_len,
+                                       int              _payload_valid,
+                                       framesyncstats_s _stats,
+                                       void *           _userdata);
+
 private:
     // ...
     void RunChannelizer();
@@ -79,7 +118,15 @@ private:
     ofdmflexframesync * framesync;  // array of frame generator objects
     void ** userdata;               // array of userdata pointers
     framesync_callback * callback;  // array of callback functions
+    struct multichannelrx_context_s * context; // array of callback contexts
     nco_crcf nco;                   // frequency-centering NCO
+
+    // receive timestamps (counted at the input rate)
+    rxclock clock;                  // device time of input samples
+    unsigned int sample_offset;     // input position within current block
+    unsigned int frame_overhead;    // preamble and header symbols per frame
+    unsigned int M_data;            // number of data subcarriers
+    double frame_time;              // time of frame being delivered [s]
 };
 
 #endif // __MULTICHANNELRX_H__
@@ -26,6 +26,8 @@
 
 #include <liquid/liquid.h>
 
+#include "gather.h"
+
 class multichanneltx {
 public:
     // default constructor
@@ -61,6 +63,17 @@ public:
                     int             _fec0,
                     int             _fec1);
                     // frame generator properties...
+
+    // update payload data on a particular channel from a list of
+    // segments; the frame is encoded before returning, so the segments
+    // are no longer referenced afterwards
+    void UpdateData(unsigned int         _channel,
+                    unsigned char *      _header,
+                    const struct iovec * _payload,
+                    unsigned int         _payload_cnt,
+                    int                  _mod,
+                    int                  _fec0,
+                    int                  _fec1);
             
     // Generate samples for transmission
     void GenerateSamples(std::complex<float> * _buffer);
@@ -88,6 +101,8 @@ private:
     unsigned int fgbuffer_len;      // length of frame generator buffers
     unsigned int fgbuffer_index;    // read index of buffer
     nco_crcf nco;                   // frequency-centering NCO
+    unsigned char * gather;         // scatter-gather payload buffer
+    unsigned int gather_len;        // length of scatter-gather buffer
     
     //unsigned int * channel_id;      // channelizer IDs
 };
@@ -31,6 +31,7 @@
 #include <liquid/liquid.h>
 #include <uhd/usrp/multi_usrp.hpp>
 
+#include "amc.h"
 #include "multichanneltx.h"
 #include "multichannelrx.h"
 
@@ -40,6 +41,17 @@ void * multichanneltxrx_tx_worker(void * _arg);
 // receiver worker thread
 void * multichanneltxrx_rx_worker(void * _arg);
 
+// packet descriptor for batched transmission
+struct multichanneltxrx_packet_s {
+    unsigned int    channel;        // channel index
+    unsigned char * header;         // header [size: 8 x 1]
+    unsigned char * payload;        // payload [size: payload_len x 1]
+    unsigned int    payload_len;    // payload length [bytes]
+    int             mod;            // modulation scheme
+    int             fec0;           // inner forward error-correction scheme
+    int             fec1;           // outer forward error-correction scheme
+};
+
 class multichanneltxrx {
 public:
     // default constructor
@@ -64,7 +76,7 @@ public:
     // 
     // transmitter methods
     //
-    void set_tx_freq(float _tx_freq);
+    void set_tx_freq(double _tx_freq);
     void set_tx_rate(float _tx_rate);
     void set_tx_gain_soft(float _tx_gain_soft);
     void set_tx_gain_uhd(float _tx_gain_uhd);
@@ -73,6 +85,15 @@ public:
     void start_tx();
     void stop_tx();
 
+    // start transmitter at the given device time for a burst of
+    // _duration seconds (zero: until stop_tx()); a limited burst ends
+    // after exactly the corresponding number of samples, after which the
+    // transmitter idles until it is started again. The channels are
+    // reset before returning (waiting for a stopped burst to drain), so
+    // packets may be queued immediately afterwards.
+    void start_tx_at(double _time,
+                     double _duration);
+
     // update payload data on a particular channel (non-blocking)
     int transmit_packet(unsigned int    _channel,
                         unsigned char * _header,
@@ -82,22 +103,63 @@ public:
                         int             _fec0,
                         int             _fec1);
 
+    // update payload data on a particular channel from a list of
+    // segments (non-blocking); segments may be released on return
+    int transmit_packet(unsigned int         _channel,
+                        unsigned char *      _header,
+                        const struct iovec * _payload,
+                        unsigned int         _payload_cnt,
+                        int                  _mod,
+                        int                  _fec0,
+                        int                  _fec1);
+
+    // update payload data on a particular channel using the scheme
+    // selected by its adaptive modulation and coding controller
+    // (non-blocking); requires amc_enable()
+    int transmit_packet(unsigned int    _channel,
+                        unsigned char * _header,
+                        unsigned char * _payload,
+                        unsigned int    _payload_len);
+
+    // update payload data for a batch of packets (non-blocking); packets
+    // are submitted in order up to the first one whose channel is busy.
+    // Returns the number of packets submitted.
+    unsigned int transmit_packets(const struct multichanneltxrx_packet_s * _packets,
+                                  unsigned int                             _num_packets);
+
     // is channel available?
     bool is_channel_available(unsigned int _channel);
 
     // get index of next available channel (blocking)
     unsigned int get_available_channel();
 
+    // get index of next available channel, waiting at most _timeout
+    // seconds (zero: non-blocking); returns -1 if none became available
+    int get_available_channel(float _timeout);
+
     // wait for a specific channel to become available (blocking)
     void wait_for_channel(unsigned int _channel);
 
     // wait for all tx channels to be available (blocking, of course)
     void wait_for_tx_to_complete();
 
+    // enable adaptive modulation and coding with one controller per
+    // channel (NULL table selects default)
+    void amc_enable(const struct amc_entry_s * _table,
+                    unsigned int               _num_entries);
+
+    // disable adaptive modulation and coding
+    void amc_disable();
+
+    // get controller for a particular channel (NULL if disabled); the
+    // channel's receiver callback measures frames with amc_observe()
+    // and reads the peer's reports with amc_report_read()
+    amc get_amc(unsigned int _channel);
+
     // 
     // receiver methods
     //
-    void set_rx_freq(float _rx_freq);
+    void set_rx_freq(double _rx_freq);
     void set_rx_rate(float _rx_rate);
     void set_rx_gain_uhd(float _rx_gain_uhd);
     void set_rx_antenna(char * _rx_antenna);
@@ -105,6 +167,30 @@ public:
     void start_rx();
     void stop_rx();
 
+    // start receiver for a window of _duration seconds beginning at the
+    // given device time; call stop_rx() once the window has passed
+    void start_rx_at(double _time,
+                     double _duration);
+
+    // get device time [s] of the first sample of the frame being
+    // delivered, or -1 if unknown; only meaningful from within a
+    // channel callback
+    double get_frame_time() { return mcrx.GetFrameTime(); }
+
+    //
+    // device time
+    //
+    void   set_time_now(double _time);
+    double get_time_now();
+
+    // align device time to host time (whole UTC seconds) at a PPS edge;
+    // nodes whose PPS inputs and host clocks agree (e.g. GPS and NTP)
+    // then share device time. Blocks for up to about two seconds.
+    void set_time_pps();
+
+    // sleep until device time reaches _time
+    void wait_until(double _time);
+
     //
     // additional methods
     // 
@@ -136,6 +222,11 @@ private:
     pthread_cond_t  tx_cond;        // transmit condition
     bool tx_running;                // is transmitter running? (physical transmitter)
     bool tx_thread_running;         // is transmitter thread running?
+    bool tx_active;                 // is tx worker generating a burst?
+    unsigned int tx_burst;          // burst counter, incremented on each start
+    double tx_start_time;           // burst launch time (negative: now)
+    unsigned long int tx_num_samples;   // burst length (0: until stopped)
+    amc * amc_channel;              // per-channel AMC controllers (NULL if disabled)
 
     // receiver objects
     multichannelrx mcrx;            // mutlichannel receiver
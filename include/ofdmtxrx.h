@@ -31,9 +31,64 @@
 #include <liquid/liquid.h>
 #include <uhd/usrp/multi_usrp.hpp>
 
+#include "bufpool.h"
+#include "chunkdecoder.h"
+#include "gather.h"
+#include "rxclock.h"
+#include "rxqueue.h"
+
 // receiver worker thread
 void * ofdmtxrx_rx_worker(void * _arg);
 
+// frequency hopping worker thread
+void * ofdmtxrx_hop_worker(void * _arg);
+
+// packet descriptor for batched transmission
+struct ofdmtxrx_packet_s {
+    unsigned char * header;         // header [size: 8 x 1]
+    unsigned char * payload;        // payload [size: payload_len x 1]
+    unsigned int    payload_len;    // payload length [bytes]
+    int             mod;            // modulation scheme
+    int             fec0;           // inner forward error-correction scheme
+    int             fec1;           // outer forward error-correction scheme
+};
+
+// turnaround latency statistics, measured on the host: tx-to-rx runs
+// from the end of a transmission (end of burst handed to the device) to
+// the first samples processed after start_rx(); rx-to-tx runs from
+// stop_rx() to the first samples of the next transmission
+struct ofdmtxrx_turnaround_s {
+    unsigned int num_tx2rx;         // number of tx-to-rx switches
+    float        tx2rx_mean;        // mean tx-to-rx latency [s]
+    float        tx2rx_max;         // maximum tx-to-rx latency [s]
+    unsigned int num_rx2tx;         // number of rx-to-tx switches
+    float        rx2tx_mean;        // mean rx-to-tx latency [s]
+    float        rx2tx_max;         // maximum rx-to-tx latency [s]
+};
+
+// hop-set entry: tuning recorded when the hop set was loaded, replayed
+// with manual policies so that a timed retune needs no host-side work
+struct ofdmtxrx_hop_s {
+    double freq;                    // hop frequency [Hz]
+    uhd::tune_request_t tx_tune;    // transmitter tuning
+    uhd::tune_request_t rx_tune;    // receiver tuning
+};
+
+// frame synchronizer callback: forwards frames to the user callback, or
+// queues them when asynchronous delivery is enabled
+int ofdmtxrx_rx_callback(unsigned char *  _header,
+                         int              _header_valid,
+                         unsigned char *  _payload,
+                         unsigned int     _payload_len,
+                         int              _payload_valid,
+                         framesyncstats_s _stats,
+                         void *           _userdata);
+
+// segmented receiver synchronizer create hook (see chunkdecoder.h)
+void * ofdmtxrx_segment_create(framesync_callback _callback,
+                               void **            _userdata,
+                               void *             _context);
+
 class ofdmtxrx {
 public:
     // default constructor
@@ -50,13 +105,35 @@ public:
              framesync_callback _callback,
              void *             _userdata);
 
+    // loopback constructor: rather than using a usrp, transmitted
+    // samples are written to one file and received samples are read
+    // from another (e.g. named pipes created with mkfifo, which keep
+    // the samples in memory); two instances with swapped filenames
+    // form a link
+    //  _M              :   OFDM: number of subcarriers
+    //  _cp_len         :   OFDM: cyclic prefix length
+    //  _taper_len      :   OFDM: taper prefix length
+    //  _p              :   OFDM: subcarrier allocation
+    //  _callback       :   frame synchronizer callback function
+    //  _userdata       :   user-defined data structure
+    //  _tx_filename    :   transmit sample file (complex float)
+    //  _rx_filename    :   receive sample file (complex float)
+    ofdmtxrx(unsigned int       _M,
+             unsigned int       _cp_len,
+             unsigned int       _taper_len,
+             unsigned char *    _p,
+             framesync_callback _callback,
+             void *             _userdata,
+             const char *       _tx_filename,
+             const char *       _rx_filename);
+
     // destructor
     ~ofdmtxrx();
 
     // 
     // transmitter methods
     //
-    void set_tx_freq(float _tx_freq);
+    void set_tx_freq(double _tx_freq);
     void set_tx_rate(float _tx_rate);
     void set_tx_gain_soft(float _tx_gain_soft);
     void set_tx_gain_uhd(float _tx_gain_uhd);
@@ -72,34 +149,289 @@ public:
                          int             _fec1);
                          // frame generator properties...
 
+    // transmit packet with payload given as a list of segments, e.g.
+    // protocol fields and data from separate buffers; the segments are
+    // no longer referenced once the call returns
+    void transmit_packet(unsigned char *      _header,
+                         const struct iovec * _payload,
+                         unsigned int         _payload_cnt,
+                         int                  _mod,
+                         int                  _fec0,
+                         int                  _fec1);
+
+    // transmit several packets back to back in a single burst; frame
+    // properties are only updated when they change between packets, and
+    // samples are handed to the device several symbols at a time
+    void transmit_packets(const struct ofdmtxrx_packet_s * _packets,
+                          unsigned int                     _num_packets);
+
+    // transmit several packets sharing the same properties (the
+    // descriptors' mod/fec fields are ignored)
+    void transmit_packets(const struct ofdmtxrx_packet_s * _packets,
+                          unsigned int                     _num_packets,
+                          int                              _mod,
+                          int                              _fec0,
+                          int                              _fec1);
+
+    // transmit several packets in a single burst launched at the given
+    // device time (see get_time_now()); in loopback the silence since
+    // the previous timed burst is written out, so that the samples read
+    // at the other end keep counting device time
+    void transmit_packets_at(const struct ofdmtxrx_packet_s * _packets,
+                             unsigned int                     _num_packets,
+                             double                           _time);
+
     // 
     // receiver methods
     //
-    void set_rx_freq(float _rx_freq);
+    void set_rx_freq(double _rx_freq);
     void set_rx_rate(float _rx_rate);
     void set_rx_gain_uhd(float _rx_gain_uhd);
     void set_rx_antenna(char * _rx_antenna);
     void reset_rx();
+
+    // start receiver; frames are delivered to the callback until
+    // stop_rx() returns
     void start_rx();
+
+    // stop receiver; returns once the worker has stopped processing,
+    // so that no callback is in progress or pending
     void stop_rx();
 
+    // start receiver for a window of _duration seconds beginning at the
+    // given device time; the device streams only the samples in the
+    // window. Call stop_rx() once the window has passed. Requires fast
+    // turnaround to be disabled; loopback starts immediately.
+    void start_rx_at(double _time,
+                     double _duration);
+
+    // set number of received samples handed to the synchronizer per
+    // call (default: 1); frame times resolve to the end of the block, so
+    // larger blocks trade timestamp accuracy for throughput. Call while
+    // the receiver is stopped.
+    void set_rx_block_len(unsigned int _block_len);
+
+    // get device time [s] of the first sample of the frame being
+    // delivered, or -1 if unknown; only meaningful from within the user
+    // callback (pooled buffers carry it in their time field)
+    double get_frame_time();
+
+    // get number of samples processed by the receiver and the host time
+    // spent processing them [s]
+    unsigned long long int get_rx_num_samples() { return rx_num_samples; }
+    double get_rx_processing_time() { return rx_processing_time; }
+
+    //
+    // device time
+    //
+
+    // set/get device time [s] (loopback: host monotonic clock plus offset)
+    void   set_time_now(double _time);
+    double get_time_now();
+
+    // sleep until device time reaches _time
+    void wait_until(double _time);
+
+    //
+    // frequency hopping
+    //
+    // Transmitter and receiver hop together. Hop k starts at device time
+    // epoch + k*dwell on hop-set entry k mod num_freqs; the retune is
+    // queued on the device as a timed command shortly ahead of the hop
+    // by a background thread, so that the hop rate is limited by the
+    // hardware (LO settling, command queue) rather than by host
+    // round-trips. Received samples within the settling time at the
+    // start of each dwell are blanked (zeroed) before synchronization.
+    //
+
+    // load hop set; each frequency is validated against the tuning
+    // ranges and tuned once (blocking) to record its LO and DSP
+    // settings. Call only while not hopping.
+    //  _freqs      :   hop frequencies [Hz] [size: _num_freqs x 1]
+    //  _num_freqs  :   number of frequencies
+    //  _dwell      :   dwell time per hop [s]
+    //  _settle     :   settling time at start of each dwell [s]
+    void hop_load(const double * _freqs,
+                  unsigned int   _num_freqs,
+                  double         _dwell,
+                  double         _settle);
+
+    // start hopping with hop 0 at device time _time
+    void hop_start(double _time);
+
+    // stop hopping; retunes already queued on the device still execute
+    void hop_stop();
+
+    // find the first hop whose usable part (after settling) starts at or
+    // after _time; returns hop number and sets the usable window [s]
+    unsigned long long int hop_next(double   _time,
+                                    double * _start,
+                                    double * _end);
+
+    // get frequency of hop number _hop [Hz]
+    double hop_get_freq(unsigned long long int _hop);
+
+    // get number of retunes issued
+    unsigned long long int hop_get_num_retunes() { return hop_num_retunes; }
+
+    // get number of received samples blanked while settling
+    unsigned long long int hop_get_num_blanked() { return hop_num_blanked; }
+
     //
     // additional methods
     // 
     void debug_enable();
     void debug_disable();
 
-    // specify rx worker method as friend function so that it may
-    // gain acess to private members of the class
+    // enable fast turnaround: the device rx stream is started once and
+    // kept alive, and start_rx()/stop_rx() only gate processing in
+    // software (samples received while stopped are discarded); call only
+    // while the receiver is stopped
+    void turnaround_enable();
+    void turnaround_disable();
+
+    // get/reset turnaround latency statistics
+    void get_turnaround(struct ofdmtxrx_turnaround_s * _stats);
+    void reset_turnaround();
+
+    // enable segmented receiver: the received stream is cut into
+    // overlapping segments which are decoded in parallel by a pool
+    // of synchronizers; call only while the receiver is stopped
+    //  _num_threads    :   number of decoding threads (0: number of cores)
+    //  _segment_len    :   segment length [samples]
+    //  _overlap_len    :   overlap between segments (longest frame) [samples]
+    void segmented_rx_enable(unsigned int _num_threads,
+                             unsigned int _segment_len,
+                             unsigned int _overlap_len);
+    void segmented_rx_disable();
+
+    // enable asynchronous delivery: decoded frames are queued without
+    // blocking the receiver, and the user callback is invoked from
+    // drain_rx() on the caller's thread; call only while the receiver
+    // is stopped. Disabling wakes threads blocked in drain_rx() and
+    // waits for them to return, so it must not be called from within
+    // the callback.
+    //  _num_slots      :   queue capacity [frames]
+    //  _max_payload_len:   longest payload retained [bytes]
+    void async_rx_enable(unsigned int _num_slots,
+                         unsigned int _max_payload_len);
+    void async_rx_disable();
+
+    // deliver up to _max_frames queued frames to the user callback;
+    // returns number of frames delivered (none once disabled)
+    //  _max_frames     :   maximum batch size
+    //  _timeout        :   time to wait for the first frame [s]; zero
+    //                      polls, negative blocks
+    unsigned int drain_rx(unsigned int _max_frames,
+                          float        _timeout);
+
+    // enable pooled delivery: decoded frames are copied into buffers of
+    // a fixed pool and passed to _callback as reference-counted handles
+    // (see bufpool.h) which may be retained beyond the call; takes
+    // precedence over asynchronous delivery. Call only while the
+    // receiver is stopped.
+    //  _num_buffers    :   number of buffers in pool
+    //  _buffer_len     :   payload capacity of each buffer [bytes]
+    //  _callback       :   buffer callback
+    //  _userdata       :   user-defined data passed to callback
+    void pooled_rx_enable(unsigned int   _num_buffers,
+                          unsigned int   _buffer_len,
+                          rxbuf_callback _callback,
+                          void *         _userdata);
+    void pooled_rx_disable();
+
+    // specify rx worker method and segmented receiver hook as friend
+    // functions so that they may gain acess to private members of the class
     friend void * ofdmtxrx_rx_worker(void * _arg);
+    friend void * ofdmtxrx_hop_worker(void * _arg);
+    friend int ofdmtxrx_rx_callback(unsigned char *  _header,
+                                    int              _header_valid,
+                                    unsigned char *  _payload,
+                                    unsigned int     _payload_len,
+                                    int              _payload_valid,
+                                    framesyncstats_s _stats,
+                                    void *           _userdata);
+    friend void * ofdmtxrx_segment_create(framesync_callback _callback,
+                                          void **            _userdata,
+                                          void *             _context);
             
 private:
+    // common initialization for constructors
+    void initialize(unsigned int       _M,
+                    unsigned int       _cp_len,
+                    unsigned int       _taper_len,
+                    unsigned char *    _p,
+                    framesync_callback _callback,
+                    void *             _userdata);
+
+    // update frame generator properties if they differ from current ones
+    void set_frame_props(int _mod,
+                         int _fec0,
+                         int _fec1);
+
+    // generate and send frames for a batch of packets
+    //  _time       :   device launch time [s], negative to send immediately
+    void transmit_frames(const struct ofdmtxrx_packet_s * _packets,
+                         unsigned int                     _num_packets,
+                         bool                             _shared_props,
+                         int                              _mod,
+                         int                              _fec0,
+                         int                              _fec1,
+                         double                           _time);
+
+    // send samples to device (or loopback file)
+    void send_samples(std::complex<float> * _x,
+                      unsigned int          _n);
+
+    // write samples to loopback file, blocking while a pipe is full
+    void loop_write(const std::complex<float> * _x,
+                    unsigned int                _n);
+
+    // signal end of burst to device (or pad loopback file)
+    void send_eob();
+
+    // record end of rx-to-tx turnaround
+    void rx_to_tx();
+
+    // queue timed retune to hop-set entry _index at device time _time
+    void hop_tune(unsigned int _index,
+                  double       _time);
+
+    // is hopping? (reads hop_running under hop_mutex)
+    bool hop_is_running();
+
+    // blank received samples within the settling time of each hop
+    //  _x          :   received block [size: _n x 1]
+    //  _n          :   block length
+    //  _time       :   device time of first sample [s]
+    void hop_blank(std::complex<float> * _x,
+                   unsigned int          _n,
+                   double                _time);
+
+    // issue stream command to device (serialized with timed commands)
+    void issue_stream_cmd(const uhd::stream_cmd_t & _cmd);
+
+    // receive samples from device (or loopback file), waiting at most
+    // 100 ms; returns number of samples received
+    unsigned int recv_samples(std::complex<float> * _x,
+                              unsigned int          _n,
+                              uhd::rx_metadata_t &  _md);
+
     // set timespec for timeout
     //  _ts         :   pointer to timespec structure
     //  _timeout    :   time before timeout
     void set_timespec(struct timespec * _ts,
                       float             _timeout);
 
+    // monotonic time [s]
+    static double get_time();
+
+    // accumulate turnaround latency sample (rx_mutex held)
+    static void update_turnaround(unsigned int * _num,
+                                  float *        _mean,
+                                  float *        _max,
+                                  float          _latency);
+
     // OFDM properties
     unsigned int M;                 // number of subcarriers
     unsigned int cp_len;            // cyclic prefix length
@@ -111,6 +443,8 @@ private:
     std::complex<float> * fgbuffer; // frame generator output buffer [size: M + cp_len x 1]
     unsigned int fgbuffer_len;      // length of frame generator buffer
     float tx_gain;                  // soft transmit gain (linear)
+    unsigned char * tx_gather;      // scatter-gather payload buffer
+    unsigned int tx_gather_len;     // length of scatter-gather buffer
 #if 0
     pthread_t tx_process;           // transmit thread
     pthread_mutex_t tx_mutex;       // transmit mutex
@@ -118,17 +452,69 @@ private:
 
     // receiver objects
     ofdmflexframesync fs;           // frame synchronizer object
+    framesync_callback callback;    // user-defined callback function
+    void * userdata;                // user-defined data structure
+    chunkdecoder rx_decoder;        // segmented receiver (NULL if disabled)
+    rxqueue rx_queue;               // asynchronous delivery (NULL if disabled)
+    unsigned int rx_num_draining;   // threads inside drain_rx()
+    bufpool rx_pool;                // pooled delivery (NULL if disabled)
+    rxbuf_callback rx_pool_callback;// pooled delivery callback
+    void * rx_pool_userdata;        // pooled delivery user data
     pthread_t rx_process;           // receive thread
-    pthread_mutex_t rx_mutex;       // receive mutex
-    pthread_cond_t  rx_cond;        // receive condition
-    bool rx_running;                // is receiver running? (physical receiver)
+    pthread_mutex_t rx_mutex;       // receive mutex (guards worker state)
+    pthread_cond_t  rx_cond;        // receive condition (state changes)
+    bool rx_running;                // is processing requested?
+    bool rx_active;                 // is worker processing? (acknowledged state)
     bool rx_thread_running;         // is receiver thread running?
+    bool rx_turnaround;             // is fast turnaround enabled?
+    bool rx_streaming;              // is device rx stream running?
     bool debug_enabled;             // is debugging enabled?
 
-    // RF objects and properties
+    // receive timestamps
+    rxclock rx_clock;               // device time of received samples
+    unsigned int rx_offset;         // end of block being synchronized within current buffer
+    unsigned int rx_block_len;      // samples per synchronizer call
+    unsigned int rx_frame_overhead; // preamble and header symbols per frame
+    unsigned int rx_M_data;         // number of data subcarriers
+
+    // receiver throughput (written by rx worker only)
+    unsigned long long int rx_num_samples;  // samples processed
+    double rx_processing_time;              // host time spent processing [s]
+
+    // frequency hopping (schedule is fixed while hopping)
+    struct ofdmtxrx_hop_s * hop_table; // hop set (NULL if not loaded)
+    unsigned int hop_len;           // number of hop-set entries
+    double hop_dwell;               // dwell time per hop [s]
+    double hop_settle;              // settling time at start of dwell [s]
+    double hop_epoch;               // device time of hop 0 [s]
+    bool hop_running;               // is hopping? (guarded by hop_mutex)
+    unsigned long long int hop_num_retunes; // retunes issued
+    unsigned long long int hop_num_blanked; // samples blanked (rx worker)
+    pthread_t hop_process;          // hop thread
+    pthread_mutex_t hop_mutex;      // hop mutex
+    pthread_cond_t  hop_cond;       // hop condition (stop request)
+
+    // device commands issued from any thread (guards the command time)
+    pthread_mutex_t cmd_mutex;
+
+    // turnaround latency measurement (guarded by rx_mutex)
+    double tx_end_time;             // end of last transmission (0: none pending)
+    double rx_stop_time;            // last stop_rx() (0: none pending)
+    struct ofdmtxrx_turnaround_s turnaround;
+
+    // RF objects and properties (one device serves both directions)
     uhd::usrp::multi_usrp::sptr usrp_tx;
     uhd::usrp::multi_usrp::sptr usrp_rx;
     uhd::tx_metadata_t          metadata_tx;
+
+    // loopback (file descriptors are -1 when using usrp)
+    int loop_tx_fd;                 // transmit sample file
+    int loop_rx_fd;                 // receive sample file
+    unsigned char loop_rx_residual[sizeof(std::complex<float>)]; // partial sample
+    unsigned int  loop_rx_residual_len;
+    double loop_time_offset;        // device time minus host monotonic time
+    double loop_tx_rate;            // transmit sample rate [samples/s]
+    double loop_tx_time;            // device time after last timed sample written (0: none)
 };
 
 #if 0
@@ -0,0 +1,179 @@
+/*
+ * Copyright (c) 2013 Joseph Gaeddert
+ *
+ * This file is part of liquid.
+ *
+ * liquid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * liquid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with liquid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+//
+// packetlog.h
+//
+// compact, indexed binary log of decoded frames
+//
+// File layout (host byte order):
+//
+//   file header    packetlog_fileheader_s
+//   records        packetlog_recordheader_s, frame header bytes,
+//                  payload bytes (optional), zero padding to 8 bytes
+//   index          record offsets (uint64_t x num_records)
+//   trailer        packetlog_trailer_s
+//
+// The index and trailer are written when the log is destroyed; a
+// file without them (e.g. after a crash) is still readable as the
+// reader re-builds the index by scanning the records.
+//
+
+#ifndef __PACKETLOG_H__
+#define __PACKETLOG_H__
+
+#include <stdint.h>
+#include <liquid/liquid.h>
+
+#define PACKETLOG_MAGIC         "LQPKTLOG"  // file header magic
+#define PACKETLOG_TRAILER_MAGIC "LQPKTIDX"  // trailer magic
+#define PACKETLOG_VERSION       (1)
+
+// record flags
+#define PACKETLOG_HEADER_VALID  (0x01)      // frame header passed crc
+#define PACKETLOG_PAYLOAD_VALID (0x02)      // frame payload passed crc
+#define PACKETLOG_PAYLOAD_SAVED (0x04)      // payload bytes are in record
+
+// on-disk file header
+struct packetlog_fileheader_s {
+    char     magic[8];          // PACKETLOG_MAGIC
+    uint32_t version;           // PACKETLOG_VERSION
+    uint32_t header_len;        // length of each frame header [bytes]
+    uint32_t save_payloads;     // are payloads saved?
+    uint32_t reserved;
+    double   time_start;        // log creation time [s since epoch]
+};
+
+// on-disk record header
+struct packetlog_recordheader_s {
+    double   timestamp;         // time relative to time_start [s]
+    uint32_t record_len;        // total record length incl. padding
+    uint32_t channel;           // channel index
+    uint32_t flags;             // PACKETLOG_* flags
+    uint32_t payload_len;       // payload length [bytes]
+
+    // frame synchronizer statistics (framesyncstats_s without symbols)
+    float    evm;               // error vector magnitude [dB]
+    float    rssi;              // received signal strength [dB]
+    float    cfo;               // carrier frequency offset (f/Fs)
+    uint32_t num_framesyms;     // number of frame symbols
+    uint32_t mod_scheme;        // modulation scheme
+    uint32_t mod_bps;           // modulation depth [bits/symbol]
+    uint32_t check;             // data validity check
+    uint32_t fec0;              // forward error-correction (inner)
+    uint32_t fec1;              // forward error-correction (outer)
+    uint32_t reserved;
+};
+
+// on-disk trailer
+struct packetlog_trailer_s {
+    uint64_t index_offset;      // file offset of record index
+    uint64_t num_records;       // number of records in index
+    char     magic[8];          // PACKETLOG_TRAILER_MAGIC
+};
+
+// 
+// packetlog object interface declarations (writer)
+//
+
+typedef struct packetlog_s * packetlog;
+
+// create packetlog object
+//  _filename       :   output filename
+//  _header_len     :   frame header length [bytes], e.g. 8 for ofdmflexframe
+//  _save_payloads  :   save payload bytes with each record?
+packetlog packetlog_create(const char * _filename,
+                           unsigned int _header_len,
+                           int          _save_payloads);
+
+// destroy packetlog object, writing index to file
+void packetlog_destroy(packetlog _q);
+
+// print packetlog statistics
+void packetlog_print(packetlog _q);
+
+// log decoded frame; arguments follow framesync_callback so this
+// may be called directly from within a synchronizer callback
+//  _q              :   packetlog object
+//  _channel        :   channel index
+//  _header         :   frame header [size: header_len x 1]
+//  _header_valid   :   frame header passed crc?
+//  _payload        :   frame payload [size: _payload_len x 1]
+//  _payload_len    :   frame payload length [bytes]
+//  _payload_valid  :   frame payload passed crc?
+//  _stats          :   frame synchronizer statistics
+void packetlog_write(packetlog        _q,
+                     unsigned int     _channel,
+                     unsigned char *  _header,
+                     int              _header_valid,
+                     unsigned char *  _payload,
+                     unsigned int     _payload_len,
+                     int              _payload_valid,
+                     framesyncstats_s _stats);
+
+// get number of records logged/dropped
+unsigned int packetlog_get_num_records(packetlog _q);
+unsigned int packetlog_get_num_dropped(packetlog _q);
+
+// 
+// packetlogreader object interface declarations (memory-mapped reader)
+//
+
+typedef struct packetlogreader_s * packetlogreader;
+
+// decoded record; pointers reference the memory-mapped file and are
+// valid until the reader is closed
+struct packetlog_record_s {
+    double           timestamp;     // time relative to log start [s]
+    unsigned int     channel;       // channel index
+    unsigned char *  header;        // frame header [size: header_len x 1]
+    int              header_valid;  // frame header passed crc?
+    unsigned char *  payload;       // payload (NULL if not saved)
+    unsigned int     payload_len;   // payload length [bytes]
+    int              payload_valid; // frame payload passed crc?
+    framesyncstats_s stats;         // statistics (framesyms is NULL)
+};
+
+// open log file for reading; returns NULL on error
+packetlogreader packetlogreader_open(const char * _filename);
+
+// close log file
+void packetlogreader_close(packetlogreader _q);
+
+// accessor methods
+unsigned int packetlogreader_get_num_records(packetlogreader _q);
+unsigned int packetlogreader_get_header_len(packetlogreader _q);
+double       packetlogreader_get_time_start(packetlogreader _q);
+
+// read record at index _i (constant time)
+//  _q      :   packetlogreader object
+//  _i      :   record index, _i < num_records
+//  _record :   output record
+//  returns 0 on success, -1 if index is out of range
+int packetlogreader_read(packetlogreader              _q,
+                         unsigned int                 _i,
+                         struct packetlog_record_s *  _record);
+
+// find index of first record with timestamp >= _t (binary search)
+unsigned int packetlogreader_find(packetlogreader _q,
+                                  double          _t);
+
+#endif // __PACKETLOG_H__
+
@@ -0,0 +1,135 @@
+/*
+ * Copyright (c) 2013 Joseph Gaeddert
+ *
+ * This file is part of liquid.
+ *
+ * liquid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * liquid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with liquid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+//
+// rateplan.h
+//
+// sample-rate planner: chooses the device sample rate and the
+// resampling decomposition between it and the baseband rate
+//
+// The resampler between the device and baseband is a chain of integer
+// halfband stages (by 2) and at most one fractional stage (liquid's
+// polyphase arbitrary resampler), either next to the device or next to
+// baseband. Each rate the device supports at or above rate*2^k is a
+// candidate, provided the passband lies within the part of the device
+// rate over which its own filters are flat (40%); the planner designs the stages for every candidate and
+// keeps the one with the lowest estimated cost (multiplies per second,
+// plus a per-sample cost for moving samples off the device). A device
+// rate of exactly rate*2^k needs no fractional stage at all. A minimum
+// device rate may be imposed, e.g. to run at the highest device rate.
+//
+// Every stage must keep aliases (rx) or images (tx) at least As dB
+// below the passband [-fp*rate, fp*rate]. Halfband filters are Kaiser
+// designs whose stop-band attenuation is verified on a dense grid for
+// increasing lengths; the shortest length meeting the spec is cached
+// in memory and in $HOME/RATEPLAN_CACHE_FILENAME so that later runs
+// start without redesigning.
+//
+
+#ifndef __RATEPLAN_H__
+#define __RATEPLAN_H__
+
+#include <uhd/usrp/multi_usrp.hpp>
+
+#define RATEPLAN_MAX_HALFBAND       (8)     // maximum number of halfband stages
+#define RATEPLAN_PASSBAND           (0.4f)  // typical passband edge (relative to rate)
+#define RATEPLAN_CACHE_FILENAME     ".liquid-usrp-rateplan"
+
+// resampling direction
+typedef enum {
+    RATEPLAN_DECIM=0,       // receive: device rate down to baseband
+    RATEPLAN_INTERP         // transmit: baseband up to device rate
+} rateplan_type;
+
+// supported device rates: start to stop in increments of step
+// (step 0: any rate in [start,stop])
+struct rateplan_range_s {
+    double start;
+    double stop;
+    double step;
+};
+
+typedef struct rateplan_s * rateplan;
+
+// create plan; returns NULL (with a message) if no supported device
+// rate is at or above the baseband rate
+//  _type       :   decimation (rx) or interpolation (tx)
+//  _rate       :   baseband sample rate [Hz]
+//  _fp         :   passband edge relative to _rate, in (0,0.5)
+//  _As         :   stop-band attenuation [dB]
+//  _device_min :   minimum device rate [Hz] (0: none); anything above
+//                  the highest supported rate (e.g. HUGE_VAL) selects it
+//  _ranges     :   supported device rates [size: _num_ranges x 1]
+//  _num_ranges :   number of ranges
+rateplan rateplan_create(rateplan_type                   _type,
+                         double                          _rate,
+                         float                           _fp,
+                         float                           _As,
+                         double                          _device_min,
+                         const struct rateplan_range_s * _ranges,
+                         unsigned int                    _num_ranges);
+
+// create plan from the rates the device reports (rx/tx channel 0)
+rateplan rateplan_create_rx(uhd::usrp::multi_usrp::sptr _usrp,
+                            double                      _rate,
+                            float                       _fp,
+                            float                       _As,
+                            double                      _device_min);
+rateplan rateplan_create_tx(uhd::usrp::multi_usrp::sptr _usrp,
+                            double                      _rate,
+                            float                       _fp,
+                            float                       _As,
+                            double                      _device_min);
+
+// destroy plan
+void rateplan_destroy(rateplan _q);
+
+// print plan
+void rateplan_print(rateplan _q);
+
+// get plan properties
+rateplan_type rateplan_get_type(rateplan _q);
+double rateplan_get_rate(rateplan _q);          // baseband rate [Hz]
+double rateplan_get_device_rate(rateplan _q);   // chosen device rate [Hz]
+float  rateplan_get_As(rateplan _q);            // stop-band attenuation [dB]
+float  rateplan_get_cost(rateplan _q);          // estimated multiplies/s
+
+// get number of halfband stages
+unsigned int rateplan_get_num_halfband(rateplan _q);
+
+// get halfband stage _i (counted from the device side): filter length
+// 4*m+1 and taps, scaled for unity passband gain (decimation) or for
+// a gain of two (interpolation)
+unsigned int rateplan_get_halfband_len(rateplan     _q,
+                                       unsigned int _i);
+void rateplan_get_halfband(rateplan     _q,
+                           unsigned int _i,
+                           float *      _h);
+
+// get fractional stage for the actual device rate: resampling rate
+// (output/input), filter semi-length and cutoff for resamp_crcf_create();
+// _m is zero if no fractional stage is needed. Returns non-zero if the
+// stage sits next to the device, zero if next to baseband.
+int rateplan_get_fractional(rateplan       _q,
+                            double         _device_rate,
+                            double *       _r,
+                            unsigned int * _m,
+                            float *        _fc);
+
+#endif // __RATEPLAN_H__
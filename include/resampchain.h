@@ -0,0 +1,105 @@
+/*
+ * Copyright (c) 2013 Joseph Gaeddert
+ *
+ * This file is part of liquid.
+ *
+ * liquid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * liquid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with liquid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+//
+// resampchain.h
+//
+// multi-stage resampler built from a rate plan: halfband stages by two
+// and an optional fractional stage, run block-wise
+//
+// Decimation takes samples at the device rate and produces baseband;
+// interpolation the reverse. Halfband stages skip the zero taps of
+// their filters, so each output costs about half the filter length.
+//
+// For very high device rates the halfband decimation ahead of the
+// fractional stage can be split across threads: input is buffered one
+// block per thread and the blocks are decimated concurrently, each
+// thread picking up the filter states exactly where the previous block
+// ends. The output is identical to the single-threaded path, but lags
+// behind the input by up to one buffer. With no halfband stages ahead
+// of the fractional stage (or for interpolation) this has no effect.
+//
+
+#ifndef __RESAMPCHAIN_H__
+#define __RESAMPCHAIN_H__
+
+#include <complex>
+#include "rateplan.h"
+
+typedef struct resampchain_s * resampchain;
+
+// create resampler from plan
+//  _plan           :   rate plan
+//  _device_rate    :   actual device rate [Hz] (as reported by the
+//                      device after setting the planned rate)
+resampchain resampchain_create(rateplan _plan,
+                               double   _device_rate);
+
+// run halfband decimation on several threads; call once, before the
+// first execute
+//  _q              :   resampler
+//  _num_threads    :   number of threads (0: number of cores)
+void resampchain_set_num_threads(resampchain  _q,
+                                 unsigned int _num_threads);
+
+// destroy resampler
+void resampchain_destroy(resampchain _q);
+
+// print resampler stages
+void resampchain_print(resampchain _q);
+
+// clear filter states
+void resampchain_reset(resampchain _q);
+
+// get overall resampling rate (output/input)
+double resampchain_get_rate(resampchain _q);
+
+// get group delay [output samples]
+float resampchain_get_delay(resampchain _q);
+
+// is a block of _nx input samples a whole period of every stage, i.e.
+// does it map to a whole number of samples at each stage so that the
+// fractional stage returns to the same phase?
+int resampchain_is_periodic(resampchain  _q,
+                            unsigned int _nx);
+
+// get the shortest whole period of every stage of at least _nx input
+// samples which also spans the filter histories; returns 0 if there is
+// none within twice that length
+unsigned int resampchain_get_period(resampchain  _q,
+                                    unsigned int _nx);
+
+// get maximum number of output samples for _nx input samples (use to
+// size output buffers, after setting the number of threads)
+unsigned int resampchain_get_max_output(resampchain  _q,
+                                        unsigned int _nx);
+
+// resample block of samples
+//  _q      :   resampler
+//  _x      :   input samples [size: _nx x 1]
+//  _nx     :   number of input samples
+//  _y      :   output samples [size: resampchain_get_max_output() x 1]
+//  _ny     :   number of output samples written
+void resampchain_execute(resampchain           _q,
+                         std::complex<float> * _x,
+                         unsigned int          _nx,
+                         std::complex<float> * _y,
+                         unsigned int *        _ny);
+
+#endif // __RESAMPCHAIN_H__
@@ -0,0 +1,86 @@
+/*
+ * Copyright (c) 2013 Joseph Gaeddert
+ *
+ * This file is part of liquid.
+ *
+ * liquid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * liquid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with liquid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+//
+// ringbuf.h
+//
+// single-writer, multi-reader sample ring buffer
+//
+
+#ifndef __RINGBUF_H__
+#define __RINGBUF_H__
+
+#include <complex>
+
+// 
+// ringbuf object interface declarations
+//
+// The writer copies samples into the ring and publishes them by
+// advancing the write position; it never blocks. Each reader keeps
+// its own read position. The writer publishes at most a quarter of
+// the ring at a time, so samples at or after ringbuf_get_oldest() are
+// intact; a reader that falls further behind skips ahead. Readers wait
+// for samples on the ring's lock, which may also guard their own
+// shared state.
+//
+
+typedef struct ringbuf_s * ringbuf;
+
+// create ring buffer
+//  _min_len    :   minimum length [samples], rounded up to a power of 2
+ringbuf ringbuf_create(unsigned long long int _min_len);
+
+// destroy ring buffer
+void ringbuf_destroy(ringbuf _q);
+
+// get ring length [samples]
+unsigned long long int ringbuf_get_len(ringbuf _q);
+
+// write samples (single writer), waking waiting readers
+void ringbuf_write(ringbuf               _q,
+                   std::complex<float> * _x,
+                   unsigned int          _n);
+
+// get write position (number of samples written)
+unsigned long long int ringbuf_get_write_pos(ringbuf _q);
+
+// get oldest position which is safe to read for write position _w
+unsigned long long int ringbuf_get_oldest(ringbuf                _q,
+                                          unsigned long long int _w);
+
+// copy _n samples starting at position _pos; returns non-zero if they
+// were overwritten while copying (the output is then invalid)
+int ringbuf_read(ringbuf                _q,
+                 unsigned long long int _pos,
+                 std::complex<float> *  _y,
+                 unsigned int           _n);
+
+// lock/unlock ring (reader side)
+void ringbuf_lock(ringbuf _q);
+void ringbuf_unlock(ringbuf _q);
+
+// wait (lock held) until the write position moves beyond _w or the
+// readers are woken
+void ringbuf_wait(ringbuf                _q,
+                  unsigned long long int _w);
+
+// wake all waiting readers (lock held), e.g. after stopping them
+void ringbuf_wake(ringbuf _q);
+
+#endif // __RINGBUF_H__
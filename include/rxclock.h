@@ -0,0 +1,130 @@
+/*
+ * Copyright (c) 2013 Joseph Gaeddert
+ *
+ * This file is part of liquid.
+ *
+ * liquid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * liquid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with liquid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+//
+// rxclock.h
+//
+// receive sample clock: maps the index of a received sample onto the
+// device time at which it arrived at the antenna
+//
+
+#ifndef __RXCLOCK_H__
+#define __RXCLOCK_H__
+
+#include <liquid/liquid.h>
+
+// 
+// rxclock object interface declarations
+//
+// The receiver counts the samples it processes, one increment per block
+// (rxclock_advance), and hands the device timestamp of each block to
+// rxclock_sync(). The clock is anchored at the first timestamp and only
+// re-anchored when a timestamp disagrees with the count by more than
+// half a sample (overflow, restart of the stream), so the per-block
+// cost is a comparison. Converting an index to time may be done from
+// any thread: a short history of anchors lets frames decoded after a
+// discontinuity still resolve against the anchor of their own samples.
+//
+// The clock runs at the rate at which samples are counted. A processing
+// delay [samples] (resampler or channelizer filter delay) is subtracted
+// from all times so that they refer to the antenna.
+//
+
+typedef struct rxclock_s * rxclock;
+
+// create receive clock
+//  _rate       :   sample rate of counted samples [samples/s]
+rxclock rxclock_create(double _rate);
+
+// destroy receive clock
+void rxclock_destroy(rxclock _q);
+
+// print clock state
+void rxclock_print(rxclock _q);
+
+// reset sample count and drop all anchors
+void rxclock_reset(rxclock _q);
+
+// set sample rate [samples/s]; drops all anchors as the existing ones
+// no longer map onto the new rate
+void rxclock_set_rate(rxclock _q,
+                      double  _rate);
+
+// set processing delay [samples]
+void rxclock_set_delay(rxclock _q,
+                       double  _delay);
+
+// synchronize to the device time [s] of the next sample to be counted;
+// returns 1 if the clock was (re-)anchored, 0 otherwise
+int rxclock_sync(rxclock _q,
+                 double  _time);
+
+// count block of _n samples
+void rxclock_advance(rxclock      _q,
+                     unsigned int _n);
+
+// index of the next sample to be counted
+unsigned long long int rxclock_get_index(rxclock _q);
+
+// device time of sample with index _index [s] minus the processing
+// delay, or -1 if the clock has not been synchronized yet
+double rxclock_get_time(rxclock                _q,
+                        unsigned long long int _index);
+
+// has the clock been synchronized?
+int rxclock_is_synced(rxclock _q);
+
+// accessor methods
+double       rxclock_get_rate(rxclock _q);      // sample rate [samples/s]
+unsigned int rxclock_get_num_gaps(rxclock _q);  // re-anchors after the first
+
+//
+// OFDM flexframe length: a synchronizer reports a frame once its last
+// symbol has been received, so its first sample precedes the detection
+// by the frame length
+//
+
+// number of preamble and header symbols of an OFDM flexframe, measured
+// once with a scratch frame generator
+//  _M          :   number of subcarriers
+//  _cp_len     :   cyclic prefix length
+//  _taper_len  :   taper length
+//  _p          :   subcarrier allocation (NULL: default)
+//  _M_data     :   output number of data subcarriers
+unsigned int rxclock_ofdmflexframe_overhead(unsigned int    _M,
+                                            unsigned int    _cp_len,
+                                            unsigned int    _taper_len,
+                                            unsigned char * _p,
+                                            unsigned int *  _M_data);
+
+// length of received OFDM flexframe [samples]
+//  _M          :   number of subcarriers
+//  _cp_len     :   cyclic prefix length
+//  _M_data     :   number of data subcarriers
+//  _overhead   :   preamble and header symbols (see above)
+//  _stats      :   frame statistics from synchronizer callback
+//  _payload_len:   payload length [bytes]
+unsigned int rxclock_ofdmflexframe_len(unsigned int     _M,
+                                       unsigned int     _cp_len,
+                                       unsigned int     _M_data,
+                                       unsigned int     _overhead,
+                                       framesyncstats_s _stats,
+                                       unsigned int     _payload_len);
+
+#endif // __RXCLOCK_H__
@@ -0,0 +1,126 @@
+/*
+ * Copyright (c) 2013 Joseph Gaeddert
+ *
+ * This file is part of liquid.
+ *
+ * liquid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * liquid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with liquid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+//
+// rxqueue.h
+//
+// lock-free queue of received frames, decoupling user processing from
+// the frame synchronizer (DSP) thread
+//
+
+#ifndef __RXQUEUE_H__
+#define __RXQUEUE_H__
+
+#include <liquid/liquid.h>
+
+// maximum header length stored per frame [bytes]
+#define RXQUEUE_MAX_HEADER_LEN  (16)
+
+// 
+// rxqueue object interface declarations
+//
+// Frames are copied into preallocated slots of a bounded ring buffer
+// using atomic operations only, so any number of synchronizer threads
+// may push without ever blocking. Consumers drain frames in batches,
+// and the user callback is invoked on the consumer's thread with
+// pointers directly into the slot. When the queue is full, new frames
+// are dropped (and counted) rather than stalling sample processing.
+// Frame symbols are not retained (stats.framesyms is NULL).
+//
+
+typedef struct rxqueue_s * rxqueue;
+
+// create rxqueue object
+//  _num_slots      :   queue capacity [frames], rounded up to power of 2
+//  _header_len     :   header length [bytes]
+//  _max_payload_len:   longest payload retained [bytes]; longer ones are dropped
+rxqueue rxqueue_create(unsigned int _num_slots,
+                       unsigned int _header_len,
+                       unsigned int _max_payload_len);
+
+// destroy rxqueue object, discarding queued frames; no consumer may be
+// inside rxqueue_drain() (see rxqueue_close())
+void rxqueue_destroy(rxqueue _q);
+
+// print queue statistics
+void rxqueue_print(rxqueue _q);
+
+// push frame; returns 0 on success, -1 if the frame was dropped
+int rxqueue_push(rxqueue          _q,
+                 unsigned char *  _header,
+                 int              _header_valid,
+                 unsigned char *  _payload,
+                 unsigned int     _payload_len,
+                 int              _payload_valid,
+                 framesyncstats_s _stats);
+
+// push frame tagged with the device time of its first sample [s]
+// (rxqueue_push() tags frames with -1: unknown); returns 0 on success,
+// -1 if the frame was dropped
+int rxqueue_push_time(rxqueue          _q,
+                      unsigned char *  _header,
+                      int              _header_valid,
+                      unsigned char *  _payload,
+                      unsigned int     _payload_len,
+                      int              _payload_valid,
+                      framesyncstats_s _stats,
+                      double           _time);
+
+// framesync_callback adapter pushing to the queue given as _userdata
+int rxqueue_callback(unsigned char *  _header,
+                     int              _header_valid,
+                     unsigned char *  _payload,
+                     unsigned int     _payload_len,
+                     int              _payload_valid,
+                     framesyncstats_s _stats,
+                     void *           _userdata);
+
+// drain up to _max_frames queued frames, invoking _callback for each;
+// returns number of frames delivered (none once the queue is closed)
+//  _q          :   rxqueue object
+//  _callback   :   user callback
+//  _userdata   :   user data passed to callback
+//  _max_frames :   maximum batch size
+//  _timeout    :   time to wait for the first frame [s]: zero polls,
+//                  negative blocks until a frame arrives
+unsigned int rxqueue_drain(rxqueue            _q,
+                           framesync_callback _callback,
+                           void *             _userdata,
+                           unsigned int       _max_frames,
+                           float              _timeout);
+
+// get device time of the frame being delivered to the calling thread
+// [s]; only meaningful from within the callback of rxqueue_drain()
+double rxqueue_get_frame_time(rxqueue _q);
+
+// wake up consumers blocked in rxqueue_drain()
+void rxqueue_wakeup(rxqueue _q);
+
+// close queue before destroying it: consumers blocked in or entering
+// rxqueue_drain() return, and the call waits until all have left. Must
+// not be called from within the drain callback.
+void rxqueue_close(rxqueue _q);
+
+// accessor methods
+unsigned int rxqueue_get_num_queued(rxqueue _q);    // frames currently queued
+unsigned int rxqueue_get_num_pushed(rxqueue _q);    // frames accepted
+unsigned int rxqueue_get_num_dropped(rxqueue _q);   // frames dropped
+
+#endif // __RXQUEUE_H__
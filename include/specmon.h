@@ -0,0 +1,98 @@
+/*
+ * Copyright (c) 2013 Joseph Gaeddert
+ *
+ * This file is part of liquid.
+ *
+ * liquid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * liquid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with liquid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+//
+// specmon.h
+//
+// multi-threaded spectrum monitor: overlapped windowed FFTs computed
+// by a pool of worker threads from a ring buffer of received samples
+//
+
+#ifndef __SPECMON_H__
+#define __SPECMON_H__
+
+#include <complex>
+
+// 
+// specmon object interface declarations
+//
+// The receiver copies samples into a ring buffer (never blocking) and
+// the workers transform segments of nfft samples starting every hop
+// samples, several at a time, accumulating power spectra locally and
+// merging them once per batch. If the workers fall behind by more than
+// the ring buffer, the oldest segments are skipped and counted, but
+// the receiver itself never drops samples.
+//
+// Each readout provides (in dB, DC in the center bin):
+//  welch   :   mean of the periodograms since the last readout
+//  maxhold :   maximum of all periodograms since the last reset
+//  average :   exponential average of the Welch estimates
+//
+
+typedef struct specmon_s * specmon;
+
+// create spectrum monitor
+//  _nfft       :   FFT size
+//  _hop        :   samples between segment starts (nfft/2: 50% overlap)
+//  _num_threads:   number of worker threads (0: number of cores)
+specmon specmon_create(unsigned int _nfft,
+                       unsigned int _hop,
+                       unsigned int _num_threads);
+
+// destroy spectrum monitor, stopping the workers
+void specmon_destroy(specmon _q);
+
+// print spectrum monitor properties and counters
+void specmon_print(specmon _q);
+
+// clear Welch accumulator, max-hold and average
+void specmon_reset(specmon _q);
+
+// set exponential averaging factor in (0,1], default 0.1
+void specmon_set_alpha(specmon _q,
+                       float   _alpha);
+
+// push samples (never blocks)
+void specmon_write(specmon               _q,
+                   std::complex<float> * _x,
+                   unsigned int          _n);
+
+// compute spectrum estimates; returns number of segments in the Welch
+// estimate (if zero, the outputs are left untouched)
+//  _q          :   spectrum monitor
+//  _welch      :   Welch estimate [dB] [size: nfft x 1] (or NULL)
+//  _maxhold    :   max-hold [dB] [size: nfft x 1] (or NULL)
+//  _average    :   exponential average [dB] [size: nfft x 1] (or NULL)
+unsigned int specmon_execute(specmon _q,
+                             float * _welch,
+                             float * _maxhold,
+                             float * _average);
+
+// accessor methods
+unsigned int           specmon_get_nfft(specmon _q);
+float                  specmon_get_enbw(specmon _q);            // window noise bandwidth [bins]
+unsigned long long int specmon_get_num_samples(specmon _q);     // samples pushed
+unsigned long long int specmon_get_num_segments(specmon _q);    // segments transformed
+unsigned long long int specmon_get_num_dropped(specmon _q);     // segments skipped (overrun)
+
+// fast approximation of 10*log10(_x) for _x > 0 [dB], within about
+// 0.03 dB
+float specmon_fast_db(float _x);
+
+#endif // __SPECMON_H__
@@ -0,0 +1,96 @@
+/*
+ * Copyright (c) 2013 Joseph Gaeddert
+ *
+ * This file is part of liquid.
+ *
+ * liquid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * liquid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with liquid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+//
+// tddsched.h
+//
+// time-division duplex (TDD) slot scheduler: maps a periodic frame of
+// transmit and receive slots onto device time
+//
+
+#ifndef __TDDSCHED_H__
+#define __TDDSCHED_H__
+
+// slot types
+#define TDDSCHED_SLOT_TX    (0)
+#define TDDSCHED_SLOT_RX    (1)
+
+// 
+// tddsched object interface declarations
+//
+// A TDD frame of length frame_len [s] repeats from the epoch (device
+// time of the start of frame 0). Each slot occupies [offset,
+// offset+duration) within the frame; slots may not overlap, and
+// consecutive slots (including across the frame boundary) must be
+// separated by at least the guard time, which covers the tx/rx
+// switching and propagation delay. All times are in seconds.
+//
+
+typedef struct tddsched_s * tddsched;
+
+// create scheduler with given frame length and guard time [s]
+tddsched tddsched_create(double _frame_len,
+                         double _guard);
+
+// destroy scheduler
+void tddsched_destroy(tddsched _q);
+
+// print frame structure
+void tddsched_print(tddsched _q);
+
+// add slot to frame; returns slot index
+//  _q          :   scheduler
+//  _type       :   slot type (TDDSCHED_SLOT_TX or TDDSCHED_SLOT_RX)
+//  _offset     :   slot start relative to frame start [s]
+//  _duration   :   slot duration [s]
+unsigned int tddsched_add_slot(tddsched _q,
+                               int      _type,
+                               double   _offset,
+                               double   _duration);
+
+// set device time of the start of frame 0
+void tddsched_set_epoch(tddsched _q,
+                        double   _epoch);
+
+// find the next slot of a given type starting at or after _time; returns
+// slot index, or -1 if the frame has no slot of that type
+//  _q          :   scheduler
+//  _type       :   slot type
+//  _time       :   earliest start time (device time) [s]
+//  _start      :   output slot start time (device time) [s]
+//  _duration   :   output slot duration [s]
+int tddsched_next(tddsched _q,
+                  int      _type,
+                  double   _time,
+                  double * _start,
+                  double * _duration);
+
+// number of samples fitting in a slot at a given sample rate
+unsigned int tddsched_slot_samples(tddsched     _q,
+                                   unsigned int _slot,
+                                   double       _rate);
+
+// accessor methods
+double       tddsched_get_frame_len(tddsched _q);
+double       tddsched_get_guard(tddsched _q);
+double       tddsched_get_epoch(tddsched _q);
+unsigned int tddsched_get_num_slots(tddsched _q);
+double       tddsched_get_duty_cycle(tddsched _q, int _type);  // fraction of frame
+
+#endif // __TDDSCHED_H__
@@ -0,0 +1,148 @@
+/*
+ * Copyright (c) 2013 Joseph Gaeddert
+ *
+ * This file is part of liquid.
+ *
+ * liquid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * liquid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with liquid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+//
+// trafficgen.h
+//
+// seeded pseudo-random packet generator and matching checker for
+// measuring bit/packet error rates and goodput
+//
+
+#ifndef __TRAFFICGEN_H__
+#define __TRAFFICGEN_H__
+
+//
+// Header layout (header length must be at least 8 bytes):
+//  [0..1]  : packet id (sequence number, lower 16 bits), big endian
+//  [2]     : channel index
+//  [3]     : TRAFFICGEN_HEADER_ID, identifies generated traffic
+//  [4..7]  : 32-bit sequence number, big endian
+//  [8..]   : pseudo-random
+//
+// Payloads are xorshift sequences keyed on seed, channel and sequence
+// number, so the receiver can regenerate them from the header alone.
+//
+
+#define TRAFFICGEN_HEADER_ID    (0x5a)
+#define TRAFFICGEN_DEFAULT_SEED (0x1f2e3d4c)
+
+// fill buffer with pseudo-random bytes keyed on seed, channel and
+// sequence number
+void trafficgen_prbs(unsigned int    _seed,
+                     unsigned int    _channel,
+                     unsigned int    _seq,
+                     unsigned char * _buf,
+                     unsigned int    _n);
+
+// assemble packet with given sequence number (stateless version of
+// trafficgen_generate())
+//  _seed       :   generator seed
+//  _channel    :   channel index
+//  _seq        :   sequence number
+//  _header     :   output header [size: _header_len x 1]
+//  _header_len :   header length [bytes], at least 8
+//  _payload    :   output payload [size: _payload_len x 1]
+//  _payload_len:   payload length [bytes]
+void trafficgen_assemble(unsigned int    _seed,
+                         unsigned int    _channel,
+                         unsigned int    _seq,
+                         unsigned char * _header,
+                         unsigned int    _header_len,
+                         unsigned char * _payload,
+                         unsigned int    _payload_len);
+
+// 
+// trafficgen object interface declarations
+//
+
+typedef struct trafficgen_s * trafficgen;
+
+// create traffic generator
+//  _seed       :   generator seed (must match receiver)
+//  _channel    :   channel index, written to header[2]
+//  _header_len :   header length [bytes], at least 8
+trafficgen trafficgen_create(unsigned int _seed,
+                             unsigned int _channel,
+                             unsigned int _header_len);
+
+// destroy traffic generator
+void trafficgen_destroy(trafficgen _q);
+
+// reset sequence number to zero
+void trafficgen_reset(trafficgen _q);
+
+// generate next packet; returns its sequence number
+//  _q          :   traffic generator
+//  _header     :   output header [size: header_len x 1]
+//  _payload    :   output payload [size: _payload_len x 1]
+//  _payload_len:   payload length [bytes]
+unsigned int trafficgen_generate(trafficgen      _q,
+                                 unsigned char * _header,
+                                 unsigned char * _payload,
+                                 unsigned int    _payload_len);
+
+// get sequence number of next packet
+unsigned int trafficgen_get_seq(trafficgen _q);
+
+// 
+// trafficcheck object interface declarations
+//
+
+typedef struct trafficcheck_s * trafficcheck;
+
+// create traffic checker
+//  _seed       :   generator seed (must match transmitter)
+//  _header_len :   header length [bytes], at least 8
+trafficcheck trafficcheck_create(unsigned int _seed,
+                                 unsigned int _header_len);
+
+// destroy traffic checker
+void trafficcheck_destroy(trafficcheck _q);
+
+// reset counters
+void trafficcheck_reset(trafficcheck _q);
+
+// print statistics
+//  _q          :   traffic checker
+//  _runtime    :   run time for goodput computation [s]
+void trafficcheck_print(trafficcheck _q,
+                        float        _runtime);
+
+// check received frame (typically from within framesync callback);
+// returns number of bit errors in payload, or -1 if the header is
+// invalid or does not belong to generated traffic
+int trafficcheck_execute(trafficcheck    _q,
+                         unsigned char * _header,
+                         int             _header_valid,
+                         unsigned char * _payload,
+                         unsigned int    _payload_len,
+                         int             _payload_valid);
+
+// accessor methods
+unsigned int       trafficcheck_get_num_packets(trafficcheck _q);   // packets with valid header
+unsigned int       trafficcheck_get_num_valid(trafficcheck _q);     // packets with valid payload
+unsigned int       trafficcheck_get_num_lost(trafficcheck _q);      // packets missing from sequence
+unsigned long long trafficcheck_get_num_bits(trafficcheck _q);      // payload bits checked
+unsigned long long trafficcheck_get_num_bit_errors(trafficcheck _q);// payload bit errors
+float              trafficcheck_get_ber(trafficcheck _q);           // bit error rate
+float              trafficcheck_get_per(trafficcheck _q);           // packet error rate
+
+#endif // __TRAFFICGEN_H__
+
@@ -0,0 +1,177 @@
+/*
+ * Copyright (c) 2013 Joseph Gaeddert
+ *
+ * This file is part of liquid.
+ *
+ * liquid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * liquid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with liquid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+//
+// waterfall.h
+//
+// compact binary waterfall (spectrogram) recording: quantized power
+// spectrum rows with a time index, for long-term spectrum occupancy
+// logging without storing raw samples
+//
+// File layout (host byte order):
+//
+//   file header    waterfall_fileheader_s
+//   rows           waterfall_rowheader_s, num_bins quantized values
+//                  (uint8_t), zero padding to 8 bytes
+//   time index     first row at or after k*index_interval seconds
+//                  (uint32_t x num_buckets)
+//   trailer        waterfall_trailer_s
+//
+// Bin _i is at frequency + (_i - (num_bins-1)/2) * span/num_bins [Hz].
+// All rows have the same length so row _i is at a fixed offset. Each
+// value is quantized as v = round((dB - db_min)/db_step), clipped to
+// [0,255]. The time index and trailer are written when the waterfall
+// is destroyed; a file without them (e.g. after a crash) is still
+// readable as the reader re-builds the index from the row timestamps.
+//
+
+#ifndef __WATERFALL_H__
+#define __WATERFALL_H__
+
+#include <stdint.h>
+
+#define WATERFALL_MAGIC         "LQWATERF"  // file header magic
+#define WATERFALL_TRAILER_MAGIC "LQWFTIDX"  // trailer magic
+#define WATERFALL_VERSION       (1)
+
+// on-disk file header
+struct waterfall_fileheader_s {
+    char     magic[8];          // WATERFALL_MAGIC
+    uint32_t version;           // WATERFALL_VERSION
+    uint32_t num_bins;          // number of frequency bins in each row
+    uint32_t row_len;           // length of each row incl. padding [bytes]
+    uint32_t reserved;
+    double   frequency;         // frequency between first and last bin [Hz]
+    double   span;              // frequency span of all bins [Hz]
+    double   rbw;               // resolution bandwidth [Hz]
+    double   time_start;        // recording start time [s since epoch]
+    double   index_interval;    // time index resolution [s]
+    float    db_min;            // dB value of quantized 0
+    float    db_step;           // dB per quantization step
+};
+
+// on-disk row header
+struct waterfall_rowheader_s {
+    double   timestamp;         // time relative to time_start [s]
+    uint32_t num_averaged;      // number of spectra averaged in row
+    uint32_t reserved;
+};
+
+// on-disk trailer
+struct waterfall_trailer_s {
+    uint64_t index_offset;      // file offset of time index
+    uint64_t num_buckets;       // number of entries in time index
+    uint64_t num_rows;          // number of rows
+    char     magic[8];          // WATERFALL_TRAILER_MAGIC
+};
+
+// 
+// waterfall object interface declarations (writer)
+//
+
+typedef struct waterfall_s * waterfall;
+
+// create waterfall recording
+//  _filename       :   output filename
+//  _num_bins       :   number of frequency bins in each row
+//  _frequency      :   frequency between first and last bin [Hz]
+//  _span           :   frequency span of all bins [Hz]
+//  _rbw            :   resolution bandwidth [Hz]
+//  _db_min         :   dB value of quantized 0, e.g. -140
+//  _db_step        :   dB per quantization step, e.g. 0.5
+waterfall waterfall_create(const char * _filename,
+                           unsigned int _num_bins,
+                           double       _frequency,
+                           double       _span,
+                           double       _rbw,
+                           float        _db_min,
+                           float        _db_step);
+
+// destroy waterfall, writing time index to file
+void waterfall_destroy(waterfall _q);
+
+// print waterfall statistics
+void waterfall_print(waterfall _q);
+
+// set time index resolution [s] (default 1); must be set before the
+// first row is written
+void waterfall_set_index_interval(waterfall _q,
+                                  double    _interval);
+
+// append row, time-stamped with the current time (never blocks)
+//  _q              :   waterfall object
+//  _psd            :   power spectral density [dB] [size: num_bins x 1]
+//  _num_averaged   :   number of spectra averaged in _psd
+void waterfall_write(waterfall    _q,
+                     const float * _psd,
+                     unsigned int _num_averaged);
+
+// get number of rows recorded/dropped
+unsigned int waterfall_get_num_rows(waterfall _q);
+unsigned int waterfall_get_num_dropped(waterfall _q);
+
+// 
+// waterfallreader object interface declarations (memory-mapped reader)
+//
+
+typedef struct waterfallreader_s * waterfallreader;
+
+// open waterfall file for reading; returns NULL on error
+waterfallreader waterfallreader_open(const char * _filename);
+
+// close waterfall file
+void waterfallreader_close(waterfallreader _q);
+
+// accessor methods
+unsigned int waterfallreader_get_num_rows(waterfallreader _q);
+unsigned int waterfallreader_get_num_bins(waterfallreader _q);
+double       waterfallreader_get_frequency(waterfallreader _q);
+double       waterfallreader_get_span(waterfallreader _q);
+double       waterfallreader_get_rbw(waterfallreader _q);
+double       waterfallreader_get_time_start(waterfallreader _q);
+
+// get quantized row at index _i (constant time); the pointer
+// references the memory-mapped file and is valid until the reader is
+// closed
+//  _q          :   waterfallreader object
+//  _i          :   row index, _i < num_rows
+//  _timestamp  :   output time relative to recording start [s] (or NULL)
+//  returns NULL if index is out of range
+const uint8_t * waterfallreader_get_row(waterfallreader _q,
+                                        unsigned int    _i,
+                                        double *        _timestamp);
+
+// read row at index _i (constant time), converted to dB
+//  _q          :   waterfallreader object
+//  _i          :   row index, _i < num_rows
+//  _psd        :   output power spectral density [dB] [size: num_bins x 1]
+//  _timestamp  :   output time relative to recording start [s] (or NULL)
+//  returns 0 on success, -1 if index is out of range
+int waterfallreader_read(waterfallreader _q,
+                         unsigned int    _i,
+                         float *         _psd,
+                         double *        _timestamp);
+
+// find index of first row with timestamp >= _t; constant time via the
+// time index (scans only the rows within one index interval)
+unsigned int waterfallreader_find(waterfallreader _q,
+                                  double          _t);
+
+#endif // __WATERFALL_H__
@@ -0,0 +1,422 @@
+/*
+ * Copyright (c) 2013 Joseph Gaeddert
+ *
+ * This file is part of liquid.
+ *
+ * liquid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * liquid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with liquid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+//
+// amc.cc
+//
+// closed-loop adaptive modulation and coding (AMC) controller with
+// link-quality feedback
+//
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "amc.h"
+
+// packet outcomes kept in the PER window
+#define AMC_WINDOW_LEN  (32)
+
+// EVM smoothing factor
+#define AMC_EVM_ALPHA   (0.2f)
+
+// default table: approximate EVM required for a low packet error rate
+static const struct amc_entry_s amc_default_table[] = {
+    {LIQUID_MODEM_BPSK,  LIQUID_FEC_CONV_V27,    LIQUID_FEC_NONE,  -3.0f},
+    {LIQUID_MODEM_QPSK,  LIQUID_FEC_CONV_V27,    LIQUID_FEC_NONE,  -6.0f},
+    {LIQUID_MODEM_QPSK,  LIQUID_FEC_CONV_V27P34, LIQUID_FEC_NONE,  -8.5f},
+    {LIQUID_MODEM_QAM16, LIQUID_FEC_CONV_V27,    LIQUID_FEC_NONE, -12.0f},
+    {LIQUID_MODEM_QAM16, LIQUID_FEC_CONV_V27P34, LIQUID_FEC_NONE, -14.5f},
+    {LIQUID_MODEM_QAM64, LIQUID_FEC_CONV_V27P34, LIQUID_FEC_NONE, -20.0f},
+    {LIQUID_MODEM_QAM64, LIQUID_FEC_NONE,        LIQUID_FEC_NONE, -25.0f},
+};
+
+struct amc_s {
+    struct amc_entry_s * table;     // modulation/coding table
+    unsigned int num_entries;       // number of table entries
+    unsigned int index;             // selected entry
+
+    // parameters
+    float hysteresis;               // margin [dB]
+    float per_up;                   // PER required to step up
+    float per_down;                 // PER forcing step down
+    unsigned int hold_up;           // packets before stepping up
+    unsigned int hold_down;         // packets before stepping down
+
+    // history since last change
+    float evm;                      // smoothed EVM [dB]
+    int evm_valid;                  // has EVM been observed?
+    unsigned char window[AMC_WINDOW_LEN];   // packet outcomes (1: error)
+    unsigned int num_packets;       // packets since last change
+    unsigned int num_errors;        // errors within window
+    unsigned int num_changes;       // total scheme changes
+
+    // frames received from the peer (reported back to it)
+    int rx_index;                   // entry of frames counted (-1: none)
+    unsigned int rx_num_valid;      // frames received intact
+    unsigned int rx_num_errors;     // frames received in error
+    float rx_evm;                   // smoothed EVM [dB]
+    int rx_evm_valid;               // has EVM been observed?
+
+    // last report read from the peer for the selected entry
+    int fb_synced;                  // have report counts been seen?
+    unsigned int fb_num_valid;      // frames reported intact
+    unsigned int fb_num_errors;     // frames reported in error
+};
+
+// spectral efficiency of a modulation and coding option
+float amc_entry_efficiency(const struct amc_entry_s * _entry)
+{
+    return modulation_types[_entry->ms].bps *
+           fec_get_rate(_entry->fec0) *
+           fec_get_rate(_entry->fec1);
+}
+
+// create AMC controller
+amc amc_create(const struct amc_entry_s * _table,
+               unsigned int               _num_entries)
+{
+    if (_table == NULL) {
+        _table       = amc_default_table;
+        _num_entries = sizeof(amc_default_table) / sizeof(struct amc_entry_s);
+    } else if (_num_entries == 0) {
+        fprintf(stderr,"error: amc_create(), table must have at least one entry\n");
+        exit(1);
+    }
+
+    amc q = (amc) malloc(sizeof(struct amc_s));
+    q->num_entries = _num_entries;
+    q->table = (struct amc_entry_s*) malloc(q->num_entries*sizeof(struct amc_entry_s));
+    memmove(q->table, _table, q->num_entries*sizeof(struct amc_entry_s));
+
+    q->hysteresis = 1.0f;
+    q->per_up     = 0.02f;
+    q->per_down   = 0.1f;
+    q->hold_up    = 16;
+    q->hold_down  = 4;
+
+    amc_reset(q);
+    return q;
+}
+
+// destroy AMC controller
+void amc_destroy(amc _q)
+{
+    free(_q->table);
+    free(_q);
+}
+
+// print controller state and table
+void amc_print(amc _q)
+{
+    printf("amc: entry %u/%u, evm=%7.2f dB, per=%6.3f, goodput=%5.3f b/sym, %u changes\n",
+            _q->index, _q->num_entries, _q->evm, amc_get_per(_q),
+            amc_get_goodput(_q), _q->num_changes);
+    unsigned int i;
+    for (i=0; i<_q->num_entries; i++) {
+        printf("  %c %2u : %-8s %-8s %-8s evm < %6.2f dB, %5.3f b/sym\n",
+                i == _q->index ? '*' : ' ', i,
+                modulation_types[_q->table[i].ms].name,
+                fec_scheme_str[_q->table[i].fec0][0],
+                fec_scheme_str[_q->table[i].fec1][0],
+                _q->table[i].evm_max,
+                amc_entry_efficiency(&_q->table[i]));
+    }
+}
+
+// restart history (after a scheme change)
+static void amc_restart(amc _q)
+{
+    memset(_q->window, 0x00, sizeof(_q->window));
+    _q->num_packets = 0;
+    _q->num_errors  = 0;
+
+    // the next report for the new entry sets the reference counts
+    _q->fb_synced   = 0;
+}
+
+// reset history and return to the most robust entry
+void amc_reset(amc _q)
+{
+    _q->index       = 0;
+    _q->evm         = 0.0f;
+    _q->evm_valid   = 0;
+    _q->num_changes = 0;
+    amc_restart(_q);
+
+    _q->rx_index      = -1;
+    _q->rx_num_valid  = 0;
+    _q->rx_num_errors = 0;
+    _q->rx_evm        = 0.0f;
+    _q->rx_evm_valid  = 0;
+}
+
+// set hysteresis margin [dB]
+void amc_set_hysteresis(amc   _q,
+                        float _hysteresis)
+{
+    if (_hysteresis < 0.0f) {
+        fprintf(stderr,"error: amc_set_hysteresis(), hysteresis must be non-negative\n");
+        exit(1);
+    }
+    _q->hysteresis = _hysteresis;
+}
+
+// set PER thresholds for stepping up and down
+void amc_set_per_thresholds(amc   _q,
+                            float _per_up,
+                            float _per_down)
+{
+    if (_per_up < 0.0f || _per_up > _per_down || _per_down > 1.0f) {
+        fprintf(stderr,"error: amc_set_per_thresholds(), must have 0 <= per_up <= per_down <= 1\n");
+        exit(1);
+    }
+    _q->per_up   = _per_up;
+    _q->per_down = _per_down;
+}
+
+// set number of packets required after a change before stepping
+void amc_set_hold(amc          _q,
+                  unsigned int _hold_up,
+                  unsigned int _hold_down)
+{
+    if (_hold_down == 0) {
+        fprintf(stderr,"error: amc_set_hold(), hold must be greater than zero\n");
+        exit(1);
+    }
+    _q->hold_up   = _hold_up;
+    _q->hold_down = _hold_down;
+}
+
+// select table entry explicitly
+void amc_set_index(amc          _q,
+                   unsigned int _index)
+{
+    if (_index >= _q->num_entries) {
+        fprintf(stderr,"error: amc_set_index(), index (%u) exceeds table size (%u)\n", _index, _q->num_entries);
+        exit(1);
+    }
+    _q->index = _index;
+    amc_restart(_q);
+}
+
+// record packet outcome and step through the table if warranted
+static void amc_record(amc _q,
+                       int _error)
+{
+    unsigned int k = _q->num_packets % AMC_WINDOW_LEN;
+    _q->num_errors -= _q->window[k];
+    _q->window[k]   = _error ? 1 : 0;
+    _q->num_errors += _q->window[k];
+    _q->num_packets++;
+
+    float per = amc_get_per(_q);
+
+    // step down on high PER or insufficient EVM
+    if (_q->index > 0 && _q->num_packets >= _q->hold_down &&
+        (per > _q->per_down ||
+         (_q->evm_valid && _q->evm > _q->table[_q->index].evm_max + _q->hysteresis)))
+    {
+        _q->index--;
+        _q->num_changes++;
+        amc_restart(_q);
+        return;
+    }
+
+    // step up on low PER and EVM comfortably meeting next entry
+    if (_q->index+1 < _q->num_entries && _q->num_packets >= _q->hold_up &&
+        per <= _q->per_up && _q->evm_valid &&
+        _q->evm < _q->table[_q->index+1].evm_max - _q->hysteresis)
+    {
+        _q->index++;
+        _q->num_changes++;
+        amc_restart(_q);
+    }
+}
+
+// update with outcome of a packet on the link
+void amc_update(amc   _q,
+                int   _valid,
+                float _evm)
+{
+    if (_q->evm_valid) {
+        _q->evm = (1.0f - AMC_EVM_ALPHA)*_q->evm + AMC_EVM_ALPHA*_evm;
+    } else {
+        _q->evm = _evm;
+        _q->evm_valid = 1;
+    }
+
+    amc_record(_q, !_valid);
+}
+
+// update with a packet that was lost altogether
+void amc_update_lost(amc _q)
+{
+    amc_record(_q, 1);
+}
+
+// measure a frame received from the peer
+void amc_observe(amc              _q,
+                 int              _header_valid,
+                 int              _payload_valid,
+                 framesyncstats_s _stats)
+{
+    // without a header the scheme is unknown: count against the entry
+    // last received
+    if (!_header_valid) {
+        if (_q->rx_index >= 0)
+            _q->rx_num_errors++;
+        return;
+    }
+
+    // find entry; restart counts when the peer changes entry
+    unsigned int i;
+    for (i=0; i<_q->num_entries; i++) {
+        if (_q->table[i].ms   == (modulation_scheme)_stats.mod_scheme &&
+            _q->table[i].fec0 == (fec_scheme)_stats.fec0 &&
+            _q->table[i].fec1 == (fec_scheme)_stats.fec1)
+        {
+            break;
+        }
+    }
+    if (i == _q->num_entries)
+        return;
+    if ((int)i != _q->rx_index) {
+        _q->rx_index      = i;
+        _q->rx_num_valid  = 0;
+        _q->rx_num_errors = 0;
+        _q->rx_evm_valid  = 0;
+    }
+
+    if (_q->rx_evm_valid) {
+        _q->rx_evm = (1.0f - AMC_EVM_ALPHA)*_q->rx_evm + AMC_EVM_ALPHA*_stats.evm;
+    } else {
+        _q->rx_evm = _stats.evm;
+        _q->rx_evm_valid = 1;
+    }
+
+    if (_payload_valid) _q->rx_num_valid++;
+    else                _q->rx_num_errors++;
+}
+
+// write report of frames received from the peer
+void amc_report_write(amc             _q,
+                      unsigned char * _report)
+{
+    int evm = (int)roundf(-4.0f*_q->rx_evm);
+    if (evm < 0)   evm = 0;
+    if (evm > 254) evm = 254;
+
+    _report[0] = AMC_REPORT_ID;
+    _report[1] = _q->rx_index < 0 ? 0xff : _q->rx_index;
+    _report[2] = _q->rx_num_valid  & 0xff;
+    _report[3] = _q->rx_num_errors & 0xff;
+    _report[4] = _q->rx_evm_valid ? evm : 0xff;
+}
+
+// update with a report from the peer on frames this end sent
+int amc_report_read(amc                   _q,
+                    const unsigned char * _report)
+{
+    if (_report[0] != AMC_REPORT_ID)
+        return -1;
+
+    // only frames sent with the selected entry count
+    if (_report[1] != _q->index)
+        return 0;
+
+    // new outcomes since the last report; resynchronize on the first
+    // report after a change, or if the peer's counts restarted
+    unsigned int num_valid  = (_report[2] - _q->fb_num_valid)  & 0xff;
+    unsigned int num_errors = (_report[3] - _q->fb_num_errors) & 0xff;
+    int synced = _q->fb_synced && num_valid < 128 && num_errors < 128;
+    _q->fb_synced     = 1;
+    _q->fb_num_valid  = _report[2];
+    _q->fb_num_errors = _report[3];
+    if (!synced)
+        return 0;
+
+    if (_report[4] != 0xff) {
+        _q->evm = -0.25f*_report[4];
+        _q->evm_valid = 1;
+    }
+
+    // record outcomes with errors spread evenly, stopping if the
+    // entry changes
+    unsigned int index = _q->index;
+    unsigned int total = num_valid + num_errors;
+    unsigned int n = 0;
+    while (n < total && _q->index == index) {
+        amc_record(_q, (n+1)*num_errors/total > n*num_errors/total);
+        n++;
+    }
+    return n;
+}
+
+// get currently selected scheme
+void amc_get_scheme(amc                 _q,
+                    modulation_scheme * _ms,
+                    fec_scheme *        _fec0,
+                    fec_scheme *        _fec1)
+{
+    // read index once: updates may run on another (receiver) thread
+    const struct amc_entry_s * entry = &_q->table[_q->index];
+    *_ms   = entry->ms;
+    *_fec0 = entry->fec0;
+    *_fec1 = entry->fec1;
+}
+
+// accessor methods
+unsigned int amc_get_num_entries(amc _q)
+{
+    return _q->num_entries;
+}
+
+unsigned int amc_get_index(amc _q)
+{
+    return _q->index;
+}
+
+unsigned int amc_get_num_changes(amc _q)
+{
+    return _q->num_changes;
+}
+
+float amc_get_evm(amc _q)
+{
+    return _q->evm;
+}
+
+float amc_get_per(amc _q)
+{
+    unsigned int n = _q->num_packets < AMC_WINDOW_LEN ? _q->num_packets : AMC_WINDOW_LEN;
+    return n == 0 ? 0.0f : (float)_q->num_errors / (float)n;
+}
+
+float amc_get_efficiency(amc _q)
+{
+    return amc_entry_efficiency(&_q->table[_q->index]);
+}
+
+float amc_get_goodput(amc _q)
+{
+    return amc_get_efficiency(_q) * (1.0f - amc_get_per(_q));
+}
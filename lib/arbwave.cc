@@ -0,0 +1,227 @@
+/*
+ * Copyright (c) 2013 Joseph Gaeddert
+ *
+ * This file is part of liquid.
+ *
+ * liquid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * liquid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with liquid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+//
+// arbwave.cc
+//
+// arbitrary waveform playback
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <complex>
+
+#include "arbwave.h"
+
+// read size for arbwave_create_from_file() [samples]
+#define ARBWAVE_FILE_BLOCK_LEN  (65536)
+
+struct arbwave_s {
+    std::complex<float> * x;        // waveform
+    unsigned int num_samples;       // waveform length
+
+    // playback
+    unsigned int index;             // next sample in loop
+    unsigned long long int num_loops; // completed loops
+    float gain_dB;                  // gain of first loop
+    float step_dB;                  // gain step per loop
+    unsigned int num_steps;         // steps before returning to gain_dB
+    float g;                        // gain of current loop (linear)
+};
+
+// internal methods
+static arbwave arbwave_create(std::complex<float> * _x,
+                              unsigned int          _num_samples);
+static void arbwave_update_gain(arbwave _q);
+
+// render waveform from one period of a periodic baseband signal
+arbwave arbwave_create_periodic(resampchain           _resamp,
+                                std::complex<float> * _x,
+                                unsigned int          _nx)
+{
+    if (_nx == 0) {
+        fprintf(stderr,"error: arbwave_create_periodic(), period must not be empty\n");
+        exit(1);
+    } else if (!resampchain_is_periodic(_resamp, _nx)) {
+        fprintf(stderr,"error: arbwave_create_periodic(), period of %u samples does not wrap exactly at rate %.9f\n",
+                _nx, resampchain_get_rate(_resamp));
+        exit(1);
+    }
+
+    std::complex<float> * y = (std::complex<float>*) malloc(resampchain_get_max_output(_resamp, _nx)*sizeof(std::complex<float>));
+    unsigned int ny;
+
+    // first pass settles the filter states, second is kept
+    resampchain_reset(_resamp);
+    resampchain_execute(_resamp, _x, _nx, y, &ny);
+    resampchain_execute(_resamp, _x, _nx, y, &ny);
+
+    return arbwave_create(y, ny);
+}
+
+// load waveform from file
+arbwave arbwave_create_from_file(const char * _filename)
+{
+    FILE * fid = fopen(_filename,"rb");
+    if (fid == NULL) {
+        fprintf(stderr,"error: arbwave_create_from_file(), could not open '%s' for reading\n", _filename);
+        return NULL;
+    }
+
+    std::complex<float> * x = NULL;
+    unsigned int num_samples = 0;
+    size_t n;
+    do {
+        x = (std::complex<float>*) realloc(x, (num_samples + ARBWAVE_FILE_BLOCK_LEN)*sizeof(std::complex<float>));
+        n = fread(&x[num_samples], sizeof(std::complex<float>), ARBWAVE_FILE_BLOCK_LEN, fid);
+        num_samples += n;
+    } while (n == ARBWAVE_FILE_BLOCK_LEN);
+    fclose(fid);
+
+    if (num_samples == 0) {
+        fprintf(stderr,"error: arbwave_create_from_file(), no samples in '%s'\n", _filename);
+        free(x);
+        return NULL;
+    }
+    return arbwave_create(x, num_samples);
+}
+
+// destroy waveform
+void arbwave_destroy(arbwave _q)
+{
+    free(_q->x);
+    free(_q);
+}
+
+// print waveform properties and playback state
+void arbwave_print(arbwave _q)
+{
+    printf("arbwave:\n");
+    printf("    samples             : %u\n", _q->num_samples);
+    if (_q->num_steps > 1)
+        printf("    gain                : %.2f dB, %+.2f dB/loop over %u loops\n",
+                _q->gain_dB, _q->step_dB, _q->num_steps);
+    else
+        printf("    gain                : %.2f dB\n", _q->gain_dB);
+    printf("    loops               : %llu\n", _q->num_loops);
+}
+
+// save waveform to file
+int arbwave_save(arbwave      _q,
+                 const char * _filename)
+{
+    FILE * fid = fopen(_filename,"wb");
+    if (fid == NULL) {
+        fprintf(stderr,"error: arbwave_save(), could not open '%s' for writing\n", _filename);
+        return -1;
+    }
+    size_t n = fwrite(_q->x, sizeof(std::complex<float>), _q->num_samples, fid);
+    fclose(fid);
+    if (n != _q->num_samples) {
+        fprintf(stderr,"error: arbwave_save(), could not write '%s'\n", _filename);
+        return -1;
+    }
+    return 0;
+}
+
+// set playback gain
+void arbwave_set_gain(arbwave      _q,
+                      float        _gain_dB,
+                      float        _step_dB,
+                      unsigned int _num_steps)
+{
+    if (_num_steps == 0) {
+        fprintf(stderr,"error: arbwave_set_gain(), number of steps must be at least 1\n");
+        exit(1);
+    }
+    _q->gain_dB   = _gain_dB;
+    _q->step_dB   = _step_dB;
+    _q->num_steps = _num_steps;
+    arbwave_update_gain(_q);
+}
+
+// read up to _n samples of playback, stopping at the end of the loop
+unsigned int arbwave_read(arbwave               _q,
+                          std::complex<float> * _y,
+                          unsigned int          _n)
+{
+    unsigned int n = _q->num_samples - _q->index;
+    if (n > _n)
+        n = _n;
+
+    // unity gain is a plain copy
+    std::complex<float> * x = &_q->x[_q->index];
+    if (_q->g == 1.0f) {
+        memmove(_y, x, n*sizeof(std::complex<float>));
+    } else {
+        unsigned int i;
+        for (i=0; i<n; i++)
+            _y[i] = _q->g * x[i];
+    }
+
+    _q->index += n;
+    if (_q->index == _q->num_samples) {
+        _q->index = 0;
+        _q->num_loops++;
+        arbwave_update_gain(_q);
+    }
+    return n;
+}
+
+// get waveform length [samples]
+unsigned int arbwave_get_num_samples(arbwave _q)
+{
+    return _q->num_samples;
+}
+
+// get number of completed loops
+unsigned long long int arbwave_get_num_loops(arbwave _q)
+{
+    return _q->num_loops;
+}
+
+//
+// internal methods
+//
+
+// create waveform object taking ownership of _x (allocated with malloc)
+arbwave arbwave_create(std::complex<float> * _x,
+                       unsigned int          _num_samples)
+{
+    arbwave q = (arbwave) malloc(sizeof(struct arbwave_s));
+    q->x           = _x;
+    q->num_samples = _num_samples;
+    q->index       = 0;
+    q->num_loops   = 0;
+    q->gain_dB     = 0.0f;
+    q->step_dB     = 0.0f;
+    q->num_steps   = 1;
+    arbwave_update_gain(q);
+    return q;
+}
+
+// compute linear gain of current loop
+void arbwave_update_gain(arbwave _q)
+{
+    float gain_dB = _q->gain_dB + _q->step_dB * (float)(_q->num_loops % _q->num_steps);
+    _q->g = gain_dB == 0.0f ? 1.0f : powf(10.0f, gain_dB/20.0f);
+}
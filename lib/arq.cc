@@ -0,0 +1,540 @@
+/*
+ * Copyright (c) 2013 Joseph Gaeddert
+ *
+ * This file is part of liquid.
+ *
+ * liquid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * liquid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with liquid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+//
+// arq.cc
+//
+// selective-repeat automatic repeat request (ARQ) with block
+// acknowledgements and adaptive retransmission timeout
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arq.h"
+
+// round-trip estimator gains and deviation multiplier (RFC 6298)
+#define ARQ_RTT_ALPHA   (0.125f)
+#define ARQ_RTT_BETA    (0.25f)
+#define ARQ_RTT_K       (4.0f)
+
+// sequence number distance a-b (modulo 2^16)
+#define ARQ_SEQ_DIFF(a,b)   ((unsigned int)(((a) - (b)) & 0xffff))
+
+// transmit window slot
+struct arq_txslot_s {
+    unsigned char * payload;        // payload copy
+    unsigned int payload_len;       // payload length [bytes]
+    unsigned int num_tx;            // number of times sent
+    double tx_time;                 // time of last transmission
+    unsigned long int tx_order;     // transmission counter at last send
+    int acked;                      // acknowledged?
+    int resend;                     // marked for fast retransmission?
+};
+
+// receive window slot
+struct arq_rxslot_s {
+    unsigned char * payload;        // payload copy
+    unsigned int payload_len;       // payload length [bytes]
+    int valid;                      // received?
+};
+
+struct arq_s {
+    unsigned int window;            // window size
+    unsigned int max_payload_len;   // maximum payload length
+    arq_callback callback;          // delivery callback
+    void * userdata;                // user-defined data
+
+    // transmitter: slot (tx_head+i)%window holds sequence tx_base+i
+    struct arq_txslot_s * tx;       // transmit window
+    unsigned int tx_base;           // oldest unacknowledged sequence
+    unsigned int tx_head;           // slot of tx_base
+    unsigned int tx_count;          // frames in window
+    unsigned int tx_next;           // frames in window sent at least once
+    unsigned long int tx_order;     // transmissions so far (orders sends)
+
+    // receiver: slot (rx_head+i)%window holds sequence rx_base+i
+    struct arq_rxslot_s * rx;       // receive window
+    unsigned int rx_base;           // next sequence expected in order
+    unsigned int rx_head;           // slot of rx_base
+    int rx_started;                 // has any data been received?
+    int ack_pending;                // is an ack owed to the peer?
+
+    // retransmission timeout
+    float rto_init;                 // initial timeout [s]
+    float rto_min;                  // lower limit [s]
+    float rto_max;                  // upper limit [s]
+    float rto;                      // current timeout [s]
+    float srtt;                     // smoothed round-trip time [s]
+    float rttvar;                   // round-trip time deviation [s]
+    int rtt_valid;                  // has a round trip been sampled?
+
+    // statistics
+    unsigned int num_transmissions;
+    unsigned int num_retransmissions;
+    unsigned int num_acked;
+    unsigned int num_delivered;
+    unsigned int num_duplicates;
+};
+
+// create ARQ endpoint
+arq arq_create(unsigned int _window,
+               unsigned int _max_payload_len,
+               arq_callback _callback,
+               void *       _userdata)
+{
+    // validate input
+    if (_window == 0 || _window > ARQ_MAX_WINDOW) {
+        fprintf(stderr,"error: arq_create(), window size must be in [1,%u]\n", ARQ_MAX_WINDOW);
+        exit(1);
+    } else if (_max_payload_len == 0) {
+        fprintf(stderr,"error: arq_create(), maximum payload length must be greater than zero\n");
+        exit(1);
+    }
+
+    arq q = (arq) malloc(sizeof(struct arq_s));
+    q->window          = _window;
+    q->max_payload_len = _max_payload_len;
+    q->callback        = _callback;
+    q->userdata        = _userdata;
+
+    // allocate windows
+    q->tx = (struct arq_txslot_s*) malloc(q->window*sizeof(struct arq_txslot_s));
+    q->rx = (struct arq_rxslot_s*) malloc(q->window*sizeof(struct arq_rxslot_s));
+    unsigned int i;
+    for (i=0; i<q->window; i++) {
+        q->tx[i].payload = (unsigned char*) malloc(q->max_payload_len);
+        q->rx[i].payload = (unsigned char*) malloc(q->max_payload_len);
+    }
+
+    q->rto_init = 0.2f;
+    q->rto_min  = 0.01f;
+    q->rto_max  = 2.0f;
+
+    arq_reset(q);
+    return q;
+}
+
+// destroy ARQ endpoint
+void arq_destroy(arq _q)
+{
+    unsigned int i;
+    for (i=0; i<_q->window; i++) {
+        free(_q->tx[i].payload);
+        free(_q->rx[i].payload);
+    }
+    free(_q->tx);
+    free(_q->rx);
+    free(_q);
+}
+
+// print statistics
+void arq_print(arq _q)
+{
+    printf("arq [window: %u, max payload: %u bytes]:\n", _q->window, _q->max_payload_len);
+    printf("    transmissions       : %u\n", _q->num_transmissions);
+    printf("    retransmissions     : %u\n", _q->num_retransmissions);
+    printf("    acknowledged        : %u\n", _q->num_acked);
+    printf("    delivered           : %u\n", _q->num_delivered);
+    printf("    duplicates          : %u\n", _q->num_duplicates);
+    printf("    outstanding         : %u\n", _q->tx_count);
+    printf("    srtt / rto          : %8.3f / %8.3f ms\n", _q->srtt*1e3f, _q->rto*1e3f);
+}
+
+// reset sequence numbers, window contents and statistics
+void arq_reset(arq _q)
+{
+    unsigned int i;
+    for (i=0; i<_q->window; i++) {
+        _q->tx[i].acked  = 0;
+        _q->tx[i].resend = 0;
+        _q->tx[i].num_tx = 0;
+        _q->rx[i].valid  = 0;
+    }
+    _q->tx_base     = 0;
+    _q->tx_head     = 0;
+    _q->tx_count    = 0;
+    _q->tx_next     = 0;
+    _q->tx_order    = 0;
+    _q->rx_base     = 0;
+    _q->rx_head     = 0;
+    _q->rx_started  = 0;
+    _q->ack_pending = 0;
+
+    _q->rto       = _q->rto_init;
+    _q->srtt      = 0.0f;
+    _q->rttvar    = 0.0f;
+    _q->rtt_valid = 0;
+
+    _q->num_transmissions   = 0;
+    _q->num_retransmissions = 0;
+    _q->num_acked           = 0;
+    _q->num_delivered       = 0;
+    _q->num_duplicates      = 0;
+}
+
+// set retransmission timeout initial value and limits
+void arq_set_rto(arq   _q,
+                 float _rto_init,
+                 float _rto_min,
+                 float _rto_max)
+{
+    if (_rto_min <= 0.0f || _rto_max < _rto_min) {
+        fprintf(stderr,"error: arq_set_rto(), limits must satisfy 0 < min <= max\n");
+        exit(1);
+    } else if (_rto_init < _rto_min || _rto_init > _rto_max) {
+        fprintf(stderr,"error: arq_set_rto(), initial timeout must be within limits\n");
+        exit(1);
+    }
+    _q->rto_init = _rto_init;
+    _q->rto_min  = _rto_min;
+    _q->rto_max  = _rto_max;
+    if (!_q->rtt_valid)
+        _q->rto = _rto_init;
+}
+
+// queue payload for reliable delivery
+int arq_tx_push(arq             _q,
+                unsigned char * _payload,
+                unsigned int    _payload_len)
+{
+    if (_payload_len == 0 || _payload_len > _q->max_payload_len) {
+        fprintf(stderr,"error: arq_tx_push(), payload length (%u) must be in [1,%u]\n",
+                _payload_len, _q->max_payload_len);
+        exit(1);
+    } else if (_q->tx_count == _q->window) {
+        return -1;
+    }
+
+    struct arq_txslot_s * slot = &_q->tx[(_q->tx_head + _q->tx_count) % _q->window];
+    memmove(slot->payload, _payload, _payload_len);
+    slot->payload_len = _payload_len;
+    slot->num_tx      = 0;
+    slot->tx_time     = 0.0;
+    slot->tx_order    = 0;
+    slot->acked       = 0;
+    slot->resend      = 0;
+    _q->tx_count++;
+    return 0;
+}
+
+// write header for sequence number, flags and current block ack
+static void arq_write_header(arq             _q,
+                             unsigned int    _seq,
+                             int             _flags,
+                             unsigned char * _header)
+{
+    // bitmap of frames received beyond the base
+    unsigned int bitmap = 0;
+    unsigned int i;
+    for (i=1; i<_q->window; i++) {
+        if (_q->rx[(_q->rx_head + i) % _q->window].valid)
+            bitmap |= 1 << (i-1);
+    }
+
+    if (_q->rx_started) {
+        _flags |= ARQ_FLAG_ACK;
+        _q->ack_pending = 0;
+    }
+
+    _header[0] = (_seq >> 8) & 0xff;
+    _header[1] = (_seq     ) & 0xff;
+    _header[2] = _flags;
+    _header[3] = ARQ_HEADER_ID;
+    _header[4] = (_q->rx_base >> 8) & 0xff;
+    _header[5] = (_q->rx_base     ) & 0xff;
+    _header[6] = (bitmap >> 8) & 0xff;
+    _header[7] = (bitmap     ) & 0xff;
+}
+
+// get next frame to send
+int arq_tx_pop(arq             _q,
+               double          _now,
+               unsigned char * _header,
+               unsigned char * _payload,
+               unsigned int *  _payload_len)
+{
+    // oldest frame due for retransmission
+    unsigned int i;
+    for (i=0; i<_q->tx_next; i++) {
+        struct arq_txslot_s * slot = &_q->tx[(_q->tx_head + i) % _q->window];
+        if (slot->acked)
+            continue;
+        if (!slot->resend && _now < slot->tx_time + _q->rto)
+            continue;
+
+        // back off once per expiry of the oldest frame
+        if (!slot->resend && i == 0) {
+            _q->rto *= 2.0f;
+            if (_q->rto > _q->rto_max) _q->rto = _q->rto_max;
+        }
+
+        slot->resend  = 0;
+        slot->num_tx++;
+        slot->tx_time  = _now;
+        slot->tx_order = ++_q->tx_order;
+        _q->num_transmissions++;
+        _q->num_retransmissions++;
+        arq_write_header(_q, (_q->tx_base + i) & 0xffff, ARQ_FLAG_DATA, _header);
+        memmove(_payload, slot->payload, slot->payload_len);
+        *_payload_len = slot->payload_len;
+        return 1;
+    }
+
+    // new frame
+    if (_q->tx_next < _q->tx_count) {
+        struct arq_txslot_s * slot = &_q->tx[(_q->tx_head + _q->tx_next) % _q->window];
+        slot->num_tx   = 1;
+        slot->tx_time  = _now;
+        slot->tx_order = ++_q->tx_order;
+        _q->num_transmissions++;
+        arq_write_header(_q, (_q->tx_base + _q->tx_next) & 0xffff, ARQ_FLAG_DATA, _header);
+        memmove(_payload, slot->payload, slot->payload_len);
+        *_payload_len = slot->payload_len;
+        _q->tx_next++;
+        return 1;
+    }
+
+    // ack only
+    if (_q->ack_pending) {
+        arq_write_header(_q, 0, 0, _header);
+        _payload[0]  = 0;
+        *_payload_len = 1;
+        return 1;
+    }
+
+    return 0;
+}
+
+// time until the next frame is due
+float arq_tx_next_timeout(arq    _q,
+                          double _now)
+{
+    if (_q->tx_next < _q->tx_count || _q->ack_pending)
+        return 0.0f;
+
+    float timeout = -1.0f;
+    unsigned int i;
+    for (i=0; i<_q->tx_next; i++) {
+        struct arq_txslot_s * slot = &_q->tx[(_q->tx_head + i) % _q->window];
+        if (slot->acked)
+            continue;
+        if (slot->resend)
+            return 0.0f;
+
+        float t = (float)(slot->tx_time + _q->rto - _now);
+        if (t < 0.0f) t = 0.0f;
+        if (timeout < 0.0f || t < timeout)
+            timeout = t;
+    }
+    return timeout;
+}
+
+// update round-trip estimate and timeout with new sample
+static void arq_rtt_update(arq   _q,
+                           float _rtt)
+{
+    if (!_q->rtt_valid) {
+        _q->srtt   = _rtt;
+        _q->rttvar = 0.5f*_rtt;
+        _q->rtt_valid = 1;
+    } else {
+        float d = _q->srtt > _rtt ? _q->srtt - _rtt : _rtt - _q->srtt;
+        _q->rttvar = (1.0f - ARQ_RTT_BETA)*_q->rttvar + ARQ_RTT_BETA*d;
+        _q->srtt   = (1.0f - ARQ_RTT_ALPHA)*_q->srtt + ARQ_RTT_ALPHA*_rtt;
+    }
+
+    _q->rto = _q->srtt + ARQ_RTT_K*_q->rttvar;
+    if (_q->rto < _q->rto_min) _q->rto = _q->rto_min;
+    if (_q->rto > _q->rto_max) _q->rto = _q->rto_max;
+}
+
+// process block ack
+static void arq_rx_ack(arq          _q,
+                       double       _now,
+                       unsigned int _base,
+                       unsigned int _bitmap)
+{
+    unsigned long int n_acked = 0;  // latest transmission newly acknowledged
+    double t_sample = -1.0;     // latest first transmission newly acknowledged
+    unsigned int i;
+    for (i=0; i<_q->tx_next; i++) {
+        struct arq_txslot_s * slot = &_q->tx[(_q->tx_head + i) % _q->window];
+        if (slot->acked)
+            continue;
+
+        // acknowledged cumulatively (behind base) or selectively
+        unsigned int d = ARQ_SEQ_DIFF(_q->tx_base + i, _base);
+        int acked = (d >= 0x8000) ||
+                    (d >= 1 && d <= 16 && ((_bitmap >> (d-1)) & 1));
+        if (!acked)
+            continue;
+
+        slot->acked = 1;
+        _q->num_acked++;
+        if (slot->tx_order > n_acked)
+            n_acked = slot->tx_order;
+        if (slot->num_tx == 1 && slot->tx_time > t_sample)
+            t_sample = slot->tx_time;
+    }
+
+    if (t_sample >= 0.0)
+        arq_rtt_update(_q, (float)(_now - t_sample));
+
+    // frames sent before one now acknowledged were lost: resend early;
+    // ordered by transmission rather than time since a burst shares
+    // one time stamp
+    for (i=0; i<_q->tx_next && n_acked > 0; i++) {
+        struct arq_txslot_s * slot = &_q->tx[(_q->tx_head + i) % _q->window];
+        if (!slot->acked && slot->tx_order < n_acked)
+            slot->resend = 1;
+    }
+
+    // slide window past acknowledged frames
+    while (_q->tx_count > 0 && _q->tx[_q->tx_head].acked) {
+        _q->tx[_q->tx_head].acked = 0;
+        _q->tx_head = (_q->tx_head + 1) % _q->window;
+        _q->tx_base = (_q->tx_base + 1) & 0xffff;
+        _q->tx_count--;
+        _q->tx_next--;
+    }
+}
+
+// process data frame
+static void arq_rx_data(arq             _q,
+                        unsigned int    _seq,
+                        unsigned char * _payload,
+                        unsigned int    _payload_len)
+{
+    _q->rx_started  = 1;
+    _q->ack_pending = 1;
+
+    unsigned int d = ARQ_SEQ_DIFF(_seq, _q->rx_base);
+    if (d >= _q->window) {
+        // behind the window (ack was lost) or beyond it; re-ack
+        _q->num_duplicates++;
+        return;
+    }
+
+    struct arq_rxslot_s * slot = &_q->rx[(_q->rx_head + d) % _q->window];
+    if (slot->valid) {
+        _q->num_duplicates++;
+        return;
+    } else if (_payload_len > _q->max_payload_len) {
+        fprintf(stderr,"warning: arq_rx_execute(), payload length (%u) exceeds maximum (%u)\n",
+                _payload_len, _q->max_payload_len);
+        return;
+    }
+    memmove(slot->payload, _payload, _payload_len);
+    slot->payload_len = _payload_len;
+    slot->valid       = 1;
+
+    // deliver in order
+    while (_q->rx[_q->rx_head].valid) {
+        slot = &_q->rx[_q->rx_head];
+        if (_q->callback != NULL)
+            _q->callback(slot->payload, slot->payload_len, _q->userdata);
+        slot->valid = 0;
+        _q->rx_head = (_q->rx_head + 1) % _q->window;
+        _q->rx_base = (_q->rx_base + 1) & 0xffff;
+        _q->num_delivered++;
+    }
+}
+
+// process received frame
+int arq_rx_execute(arq             _q,
+                   double          _now,
+                   unsigned char * _header,
+                   int             _header_valid,
+                   unsigned char * _payload,
+                   unsigned int    _payload_len,
+                   int             _payload_valid)
+{
+    if (!_header_valid || _header[3] != ARQ_HEADER_ID)
+        return -1;
+
+    int flags = _header[2];
+    if (flags & ARQ_FLAG_ACK) {
+        arq_rx_ack(_q, _now,
+                   (_header[4] << 8) | _header[5],
+                   (_header[6] << 8) | _header[7]);
+    }
+
+    if (flags & ARQ_FLAG_DATA) {
+        if (_payload_valid)
+            arq_rx_data(_q, (_header[0] << 8) | _header[1], _payload, _payload_len);
+        else
+            _q->ack_pending = 1;    // let the peer see the hole
+    }
+
+    return flags;
+}
+
+// window state
+unsigned int arq_tx_space(arq _q)
+{
+    return _q->window - _q->tx_count;
+}
+
+unsigned int arq_tx_outstanding(arq _q)
+{
+    return _q->tx_count;
+}
+
+int arq_ack_pending(arq _q)
+{
+    return _q->ack_pending;
+}
+
+// accessor methods
+float arq_get_rto(arq _q)
+{
+    return _q->rto;
+}
+
+float arq_get_srtt(arq _q)
+{
+    return _q->srtt;
+}
+
+unsigned int arq_get_num_transmissions(arq _q)
+{
+    return _q->num_transmissions;
+}
+
+unsigned int arq_get_num_retransmissions(arq _q)
+{
+    return _q->num_retransmissions;
+}
+
+unsigned int arq_get_num_acked(arq _q)
+{
+    return _q->num_acked;
+}
+
+unsigned int arq_get_num_delivered(arq _q)
+{
+    return _q->num_delivered;
+}
+
+unsigned int arq_get_num_duplicates(arq _q)
+{
+    return _q->num_duplicates;
+}
@@ -0,0 +1,309 @@
+/*
+ * Copyright (c) 2013 Joseph Gaeddert
+ *
+ * This file is part of liquid.
+ *
+ * liquid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * liquid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with liquid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+//
+// asyncwriter.cc
+//
+// buffered file writer with background (disk) thread
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/time.h>
+#include <pthread.h>
+
+#include "asyncwriter.h"
+
+// period with which partially-filled buffers are flushed to disk [s]
+#define ASYNCWRITER_FLUSH_PERIOD (0.25f)
+
+// disk worker thread
+void * asyncwriter_disk_worker(void * _arg);
+
+// asyncwriter data structure
+struct asyncwriter_s {
+    FILE * fid;                         // output file
+
+    // double buffer
+    unsigned char * buffer[2];          // internal buffers
+    unsigned int buffer_len;            // capacity of each buffer [bytes]
+    unsigned int num_written[2];        // number of bytes in each buffer
+    unsigned int active;                // index of buffer being filled
+    int pending;                        // inactive buffer waiting for disk?
+
+    // counters
+    long long int offset;               // total bytes accepted
+    unsigned int num_dropped;           // number of dropped blocks
+    unsigned long long num_bytes_dropped;// number of dropped bytes
+
+    // threading
+    pthread_t disk_process;             // disk thread
+    pthread_mutex_t mutex;              // buffer mutex
+    pthread_cond_t  cond_data;          // signal disk thread data are ready
+    pthread_cond_t  cond_free;          // signal writers a buffer is free
+    int running;                        // is disk thread running?
+};
+
+// set timespec for timeout
+//  _ts         :   pointer to timespec structure
+//  _timeout    :   time before timeout
+static void asyncwriter_set_timespec(struct timespec * _ts,
+                                     float             _timeout)
+{
+    // get current time (timeval)
+    struct timeval tv_now;
+    gettimeofday(&tv_now, NULL);
+
+    // add offset (timespec)
+    _ts->tv_sec  = tv_now.tv_sec;                       // seconds
+    _ts->tv_nsec = tv_now.tv_usec*1000 + _timeout*1e9;  // nanoseconds
+
+    // accumulate nanoseconds into seconds
+    while (_ts->tv_nsec >= 1000000000) {
+        _ts->tv_nsec -= 1000000000;
+        _ts->tv_sec++;
+    }
+}
+
+// swap active and inactive buffers, handing active buffer to disk
+// thread; mutex must be held and no buffer may be pending
+static void asyncwriter_swap(asyncwriter _q)
+{
+    _q->pending = 1;
+    _q->active  = 1 - _q->active;
+    pthread_cond_signal(&_q->cond_data);
+}
+
+// create asyncwriter object
+//  _filename   :   output filename (truncated if it exists)
+//  _buffer_len :   size of each internal buffer [bytes]
+asyncwriter asyncwriter_create(const char * _filename,
+                               unsigned int _buffer_len)
+{
+    // validate input
+    if (_buffer_len == 0) {
+        fprintf(stderr,"error: asyncwriter_create(), buffer length must be greater than zero\n");
+        return NULL;
+    }
+
+    // open file
+    FILE * fid = fopen(_filename, "wb");
+    if (fid == NULL) {
+        fprintf(stderr,"error: asyncwriter_create(), could not open '%s' for writing\n", _filename);
+        return NULL;
+    }
+
+    asyncwriter q = (asyncwriter) malloc(sizeof(struct asyncwriter_s));
+    q->fid = fid;
+
+    // allocate buffers
+    q->buffer_len = _buffer_len;
+    q->buffer[0] = (unsigned char*) malloc(q->buffer_len);
+    q->buffer[1] = (unsigned char*) malloc(q->buffer_len);
+    q->num_written[0] = 0;
+    q->num_written[1] = 0;
+    q->active  = 0;
+    q->pending = 0;
+
+    // reset counters
+    q->offset            = 0;
+    q->num_dropped       = 0;
+    q->num_bytes_dropped = 0;
+
+    // create and start disk thread
+    q->running = 1;
+    pthread_mutex_init(&q->mutex,     NULL);
+    pthread_cond_init (&q->cond_data, NULL);
+    pthread_cond_init (&q->cond_free, NULL);
+    pthread_create(&q->disk_process, NULL, asyncwriter_disk_worker, (void*)q);
+
+    return q;
+}
+
+// destroy asyncwriter object, writing all pending data to disk
+void asyncwriter_destroy(asyncwriter _q)
+{
+    // tell disk thread to finish
+    pthread_mutex_lock(&_q->mutex);
+    _q->running = 0;
+    pthread_cond_signal(&_q->cond_data);
+    pthread_mutex_unlock(&_q->mutex);
+
+    void * exit_status;
+    pthread_join(_q->disk_process, &exit_status);
+
+    // destroy threading objects
+    pthread_mutex_destroy(&_q->mutex);
+    pthread_cond_destroy(&_q->cond_data);
+    pthread_cond_destroy(&_q->cond_free);
+
+    // close file
+    fclose(_q->fid);
+
+    // free buffers and main object memory
+    free(_q->buffer[0]);
+    free(_q->buffer[1]);
+    free(_q);
+}
+
+// write block of data; the block is either written in its entirety
+// or dropped altogether (never split)
+//  _q          :   asyncwriter object
+//  _data       :   data block [size: _n x 1]
+//  _n          :   block size [bytes]
+//  returns file offset of the block, or -1 if the block was dropped
+long long int asyncwriter_write(asyncwriter  _q,
+                                const void * _data,
+                                unsigned int _n)
+{
+    pthread_mutex_lock(&_q->mutex);
+
+    // ensure there is room in the active buffer, swapping if necessary
+    if (_q->num_written[_q->active] + _n > _q->buffer_len &&
+        !_q->pending &&
+        _n <= _q->buffer_len)
+    {
+        asyncwriter_swap(_q);
+    }
+
+    if (_q->num_written[_q->active] + _n > _q->buffer_len) {
+        // disk cannot keep up (or block is too large); drop block
+        _q->num_dropped++;
+        _q->num_bytes_dropped += _n;
+        pthread_mutex_unlock(&_q->mutex);
+        return -1;
+    }
+
+    // copy block into active buffer
+    memmove(_q->buffer[_q->active] + _q->num_written[_q->active], _data, _n);
+    _q->num_written[_q->active] += _n;
+    long long int offset = _q->offset;
+    _q->offset += _n;
+
+    pthread_mutex_unlock(&_q->mutex);
+    return offset;
+}
+
+// write block of data, blocking until the background thread has
+// made enough room
+//  _q          :   asyncwriter object
+//  _data       :   data block [size: _n x 1]
+//  _n          :   block size [bytes]
+//  returns file offset of the block
+long long int asyncwriter_write_wait(asyncwriter  _q,
+                                     const void * _data,
+                                     unsigned int _n)
+{
+    const unsigned char * data = (const unsigned char*) _data;
+
+    pthread_mutex_lock(&_q->mutex);
+    long long int offset = _q->offset;
+
+    // copy block in pieces as buffer space becomes available
+    while (_n > 0) {
+        unsigned int num_available = _q->buffer_len - _q->num_written[_q->active];
+        if (num_available == 0) {
+            if (_q->pending) {
+                // wait for disk thread to free a buffer
+                pthread_cond_wait(&_q->cond_free, &_q->mutex);
+            } else {
+                asyncwriter_swap(_q);
+            }
+            continue;
+        }
+
+        unsigned int n = _n < num_available ? _n : num_available;
+        memmove(_q->buffer[_q->active] + _q->num_written[_q->active], data, n);
+        _q->num_written[_q->active] += n;
+        _q->offset += n;
+        data += n;
+        _n   -= n;
+    }
+
+    pthread_mutex_unlock(&_q->mutex);
+    return offset;
+}
+
+// get total number of bytes accepted so far (file offset of next block)
+long long int asyncwriter_get_offset(asyncwriter _q)
+{
+    pthread_mutex_lock(&_q->mutex);
+    long long int offset = _q->offset;
+    pthread_mutex_unlock(&_q->mutex);
+    return offset;
+}
+
+// get number of blocks dropped because the disk was too slow
+unsigned int asyncwriter_get_num_dropped(asyncwriter _q)
+{
+    return _q->num_dropped;
+}
+
+// get number of bytes dropped because the disk was too slow
+unsigned long long asyncwriter_get_num_bytes_dropped(asyncwriter _q)
+{
+    return _q->num_bytes_dropped;
+}
+
+// disk worker thread
+void * asyncwriter_disk_worker(void * _arg)
+{
+    // type cast input argument as asyncwriter object
+    asyncwriter q = (asyncwriter) _arg;
+
+    pthread_mutex_lock(&q->mutex);
+    while (1) {
+        // wait for a full buffer, periodically flushing partial ones
+        while (!q->pending && q->running) {
+            struct timespec ts;
+            asyncwriter_set_timespec(&ts, ASYNCWRITER_FLUSH_PERIOD);
+            pthread_cond_timedwait(&q->cond_data, &q->mutex, &ts);
+
+            if (!q->pending && q->num_written[q->active] > 0)
+                asyncwriter_swap(q);
+        }
+
+        if (!q->pending) {
+            // no longer running; write whatever remains and exit
+            if (q->num_written[q->active] == 0)
+                break;
+            asyncwriter_swap(q);
+        }
+
+        // write inactive buffer to disk without holding the lock
+        unsigned int b = 1 - q->active;
+        pthread_mutex_unlock(&q->mutex);
+        if (fwrite(q->buffer[b], 1, q->num_written[b], q->fid) != q->num_written[b])
+            fprintf(stderr,"warning: asyncwriter_disk_worker(), could not write to file\n");
+        fflush(q->fid);
+        pthread_mutex_lock(&q->mutex);
+
+        // mark buffer as free
+        q->num_written[b] = 0;
+        q->pending = 0;
+        pthread_cond_broadcast(&q->cond_free);
+    }
+    pthread_mutex_unlock(&q->mutex);
+
+    pthread_exit(NULL);
+}
+
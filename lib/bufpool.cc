@@ -0,0 +1,250 @@
+/*
+ * Copyright (c) 2013 Joseph Gaeddert
+ *
+ * This file is part of liquid.
+ *
+ * liquid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * liquid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with liquid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+//
+// bufpool.cc
+//
+// fixed-size pool of reference-counted receive buffers; free buffers
+// are kept on a lock-free stack whose head carries a modification tag
+// (upper 32 bits) to avoid ABA problems
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bufpool.h"
+
+// end of free list
+#define BUFPOOL_NONE    (0xffffffffU)
+
+struct bufpool_s {
+    unsigned int num_buffers;       // number of buffers
+    unsigned int buffer_len;        // payload capacity [bytes]
+    struct rxbuf_s * buffers;       // handles [size: num_buffers x 1]
+    unsigned char * memory;         // payload memory [size: num_buffers*buffer_len x 1]
+    unsigned int * next;            // free list links [size: num_buffers x 1]
+
+    unsigned long long head __attribute__((aligned(64)));   // tag:index
+
+    // counters
+    unsigned int num_free __attribute__((aligned(64)));
+    unsigned int min_free;
+    unsigned int num_acquired;
+    unsigned int num_exhausted;
+    unsigned int num_oversized;
+};
+
+// push buffer onto free list
+static void bufpool_push(bufpool      _q,
+                         unsigned int _index)
+{
+    // count first so that a concurrent pop never sees fewer free buffers
+    // than are actually listed
+    __atomic_add_fetch(&_q->num_free, 1, __ATOMIC_RELAXED);
+
+    unsigned long long head = __atomic_load_n(&_q->head, __ATOMIC_RELAXED);
+    unsigned long long next_head;
+    do {
+        __atomic_store_n(&_q->next[_index], (unsigned int)(head & 0xffffffffULL), __ATOMIC_RELAXED);
+        next_head = (((head >> 32) + 1) << 32) | _index;
+    } while (!__atomic_compare_exchange_n(&_q->head, &head, next_head, true,
+                                          __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+// pop buffer from free list; returns BUFPOOL_NONE if empty
+static unsigned int bufpool_pop(bufpool _q)
+{
+    unsigned long long head = __atomic_load_n(&_q->head, __ATOMIC_ACQUIRE);
+    for (;;) {
+        unsigned int index = (unsigned int)(head & 0xffffffffULL);
+        if (index == BUFPOOL_NONE)
+            return BUFPOOL_NONE;
+        unsigned int next = __atomic_load_n(&_q->next[index], __ATOMIC_RELAXED);
+        unsigned long long next_head = (((head >> 32) + 1) << 32) | next;
+        if (__atomic_compare_exchange_n(&_q->head, &head, next_head, true,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE))
+        {
+            unsigned int num_free = __atomic_sub_fetch(&_q->num_free, 1, __ATOMIC_RELAXED);
+            if (num_free < __atomic_load_n(&_q->min_free, __ATOMIC_RELAXED))
+                __atomic_store_n(&_q->min_free, num_free, __ATOMIC_RELAXED);
+            return index;
+        }
+    }
+}
+
+// create buffer pool
+bufpool bufpool_create(unsigned int _num_buffers,
+                       unsigned int _buffer_len)
+{
+    if (_num_buffers == 0 || _num_buffers >= BUFPOOL_NONE) {
+        fprintf(stderr,"error: bufpool_create(), invalid number of buffers\n");
+        exit(1);
+    } else if (_buffer_len == 0) {
+        fprintf(stderr,"error: bufpool_create(), buffer length must be greater than zero\n");
+        exit(1);
+    }
+
+    bufpool q = (bufpool) malloc(sizeof(struct bufpool_s));
+    q->num_buffers = _num_buffers;
+    q->buffer_len  = _buffer_len;
+    q->buffers = (struct rxbuf_s*) malloc(q->num_buffers*sizeof(struct rxbuf_s));
+    q->memory  = (unsigned char*)  malloc(q->num_buffers*q->buffer_len*sizeof(unsigned char));
+    q->next    = (unsigned int*)   malloc(q->num_buffers*sizeof(unsigned int));
+
+    // link all buffers into the free list
+    unsigned int i;
+    for (i=0; i<q->num_buffers; i++) {
+        q->buffers[i].payload  = &q->memory[i*q->buffer_len];
+        q->buffers[i].pool     = q;
+        q->buffers[i].index    = i;
+        q->buffers[i].refcount = 0;
+        q->next[i] = (i+1 < q->num_buffers) ? i+1 : BUFPOOL_NONE;
+    }
+    q->head = 0;
+
+    q->num_free      = q->num_buffers;
+    q->min_free      = q->num_buffers;
+    q->num_acquired  = 0;
+    q->num_exhausted = 0;
+    q->num_oversized = 0;
+    return q;
+}
+
+// destroy buffer pool
+void bufpool_destroy(bufpool _q)
+{
+    if (_q->num_free != _q->num_buffers)
+        fprintf(stderr,"warning: bufpool_destroy(), %u buffer(s) still in use\n", _q->num_buffers - _q->num_free);
+
+    free(_q->buffers);
+    free(_q->memory);
+    free(_q->next);
+    free(_q);
+}
+
+// print pool statistics
+void bufpool_print(bufpool _q)
+{
+    printf("bufpool:\n");
+    printf("    buffers             : %6u x %u bytes (%u free, min. %u)\n",
+            _q->num_buffers, _q->buffer_len, _q->num_free, _q->min_free);
+    printf("    acquired            : %6u\n", _q->num_acquired);
+    printf("    pool exhausted      : %6u\n", _q->num_exhausted);
+    printf("    oversized frames    : %6u\n", _q->num_oversized);
+}
+
+// acquire empty buffer
+rxbuf bufpool_acquire(bufpool _q)
+{
+    unsigned int index = bufpool_pop(_q);
+    if (index == BUFPOOL_NONE) {
+        __atomic_add_fetch(&_q->num_exhausted, 1, __ATOMIC_RELAXED);
+        return NULL;
+    }
+    __atomic_add_fetch(&_q->num_acquired, 1, __ATOMIC_RELAXED);
+
+    rxbuf b = &_q->buffers[index];
+    __atomic_store_n(&b->refcount, 1, __ATOMIC_RELAXED);
+    b->header_valid  = 0;
+    b->payload_len   = 0;
+    b->payload_valid = 0;
+    b->time          = -1.0;
+    return b;
+}
+
+// acquire buffer and copy received frame into it
+rxbuf bufpool_acquire_frame(bufpool          _q,
+                            unsigned char *  _header,
+                            unsigned int     _header_len,
+                            int              _header_valid,
+                            unsigned char *  _payload,
+                            unsigned int     _payload_len,
+                            int              _payload_valid,
+                            framesyncstats_s _stats)
+{
+    if (_payload_len > _q->buffer_len || _header_len > BUFPOOL_MAX_HEADER_LEN) {
+        __atomic_add_fetch(&_q->num_oversized, 1, __ATOMIC_RELAXED);
+        return NULL;
+    }
+
+    rxbuf b = bufpool_acquire(_q);
+    if (b == NULL)
+        return NULL;
+
+    if (_header != NULL)
+        memmove(b->header, _header, _header_len);
+    b->header_valid  = _header_valid;
+    if (_payload_len > 0)
+        memmove(b->payload, _payload, _payload_len);
+    b->payload_len   = _payload_len;
+    b->payload_valid = _payload_valid;
+    b->stats         = _stats;
+    b->stats.framesyms     = NULL;
+    b->stats.num_framesyms = 0;
+    return b;
+}
+
+// add reference to buffer
+void rxbuf_retain(rxbuf _buf)
+{
+    __atomic_add_fetch(&_buf->refcount, 1, __ATOMIC_RELAXED);
+}
+
+// drop reference to buffer
+void rxbuf_release(rxbuf _buf)
+{
+    unsigned int refcount = __atomic_sub_fetch(&_buf->refcount, 1, __ATOMIC_ACQ_REL);
+    if (refcount == 0)
+        bufpool_push(_buf->pool, _buf->index);
+    else if (refcount == (unsigned int)(-1))
+        fprintf(stderr,"warning: rxbuf_release(), buffer released too many times\n");
+}
+
+// accessor methods
+unsigned int bufpool_get_buffer_len(bufpool _q)
+{
+    return _q->buffer_len;
+}
+
+unsigned int bufpool_get_num_free(bufpool _q)
+{
+    return __atomic_load_n(&_q->num_free, __ATOMIC_RELAXED);
+}
+
+unsigned int bufpool_get_min_free(bufpool _q)
+{
+    return __atomic_load_n(&_q->min_free, __ATOMIC_RELAXED);
+}
+
+unsigned int bufpool_get_num_acquired(bufpool _q)
+{
+    return __atomic_load_n(&_q->num_acquired, __ATOMIC_RELAXED);
+}
+
+unsigned int bufpool_get_num_exhausted(bufpool _q)
+{
+    return __atomic_load_n(&_q->num_exhausted, __ATOMIC_RELAXED);
+}
+
+unsigned int bufpool_get_num_oversized(bufpool _q)
+{
+    return __atomic_load_n(&_q->num_oversized, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,672 @@
+/*
+ * Copyright (c) 2013 Joseph Gaeddert
+ *
+ * This file is part of liquid.
+ *
+ * liquid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * liquid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with liquid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+//
+// chunkdecoder.cc
+//
+// parallel frame decoder: splits a sample stream into overlapping
+// chunks and runs independent synchronizer instances on each
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <complex>
+#include <pthread.h>
+#include <liquid/liquid.h>
+
+#include "chunkdecoder.h"
+
+// synchronizer input block length; frame callbacks are time-stamped
+// with the index of the end of the block in which they fire
+#define CHUNKDECODER_BLOCK_LEN      (256)
+
+// duplicate detection: frames within this many samples of the start
+// of a chunk are compared against recently delivered frames
+#define CHUNKDECODER_DEDUPE_WINDOW  (4*CHUNKDECODER_BLOCK_LEN)
+#define CHUNKDECODER_HISTORY_LEN    (8)
+
+// read size for chunkdecoder_execute_file() [samples]
+#define CHUNKDECODER_FILE_BLOCK_LEN (65536)
+
+// job states
+enum {
+    CHUNKDECODER_JOB_FREE=0,    // available
+    CHUNKDECODER_JOB_FILLING,   // being filled with samples
+    CHUNKDECODER_JOB_READY,     // waiting for worker
+    CHUNKDECODER_JOB_BUSY,      // being decoded
+    CHUNKDECODER_JOB_DONE,      // decoded, waiting for delivery
+};
+
+// decoded frame
+struct chunkdecoder_record_s {
+    unsigned long long int index;   // sample index of detection
+    unsigned int     channel;       // channel index
+    unsigned char *  header;        // frame header [size: header_len x 1]
+    int              header_valid;  // header passed crc?
+    unsigned char *  payload;       // payload [size: payload_len x 1]
+    unsigned int     payload_len;   // payload length
+    int              payload_valid; // payload passed crc?
+    framesyncstats_s stats;         // statistics (framesyms is NULL)
+};
+
+// chunk of samples along with decoded frames
+struct chunkdecoder_job_s {
+    int state;                      // job state
+    unsigned long long int seq;     // chunk sequence number
+    unsigned long long int index;   // sample index of x[0]
+    std::complex<float> * x;        // samples [size: overlap_len + chunk_len x 1]
+    unsigned int num_samples;       // number of samples in x
+    unsigned int lead_len;          // number of lead-in samples in x
+    struct timeval tv_dispatch;     // time chunk was handed to workers
+
+    struct chunkdecoder_record_s * records; // decoded frames
+    unsigned int num_records;       // number of decoded frames
+    unsigned int max_records;       // allocated length of records
+};
+
+struct chunkdecoder_worker_s;
+
+// per-channel callback context
+struct chunkdecoder_channel_s {
+    struct chunkdecoder_worker_s * worker;
+    unsigned int id;
+};
+
+// worker thread
+struct chunkdecoder_worker_s {
+    chunkdecoder q;                 // parent object
+    pthread_t thread;               // worker thread
+    void * sync;                    // synchronizer instance
+    struct chunkdecoder_job_s * job;// job being decoded
+    unsigned long long int index;   // sample index at end of current block
+    int owned;                      // past lead-in (frames belong to job)?
+    struct chunkdecoder_channel_s * channels; // [size: num_channels x 1]
+    void ** userdata;               // [size: num_channels x 1]
+};
+
+// delivered frame history for duplicate removal
+struct chunkdecoder_history_s {
+    unsigned long long int index;   // sample index of detection
+    unsigned int channel;           // channel index
+    unsigned char * header;         // frame header [size: header_len x 1]
+};
+
+struct chunkdecoder_s {
+    // properties
+    unsigned int num_threads;       // number of worker threads
+    unsigned int chunk_len;         // chunk length
+    unsigned int overlap_len;       // lead-in length
+    unsigned int header_len;        // frame header length
+    unsigned int num_channels;      // channels per synchronizer
+
+    // synchronizer hooks
+    chunkdecoder_reset_hook   reset;
+    chunkdecoder_execute_hook execute;
+    chunkdecoder_destroy_hook destroy;
+
+    // user callback
+    framesync_callback callback;
+    void ** userdata;               // [size: num_channels x 1]
+
+    // input buffer
+    std::complex<float> * buffer;   // [size: overlap_len + chunk_len x 1]
+    unsigned int buffer_len;        // number of samples in buffer
+    unsigned int lead_len;          // number of lead-in samples in buffer
+    unsigned long long int index;   // sample index of buffer[0]
+    unsigned long long int seq;     // sequence number of next chunk
+
+    // jobs and workers
+    struct chunkdecoder_job_s * jobs;
+    unsigned int num_jobs;
+    struct chunkdecoder_worker_s * workers;
+
+    // delivery
+    unsigned long long int seq_deliver;   // next chunk to deliver
+    int delivering;                 // is a thread delivering frames?
+    unsigned long long int frame_index;   // index of frame being delivered
+    struct chunkdecoder_history_s history[CHUNKDECODER_HISTORY_LEN];
+    unsigned int history_index;     // next history entry to overwrite
+
+    // counters
+    unsigned long long int num_samples; // samples pushed
+    unsigned int num_frames;        // frames delivered
+    unsigned int num_duplicates;    // duplicate frames removed
+    float latency_max;              // maximum dispatch-to-delivery time
+
+    // threading
+    pthread_mutex_t mutex;
+    pthread_cond_t  cond_ready;     // job ready for worker
+    pthread_cond_t  cond_free;      // job freed (or delivered)
+    int running;                    // are worker threads running?
+};
+
+// internal methods
+void * chunkdecoder_worker(void * _arg);
+int chunkdecoder_callback(unsigned char *  _header,
+                          int              _header_valid,
+                          unsigned char *  _payload,
+                          unsigned int     _payload_len,
+                          int              _payload_valid,
+                          framesyncstats_s _stats,
+                          void *           _userdata);
+static void chunkdecoder_dispatch(chunkdecoder _q);
+static void chunkdecoder_deliver(chunkdecoder                _q,
+                                 struct chunkdecoder_job_s * _job);
+
+// create chunkdecoder object
+chunkdecoder chunkdecoder_create(unsigned int              _num_threads,
+                                 unsigned int              _chunk_len,
+                                 unsigned int              _overlap_len,
+                                 unsigned int              _header_len,
+                                 unsigned int              _num_channels,
+                                 chunkdecoder_create_hook  _create,
+                                 chunkdecoder_reset_hook   _reset,
+                                 chunkdecoder_execute_hook _execute,
+                                 chunkdecoder_destroy_hook _destroy,
+                                 void *                    _context,
+                                 framesync_callback        _callback,
+                                 void **                   _userdata)
+{
+    // validate input
+    if (_chunk_len == 0) {
+        fprintf(stderr,"error: chunkdecoder_create(), chunk length must be greater than zero\n");
+        exit(1);
+    } else if (_overlap_len > _chunk_len) {
+        fprintf(stderr,"error: chunkdecoder_create(), overlap cannot exceed chunk length\n");
+        exit(1);
+    } else if (_num_channels == 0) {
+        fprintf(stderr,"error: chunkdecoder_create(), must have at least one channel\n");
+        exit(1);
+    }
+
+    chunkdecoder q = (chunkdecoder) malloc(sizeof(struct chunkdecoder_s));
+    unsigned int i;
+
+    // number of threads defaults to number of cores
+    if (_num_threads == 0) {
+        long int num_cores = sysconf(_SC_NPROCESSORS_ONLN);
+        _num_threads = num_cores < 1 ? 1 : (unsigned int)num_cores;
+    }
+
+    q->num_threads  = _num_threads;
+    q->chunk_len    = _chunk_len;
+    q->overlap_len  = _overlap_len;
+    q->header_len   = _header_len;
+    q->num_channels = _num_channels;
+    q->reset        = _reset;
+    q->execute      = _execute;
+    q->destroy      = _destroy;
+    q->callback     = _callback;
+
+    q->userdata = (void**) malloc(q->num_channels*sizeof(void*));
+    for (i=0; i<q->num_channels; i++)
+        q->userdata[i] = _userdata[i];
+
+    // input buffer
+    q->buffer = (std::complex<float>*) malloc((q->overlap_len + q->chunk_len)*sizeof(std::complex<float>));
+    q->buffer_len = 0;
+    q->lead_len   = 0;
+    q->index      = 0;
+    q->seq        = 0;
+
+    // jobs: two per worker so that one can be filled while the
+    // other is being decoded
+    q->num_jobs = 2*q->num_threads;
+    q->jobs = (struct chunkdecoder_job_s*) malloc(q->num_jobs*sizeof(struct chunkdecoder_job_s));
+    for (i=0; i<q->num_jobs; i++) {
+        q->jobs[i].state       = CHUNKDECODER_JOB_FREE;
+        q->jobs[i].x           = (std::complex<float>*) malloc((q->overlap_len + q->chunk_len)*sizeof(std::complex<float>));
+        q->jobs[i].records     = NULL;
+        q->jobs[i].num_records = 0;
+        q->jobs[i].max_records = 0;
+    }
+
+    // delivery
+    q->seq_deliver   = 0;
+    q->delivering    = 0;
+    q->frame_index   = 0;
+    q->history_index = 0;
+    for (i=0; i<CHUNKDECODER_HISTORY_LEN; i++) {
+        q->history[i].index   = 0;
+        q->history[i].channel = (unsigned int)(-1);   // empty
+        q->history[i].header  = (unsigned char*) calloc(q->header_len > 0 ? q->header_len : 1, 1);
+    }
+
+    q->num_samples    = 0;
+    q->num_frames     = 0;
+    q->num_duplicates = 0;
+    q->latency_max    = 0.0f;
+
+    pthread_mutex_init(&q->mutex, NULL);
+    pthread_cond_init(&q->cond_ready, NULL);
+    pthread_cond_init(&q->cond_free,  NULL);
+    q->running = 1;
+
+    // create synchronizers here rather than in the worker threads as
+    // FFT planning is not thread-safe
+    q->workers = (struct chunkdecoder_worker_s*) malloc(q->num_threads*sizeof(struct chunkdecoder_worker_s));
+    for (i=0; i<q->num_threads; i++) {
+        struct chunkdecoder_worker_s * w = &q->workers[i];
+        w->q        = q;
+        w->job      = NULL;
+        w->index    = 0;
+        w->owned    = 0;
+        w->channels = (struct chunkdecoder_channel_s*) malloc(q->num_channels*sizeof(struct chunkdecoder_channel_s));
+        w->userdata = (void**) malloc(q->num_channels*sizeof(void*));
+        unsigned int k;
+        for (k=0; k<q->num_channels; k++) {
+            w->channels[k].worker = w;
+            w->channels[k].id     = k;
+            w->userdata[k]        = (void*)&w->channels[k];
+        }
+        w->sync = _create(chunkdecoder_callback, w->userdata, _context);
+    }
+
+    // start worker threads
+    for (i=0; i<q->num_threads; i++)
+        pthread_create(&q->workers[i].thread, NULL, chunkdecoder_worker, (void*)&q->workers[i]);
+
+    return q;
+}
+
+// destroy chunkdecoder object (flushes pending samples first)
+void chunkdecoder_destroy(chunkdecoder _q)
+{
+    chunkdecoder_flush(_q);
+
+    // stop worker threads
+    pthread_mutex_lock(&_q->mutex);
+    _q->running = 0;
+    pthread_cond_broadcast(&_q->cond_ready);
+    pthread_mutex_unlock(&_q->mutex);
+
+    unsigned int i;
+    for (i=0; i<_q->num_threads; i++) {
+        pthread_join(_q->workers[i].thread, NULL);
+        _q->destroy(_q->workers[i].sync);
+        free(_q->workers[i].channels);
+        free(_q->workers[i].userdata);
+    }
+    free(_q->workers);
+
+    for (i=0; i<_q->num_jobs; i++) {
+        free(_q->jobs[i].x);
+        free(_q->jobs[i].records);
+    }
+    free(_q->jobs);
+
+    for (i=0; i<CHUNKDECODER_HISTORY_LEN; i++)
+        free(_q->history[i].header);
+
+    pthread_mutex_destroy(&_q->mutex);
+    pthread_cond_destroy(&_q->cond_ready);
+    pthread_cond_destroy(&_q->cond_free);
+
+    free(_q->buffer);
+    free(_q->userdata);
+    free(_q);
+}
+
+// print chunkdecoder object properties and counters
+void chunkdecoder_print(chunkdecoder _q)
+{
+    printf("chunkdecoder:\n");
+    printf("    threads             : %u\n", _q->num_threads);
+    printf("    chunk length        : %u samples (+%u overlap)\n", _q->chunk_len, _q->overlap_len);
+    printf("    samples processed   : %llu\n", _q->num_samples);
+    printf("    frames delivered    : %u\n", _q->num_frames);
+    printf("    duplicates removed  : %u\n", _q->num_duplicates);
+    printf("    maximum latency     : %8.3f ms\n", _q->latency_max*1e3f);
+}
+
+// push samples into decoder; blocks while all workers are busy
+void chunkdecoder_execute(chunkdecoder          _q,
+                          std::complex<float> * _x,
+                          unsigned int          _n)
+{
+    _q->num_samples += _n;
+
+    while (_n > 0) {
+        // fill buffer up to end of chunk
+        unsigned int num_free = _q->lead_len + _q->chunk_len - _q->buffer_len;
+        unsigned int k = _n < num_free ? _n : num_free;
+        memmove(&_q->buffer[_q->buffer_len], _x, k*sizeof(std::complex<float>));
+        _q->buffer_len += k;
+        _x += k;
+        _n -= k;
+
+        // hand full chunk to workers
+        if (_q->buffer_len == _q->lead_len + _q->chunk_len)
+            chunkdecoder_dispatch(_q);
+    }
+}
+
+// decode remaining samples and wait until all frames have been delivered
+void chunkdecoder_flush(chunkdecoder _q)
+{
+    // dispatch partial chunk
+    if (_q->buffer_len > _q->lead_len)
+        chunkdecoder_dispatch(_q);
+
+    // wait for all dispatched chunks to be delivered
+    pthread_mutex_lock(&_q->mutex);
+    while (_q->seq_deliver < _q->seq)
+        pthread_cond_wait(&_q->cond_free, &_q->mutex);
+    pthread_mutex_unlock(&_q->mutex);
+}
+
+// flush and restart stream
+void chunkdecoder_reset(chunkdecoder _q)
+{
+    chunkdecoder_flush(_q);
+
+    // drop lead-in; keep sample index monotonic
+    _q->index     += _q->buffer_len;
+    _q->buffer_len = 0;
+    _q->lead_len   = 0;
+}
+
+// decode entire file of interleaved 32-bit float I/Q samples and flush
+long long int chunkdecoder_execute_file(chunkdecoder _q,
+                                        const char * _filename)
+{
+    FILE * fid = fopen(_filename,"rb");
+    if (fid == NULL) {
+        fprintf(stderr,"error: chunkdecoder_execute_file(), could not open '%s' for reading\n", _filename);
+        return -1;
+    }
+
+    std::complex<float> * x = (std::complex<float>*) malloc(CHUNKDECODER_FILE_BLOCK_LEN*sizeof(std::complex<float>));
+    long long int num_samples = 0;
+    size_t n;
+    while ( (n = fread(x, sizeof(std::complex<float>), CHUNKDECODER_FILE_BLOCK_LEN, fid)) > 0) {
+        chunkdecoder_execute(_q, x, n);
+        num_samples += n;
+    }
+    chunkdecoder_flush(_q);
+
+    free(x);
+    fclose(fid);
+    return num_samples;
+}
+
+// get sample index of the frame currently being delivered
+unsigned long long int chunkdecoder_get_frame_index(chunkdecoder _q)
+{
+    return _q->frame_index;
+}
+
+unsigned int chunkdecoder_get_num_threads(chunkdecoder _q)
+{
+    return _q->num_threads;
+}
+
+unsigned long long int chunkdecoder_get_num_samples(chunkdecoder _q)
+{
+    return _q->num_samples;
+}
+
+unsigned int chunkdecoder_get_num_duplicates(chunkdecoder _q)
+{
+    return _q->num_duplicates;
+}
+
+float chunkdecoder_get_max_latency(chunkdecoder _q)
+{
+    return _q->latency_max;
+}
+
+// 
+// internal methods
+//
+
+// hand buffer to a free job, keeping the tail as lead-in for the next
+static void chunkdecoder_dispatch(chunkdecoder _q)
+{
+    // wait for free job
+    pthread_mutex_lock(&_q->mutex);
+    struct chunkdecoder_job_s * job = NULL;
+    while (job == NULL) {
+        unsigned int i;
+        for (i=0; i<_q->num_jobs; i++) {
+            if (_q->jobs[i].state == CHUNKDECODER_JOB_FREE) {
+                job = &_q->jobs[i];
+                break;
+            }
+        }
+        if (job == NULL)
+            pthread_cond_wait(&_q->cond_free, &_q->mutex);
+    }
+    job->state = CHUNKDECODER_JOB_FILLING;
+    pthread_mutex_unlock(&_q->mutex);
+
+    // copy samples (outside of lock)
+    memmove(job->x, _q->buffer, _q->buffer_len*sizeof(std::complex<float>));
+    job->index       = _q->index;
+    job->num_samples = _q->buffer_len;
+    job->lead_len    = _q->lead_len;
+    job->num_records = 0;
+    gettimeofday(&job->tv_dispatch, NULL);
+
+    // mark ready and wake a worker
+    pthread_mutex_lock(&_q->mutex);
+    job->seq   = _q->seq++;
+    job->state = CHUNKDECODER_JOB_READY;
+    pthread_cond_signal(&_q->cond_ready);
+    pthread_mutex_unlock(&_q->mutex);
+
+    // retain tail of buffer as lead-in for next chunk
+    unsigned int keep = _q->buffer_len < _q->overlap_len ? _q->buffer_len : _q->overlap_len;
+    memmove(_q->buffer, &_q->buffer[_q->buffer_len - keep], keep*sizeof(std::complex<float>));
+    _q->index     += _q->buffer_len - keep;
+    _q->buffer_len = keep;
+    _q->lead_len   = keep;
+}
+
+// worker thread
+void * chunkdecoder_worker(void * _arg)
+{
+    struct chunkdecoder_worker_s * w = (struct chunkdecoder_worker_s*) _arg;
+    chunkdecoder q = w->q;
+
+    while (1) {
+        // wait for oldest ready job
+        pthread_mutex_lock(&q->mutex);
+        struct chunkdecoder_job_s * job = NULL;
+        while (job == NULL && q->running) {
+            unsigned int i;
+            for (i=0; i<q->num_jobs; i++) {
+                if (q->jobs[i].state == CHUNKDECODER_JOB_READY &&
+                    (job == NULL || q->jobs[i].seq < job->seq))
+                {
+                    job = &q->jobs[i];
+                }
+            }
+            if (job == NULL)
+                pthread_cond_wait(&q->cond_ready, &q->mutex);
+        }
+        if (job == NULL) {
+            pthread_mutex_unlock(&q->mutex);
+            break;
+        }
+        job->state = CHUNKDECODER_JOB_BUSY;
+        pthread_mutex_unlock(&q->mutex);
+
+        // decode chunk in blocks, splitting the block which straddles
+        // the end of the lead-in
+        w->job = job;
+        q->reset(w->sync);
+        unsigned int i;
+        unsigned int n;
+        for (i=0; i<job->num_samples; i+=n) {
+            n = job->num_samples - i;
+            if (n > CHUNKDECODER_BLOCK_LEN)
+                n = CHUNKDECODER_BLOCK_LEN;
+            if (i < job->lead_len && i + n > job->lead_len)
+                n = job->lead_len - i;
+
+            w->owned = (i >= job->lead_len);
+            w->index = job->index + i + n;
+            q->execute(w->sync, &job->x[i], n);
+        }
+        w->job = NULL;
+
+        // mark done and deliver completed chunks in order unless
+        // another thread is already doing so
+        pthread_mutex_lock(&q->mutex);
+        job->state = CHUNKDECODER_JOB_DONE;
+        if (!q->delivering) {
+            q->delivering = 1;
+            while (1) {
+                struct chunkdecoder_job_s * next = NULL;
+                for (i=0; i<q->num_jobs; i++) {
+                    if (q->jobs[i].state == CHUNKDECODER_JOB_DONE &&
+                        q->jobs[i].seq   == q->seq_deliver)
+                    {
+                        next = &q->jobs[i];
+                        break;
+                    }
+                }
+                if (next == NULL)
+                    break;
+
+                pthread_mutex_unlock(&q->mutex);
+                chunkdecoder_deliver(q, next);
+                pthread_mutex_lock(&q->mutex);
+
+                next->state = CHUNKDECODER_JOB_FREE;
+                q->seq_deliver++;
+                pthread_cond_broadcast(&q->cond_free);
+            }
+            q->delivering = 0;
+        }
+        pthread_mutex_unlock(&q->mutex);
+    }
+
+    return NULL;
+}
+
+// internal callback: store frame with job
+int chunkdecoder_callback(unsigned char *  _header,
+                          int              _header_valid,
+                          unsigned char *  _payload,
+                          unsigned int     _payload_len,
+                          int              _payload_valid,
+                          framesyncstats_s _stats,
+                          void *           _userdata)
+{
+    struct chunkdecoder_channel_s * c = (struct chunkdecoder_channel_s*) _userdata;
+    struct chunkdecoder_worker_s  * w = c->worker;
+    struct chunkdecoder_job_s * job = w->job;
+
+    // frames detected during lead-in belong to previous chunk
+    if (job == NULL || !w->owned)
+        return 0;
+
+    unsigned int header_len = w->q->header_len;
+
+    // grow record array as needed
+    if (job->num_records == job->max_records) {
+        job->max_records = job->max_records == 0 ? 16 : 2*job->max_records;
+        job->records = (struct chunkdecoder_record_s*) realloc(job->records,
+                job->max_records*sizeof(struct chunkdecoder_record_s));
+    }
+
+    struct chunkdecoder_record_s * r = &job->records[job->num_records++];
+    r->index         = w->index;
+    r->channel       = c->id;
+    r->header        = (unsigned char*) malloc(header_len > 0 ? header_len : 1);
+    r->header_valid  = _header_valid;
+    r->payload       = (unsigned char*) malloc(_payload_len > 0 ? _payload_len : 1);
+    r->payload_len   = _payload_len;
+    r->payload_valid = _payload_valid;
+    r->stats         = _stats;
+    r->stats.framesyms     = NULL;
+    r->stats.num_framesyms = 0;
+    memmove(r->header, _header, header_len);
+    if (_payload_len > 0)
+        memmove(r->payload, _payload, _payload_len);
+
+    return 0;
+}
+
+// deliver frames of completed job to user callback, removing
+// duplicates close to the start of the chunk
+static void chunkdecoder_deliver(chunkdecoder                _q,
+                                 struct chunkdecoder_job_s * _job)
+{
+    unsigned long long int start = _job->index + _job->lead_len;
+    unsigned int i;
+    unsigned int k;
+    for (i=0; i<_job->num_records; i++) {
+        struct chunkdecoder_record_s * r = &_job->records[i];
+
+        // check for duplicate
+        int duplicate = 0;
+        if (r->header_valid && r->index < start + CHUNKDECODER_DEDUPE_WINDOW) {
+            for (k=0; k<CHUNKDECODER_HISTORY_LEN; k++) {
+                struct chunkdecoder_history_s * h = &_q->history[k];
+                if (h->channel == r->channel &&
+                    r->index <= h->index + CHUNKDECODER_DEDUPE_WINDOW &&
+                    memcmp(h->header, r->header, _q->header_len) == 0)
+                {
+                    duplicate = 1;
+                    break;
+                }
+            }
+        }
+
+        if (duplicate) {
+            _q->num_duplicates++;
+        } else {
+            // remember frame
+            if (r->header_valid) {
+                struct chunkdecoder_history_s * h = &_q->history[_q->history_index];
+                h->index   = r->index;
+                h->channel = r->channel;
+                memmove(h->header, r->header, _q->header_len);
+                _q->history_index = (_q->history_index + 1) % CHUNKDECODER_HISTORY_LEN;
+            }
+
+            // invoke user callback
+            _q->frame_index = r->index;
+            _q->callback(r->header, r->header_valid,
+                         r->payload, r->payload_len, r->payload_valid,
+                         r->stats, _q->userdata[r->channel]);
+            _q->num_frames++;
+        }
+
+        free(r->header);
+        free(r->payload);
+    }
+    _job->num_records = 0;
+
+    // update latency
+    struct timeval tv_now;
+    gettimeofday(&tv_now, NULL);
+    float latency = (float)(tv_now.tv_sec  - _job->tv_dispatch.tv_sec) +
+                    (float)(tv_now.tv_usec - _job->tv_dispatch.tv_usec)*1e-6f;
+    if (latency > _q->latency_max)
+        _q->latency_max = latency;
+}
+
@@ -0,0 +1,242 @@
+/*
+ * Copyright (c) 2013 Joseph Gaeddert
+ *
+ * This file is part of liquid.
+ *
+ * liquid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * liquid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with liquid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+//
+// fanout.cc
+//
+// fan one sample stream out to several processing branches
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <complex>
+
+#include "fanout.h"
+#include "ringbuf.h"
+
+// default ring buffer length [samples]
+#define FANOUT_DEFAULT_RING_LEN (1<<20)
+
+// maximum number of branches
+#define FANOUT_MAX_BRANCHES     (16)
+
+// branch thread
+static void * fanout_branch_worker(void * _arg);
+
+struct fanout_branch_s {
+    fanout q;                           // parent object
+    fanout_callback callback;           // processing callback
+    void * userdata;                    // user data
+    std::complex<float> * buffer;       // block copied from ring
+    pthread_t thread;
+
+    unsigned long long int read_pos __attribute__((aligned(64)));
+    unsigned long long int num_processed;
+    unsigned long long int num_dropped;
+};
+
+struct fanout_s {
+    ringbuf ring;                       // shared ring buffer
+
+    // branches
+    struct fanout_branch_s * branches[FANOUT_MAX_BRANCHES];
+    unsigned int num_branches;
+
+    // threading
+    int started;                        // have branches been started?
+    int running;                        // keep waiting? (guarded by ring lock)
+};
+
+// create fanout object
+fanout fanout_create(unsigned int _ring_len)
+{
+    fanout q = (fanout) malloc(sizeof(struct fanout_s));
+
+    // ring buffer
+    unsigned long long int n = _ring_len == 0 ? FANOUT_DEFAULT_RING_LEN : _ring_len;
+    q->ring = ringbuf_create(n > 4*FANOUT_MAX_BLOCK_LEN ? n : 4*FANOUT_MAX_BLOCK_LEN);
+
+    q->num_branches = 0;
+    q->started      = 0;
+    q->running      = 0;
+
+    return q;
+}
+
+// destroy fanout object
+void fanout_destroy(fanout _q)
+{
+    // stop branches once they have caught up
+    ringbuf_lock(_q->ring);
+    _q->running = 0;
+    ringbuf_wake(_q->ring);
+    ringbuf_unlock(_q->ring);
+
+    unsigned int i;
+    for (i=0; i<_q->num_branches; i++) {
+        if (_q->started)
+            pthread_join(_q->branches[i]->thread, NULL);
+        free(_q->branches[i]->buffer);
+        free(_q->branches[i]);
+    }
+
+    ringbuf_destroy(_q->ring);
+    free(_q);
+}
+
+// print fanout statistics
+void fanout_print(fanout _q)
+{
+    printf("fanout:\n");
+    printf("    ring buffer         : %llu samples\n", ringbuf_get_len(_q->ring));
+    printf("    samples             : %llu\n", fanout_get_num_samples(_q));
+    unsigned int i;
+    for (i=0; i<_q->num_branches; i++) {
+        printf("    branch %2u           : %llu processed, %llu dropped\n", i,
+                fanout_get_num_processed(_q, i),
+                fanout_get_num_dropped(_q, i));
+    }
+}
+
+// add branch
+unsigned int fanout_add_branch(fanout          _q,
+                               fanout_callback _callback,
+                               void *          _userdata)
+{
+    if (_q->started) {
+        fprintf(stderr,"error: fanout_add_branch(), branches already started\n");
+        exit(1);
+    } else if (_q->num_branches == FANOUT_MAX_BRANCHES) {
+        fprintf(stderr,"error: fanout_add_branch(), too many branches (maximum %u)\n", FANOUT_MAX_BRANCHES);
+        exit(1);
+    }
+
+    struct fanout_branch_s * b = (struct fanout_branch_s*) malloc(sizeof(struct fanout_branch_s));
+    b->q             = _q;
+    b->callback      = _callback;
+    b->userdata      = _userdata;
+    b->buffer        = (std::complex<float>*) malloc(FANOUT_MAX_BLOCK_LEN*sizeof(std::complex<float>));
+    b->read_pos      = 0;
+    b->num_processed = 0;
+    b->num_dropped   = 0;
+
+    _q->branches[_q->num_branches] = b;
+    return _q->num_branches++;
+}
+
+// start branch threads
+void fanout_start(fanout _q)
+{
+    if (_q->started) {
+        fprintf(stderr,"warning: fanout_start(), branches already started\n");
+        return;
+    }
+
+    _q->started = 1;
+    _q->running = 1;
+    unsigned int i;
+    for (i=0; i<_q->num_branches; i++)
+        pthread_create(&_q->branches[i]->thread, NULL, fanout_branch_worker, (void*)_q->branches[i]);
+}
+
+// push samples to all branches
+void fanout_write(fanout                _q,
+                  std::complex<float> * _x,
+                  unsigned int          _n)
+{
+    ringbuf_write(_q->ring, _x, _n);
+}
+
+unsigned int fanout_get_num_branches(fanout _q)
+{
+    return _q->num_branches;
+}
+
+unsigned long long int fanout_get_num_samples(fanout _q)
+{
+    return ringbuf_get_write_pos(_q->ring);
+}
+
+unsigned long long int fanout_get_num_processed(fanout       _q,
+                                                unsigned int _branch)
+{
+    if (_branch >= _q->num_branches) {
+        fprintf(stderr,"error: fanout_get_num_processed(), branch index out of range\n");
+        exit(1);
+    }
+    return __atomic_load_n(&_q->branches[_branch]->num_processed, __ATOMIC_RELAXED);
+}
+
+unsigned long long int fanout_get_num_dropped(fanout       _q,
+                                              unsigned int _branch)
+{
+    if (_branch >= _q->num_branches) {
+        fprintf(stderr,"error: fanout_get_num_dropped(), branch index out of range\n");
+        exit(1);
+    }
+    return __atomic_load_n(&_q->branches[_branch]->num_dropped, __ATOMIC_RELAXED);
+}
+
+// branch thread
+static void * fanout_branch_worker(void * _arg)
+{
+    struct fanout_branch_s * b = (struct fanout_branch_s*) _arg;
+    fanout q = b->q;
+    unsigned long long int r = b->read_pos;
+
+    ringbuf_lock(q->ring);
+    while (1) {
+        unsigned long long int w = ringbuf_get_write_pos(q->ring);
+
+        // skip samples the producer may already be overwriting
+        unsigned long long int oldest = ringbuf_get_oldest(q->ring, w);
+        if (r < oldest) {
+            __atomic_fetch_add(&b->num_dropped, oldest - r, __ATOMIC_RELAXED);
+            r = oldest;
+        }
+
+        // wait for samples (exit once caught up after stopping)
+        if (r == w) {
+            if (!q->running)
+                break;
+            ringbuf_wait(q->ring, w);
+            continue;
+        }
+        ringbuf_unlock(q->ring);
+
+        // copy block out of the ring, discarding it if it was
+        // overwritten while copying
+        unsigned int n = w - r > FANOUT_MAX_BLOCK_LEN ? FANOUT_MAX_BLOCK_LEN : (unsigned int)(w - r);
+        if (ringbuf_read(q->ring, r, b->buffer, n)) {
+            __atomic_fetch_add(&b->num_dropped, n, __ATOMIC_RELAXED);
+        } else {
+            b->callback(b->buffer, n, b->userdata);
+            __atomic_fetch_add(&b->num_processed, n, __ATOMIC_RELAXED);
+        }
+        r += n;
+        __atomic_store_n(&b->read_pos, r, __ATOMIC_RELAXED);
+
+        ringbuf_lock(q->ring);
+    }
+    ringbuf_unlock(q->ring);
+
+    return NULL;
+}
@@ -0,0 +1,77 @@
+/*
+ * Copyright (c) 2013 Joseph Gaeddert
+ *
+ * This file is part of liquid.
+ *
+ * liquid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * liquid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with liquid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+//
+// gather.cc
+//
+// scatter-gather (iovec) payload support
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gather.h"
+
+// total length of payload segments
+unsigned int gather_length(const struct iovec * _iov,
+                           unsigned int         _iovcnt)
+{
+    unsigned int len = 0;
+    unsigned int i;
+    for (i=0; i<_iovcnt; i++)
+        len += _iov[i].iov_len;
+    return len;
+}
+
+// present payload segments as one contiguous block
+unsigned char * gather_iovec(const struct iovec * _iov,
+                             unsigned int         _iovcnt,
+                             unsigned char **     _buffer,
+                             unsigned int *       _buffer_len,
+                             unsigned int *       _len)
+{
+    *_len = gather_length(_iov, _iovcnt);
+
+    // nothing to gather
+    if (_iovcnt == 0)
+        return *_buffer;
+    if (_iovcnt == 1)
+        return (unsigned char*) _iov[0].iov_base;
+
+    // grow scratch buffer if needed
+    if (*_len > *_buffer_len) {
+        *_buffer = (unsigned char*) realloc(*_buffer, *_len*sizeof(unsigned char));
+        if (*_buffer == NULL) {
+            fprintf(stderr,"error: gather_iovec(), could not allocate %u bytes\n", *_len);
+            exit(1);
+        }
+        *_buffer_len = *_len;
+    }
+
+    // copy segments
+    unsigned int n = 0;
+    unsigned int i;
+    for (i=0; i<_iovcnt; i++) {
+        memmove(*_buffer + n, _iov[i].iov_base, _iov[i].iov_len);
+        n += _iov[i].iov_len;
+    }
+    return *_buffer;
+}
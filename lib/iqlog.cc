@@ -0,0 +1,353 @@
+/*
+ * Copyright (c) 2013 Joseph Gaeddert
+ *
+ * This file is part of liquid.
+ *
+ * liquid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * liquid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with liquid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+//
+// iqlog.cc
+//
+// streaming binary log of received samples and RSSI track
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#include "asyncwriter.h"
+#include "iqlog.h"
+
+// size of each asyncwriter buffer [bytes]
+#define IQLOG_BUFFER_LEN        (8*1024*1024)
+
+// maximum number of values in each block
+#define IQLOG_IQ_BLOCK_LEN      (8192)
+#define IQLOG_RSSI_BLOCK_LEN    (1024)
+
+// 
+// iqlog (writer)
+//
+
+// iqlog data structure
+struct iqlog_s {
+    asyncwriter writer;         // background file writer
+    int save_iq;                // save samples?
+    unsigned int rssi_decim;    // samples per RSSI value
+
+    // sample block being assembled
+    unsigned char * iq_block;   // block buffer
+    unsigned int iq_num;        // number of samples in block
+
+    // RSSI block being assembled
+    unsigned char * rssi_block; // block buffer
+    unsigned int rssi_num;      // number of values in block
+    float rssi_acc;             // accumulated power
+    unsigned int rssi_count;    // number of samples accumulated
+
+    unsigned long long int num_samples; // samples logged
+    unsigned int num_dropped;           // blocks dropped
+};
+
+// hand block to background writer
+static void iqlog_flush(iqlog           _q,
+                        unsigned char * _block,
+                        unsigned int    _value_len,
+                        int             _wait)
+{
+    struct iqlog_blockheader_s * bh = (struct iqlog_blockheader_s*) _block;
+    if (bh->num_values == 0)
+        return;
+
+    unsigned int n = sizeof(struct iqlog_blockheader_s) + bh->num_values*_value_len;
+    long long int offset = _wait ? asyncwriter_write_wait(_q->writer, _block, n) :
+                                   asyncwriter_write     (_q->writer, _block, n);
+    if (offset < 0)
+        _q->num_dropped++;
+}
+
+// create iqlog object
+iqlog iqlog_create(const char * _filename,
+                   double       _sample_rate,
+                   double       _frequency,
+                   int          _save_iq,
+                   unsigned int _rssi_decim)
+{
+    if (!_save_iq && _rssi_decim == 0) {
+        fprintf(stderr,"error: iqlog_create(), nothing to log\n");
+        exit(1);
+    }
+
+    asyncwriter writer = asyncwriter_create(_filename, IQLOG_BUFFER_LEN);
+    if (writer == NULL) {
+        fprintf(stderr,"error: iqlog_create(), could not create log '%s'\n", _filename);
+        return NULL;
+    }
+
+    iqlog q = (iqlog) malloc(sizeof(struct iqlog_s));
+    q->writer     = writer;
+    q->save_iq    = _save_iq;
+    q->rssi_decim = _rssi_decim;
+
+    // allocate blocks
+    q->iq_block   = (unsigned char*) malloc(sizeof(struct iqlog_blockheader_s) +
+                                            IQLOG_IQ_BLOCK_LEN*sizeof(std::complex<float>));
+    q->rssi_block = (unsigned char*) malloc(sizeof(struct iqlog_blockheader_s) +
+                                            IQLOG_RSSI_BLOCK_LEN*sizeof(float));
+    memset(q->iq_block,   0x00, sizeof(struct iqlog_blockheader_s));
+    memset(q->rssi_block, 0x00, sizeof(struct iqlog_blockheader_s));
+    ((struct iqlog_blockheader_s*) q->iq_block)->type   = IQLOG_BLOCK_IQ;
+    ((struct iqlog_blockheader_s*) q->rssi_block)->type = IQLOG_BLOCK_RSSI;
+    q->iq_num     = 0;
+    q->rssi_num   = 0;
+    q->rssi_acc   = 0.0f;
+    q->rssi_count = 0;
+
+    q->num_samples = 0;
+    q->num_dropped = 0;
+
+    // write file header
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    struct iqlog_fileheader_s fh;
+    memset(&fh, 0x00, sizeof(fh));
+    memmove(fh.magic, IQLOG_MAGIC, 8);
+    fh.version     = IQLOG_VERSION;
+    fh.save_iq     = q->save_iq ? 1 : 0;
+    fh.rssi_decim  = q->rssi_decim;
+    fh.sample_rate = _sample_rate;
+    fh.frequency   = _frequency;
+    fh.time_start  = (double)tv.tv_sec + 1e-6*(double)tv.tv_usec;
+    asyncwriter_write_wait(q->writer, &fh, sizeof(fh));
+
+    return q;
+}
+
+// destroy iqlog object, writing partial blocks to file
+void iqlog_destroy(iqlog _q)
+{
+    // write partial blocks (RSSI of incomplete window is discarded)
+    iqlog_flush(_q, _q->iq_block,   sizeof(std::complex<float>), 1);
+    iqlog_flush(_q, _q->rssi_block, sizeof(float),               1);
+
+    // flush and close file
+    asyncwriter_destroy(_q->writer);
+
+    // free memory
+    free(_q->iq_block);
+    free(_q->rssi_block);
+    free(_q);
+}
+
+// print iqlog statistics
+void iqlog_print(iqlog _q)
+{
+    printf("iqlog: %llu samples, %u blocks dropped, %lld bytes\n",
+            _q->num_samples,
+            _q->num_dropped,
+            asyncwriter_get_offset(_q->writer));
+}
+
+// log samples
+void iqlog_write(iqlog                 _q,
+                 std::complex<float> * _x,
+                 unsigned int          _n)
+{
+    struct iqlog_blockheader_s * iq_bh   = (struct iqlog_blockheader_s*) _q->iq_block;
+    struct iqlog_blockheader_s * rssi_bh = (struct iqlog_blockheader_s*) _q->rssi_block;
+    std::complex<float> * iq = (std::complex<float>*) (_q->iq_block   + sizeof(struct iqlog_blockheader_s));
+    float *             rssi = (float*)               (_q->rssi_block + sizeof(struct iqlog_blockheader_s));
+
+    unsigned int i;
+    while (_n > 0) {
+        // samples: copy as many as fit in current block
+        unsigned int n = _n;
+        if (_q->save_iq) {
+            if (iq_bh->num_values == 0)
+                iq_bh->sample_index = _q->num_samples;
+            if (n > IQLOG_IQ_BLOCK_LEN - iq_bh->num_values)
+                n = IQLOG_IQ_BLOCK_LEN - iq_bh->num_values;
+            memmove(&iq[iq_bh->num_values], _x, n*sizeof(std::complex<float>));
+            iq_bh->num_values += n;
+            if (iq_bh->num_values == IQLOG_IQ_BLOCK_LEN) {
+                iqlog_flush(_q, _q->iq_block, sizeof(std::complex<float>), 0);
+                iq_bh->num_values = 0;
+            }
+        }
+
+        // RSSI track: mean power of each rssi_decim samples
+        for (i=0; _q->rssi_decim > 0 && i<n; i++) {
+            if (_q->rssi_count == 0 && rssi_bh->num_values == 0)
+                rssi_bh->sample_index = _q->num_samples + i;
+            _q->rssi_acc += std::norm(_x[i]);
+            if (++_q->rssi_count < _q->rssi_decim)
+                continue;
+
+            float p = _q->rssi_acc / (float)_q->rssi_decim;
+            rssi[rssi_bh->num_values++] = 10*log10f(p > 1e-20f ? p : 1e-20f);
+            _q->rssi_acc   = 0.0f;
+            _q->rssi_count = 0;
+            if (rssi_bh->num_values == IQLOG_RSSI_BLOCK_LEN) {
+                iqlog_flush(_q, _q->rssi_block, sizeof(float), 0);
+                rssi_bh->num_values = 0;
+            }
+        }
+
+        _q->num_samples += n;
+        _x += n;
+        _n -= n;
+    }
+}
+
+// get number of samples logged
+unsigned long long int iqlog_get_num_samples(iqlog _q)
+{
+    return _q->num_samples;
+}
+
+// get number of blocks dropped
+unsigned int iqlog_get_num_dropped(iqlog _q)
+{
+    return _q->num_dropped;
+}
+
+// 
+// iqlogreader (memory-mapped reader)
+//
+
+// iqlogreader data structure
+struct iqlogreader_s {
+    unsigned char * map;            // memory-mapped file
+    size_t map_len;                 // length of file
+    struct iqlog_fileheader_s * fh;
+    size_t offset;                  // offset of next block
+};
+
+// open log file for reading
+iqlogreader iqlogreader_open(const char * _filename)
+{
+    int fd = open(_filename, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr,"error: iqlogreader_open(), could not open '%s' for reading\n", _filename);
+        return NULL;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(struct iqlog_fileheader_s)) {
+        fprintf(stderr,"error: iqlogreader_open(), '%s' is not an iq log\n", _filename);
+        close(fd);
+        return NULL;
+    }
+
+    size_t map_len = st.st_size;
+    void * map = mmap(NULL, map_len, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        fprintf(stderr,"error: iqlogreader_open(), could not map '%s'\n", _filename);
+        return NULL;
+    }
+
+    // validate file header
+    struct iqlog_fileheader_s * fh = (struct iqlog_fileheader_s*) map;
+    if (memcmp(fh->magic, IQLOG_MAGIC, 8) != 0 || fh->version != IQLOG_VERSION) {
+        fprintf(stderr,"error: iqlogreader_open(), '%s' is not an iq log (or unsupported version)\n", _filename);
+        munmap(map, map_len);
+        return NULL;
+    }
+
+    iqlogreader q = (iqlogreader) malloc(sizeof(struct iqlogreader_s));
+    q->map     = (unsigned char*) map;
+    q->map_len = map_len;
+    q->fh      = fh;
+    q->offset  = sizeof(struct iqlog_fileheader_s);
+    return q;
+}
+
+// close log file
+void iqlogreader_close(iqlogreader _q)
+{
+    munmap(_q->map, _q->map_len);
+    free(_q);
+}
+
+// get sample rate [Hz]
+double iqlogreader_get_sample_rate(iqlogreader _q)
+{
+    return _q->fh->sample_rate;
+}
+
+// get center frequency [Hz]
+double iqlogreader_get_frequency(iqlogreader _q)
+{
+    return _q->fh->frequency;
+}
+
+// get log creation time [s since epoch]
+double iqlogreader_get_time_start(iqlogreader _q)
+{
+    return _q->fh->time_start;
+}
+
+// get samples per RSSI value
+unsigned int iqlogreader_get_rssi_decim(iqlogreader _q)
+{
+    return _q->fh->rssi_decim;
+}
+
+// rewind to first block
+void iqlogreader_rewind(iqlogreader _q)
+{
+    _q->offset = sizeof(struct iqlog_fileheader_s);
+}
+
+// read next block
+int iqlogreader_next(iqlogreader            _q,
+                     struct iqlog_block_s * _block)
+{
+    if (_q->offset + sizeof(struct iqlog_blockheader_s) > _q->map_len)
+        return -1;
+
+    struct iqlog_blockheader_s * bh = (struct iqlog_blockheader_s*) (_q->map + _q->offset);
+    unsigned int value_len;
+    switch (bh->type) {
+    case IQLOG_BLOCK_IQ:    value_len = sizeof(std::complex<float>); break;
+    case IQLOG_BLOCK_RSSI:  value_len = sizeof(float);               break;
+    default:
+        fprintf(stderr,"warning: iqlogreader_next(), invalid block at offset %lu\n", (unsigned long)_q->offset);
+        return -1;
+    }
+
+    // truncated block (e.g. log was not closed)
+    size_t block_len = sizeof(struct iqlog_blockheader_s) + (size_t)bh->num_values*value_len;
+    if (_q->offset + block_len > _q->map_len)
+        return -1;
+
+    unsigned char * v = _q->map + _q->offset + sizeof(struct iqlog_blockheader_s);
+    _block->type         = bh->type;
+    _block->sample_index = bh->sample_index;
+    _block->num_values   = bh->num_values;
+    _block->iq           = bh->type == IQLOG_BLOCK_IQ   ? (std::complex<float>*) v : NULL;
+    _block->rssi         = bh->type == IQLOG_BLOCK_RSSI ? (float*) v : NULL;
+
+    _q->offset += block_len;
+    return 0;
+}
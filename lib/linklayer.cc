@@ -0,0 +1,443 @@
+/*
+ * Copyright (c) 2013 Joseph Gaeddert
+ *
+ * This file is part of liquid.
+ *
+ * liquid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * liquid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with liquid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+//
+// linklayer.cc
+//
+// aggregation and segmentation of SDUs into frame payloads
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "linklayer.h"
+
+// record header lengths [bytes]
+#define LINKLAYER_COMPLETE_HEADER_LEN   (3)
+#define LINKLAYER_SEGMENT_HEADER_LEN    (7)
+
+// minimum segment length worth starting at the end of a frame [bytes]
+#define LINKLAYER_MIN_SEGMENT_LEN       (16)
+
+struct linklayer_s {
+    unsigned int frame_len;         // frame payload length
+
+    // transmit queue (ring buffer of SDU copies)
+    unsigned int queue_len;         // queue capacity
+    unsigned char ** sdu;           // queued SDUs
+    unsigned int * sdu_len;         // queued SDU lengths
+    unsigned int read_index;        // index of head SDU
+    unsigned int num_queued;        // number of queued SDUs
+    unsigned int num_pending;       // queued bytes not yet sent
+    unsigned int offset;            // bytes of head SDU already sent
+    unsigned int tx_id;             // id of head SDU (if segmented)
+    unsigned int next_id;           // id of next segmented SDU
+
+    // receive reassembly
+    linklayer_callback callback;
+    void * userdata;
+    unsigned char * rx_buffer;      // partial SDU
+    unsigned int rx_len;            // bytes received of partial SDU
+    unsigned int rx_id;             // id of partial SDU
+    int rx_active;                  // partial SDU in progress?
+
+    // counters
+    unsigned int num_sdus_tx;       // SDUs fully transmitted
+    unsigned int num_segments_tx;   // segment records transmitted
+    unsigned int num_frames_tx;     // frames produced
+    unsigned long long num_bytes_tx;// SDU bytes transmitted
+    unsigned long long num_frame_bytes_tx; // frame payload bytes produced
+    unsigned int num_sdus_rx;       // SDUs delivered
+    unsigned int num_frames_rx;     // frames unpacked
+    unsigned int num_sdus_dropped;  // partial SDUs discarded
+    unsigned int num_frames_malformed;
+};
+
+// compute number of OFDM symbols occupied by a frame payload
+static unsigned int linklayer_payload_symbols(unsigned int _len,
+                                              fec_scheme   _fec0,
+                                              fec_scheme   _fec1,
+                                              unsigned int _bps,
+                                              unsigned int _M_data)
+{
+    unsigned int enc_len = packetizer_compute_enc_msg_len(_len, LIQUID_CRC_32, _fec0, _fec1);
+    unsigned int num_mod_symbols = (8*enc_len + _bps - 1) / _bps;
+    return (num_mod_symbols + _M_data - 1) / _M_data;
+}
+
+// compute frame payload length maximizing expected goodput
+unsigned int linklayer_plan_frame_len(unsigned int      _M,
+                                      unsigned int      _cp_len,
+                                      unsigned int      _taper_len,
+                                      unsigned char *   _p,
+                                      modulation_scheme _ms,
+                                      fec_scheme        _fec0,
+                                      fec_scheme        _fec1,
+                                      float             _ber,
+                                      unsigned int      _max_len)
+{
+    if (_max_len == 0 || _max_len > LINKLAYER_MAX_SDU_LEN) {
+        fprintf(stderr,"error: linklayer_plan_frame_len(), maximum length must be in [1,%u]\n", LINKLAYER_MAX_SDU_LEN);
+        exit(1);
+    } else if (_ber < 0.0f || _ber >= 1.0f) {
+        fprintf(stderr,"error: linklayer_plan_frame_len(), bit error rate must be in [0,1)\n");
+        exit(1);
+    }
+
+    // count data subcarriers
+    unsigned char p_default[_M];
+    if (_p == NULL) {
+        ofdmframe_init_default_sctype(_M, p_default);
+        _p = p_default;
+    }
+    unsigned int M_data = 0;
+    unsigned int i;
+    for (i=0; i<_M; i++)
+        M_data += (_p[i] == OFDMFRAME_SCTYPE_DATA) ? 1 : 0;
+    unsigned int bps = modulation_types[_ms].bps;
+    if (M_data == 0 || bps == 0) {
+        fprintf(stderr,"error: linklayer_plan_frame_len(), invalid subcarrier allocation or modulation scheme\n");
+        exit(1);
+    }
+
+    // measure preamble and header overhead once with a minimal frame
+    ofdmflexframegenprops_s fgprops;
+    ofdmflexframegenprops_init_default(&fgprops);
+    fgprops.check       = LIQUID_CRC_32;
+    fgprops.fec0        = _fec0;
+    fgprops.fec1        = _fec1;
+    fgprops.mod_scheme  = _ms;
+    ofdmflexframegen fg = ofdmflexframegen_create(_M, _cp_len, _taper_len, _p, &fgprops);
+    unsigned char header[8];
+    unsigned char payload[1];
+    memset(header,  0x00, sizeof(header));
+    memset(payload, 0x00, sizeof(payload));
+    ofdmflexframegen_assemble(fg, header, payload, 1);
+    unsigned int overhead = ofdmflexframegen_getframelen(fg) -
+                            linklayer_payload_symbols(1, _fec0, _fec1, bps, M_data);
+    ofdmflexframegen_destroy(fg);
+
+    // expected goodput per symbol: L (1-ber)^(8L) / (overhead + symbols(L))
+    float log_p = logf(1.0f - _ber);
+    unsigned int len_opt = 1;
+    float goodput_opt = 0.0f;
+    unsigned int len;
+    for (len=1; len<=_max_len; len++) {
+        unsigned int num_symbols = overhead + linklayer_payload_symbols(len, _fec0, _fec1, bps, M_data);
+        float goodput = (float)len * expf(8.0f*len*log_p) / (float)num_symbols;
+        if (goodput > goodput_opt) {
+            goodput_opt = goodput;
+            len_opt     = len;
+        }
+    }
+
+    return len_opt;
+}
+
+// create link layer
+linklayer linklayer_create(unsigned int       _frame_len,
+                           unsigned int       _queue_len,
+                           linklayer_callback _callback,
+                           void *             _userdata)
+{
+    if (_queue_len == 0) {
+        fprintf(stderr,"error: linklayer_create(), queue length must be greater than zero\n");
+        exit(1);
+    }
+
+    linklayer q = (linklayer) malloc(sizeof(struct linklayer_s));
+    linklayer_set_frame_len(q, _frame_len);
+
+    q->queue_len = _queue_len;
+    q->sdu       = (unsigned char **) malloc(q->queue_len*sizeof(unsigned char*));
+    q->sdu_len   = (unsigned int *)   malloc(q->queue_len*sizeof(unsigned int));
+    q->num_queued = 0;
+
+    q->callback  = _callback;
+    q->userdata  = _userdata;
+    q->rx_buffer = (unsigned char *) malloc(LINKLAYER_MAX_SDU_LEN*sizeof(unsigned char));
+
+    linklayer_reset(q);
+    return q;
+}
+
+// destroy link layer
+void linklayer_destroy(linklayer _q)
+{
+    // free queued SDUs
+    linklayer_reset(_q);
+
+    free(_q->sdu);
+    free(_q->sdu_len);
+    free(_q->rx_buffer);
+    free(_q);
+}
+
+// print link layer statistics
+void linklayer_print(linklayer _q)
+{
+    printf("linklayer:\n");
+    printf("    frame length        : %6u bytes\n", _q->frame_len);
+    printf("    SDUs sent           : %6u (%u segments, %u queued)\n",
+            _q->num_sdus_tx, _q->num_segments_tx, _q->num_queued);
+    printf("    frames sent         : %6u (%6.2f SDUs/frame, %6.2f%% filled)\n",
+            _q->num_frames_tx,
+            _q->num_frames_tx == 0 ? 0.0f : (float)_q->num_sdus_tx / (float)_q->num_frames_tx,
+            _q->num_frame_bytes_tx == 0 ? 0.0f : 100.0f * (float)_q->num_bytes_tx / (float)_q->num_frame_bytes_tx);
+    printf("    SDUs received       : %6u (%u frames)\n", _q->num_sdus_rx, _q->num_frames_rx);
+    printf("    SDUs dropped        : %6u\n", _q->num_sdus_dropped);
+    printf("    malformed frames    : %6u\n", _q->num_frames_malformed);
+}
+
+// reset transmit queue, receive reassembly state and counters
+void linklayer_reset(linklayer _q)
+{
+    while (_q->num_queued > 0) {
+        free(_q->sdu[_q->read_index]);
+        _q->read_index = (_q->read_index + 1) % _q->queue_len;
+        _q->num_queued--;
+    }
+    _q->read_index  = 0;
+    _q->num_pending = 0;
+    _q->offset      = 0;
+    _q->tx_id       = 0;
+    _q->next_id     = 0;
+
+    _q->rx_len      = 0;
+    _q->rx_id       = 0;
+    _q->rx_active   = 0;
+
+    _q->num_sdus_tx         = 0;
+    _q->num_segments_tx     = 0;
+    _q->num_frames_tx       = 0;
+    _q->num_bytes_tx        = 0;
+    _q->num_frame_bytes_tx  = 0;
+    _q->num_sdus_rx         = 0;
+    _q->num_frames_rx       = 0;
+    _q->num_sdus_dropped    = 0;
+    _q->num_frames_malformed= 0;
+}
+
+// set frame payload length
+void linklayer_set_frame_len(linklayer    _q,
+                             unsigned int _frame_len)
+{
+    if (_frame_len < 16 || _frame_len > LINKLAYER_MAX_SDU_LEN) {
+        fprintf(stderr,"error: linklayer_set_frame_len(), frame length must be in [16,%u]\n", LINKLAYER_MAX_SDU_LEN);
+        exit(1);
+    }
+    _q->frame_len = _frame_len;
+}
+
+// get frame payload length
+unsigned int linklayer_get_frame_len(linklayer _q)
+{
+    return _q->frame_len;
+}
+
+// queue SDU for transmission
+int linklayer_tx_push(linklayer       _q,
+                      unsigned char * _sdu,
+                      unsigned int    _sdu_len)
+{
+    if (_sdu_len == 0 || _sdu_len > LINKLAYER_MAX_SDU_LEN || _q->num_queued == _q->queue_len)
+        return -1;
+
+    unsigned int index = (_q->read_index + _q->num_queued) % _q->queue_len;
+    _q->sdu[index] = (unsigned char *) malloc(_sdu_len*sizeof(unsigned char));
+    memmove(_q->sdu[index], _sdu, _sdu_len);
+    _q->sdu_len[index] = _sdu_len;
+    _q->num_queued++;
+    _q->num_pending += _sdu_len;
+    return 0;
+}
+
+// pack next frame payload from queued SDUs
+unsigned int linklayer_tx_pop(linklayer       _q,
+                              unsigned char * _frame,
+                              int             _flush)
+{
+    if (_q->num_queued == 0)
+        return 0;
+
+    // wait for enough data to fill the frame unless flushing
+    if (!_flush && _q->num_pending + LINKLAYER_COMPLETE_HEADER_LEN*_q->num_queued < _q->frame_len)
+        return 0;
+
+    unsigned int n = 0;
+    while (_q->num_queued > 0) {
+        unsigned char * sdu = _q->sdu[_q->read_index];
+        unsigned int    len = _q->sdu_len[_q->read_index];
+        unsigned int remain = _q->frame_len - n;
+
+        if (_q->offset == 0 && LINKLAYER_COMPLETE_HEADER_LEN + len <= remain) {
+            // complete SDU fits
+            _frame[n+0] = LINKLAYER_FLAG_FIRST | LINKLAYER_FLAG_LAST;
+            _frame[n+1] = (len >> 8) & 0xff;
+            _frame[n+2] = (len     ) & 0xff;
+            memmove(&_frame[n+LINKLAYER_COMPLETE_HEADER_LEN], sdu, len);
+            n += LINKLAYER_COMPLETE_HEADER_LEN + len;
+        } else {
+            // segment: avoid starting tiny fragments at the end of a frame
+            unsigned int rem = len - _q->offset;
+            if (remain <= LINKLAYER_SEGMENT_HEADER_LEN)
+                break;
+            unsigned int seg = rem < remain - LINKLAYER_SEGMENT_HEADER_LEN ?
+                               rem : remain - LINKLAYER_SEGMENT_HEADER_LEN;
+            if (n > 0 && seg < rem && seg < LINKLAYER_MIN_SEGMENT_LEN)
+                break;
+
+            if (_q->offset == 0)
+                _q->tx_id = _q->next_id++ & 0xffff;
+
+            _frame[n+0] = LINKLAYER_FLAG_SEGMENT |
+                          (_q->offset == 0 ? LINKLAYER_FLAG_FIRST : 0) |
+                          (seg == rem      ? LINKLAYER_FLAG_LAST  : 0);
+            _frame[n+1] = (seg >> 8) & 0xff;
+            _frame[n+2] = (seg     ) & 0xff;
+            _frame[n+3] = (_q->tx_id >> 8) & 0xff;
+            _frame[n+4] = (_q->tx_id     ) & 0xff;
+            _frame[n+5] = (_q->offset >> 8) & 0xff;
+            _frame[n+6] = (_q->offset     ) & 0xff;
+            memmove(&_frame[n+LINKLAYER_SEGMENT_HEADER_LEN], &sdu[_q->offset], seg);
+            n += LINKLAYER_SEGMENT_HEADER_LEN + seg;
+            _q->num_segments_tx++;
+
+            _q->offset += seg;
+            _q->num_pending -= seg;
+            _q->num_bytes_tx += seg;
+            if (_q->offset < len)
+                break;  // frame is full
+            _q->offset = 0;
+            _q->num_sdus_tx++;
+            free(sdu);
+            _q->read_index = (_q->read_index + 1) % _q->queue_len;
+            _q->num_queued--;
+            continue;
+        }
+
+        // complete SDU sent
+        _q->num_pending -= len;
+        _q->num_bytes_tx += len;
+        _q->num_sdus_tx++;
+        free(sdu);
+        _q->read_index = (_q->read_index + 1) % _q->queue_len;
+        _q->num_queued--;
+    }
+
+    // terminate short frame
+    if (n > 0 && n < _q->frame_len)
+        _frame[n++] = 0;
+
+    if (n > 0) {
+        _q->num_frames_tx++;
+        _q->num_frame_bytes_tx += n;
+    }
+    return n;
+}
+
+// number of queued bytes awaiting transmission
+unsigned int linklayer_tx_pending(linklayer _q)
+{
+    return _q->num_pending;
+}
+
+// unpack received frame payload
+int linklayer_rx_execute(linklayer       _q,
+                         unsigned char * _frame,
+                         unsigned int    _frame_len)
+{
+    _q->num_frames_rx++;
+
+    int num_delivered = 0;
+    unsigned int i = 0;
+    while (i < _frame_len && _frame[i] != 0) {
+        unsigned int flags = _frame[i];
+        if (i + LINKLAYER_COMPLETE_HEADER_LEN > _frame_len)
+            break;
+        unsigned int len = (_frame[i+1] << 8) | _frame[i+2];
+
+        if (flags == (LINKLAYER_FLAG_FIRST | LINKLAYER_FLAG_LAST)) {
+            // complete SDU
+            if (i + LINKLAYER_COMPLETE_HEADER_LEN + len > _frame_len)
+                break;
+            if (_q->callback != NULL)
+                _q->callback(&_frame[i+LINKLAYER_COMPLETE_HEADER_LEN], len, _q->userdata);
+            _q->num_sdus_rx++;
+            num_delivered++;
+            i += LINKLAYER_COMPLETE_HEADER_LEN + len;
+            continue;
+        }
+
+        // segment
+        if ( !(flags & LINKLAYER_FLAG_SEGMENT) || i + LINKLAYER_SEGMENT_HEADER_LEN + len > _frame_len)
+            break;
+        unsigned int id     = (_frame[i+3] << 8) | _frame[i+4];
+        unsigned int offset = (_frame[i+5] << 8) | _frame[i+6];
+        unsigned char * data = &_frame[i+LINKLAYER_SEGMENT_HEADER_LEN];
+        i += LINKLAYER_SEGMENT_HEADER_LEN + len;
+
+        if (flags & LINKLAYER_FLAG_FIRST) {
+            if (_q->rx_active)
+                _q->num_sdus_dropped++;
+            _q->rx_active = 1;
+            _q->rx_id     = id;
+            _q->rx_len    = 0;
+        }
+
+        // discard partial SDU if a segment is missing
+        if (!_q->rx_active || id != _q->rx_id || offset != _q->rx_len ||
+            _q->rx_len + len > LINKLAYER_MAX_SDU_LEN)
+        {
+            if (_q->rx_active)
+                _q->num_sdus_dropped++;
+            _q->rx_active = 0;
+            continue;
+        }
+
+        memmove(&_q->rx_buffer[_q->rx_len], data, len);
+        _q->rx_len += len;
+        if (flags & LINKLAYER_FLAG_LAST) {
+            if (_q->callback != NULL)
+                _q->callback(_q->rx_buffer, _q->rx_len, _q->userdata);
+            _q->num_sdus_rx++;
+            num_delivered++;
+            _q->rx_active = 0;
+        }
+    }
+
+    // record runs past end of frame
+    if (i < _frame_len && _frame[i] != 0) {
+        _q->num_frames_malformed++;
+        linklayer_rx_lost(_q);
+        return -1;
+    }
+    return num_delivered;
+}
+
+// note that a frame was lost
+void linklayer_rx_lost(linklayer _q)
+{
+    if (_q->rx_active)
+        _q->num_sdus_dropped++;
+    _q->rx_active = 0;
+}
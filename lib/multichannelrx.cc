@@ -76,10 +76,14 @@ multichannelrx::multichannelrx(unsigned int         _num_channels,
     framesync = (ofdmflexframesync*)  malloc(num_channels * sizeof(ofdmflexframesync));
     userdata  = (void **)             malloc(num_channels * sizeof(void *));
     callback  = (framesync_callback*) malloc(num_channels * sizeof(framesync_callback));
+    context   = (struct multichannelrx_context_s*) malloc(num_channels * sizeof(struct multichannelrx_context_s));
     for (i=0; i<num_channels; i++) {
         userdata[i]  = _userdata[i];
         callback[i]  = _callback[i];
-        framesync[i] = ofdmflexframesync_create(M, cp_len, taper_len, _p, callback[i], userdata[i]);
+        context[i].rx      = this;
+        context[i].channel = i;
+        framesync[i] = ofdmflexframesync_create(M, cp_len, taper_len, _p,
+                                                multichannelrx_callback, (void*)&context[i]);
 #if BST_DEBUG
         ofdmflexframesync_debug_enable(framesync[i]);
 #endif
@@ -99,6 +103,14 @@ multichannelrx::multichannelrx(unsigned int         _num_channels,
     nco = nco_crcf_create(LIQUID_VCO);
     nco_crcf_set_frequency(nco, offset);
 
+    // receive timestamps: the channelizer delays its output by m
+    // filterbank steps (rate is set by the owner)
+    clock = rxclock_create(1.0);
+    rxclock_set_delay(clock, (double)(2*num_channels*m));
+    sample_offset  = 0;
+    frame_overhead = rxclock_ofdmflexframe_overhead(M, cp_len, taper_len, _p, &M_data);
+    frame_time     = -1.0;
+
     // reset base station transmitter
     Reset();
 }
@@ -125,6 +137,8 @@ multichannelrx::~multichannelrx()
     free(framesync);
     free(userdata);
     free(callback);
+    free(context);
+    rxclock_destroy(clock);
 
     // free other buffers
     free(X);
@@ -155,12 +169,12 @@ void multichannelrx::Reset()
 void multichannelrx::Execute(std::complex<float> * _x,
                                   unsigned int          _num_samples)
 {
-    unsigned int i;
-    for (i=0; i<_num_samples; i++) {
+    // the callback locates frames by the position within the block
+    for (sample_offset=0; sample_offset<_num_samples; sample_offset++) {
 #if 1
         // mix signal down and put resulting sample into
         // channelizer input buffer
-        nco_crcf_mix_down(nco, _x[i], &x[buffer_index]);
+        nco_crcf_mix_down(nco, _x[sample_offset], &x[buffer_index]);
         nco_crcf_step(nco);
 
         // update buffer index and...
@@ -175,10 +189,49 @@ void multichannelrx::Execute(std::complex<float> * _x,
 #else
         buffer_index++;
         if ( (buffer_index % (2*num_channels))==0 )
-            ofdmflexframesync_execute(framesync[0], &_x[i], 1);
+            ofdmflexframesync_execute(framesync[0], &_x[sample_offset], 1);
         
 #endif
     }
+    rxclock_advance(clock, _num_samples);
+}
+
+// set input sample rate
+void multichannelrx::SetSampleRate(double _rate)
+{
+    rxclock_set_rate(clock, _rate);
+}
+
+// set device time of the next input sample
+void multichannelrx::SetTime(double _time)
+{
+    rxclock_sync(clock, _time);
+}
+
+// frame synchronizer callback
+int multichannelrx_callback(unsigned char *  _header,
+                            int              _header_valid,
+                            unsigned char *  _payload,
+                            unsigned int     _payload_len,
+                            int              _payload_valid,
+                            framesyncstats_s _stats,
+                            void *           _userdata)
+{
+    struct multichannelrx_context_s * c = (struct multichannelrx_context_s*) _userdata;
+    multichannelrx * rx = c->rx;
+
+    // the frame ended with the current input sample; each channel sample
+    // spans 2*num_channels input samples
+    unsigned long long int index = rxclock_get_index(rx->clock) + rx->sample_offset + 1;
+    unsigned int frame_len = 2 * rx->num_channels *
+        rxclock_ofdmflexframe_len(rx->M, rx->cp_len, rx->M_data, rx->frame_overhead,
+                                  _stats, _payload_len);
+    rx->frame_time = index >= frame_len ? rxclock_get_time(rx->clock, index - frame_len) : -1.0;
+
+    if (rx->callback[c->channel] == NULL)
+        return 0;
+    return rx->callback[c->channel](_header, _header_valid, _payload, _payload_len,
+                                    _payload_valid, _stats, rx->userdata[c->channel]);
 }
 
 // TODO: make this multi-threaded (each synchronizer runs in its own thread)
@@ -95,6 +95,10 @@ multichanneltx::multichanneltx(unsigned int    _num_channels,
     nco = nco_crcf_create(LIQUID_VCO);
     nco_crcf_set_frequency(nco, offset);
 
+    // scatter-gather buffer (allocated on first use)
+    gather     = NULL;
+    gather_len = 0;
+
     // reset base station transmitter
     Reset();
 }
@@ -120,6 +124,7 @@ multichanneltx::~multichanneltx()
     // TODO: free other buffers
     free(X);
     free(x);
+    free(gather);
 }
 
 // reset
@@ -180,13 +185,37 @@ void multichanneltx::UpdateData(unsigned int    _channel,
         return;
     }
 
-    // set frame properties
-    ofdmflexframegenprops_s fgprops = {LIQUID_CRC_32, _fec0, _fec1, _mod};
-    ofdmflexframegen_setprops(framegen[_channel], &fgprops);
+    // set frame properties, only if they have changed (setting them
+    // re-creates the payload encoder and modem)
+    ofdmflexframegenprops_s fgprops;
+    ofdmflexframegen_getprops(framegen[_channel], &fgprops);
+    if (fgprops.check      != LIQUID_CRC_32       ||
+        fgprops.fec0       != (unsigned int)_fec0 ||
+        fgprops.fec1       != (unsigned int)_fec1 ||
+        fgprops.mod_scheme != (unsigned int)_mod)
+    {
+        ofdmflexframegenprops_s props = {LIQUID_CRC_32, _fec0, _fec1, _mod};
+        ofdmflexframegen_setprops(framegen[_channel], &props);
+    }
 
     // assemble frame
     ofdmflexframegen_assemble(framegen[_channel], _header, _payload, _payload_len);
 }
+
+// update payload data on a particular channel from a list of segments
+void multichanneltx::UpdateData(unsigned int         _channel,
+                                unsigned char *      _header,
+                                const struct iovec * _payload,
+                                unsigned int         _payload_cnt,
+                                int                  _mod,
+                                int                  _fec0,
+                                int                  _fec1)
+{
+    unsigned int payload_len;
+    unsigned char * payload = gather_iovec(_payload, _payload_cnt,
+                                           &gather, &gather_len, &payload_len);
+    UpdateData(_channel, _header, payload, payload_len, _mod, _fec0, _fec1);
+}
             
 // Generate samples for transmission
 void multichanneltx::GenerateSamples(std::complex<float> * _buffer)
@@ -78,6 +78,7 @@ multichanneltxrx::multichanneltxrx(unsigned int         _num_channels,
 
     // set internal properties
     debug_enabled= false;
+    amc_channel  = NULL;
 
     // allocate buffers
     tx_buffer_len = 2*num_channels;
@@ -85,19 +86,19 @@ multichanneltxrx::multichanneltxrx(unsigned int         _num_channels,
     
     // TODO: create rx buffer
 
-    // create usrp objects
+    // create usrp object, shared by transmitter and receiver
     uhd::device_addr_t dev_addr;
     usrp_tx = uhd::usrp::multi_usrp::make(dev_addr);
-    usrp_rx = uhd::usrp::multi_usrp::make(dev_addr);
+    usrp_rx = usrp_tx;
 
     // initialize default tx values
-    set_tx_freq(462.0e6f);
+    set_tx_freq(462.0e6);
     set_tx_rate(500e3);
     set_tx_gain_soft(-12.0f);
     set_tx_gain_uhd(40.0f);
 
     // initialize default rx values
-    set_rx_freq(462.0e6f);
+    set_rx_freq(462.0e6);
     set_rx_rate(500e3);
     set_rx_gain_uhd(20.0f);
 
@@ -113,7 +114,11 @@ multichanneltxrx::multichanneltxrx(unsigned int         _num_channels,
     pthread_create(&rx_process,   NULL, multichanneltxrx_rx_worker, (void*)this);
     
     // create and start tx thread
+    tx_burst       = 0;
+    tx_start_time  = -1.0;
+    tx_num_samples = 0;
     tx_running = false;                     // receiver is not running initially
+    tx_active  = false;
     tx_thread_running = true;               // receiver thread IS running initially
     pthread_mutex_init(&tx_mutex, NULL);    // receiver mutex
     pthread_cond_init(&tx_cond,   NULL);    // receiver condition
@@ -128,10 +133,12 @@ multichanneltxrx::~multichanneltxrx()
     // ensure reciever thread is not running
     if (rx_running) stop_rx();
 
-    // signal condition (tell rx worker to continue)
+    // signal condition (tell rx worker to exit)
     dprintf("destructor signaling condition...\n");
+    pthread_mutex_lock(&rx_mutex);
     rx_thread_running = false;
     pthread_cond_signal(&rx_cond);
+    pthread_mutex_unlock(&rx_mutex);
 
     dprintf("destructor joining rx thread...\n");
     void * exit_status;
@@ -148,6 +155,7 @@ multichanneltxrx::~multichanneltxrx()
 
     // free other allocated arrays
     free(tx_buffer);
+    amc_disable();
     
     dprintf("destructor finished\n");
 }
@@ -158,7 +166,7 @@ multichanneltxrx::~multichanneltxrx()
 //
 
 // set transmitter frequency
-void multichanneltxrx::set_tx_freq(float _tx_freq)
+void multichanneltxrx::set_tx_freq(double _tx_freq)
 {
     usrp_tx->set_tx_freq(_tx_freq);
 }
@@ -196,12 +204,7 @@ void multichanneltxrx::reset_tx()
 // start transmitter
 void multichanneltxrx::start_tx()
 {
-    dprintf("usrp tx start\n");
-    // set tx running flag
-    tx_running = true;
-
-    // signal condition (tell tx worker to start)
-    pthread_cond_signal(&tx_cond);
+    start_tx_at(-1.0, 0.0);
 }
 
 // stop transmitter
@@ -210,7 +213,36 @@ void multichanneltxrx::stop_tx()
     dprintf("usrp tx stop\n");
 
     // set tx running flag
+    pthread_mutex_lock(&tx_mutex);
     tx_running = false;
+    pthread_cond_broadcast(&tx_cond);
+    pthread_mutex_unlock(&tx_mutex);
+}
+
+// start transmitter at a device time for a limited burst
+void multichanneltxrx::start_tx_at(double _time,
+                                   double _duration)
+{
+    dprintf("usrp tx start\n");
+    pthread_mutex_lock(&tx_mutex);
+
+    // wait for a stopped burst to drain, then reset the channels while
+    // the worker is idle so packets queued after returning are kept
+    while (tx_active && !tx_running)
+        pthread_cond_wait(&tx_cond, &tx_mutex);
+    if (!tx_active)
+        mctx.Reset();
+
+    // set burst parameters and tx running flag
+    tx_start_time  = _time;
+    tx_num_samples = _duration > 0.0 ? (unsigned long int) llround(_duration * usrp_tx->get_tx_rate()) : 0;
+    tx_burst++;
+    tx_running = true;
+
+    // signal condition (tell tx worker to start); the worker checks the
+    // burst counter before waiting, so the request cannot be lost
+    pthread_cond_broadcast(&tx_cond);
+    pthread_mutex_unlock(&tx_mutex);
 }
 
 // update payload data on a particular channel (non-blocking)
@@ -239,6 +271,80 @@ int multichanneltxrx::transmit_packet(unsigned int    _channel,
     return 0;
 }
 
+// update payload data on a particular channel from a list of segments
+int multichanneltxrx::transmit_packet(unsigned int         _channel,
+                                      unsigned char *      _header,
+                                      const struct iovec * _payload,
+                                      unsigned int         _payload_cnt,
+                                      int                  _mod,
+                                      int                  _fec0,
+                                      int                  _fec1)
+{
+    if (!tx_running) {
+        fprintf(stderr,"error: multichanneltxrx:transmit_packet(), transmitter not yet running\n");
+        throw 0;
+    } else if (_channel >= num_channels) {
+        fprintf(stderr,"error: multichanneltxrx:transmit_packet(), invalid channel %u\n", _channel);
+        throw 0;
+    } else if (!mctx.IsChannelReadyForData(_channel)) {
+        fprintf(stderr,"warning: multichanneltxrx:transmit_packet(), channel %u not ready for data\n", _channel);
+        return -1;
+    }
+
+    // gather and encode segments on the channel
+    mctx.UpdateData(_channel, _header, _payload, _payload_cnt, _mod, _fec0, _fec1);
+
+    return 0;
+}
+
+// update payload data on a particular channel using its AMC scheme
+int multichanneltxrx::transmit_packet(unsigned int    _channel,
+                                      unsigned char * _header,
+                                      unsigned char * _payload,
+                                      unsigned int    _payload_len)
+{
+    if (amc_channel == NULL) {
+        fprintf(stderr,"error: multichanneltxrx:transmit_packet(), adaptive modulation and coding not enabled\n");
+        throw 0;
+    } else if (_channel >= num_channels) {
+        fprintf(stderr,"error: multichanneltxrx:transmit_packet(), invalid channel %u\n", _channel);
+        throw 0;
+    }
+
+    modulation_scheme ms;
+    fec_scheme fec0, fec1;
+    amc_get_scheme(amc_channel[_channel], &ms, &fec0, &fec1);
+
+    return transmit_packet(_channel, _header, _payload, _payload_len, ms, fec0, fec1);
+}
+
+// update payload data for a batch of packets
+unsigned int multichanneltxrx::transmit_packets(const struct multichanneltxrx_packet_s * _packets,
+                                                unsigned int                             _num_packets)
+{
+    if (!tx_running) {
+        fprintf(stderr,"error: multichanneltxrx:transmit_packets(), transmitter not yet running\n");
+        throw 0;
+    }
+
+    unsigned int k;
+    for (k=0; k<_num_packets; k++) {
+        if (_packets[k].channel >= num_channels) {
+            fprintf(stderr,"error: multichanneltxrx:transmit_packets(), invalid channel %u\n", _packets[k].channel);
+            throw 0;
+        } else if (!mctx.IsChannelReadyForData(_packets[k].channel)) {
+            break;
+        }
+
+        // update data on the channel
+        mctx.UpdateData(_packets[k].channel, _packets[k].header,
+                        _packets[k].payload, _packets[k].payload_len,
+                        _packets[k].mod, _packets[k].fec0, _packets[k].fec1);
+    }
+
+    return k;
+}
+
 // is channel available?
 bool multichanneltxrx::is_channel_available(unsigned int _channel)
 {
@@ -266,6 +372,27 @@ unsigned int multichanneltxrx::get_available_channel()
     }
 }
 
+// get index of next available channel (timed)
+int multichanneltxrx::get_available_channel(float _timeout)
+{
+    // poll channels as above, giving up once the timeout expires
+    unsigned int num_polls = (unsigned int)(_timeout / 500e-6f);
+    unsigned int n;
+    for (n=0; n<=num_polls; n++) {
+        unsigned int i;
+        for (i=0; i<num_channels; i++) {
+            if (mctx.IsChannelReadyForData(i)) {
+                usleep(20);
+                return i;
+            }
+        }
+
+        if (n < num_polls)
+            usleep(500);
+    }
+    return -1;
+}
+
 // wait for a specific channel to become available (blocking)
 void multichanneltxrx::wait_for_channel(unsigned int _channel)
 {
@@ -299,12 +426,51 @@ void multichanneltxrx::wait_for_tx_to_complete()
 }
 
 
+// enable adaptive modulation and coding, one controller per channel
+void multichanneltxrx::amc_enable(const struct amc_entry_s * _table,
+                                  unsigned int               _num_entries)
+{
+    if (amc_channel != NULL) {
+        fprintf(stderr,"warning: multichanneltxrx::amc_enable(), already enabled\n");
+        return;
+    }
+
+    amc_channel = (amc*) malloc(num_channels*sizeof(amc));
+    unsigned int i;
+    for (i=0; i<num_channels; i++)
+        amc_channel[i] = amc_create(_table, _num_entries);
+}
+
+// disable adaptive modulation and coding
+void multichanneltxrx::amc_disable()
+{
+    if (amc_channel == NULL)
+        return;
+
+    unsigned int i;
+    for (i=0; i<num_channels; i++)
+        amc_destroy(amc_channel[i]);
+    free(amc_channel);
+    amc_channel = NULL;
+}
+
+// get controller for a particular channel
+amc multichanneltxrx::get_amc(unsigned int _channel)
+{
+    if (_channel >= num_channels) {
+        fprintf(stderr,"error: multichanneltxrx::get_amc(), invalid channel %u\n", _channel);
+        throw 0;
+    }
+
+    return amc_channel == NULL ? NULL : amc_channel[_channel];
+}
+
 // 
 // receiver methods
 //
 
 // set receiver frequency
-void multichanneltxrx::set_rx_freq(float _rx_freq)
+void multichanneltxrx::set_rx_freq(double _rx_freq)
 {
     usrp_rx->set_rx_freq(_rx_freq);
 }
@@ -313,6 +479,9 @@ void multichanneltxrx::set_rx_freq(float _rx_freq)
 void multichanneltxrx::set_rx_rate(float _rx_rate)
 {
     usrp_rx->set_rx_rate(_rx_rate);
+
+    // count samples at the actual device rate
+    mcrx.SetSampleRate(usrp_rx->get_rx_rate());
 }
 
 // set receiver hardware (UHD) gain
@@ -337,6 +506,8 @@ void multichanneltxrx::reset_rx()
 void multichanneltxrx::start_rx()
 {
     dprintf("usrp rx start\n");
+    pthread_mutex_lock(&rx_mutex);
+
     // set rx running flag
     rx_running = true;
 
@@ -345,6 +516,34 @@ void multichanneltxrx::start_rx()
 
     // signal condition (tell rx worker to start)
     pthread_cond_signal(&rx_cond);
+    pthread_mutex_unlock(&rx_mutex);
+}
+
+// start receiver for a window beginning at a device time
+void multichanneltxrx::start_rx_at(double _time,
+                                   double _duration)
+{
+    if (_duration <= 0.0) {
+        fprintf(stderr,"error: multichanneltxrx::start_rx_at(), window duration must be greater than zero\n");
+        throw 0;
+    }
+
+    dprintf("usrp rx start (timed)\n");
+    pthread_mutex_lock(&rx_mutex);
+
+    // set rx running flag
+    rx_running = true;
+
+    // stream exactly the samples in the window
+    uhd::stream_cmd_t cmd(uhd::stream_cmd_t::STREAM_MODE_NUM_SAMPS_AND_DONE);
+    cmd.num_samps  = (size_t) llround(_duration * usrp_rx->get_rx_rate());
+    cmd.stream_now = false;
+    cmd.time_spec  = uhd::time_spec_t(_time);
+    usrp_rx->issue_stream_cmd(cmd);
+
+    // signal condition (tell rx worker to start)
+    pthread_cond_signal(&rx_cond);
+    pthread_mutex_unlock(&rx_mutex);
 }
 
 // stop receiver
@@ -358,6 +557,49 @@ void multichanneltxrx::stop_rx()
     usrp_rx->issue_stream_cmd(uhd::stream_cmd_t::STREAM_MODE_STOP_CONTINUOUS);
 }
 
+//
+// device time
+//
+
+// set device time
+void multichanneltxrx::set_time_now(double _time)
+{
+    usrp_tx->set_time_now(uhd::time_spec_t(_time));
+}
+
+// get device time
+double multichanneltxrx::get_time_now()
+{
+    return usrp_tx->get_time_now().get_real_secs();
+}
+
+// align device time to host time at a PPS edge
+void multichanneltxrx::set_time_pps()
+{
+    // wait for an edge so that the host second it belongs to is
+    // unambiguous (host clock within half a second)
+    double last_pps = usrp_tx->get_time_last_pps().get_real_secs();
+    while (usrp_tx->get_time_last_pps().get_real_secs() == last_pps)
+        usleep(10000);
+
+    // latch the following second on the next edge and wait for it
+    struct timeval tv_now;
+    gettimeofday(&tv_now, NULL);
+    double next_pps = floor(tv_now.tv_sec + 1e-6*tv_now.tv_usec + 0.5) + 1.0;
+    usrp_tx->set_time_next_pps(uhd::time_spec_t(next_pps));
+    usleep(1100000);
+}
+
+// sleep until device time reaches _time
+void multichanneltxrx::wait_until(double _time)
+{
+    double dt;
+    while ( (dt = _time - get_time_now()) > 0.0 ) {
+        // re-read device time at least every 100 ms
+        usleep( (useconds_t)(1e6*(dt < 0.1 ? dt : 0.1)) );
+    }
+}
+
 //
 // additional methods
 //
@@ -418,38 +660,41 @@ void * multichanneltxrx_tx_worker(void * _arg)
     // transmitter metadata object
     uhd::tx_metadata_t md;
     
+    unsigned int last_burst = 0;    // last limited burst completed
+    pthread_mutex_lock(&(txcvr->tx_mutex));
     while (txcvr->tx_thread_running) {
-        // wait for signal to start; lock mutex
-        pthread_mutex_lock(&(txcvr->tx_mutex));
-
-        // this function unlocks the mutex and waits for the condition;
-        // once the condition is set, the mutex is again locked
-        dprintf("tx_worker waiting for condition...\n");
-        //int status =
-        pthread_cond_wait(&(txcvr->tx_cond), &(txcvr->tx_mutex));
-        dprintf("tx_worker received condition\n");
+        // wait for a new start; checking the state before waiting means
+        // a start requested while busy is not lost
+        if (!txcvr->tx_running || txcvr->tx_burst == last_burst) {
+            dprintf("tx_worker waiting for condition...\n");
+            pthread_cond_wait(&(txcvr->tx_cond), &(txcvr->tx_mutex));
+            continue;
+        }
 
-        // unlock the mutex
-        dprintf("tx_worker unlocking mutex\n");
+        // capture burst parameters
+        unsigned int burst            = txcvr->tx_burst;
+        double start_time             = txcvr->tx_start_time;
+        unsigned long int num_samples = txcvr->tx_num_samples;
+        txcvr->tx_active = true;
         pthread_mutex_unlock(&(txcvr->tx_mutex));
-
-        // condition given; check state: run or exit
         dprintf("tx_worker running...\n");
-        if (!txcvr->tx_running) {
-            dprintf("tx_worker finished\n");
-            break;
-        }
 
-        // set up the metadta flags
-        md.start_of_burst = false; // never SOB when continuous
+        // set up the metadta flags; a timed burst carries its launch
+        // time on the first packet
+        md.start_of_burst = start_time >= 0.0;
         md.end_of_burst   = false; // 
-        md.has_time_spec  = false; // set to false to send immediately
+        md.has_time_spec  = start_time >= 0.0;
+        if (start_time >= 0.0)
+            md.time_spec  = uhd::time_spec_t(start_time);
 
-        // reset multichannel transmitter
-        txcvr->mctx.Reset();
+        // channels were reset by start_tx_at()
+        usrp_sample_counter = 0;
     
-        // run transmitter
-        while (txcvr->tx_running) {
+        // run transmitter until stopped or, for a limited burst, until
+        // exactly num_samples samples have been sent
+        unsigned long int num_remaining = num_samples;
+        bool burst_complete = false;
+        while (txcvr->tx_running && !burst_complete) {
             // generate samples
             txcvr->mctx.GenerateSamples(tx_buffer);
 
@@ -459,17 +704,29 @@ void * multichanneltxrx_tx_worker(void * _arg)
                 // append to USRP buffer, scaling by software
                 usrp_buffer[usrp_sample_counter++] = tx_buffer[i] * txcvr->tx_gain;
 
-                // once USRP buffer is full, reset counter and send to device
-                if (usrp_sample_counter==256) {
-                    // reset counter
-                    usrp_sample_counter=0;
-
+                // once USRP buffer is full (or burst is complete), reset
+                // counter and send to device
+                if (usrp_sample_counter==256 ||
+                    (num_samples > 0 && usrp_sample_counter == num_remaining))
+                {
                     // send the result to the USRP
                     txcvr->usrp_tx->get_device()->send(
-                        &usrp_buffer.front(), usrp_buffer.size(), md,
+                        &usrp_buffer.front(), usrp_sample_counter, md,
                         uhd::io_type_t::COMPLEX_FLOAT32,
                         uhd::device::SEND_MODE_FULL_BUFF
                     );
+                    md.start_of_burst = false;
+                    md.has_time_spec  = false;
+
+                    if (num_samples > 0) {
+                        num_remaining -= usrp_sample_counter;
+                        burst_complete = (num_remaining == 0);
+                    }
+
+                    // reset counter
+                    usrp_sample_counter=0;
+                    if (burst_complete)
+                        break;
                 }
             }
 
@@ -477,12 +734,14 @@ void * multichanneltxrx_tx_worker(void * _arg)
         
         // send a few extra samples to the device
         // NOTE: this seems necessary to preserve last OFDM symbol in
-        //       frame from corruption
-        txcvr->usrp_tx->get_device()->send(
-            &usrp_buffer.front(), usrp_buffer.size(), md,
-            uhd::io_type_t::COMPLEX_FLOAT32,
-            uhd::device::SEND_MODE_FULL_BUFF
-        );
+        //       frame from corruption (limited bursts end exactly)
+        if (!burst_complete) {
+            txcvr->usrp_tx->get_device()->send(
+                &usrp_buffer.front(), usrp_buffer.size(), md,
+                uhd::io_type_t::COMPLEX_FLOAT32,
+                uhd::device::SEND_MODE_FULL_BUFF
+            );
+        }
         
         // send a mini EOB packet
         md.start_of_burst = false;
@@ -493,7 +752,15 @@ void * multichanneltxrx_tx_worker(void * _arg)
             uhd::device::SEND_MODE_FULL_BUFF
         );
         dprintf("tx_worker finished running\n");
+
+        pthread_mutex_lock(&(txcvr->tx_mutex));
+        if (num_samples > 0)
+            last_burst = burst;
+        txcvr->tx_active = false;
+        pthread_cond_broadcast(&(txcvr->tx_cond));
     }
+    pthread_mutex_unlock(&(txcvr->tx_mutex));
+
     //
     dprintf("tx_worker exiting thread\n");
     pthread_exit(NULL);
@@ -553,11 +820,11 @@ void * multichanneltxrx_rx_worker(void * _arg)
         // wait for signal to start; lock mutex
         pthread_mutex_lock(&(txcvr->rx_mutex));
 
-        // this function unlocks the mutex and waits for the condition;
-        // once the condition is set, the mutex is again locked
+        // wait for the condition unless the receiver was started before
+        // the worker got here
         dprintf("rx_worker waiting for condition...\n");
-        //int status =
-        pthread_cond_wait(&(txcvr->rx_cond), &(txcvr->rx_mutex));
+        while (!txcvr->rx_running && txcvr->rx_thread_running)
+            pthread_cond_wait(&(txcvr->rx_cond), &(txcvr->rx_mutex));
         dprintf("rx_worker received condition\n");
 
         // unlock the mutex
@@ -566,7 +833,7 @@ void * multichanneltxrx_rx_worker(void * _arg)
 
         // condition given; check state: run or exit
         dprintf("rx_worker running...\n");
-        if (!txcvr->rx_running) {
+        if (!txcvr->rx_thread_running) {
             dprintf("rx_worker finished\n");
             break;
         }
@@ -600,17 +867,13 @@ void * multichanneltxrx_rx_worker(void * _arg)
             }
 #endif
 
-            // push data through frame synchronizer
+            // timestamp block (re-anchors only on discontinuities)
+            if (md.has_time_spec)
+                txcvr->mcrx.SetTime(md.time_spec.get_real_secs());
+
+            // push block through multi-channel receiver
             // TODO : use arbitrary resampler?
-            // TODO : operate on block of samples
-            unsigned int j;
-            for (j=0; j<num_rx_samps; j++) {
-                // grab sample from usrp buffer
-                std::complex<float> usrp_sample = buffer[j];
-
-                // push resulting samples through multi-channel receiver
-                txcvr->mcrx.Execute(&usrp_sample, 1);
-            }
+            txcvr->mcrx.Execute(&buffer.front(), num_rx_samps);
 
         } // while rx_running
         dprintf("rx_worker finished running\n");
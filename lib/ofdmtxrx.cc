@@ -23,11 +23,15 @@
 
 #include <math.h>
 #include <iostream>
+#include <algorithm>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
 #include <sys/time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
 #include <complex>
 #include <liquid/liquid.h>
 
@@ -42,6 +46,18 @@
 #   define dprintf(s) /* s */
 #endif
 
+// device time of the frame being delivered, per delivering thread
+static __thread double ofdmtxrx_frame_time = -1.0;
+
+// frequency hopping: retunes are queued on the device at most this far
+// ahead of the hop [s], and at most this many hops ahead (bounding the
+// number of pending timed commands)
+#define OFDMTXRX_HOP_LEAD           (0.010)
+#define OFDMTXRX_HOP_MAX_PENDING    (4)
+
+// number of OFDM symbols handed to the device per send call
+#define OFDMTXRX_TX_SYMBOLS_PER_SEND    (16)
+
 // default constructor
 //  _M              :   OFDM: number of subcarriers
 //  _cp_len         :   OFDM: cyclic prefix length
@@ -55,6 +71,67 @@ ofdmtxrx::ofdmtxrx(unsigned int       _M,
                    unsigned char *    _p,
                    framesync_callback _callback,
                    void *             _userdata)
+{
+    // create usrp object, shared by transmitter and receiver
+    uhd::device_addr_t dev_addr;
+    usrp_tx = uhd::usrp::multi_usrp::make(dev_addr);
+    usrp_rx = usrp_tx;
+    loop_tx_fd = -1;
+    loop_rx_fd = -1;
+    loop_rx_residual_len = 0;
+    loop_time_offset = 0.0;
+    loop_tx_time = 0.0;
+
+    initialize(_M, _cp_len, _taper_len, _p, _callback, _userdata);
+}
+
+// loopback constructor
+//  _M              :   OFDM: number of subcarriers
+//  _cp_len         :   OFDM: cyclic prefix length
+//  _taper_len      :   OFDM: taper prefix length
+//  _p              :   OFDM: subcarrier allocation
+//  _callback       :   frame synchronizer callback function
+//  _userdata       :   user-defined data structure
+//  _tx_filename    :   transmit sample file (complex float)
+//  _rx_filename    :   receive sample file (complex float)
+ofdmtxrx::ofdmtxrx(unsigned int       _M,
+                   unsigned int       _cp_len,
+                   unsigned int       _taper_len,
+                   unsigned char *    _p,
+                   framesync_callback _callback,
+                   void *             _userdata,
+                   const char *       _tx_filename,
+                   const char *       _rx_filename)
+{
+    // open receive file first and without blocking so that two
+    // instances opening each other's named pipes cannot deadlock
+    loop_rx_fd = open(_rx_filename, O_RDONLY | O_CREAT | O_NONBLOCK, 0644);
+    if (loop_rx_fd < 0) {
+        fprintf(stderr,"error: ofdmtxrx::ofdmtxrx(), could not open '%s' for reading\n", _rx_filename);
+        throw 0;
+    }
+    loop_rx_residual_len = 0;
+    loop_time_offset = 0.0;
+    loop_tx_time = 0.0;
+
+    // open transmit file (blocks until the peer has opened a pipe)
+    loop_tx_fd = open(_tx_filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (loop_tx_fd < 0) {
+        fprintf(stderr,"error: ofdmtxrx::ofdmtxrx(), could not open '%s' for writing\n", _tx_filename);
+        close(loop_rx_fd);
+        throw 0;
+    }
+
+    initialize(_M, _cp_len, _taper_len, _p, _callback, _userdata);
+}
+
+// common initialization for constructors
+void ofdmtxrx::initialize(unsigned int       _M,
+                          unsigned int       _cp_len,
+                          unsigned int       _taper_len,
+                          unsigned char *    _p,
+                          framesync_callback _callback,
+                          void *             _userdata)
 {
     // validate input
     if (_M < 8) {
@@ -86,24 +163,38 @@ ofdmtxrx::ofdmtxrx(unsigned int       _M,
     // allocate memory for frame generator output (single OFDM symbol)
     fgbuffer_len = M + cp_len;
     fgbuffer = (std::complex<float>*) malloc(fgbuffer_len * sizeof(std::complex<float>));
+    tx_gather     = NULL;
+    tx_gather_len = 0;
     
     // create frame synchronizer
-    fs = ofdmflexframesync_create(M, cp_len, taper_len, p, _callback, _userdata);
+    callback   = _callback;
+    userdata   = _userdata;
+    fs = ofdmflexframesync_create(M, cp_len, taper_len, p, ofdmtxrx_rx_callback, (void*)this);
+    rx_decoder = NULL;
+    rx_queue   = NULL;
+    rx_num_draining = 0;
+    rx_pool    = NULL;
     // TODO: create buffer
 
-    // create usrp objects
-    uhd::device_addr_t dev_addr;
-    usrp_tx = uhd::usrp::multi_usrp::make(dev_addr);
-    usrp_rx = uhd::usrp::multi_usrp::make(dev_addr);
+    // receive timestamps (rate is set along with the device rate)
+    rx_clock  = rxclock_create(500e3);
+    rx_offset = 0;
+    rx_block_len = 1;
+    rx_num_samples = 0;
+    rx_processing_time = 0.0;
+    rx_frame_overhead = rxclock_ofdmflexframe_overhead(M, cp_len, taper_len, p, &rx_M_data);
+
+    // device commands are serialized around timed (hop) commands
+    pthread_mutex_init(&cmd_mutex, NULL);
 
     // initialize default tx values
-    set_tx_freq(462.0e6f);
+    set_tx_freq(462.0e6);
     set_tx_rate(500e3);
     set_tx_gain_soft(-12.0f);
     set_tx_gain_uhd(40.0f);
 
     // initialize default rx values
-    set_rx_freq(462.0e6f);
+    set_rx_freq(462.0e6);
     set_rx_rate(500e3);
     set_rx_gain_uhd(20.0f);
 
@@ -113,9 +204,30 @@ ofdmtxrx::ofdmtxrx(unsigned int       _M,
 
     // create and start rx thread
     rx_running = false;                     // receiver is not running initially
+    rx_active  = false;                     // worker is idle initially
     rx_thread_running = true;               // receiver thread IS running initially
+    rx_turnaround = false;                  // start/stop device stream with receiver
+    rx_streaming  = false;                  // device stream is not running
     pthread_mutex_init(&rx_mutex, NULL);    // receiver mutex
     pthread_cond_init(&rx_cond,   NULL);    // receiver condition
+
+    // frequency hopping (disabled)
+    hop_table       = NULL;
+    hop_len         = 0;
+    hop_dwell       = 0.0;
+    hop_settle      = 0.0;
+    hop_epoch       = 0.0;
+    hop_running     = false;
+    hop_num_retunes = 0;
+    hop_num_blanked = 0;
+    pthread_mutex_init(&hop_mutex, NULL);
+    pthread_cond_init(&hop_cond,   NULL);
+
+    // turnaround measurement
+    tx_end_time  = 0.0;
+    rx_stop_time = 0.0;
+    reset_turnaround();
+
     pthread_create(&rx_process,   NULL, ofdmtxrx_rx_worker, (void*)this);
     
     // TODO: create and start tx thread
@@ -128,11 +240,15 @@ ofdmtxrx::~ofdmtxrx()
 
     // ensure reciever thread is not running
     if (rx_running) stop_rx();
+    turnaround_disable();
+    hop_stop();
 
-    // signal condition (tell rx worker to continue)
+    // signal condition (tell rx worker to exit)
     dprintf("destructor signaling condition...\n");
+    pthread_mutex_lock(&rx_mutex);
     rx_thread_running = false;
-    pthread_cond_signal(&rx_cond);
+    pthread_cond_broadcast(&rx_cond);
+    pthread_mutex_unlock(&rx_mutex);
 
     dprintf("destructor joining rx thread...\n");
     void * exit_status;
@@ -143,6 +259,9 @@ ofdmtxrx::~ofdmtxrx()
     pthread_mutex_destroy(&rx_mutex);
     dprintf("destructor destroying condition...\n");
     pthread_cond_destroy(&rx_cond);
+    pthread_mutex_destroy(&hop_mutex);
+    pthread_cond_destroy(&hop_cond);
+    pthread_mutex_destroy(&cmd_mutex);
     
     // TODO: output debugging file
     if (debug_enabled)
@@ -152,9 +271,28 @@ ofdmtxrx::~ofdmtxrx()
     // destroy framing objects
     ofdmflexframegen_destroy(fg);
     ofdmflexframesync_destroy(fs);
+    if (rx_decoder != NULL) {
+        chunkdecoder_print(rx_decoder);
+        chunkdecoder_destroy(rx_decoder);
+    }
+    if (rx_queue != NULL) {
+        rxqueue_print(rx_queue);
+        async_rx_disable();
+    }
+    if (rx_pool != NULL) {
+        bufpool_print(rx_pool);
+        bufpool_destroy(rx_pool);
+    }
+    rxclock_destroy(rx_clock);
 
     // free other allocated arrays
     free(fgbuffer);
+    free(tx_gather);
+    free(hop_table);
+
+    // close loopback files
+    if (loop_tx_fd >= 0) close(loop_tx_fd);
+    if (loop_rx_fd >= 0) close(loop_rx_fd);
     
     dprintf("destructor finished\n");
 }
@@ -165,15 +303,20 @@ ofdmtxrx::~ofdmtxrx()
 //
 
 // set transmitter frequency
-void ofdmtxrx::set_tx_freq(float _tx_freq)
+void ofdmtxrx::set_tx_freq(double _tx_freq)
 {
-    usrp_tx->set_tx_freq(_tx_freq);
+    pthread_mutex_lock(&cmd_mutex);
+    if (usrp_tx) usrp_tx->set_tx_freq(_tx_freq);
+    pthread_mutex_unlock(&cmd_mutex);
 }
 
 // set transmitter sample rate
 void ofdmtxrx::set_tx_rate(float _tx_rate)
 {
-    usrp_tx->set_tx_rate(_tx_rate);
+    pthread_mutex_lock(&cmd_mutex);
+    if (usrp_tx) usrp_tx->set_tx_rate(_tx_rate);
+    pthread_mutex_unlock(&cmd_mutex);
+    loop_tx_rate = _tx_rate;
 }
 
 // set transmitter software gain
@@ -185,13 +328,17 @@ void ofdmtxrx::set_tx_gain_soft(float _tx_gain_soft)
 // set transmitter hardware (UHD) gain
 void ofdmtxrx::set_tx_gain_uhd(float _tx_gain_uhd)
 {
-    usrp_tx->set_tx_gain(_tx_gain_uhd);
+    pthread_mutex_lock(&cmd_mutex);
+    if (usrp_tx) usrp_tx->set_tx_gain(_tx_gain_uhd);
+    pthread_mutex_unlock(&cmd_mutex);
 }
 
 // set transmitter antenna
 void ofdmtxrx::set_tx_antenna(char * _tx_antenna)
 {
-    usrp_rx->set_tx_antenna(_tx_antenna);
+    pthread_mutex_lock(&cmd_mutex);
+    if (usrp_tx) usrp_tx->set_tx_antenna(_tx_antenna);
+    pthread_mutex_unlock(&cmd_mutex);
 }
 
 // reset transmitter objects and buffers
@@ -208,65 +355,47 @@ void ofdmtxrx::transmit_packet(unsigned char * _header,
                                int             _fec0,
                                int             _fec1)
 {
-    // set up the metadta flags
-    metadata_tx.start_of_burst = false; // never SOB when continuous
-    metadata_tx.end_of_burst   = false; // 
-    metadata_tx.has_time_spec  = false; // set to false to send immediately
-    //TODO: flush buffers
-
-    // fector buffer to send data to device
-    std::vector<std::complex<float> > usrp_buffer(fgbuffer_len);
-
-    // set properties
-    fgprops.mod_scheme  = _mod;
-    fgprops.fec0        = _fec0;
-    fgprops.fec1        = _fec1;
-    ofdmflexframegen_setprops(fg, &fgprops);
-
-    // assemble frame
-    ofdmflexframegen_assemble(fg, _header, _payload, _payload_len);
-
-    // generate a single OFDM frame
-    bool last_symbol=false;
-    unsigned int i;
-    while (!last_symbol) {
-
-        // generate symbol
-        last_symbol = ofdmflexframegen_writesymbol(fg, fgbuffer);
-
-        // copy symbol and apply gain
-        for (i=0; i<fgbuffer_len; i++)
-            usrp_buffer[i] = fgbuffer[i] * tx_gain;
+    struct ofdmtxrx_packet_s packet = {_header, _payload, _payload_len, _mod, _fec0, _fec1};
+    transmit_frames(&packet, 1, false, 0, 0, 0, -1.0);
+}
 
-        // send samples to the device
-        usrp_tx->get_device()->send(
-            &usrp_buffer.front(), usrp_buffer.size(),
-            metadata_tx,
-            uhd::io_type_t::COMPLEX_FLOAT32,
-            uhd::device::SEND_MODE_FULL_BUFF
-        );
+// transmit packet with payload given as a list of segments
+void ofdmtxrx::transmit_packet(unsigned char *      _header,
+                               const struct iovec * _payload,
+                               unsigned int         _payload_cnt,
+                               int                  _mod,
+                               int                  _fec0,
+                               int                  _fec1)
+{
+    unsigned int payload_len;
+    unsigned char * payload = gather_iovec(_payload, _payload_cnt,
+                                           &tx_gather, &tx_gather_len, &payload_len);
+    transmit_packet(_header, payload, payload_len, _mod, _fec0, _fec1);
+}
 
-    } // while loop
-
-    // send a few extra samples to the device
-    // NOTE: this seems necessary to preserve last OFDM symbol in
-    //       frame from corruption
-    usrp_tx->get_device()->send(
-        &usrp_buffer.front(), usrp_buffer.size(),
-        metadata_tx,
-        uhd::io_type_t::COMPLEX_FLOAT32,
-        uhd::device::SEND_MODE_FULL_BUFF
-    );
-    
-    // send a mini EOB packet
-    metadata_tx.start_of_burst = false;
-    metadata_tx.end_of_burst   = true;
+// transmit several packets back to back in a single burst
+void ofdmtxrx::transmit_packets(const struct ofdmtxrx_packet_s * _packets,
+                                unsigned int                     _num_packets)
+{
+    transmit_frames(_packets, _num_packets, false, 0, 0, 0, -1.0);
+}
 
-    usrp_tx->get_device()->send("", 0, metadata_tx,
-        uhd::io_type_t::COMPLEX_FLOAT32,
-        uhd::device::SEND_MODE_FULL_BUFF
-    );
+// transmit several packets sharing the same properties
+void ofdmtxrx::transmit_packets(const struct ofdmtxrx_packet_s * _packets,
+                                unsigned int                     _num_packets,
+                                int                              _mod,
+                                int                              _fec0,
+                                int                              _fec1)
+{
+    transmit_frames(_packets, _num_packets, true, _mod, _fec0, _fec1, -1.0);
+}
 
+// transmit several packets in a single burst launched at a device time
+void ofdmtxrx::transmit_packets_at(const struct ofdmtxrx_packet_s * _packets,
+                                   unsigned int                     _num_packets,
+                                   double                           _time)
+{
+    transmit_frames(_packets, _num_packets, false, 0, 0, 0, _time < 0.0 ? 0.0 : _time);
 }
 
 // 
@@ -274,27 +403,38 @@ void ofdmtxrx::transmit_packet(unsigned char * _header,
 //
 
 // set receiver frequency
-void ofdmtxrx::set_rx_freq(float _rx_freq)
+void ofdmtxrx::set_rx_freq(double _rx_freq)
 {
-    usrp_rx->set_rx_freq(_rx_freq);
+    pthread_mutex_lock(&cmd_mutex);
+    if (usrp_rx) usrp_rx->set_rx_freq(_rx_freq);
+    pthread_mutex_unlock(&cmd_mutex);
 }
 
 // set receiver sample rate
 void ofdmtxrx::set_rx_rate(float _rx_rate)
 {
-    usrp_rx->set_rx_rate(_rx_rate);
+    pthread_mutex_lock(&cmd_mutex);
+    if (usrp_rx) usrp_rx->set_rx_rate(_rx_rate);
+    pthread_mutex_unlock(&cmd_mutex);
+
+    // count samples at the actual device rate
+    rxclock_set_rate(rx_clock, usrp_rx ? usrp_rx->get_rx_rate() : _rx_rate);
 }
 
 // set receiver hardware (UHD) gain
 void ofdmtxrx::set_rx_gain_uhd(float _rx_gain_uhd)
 {
-    usrp_rx->set_rx_gain(_rx_gain_uhd);
+    pthread_mutex_lock(&cmd_mutex);
+    if (usrp_rx) usrp_rx->set_rx_gain(_rx_gain_uhd);
+    pthread_mutex_unlock(&cmd_mutex);
 }
 
 // set receiver antenna
 void ofdmtxrx::set_rx_antenna(char * _rx_antenna)
 {
-    usrp_rx->set_rx_antenna(_rx_antenna);
+    pthread_mutex_lock(&cmd_mutex);
+    if (usrp_rx) usrp_rx->set_rx_antenna(_rx_antenna);
+    pthread_mutex_unlock(&cmd_mutex);
 }
 
 // reset receiver objects and buffers
@@ -307,25 +447,44 @@ void ofdmtxrx::reset_rx()
 void ofdmtxrx::start_rx()
 {
     dprintf("usrp rx start\n");
+    pthread_mutex_lock(&rx_mutex);
+
     // set rx running flag
     rx_running = true;
 
-    // tell device to start
-    usrp_rx->issue_stream_cmd(uhd::stream_cmd_t::STREAM_MODE_START_CONTINUOUS);
+    // tell device to start (once, in turnaround mode)
+    if (!rx_streaming) {
+        issue_stream_cmd(uhd::stream_cmd_t::STREAM_MODE_START_CONTINUOUS);
+        rx_streaming = true;
+    }
 
-    // signal condition (tell rx worker to start)
-    pthread_cond_signal(&rx_cond);
+    // tell rx worker to start; the worker checks the state before
+    // waiting, so the request cannot be lost
+    pthread_cond_broadcast(&rx_cond);
+    pthread_mutex_unlock(&rx_mutex);
 }
 
 // stop receiver
 void ofdmtxrx::stop_rx()
 {
     dprintf("usrp rx stop\n");
+    pthread_mutex_lock(&rx_mutex);
+
     // set rx running flag
-    rx_running = false;
+    rx_running   = false;
+    rx_stop_time = get_time();
+
+    // tell device to stop (unless keeping stream alive)
+    if (!rx_turnaround && rx_streaming) {
+        issue_stream_cmd(uhd::stream_cmd_t::STREAM_MODE_STOP_CONTINUOUS);
+        rx_streaming = false;
+    }
 
-    // tell device to stop
-    usrp_rx->issue_stream_cmd(uhd::stream_cmd_t::STREAM_MODE_STOP_CONTINUOUS);
+    // wait for worker to acknowledge
+    pthread_cond_broadcast(&rx_cond);
+    while (rx_active)
+        pthread_cond_wait(&rx_cond, &rx_mutex);
+    pthread_mutex_unlock(&rx_mutex);
 }
 
 //
@@ -346,10 +505,779 @@ void ofdmtxrx::debug_disable()
     ofdmflexframesync_debug_disable(fs);
 }
 
+// start receiver for a window beginning at a device time
+void ofdmtxrx::start_rx_at(double _time,
+                           double _duration)
+{
+    if (rx_turnaround) {
+        fprintf(stderr,"warning: ofdmtxrx::start_rx_at(), fast turnaround must be disabled\n");
+        return;
+    } else if (_duration <= 0.0) {
+        fprintf(stderr,"error: ofdmtxrx::start_rx_at(), window duration must be greater than zero\n");
+        throw 0;
+    }
+
+    dprintf("usrp rx start (timed)\n");
+    pthread_mutex_lock(&rx_mutex);
+    rx_running = true;
+
+    // stream exactly the samples in the window; stop_rx() cancels any
+    // remainder
+    if (usrp_rx) {
+        uhd::stream_cmd_t cmd(uhd::stream_cmd_t::STREAM_MODE_NUM_SAMPS_AND_DONE);
+        cmd.num_samps  = (size_t) llround(_duration * usrp_rx->get_rx_rate());
+        cmd.stream_now = false;
+        cmd.time_spec  = uhd::time_spec_t(_time);
+        issue_stream_cmd(cmd);
+    }
+    rx_streaming = true;
+
+    pthread_cond_broadcast(&rx_cond);
+    pthread_mutex_unlock(&rx_mutex);
+}
+
+// set number of received samples handed to the synchronizer per call
+void ofdmtxrx::set_rx_block_len(unsigned int _block_len)
+{
+    if (_block_len == 0) {
+        fprintf(stderr,"error: ofdmtxrx::set_rx_block_len(), block length must be greater than zero\n");
+        throw 0;
+    }
+    rx_block_len = _block_len;
+}
+
+// get device time of the frame being delivered
+double ofdmtxrx::get_frame_time()
+{
+    // queued frames are delivered on the draining thread
+    if (rx_pool == NULL && rx_queue != NULL)
+        return rxqueue_get_frame_time(rx_queue);
+    return ofdmtxrx_frame_time;
+}
+
+//
+// device time
+//
+
+// set device time
+void ofdmtxrx::set_time_now(double _time)
+{
+    if (usrp_tx) {
+        pthread_mutex_lock(&cmd_mutex);
+        usrp_tx->set_time_now(uhd::time_spec_t(_time));
+        pthread_mutex_unlock(&cmd_mutex);
+    } else
+        loop_time_offset = _time - get_time();
+}
+
+// get device time
+double ofdmtxrx::get_time_now()
+{
+    if (usrp_tx)
+        return usrp_tx->get_time_now().get_real_secs();
+    return get_time() + loop_time_offset;
+}
+
+// sleep until device time reaches _time
+void ofdmtxrx::wait_until(double _time)
+{
+    double dt;
+    while ( (dt = _time - get_time_now()) > 0.0 ) {
+        // re-read device time at least every 100 ms
+        usleep( (useconds_t)(1e6*(dt < 0.1 ? dt : 0.1)) );
+    }
+}
+
+//
+// frequency hopping
+//
+
+// load hop set
+//  _freqs      :   hop frequencies [Hz] [size: _num_freqs x 1]
+//  _num_freqs  :   number of frequencies
+//  _dwell      :   dwell time per hop [s]
+//  _settle     :   settling time at start of each dwell [s]
+void ofdmtxrx::hop_load(const double * _freqs,
+                        unsigned int   _num_freqs,
+                        double         _dwell,
+                        double         _settle)
+{
+    if (hop_is_running()) {
+        fprintf(stderr,"warning: ofdmtxrx::hop_load(), hopping must be stopped\n");
+        return;
+    } else if (_num_freqs == 0) {
+        fprintf(stderr,"error: ofdmtxrx::hop_load(), hop set must have at least one frequency\n");
+        throw 0;
+    } else if (_dwell <= 0.0) {
+        fprintf(stderr,"error: ofdmtxrx::hop_load(), dwell time must be greater than zero\n");
+        throw 0;
+    } else if (_settle < 0.0 || _settle >= _dwell) {
+        fprintf(stderr,"error: ofdmtxrx::hop_load(), settling time must be in [0,dwell time)\n");
+        throw 0;
+    }
+
+    // validate entire hop set before touching the device
+    unsigned int i;
+    if (usrp_tx) {
+        uhd::freq_range_t tx_range = usrp_tx->get_tx_freq_range();
+        uhd::freq_range_t rx_range = usrp_tx->get_rx_freq_range();
+        for (i=0; i<_num_freqs; i++) {
+            if (_freqs[i] < tx_range.start() || _freqs[i] > tx_range.stop() ||
+                _freqs[i] < rx_range.start() || _freqs[i] > rx_range.stop())
+            {
+                fprintf(stderr,"error: ofdmtxrx::hop_load(), frequency %.3f MHz (entry %u) out of range\n",
+                        _freqs[i]*1e-6, i);
+                throw 0;
+            }
+        }
+    }
+
+    // tune to each frequency once and record the resulting settings
+    struct ofdmtxrx_hop_s * table = (struct ofdmtxrx_hop_s*) malloc(_num_freqs*sizeof(struct ofdmtxrx_hop_s));
+    pthread_mutex_lock(&cmd_mutex);
+    for (i=0; i<_num_freqs; i++) {
+        table[i].freq    = _freqs[i];
+        table[i].tx_tune = uhd::tune_request_t(_freqs[i]);
+        table[i].rx_tune = uhd::tune_request_t(_freqs[i]);
+        if (!usrp_tx)
+            continue;
+
+        uhd::tune_result_t tx_result = usrp_tx->set_tx_freq(table[i].tx_tune);
+        table[i].tx_tune.rf_freq_policy  = uhd::tune_request_t::POLICY_MANUAL;
+        table[i].tx_tune.rf_freq         = tx_result.actual_rf_freq;
+        table[i].tx_tune.dsp_freq_policy = uhd::tune_request_t::POLICY_MANUAL;
+        table[i].tx_tune.dsp_freq        = tx_result.actual_dsp_freq;
+
+        uhd::tune_result_t rx_result = usrp_tx->set_rx_freq(table[i].rx_tune);
+        table[i].rx_tune.rf_freq_policy  = uhd::tune_request_t::POLICY_MANUAL;
+        table[i].rx_tune.rf_freq         = rx_result.actual_rf_freq;
+        table[i].rx_tune.dsp_freq_policy = uhd::tune_request_t::POLICY_MANUAL;
+        table[i].rx_tune.dsp_freq        = rx_result.actual_dsp_freq;
+    }
+    pthread_mutex_unlock(&cmd_mutex);
+
+    free(hop_table);
+    hop_table  = table;
+    hop_len    = _num_freqs;
+    hop_dwell  = _dwell;
+    hop_settle = _settle;
+}
+
+// start hopping with hop 0 at device time _time
+void ofdmtxrx::hop_start(double _time)
+{
+    if (hop_table == NULL) {
+        fprintf(stderr,"warning: ofdmtxrx::hop_start(), no hop set loaded\n");
+        return;
+    }
+
+    pthread_mutex_lock(&hop_mutex);
+    if (hop_running) {
+        pthread_mutex_unlock(&hop_mutex);
+        fprintf(stderr,"warning: ofdmtxrx::hop_start(), already hopping\n");
+        return;
+    }
+    hop_epoch   = _time;
+    hop_running = true;
+    pthread_mutex_unlock(&hop_mutex);
+
+    pthread_create(&hop_process, NULL, ofdmtxrx_hop_worker, (void*)this);
+}
+
+// stop hopping
+void ofdmtxrx::hop_stop()
+{
+    pthread_mutex_lock(&hop_mutex);
+    bool running = hop_running;
+    hop_running = false;
+    pthread_cond_broadcast(&hop_cond);
+    pthread_mutex_unlock(&hop_mutex);
+
+    if (running) {
+        void * exit_status;
+        pthread_join(hop_process, &exit_status);
+    }
+}
+
+// is hopping?
+bool ofdmtxrx::hop_is_running()
+{
+    pthread_mutex_lock(&hop_mutex);
+    bool running = hop_running;
+    pthread_mutex_unlock(&hop_mutex);
+    return running;
+}
+
+// find the first hop whose usable part starts at or after _time
+unsigned long long int ofdmtxrx::hop_next(double   _time,
+                                          double * _start,
+                                          double * _end)
+{
+    double k = ceil((_time - hop_epoch - hop_settle) / hop_dwell);
+    if (k < 0.0) k = 0.0;
+    *_start = hop_epoch + k*hop_dwell + hop_settle;
+    *_end   = hop_epoch + (k+1.0)*hop_dwell;
+    return (unsigned long long int) k;
+}
+
+// get frequency of hop number _hop
+double ofdmtxrx::hop_get_freq(unsigned long long int _hop)
+{
+    return hop_table != NULL ? hop_table[_hop % hop_len].freq : 0.0;
+}
+
+// enable fast turnaround
+void ofdmtxrx::turnaround_enable()
+{
+    if (rx_running) {
+        fprintf(stderr,"warning: ofdmtxrx::turnaround_enable(), receiver must be stopped\n");
+        return;
+    }
+
+    pthread_mutex_lock(&rx_mutex);
+    rx_turnaround = true;
+    pthread_mutex_unlock(&rx_mutex);
+}
+
+// disable fast turnaround, stopping the device stream if kept alive
+void ofdmtxrx::turnaround_disable()
+{
+    if (rx_running) {
+        fprintf(stderr,"warning: ofdmtxrx::turnaround_disable(), receiver must be stopped\n");
+        return;
+    }
+
+    pthread_mutex_lock(&rx_mutex);
+    rx_turnaround = false;
+    if (rx_streaming) {
+        issue_stream_cmd(uhd::stream_cmd_t::STREAM_MODE_STOP_CONTINUOUS);
+        rx_streaming = false;
+    }
+    pthread_mutex_unlock(&rx_mutex);
+}
+
+// get turnaround latency statistics
+void ofdmtxrx::get_turnaround(struct ofdmtxrx_turnaround_s * _stats)
+{
+    pthread_mutex_lock(&rx_mutex);
+    *_stats = turnaround;
+    pthread_mutex_unlock(&rx_mutex);
+}
+
+// reset turnaround latency statistics
+void ofdmtxrx::reset_turnaround()
+{
+    pthread_mutex_lock(&rx_mutex);
+    memset(&turnaround, 0, sizeof(struct ofdmtxrx_turnaround_s));
+    pthread_mutex_unlock(&rx_mutex);
+}
+
+// segmented receiver: synchronizer hooks
+void * ofdmtxrx_segment_create(framesync_callback _callback,
+                               void **            _userdata,
+                               void *             _context)
+{
+    ofdmtxrx * txcvr = (ofdmtxrx*) _context;
+    return ofdmflexframesync_create(txcvr->M, txcvr->cp_len, txcvr->taper_len,
+                                    NULL, _callback, _userdata[0]);
+}
+
+static void ofdmtxrx_segment_reset(void * _fs)
+{
+    ofdmflexframesync_reset((ofdmflexframesync)_fs);
+}
+
+static void ofdmtxrx_segment_execute(void *                _fs,
+                                     std::complex<float> * _x,
+                                     unsigned int          _n)
+{
+    ofdmflexframesync_execute((ofdmflexframesync)_fs, _x, _n);
+}
+
+static void ofdmtxrx_segment_destroy(void * _fs)
+{
+    ofdmflexframesync_destroy((ofdmflexframesync)_fs);
+}
+
+// enable segmented receiver
+//  _num_threads    :   number of decoding threads (0: number of cores)
+//  _segment_len    :   segment length [samples]
+//  _overlap_len    :   overlap between segments (longest frame) [samples]
+void ofdmtxrx::segmented_rx_enable(unsigned int _num_threads,
+                                   unsigned int _segment_len,
+                                   unsigned int _overlap_len)
+{
+    if (rx_running) {
+        fprintf(stderr,"warning: ofdmtxrx::segmented_rx_enable(), receiver must be stopped\n");
+        return;
+    }
+
+    segmented_rx_disable();
+
+    // decoder counts samples from zero
+    rxclock_reset(rx_clock);
+
+    void * self = (void*)this;
+    rx_decoder = chunkdecoder_create(_num_threads, _segment_len, _overlap_len, 8, 1,
+                                     ofdmtxrx_segment_create,
+                                     ofdmtxrx_segment_reset,
+                                     ofdmtxrx_segment_execute,
+                                     ofdmtxrx_segment_destroy,
+                                     self, ofdmtxrx_rx_callback, &self);
+}
+
+// disable segmented receiver
+void ofdmtxrx::segmented_rx_disable()
+{
+    if (rx_running) {
+        fprintf(stderr,"warning: ofdmtxrx::segmented_rx_disable(), receiver must be stopped\n");
+        return;
+    }
+
+    if (rx_decoder != NULL) {
+        chunkdecoder_destroy(rx_decoder);
+        rx_decoder = NULL;
+    }
+}
+
+// enable asynchronous delivery
+//  _num_slots      :   queue capacity [frames]
+//  _max_payload_len:   longest payload retained [bytes]
+void ofdmtxrx::async_rx_enable(unsigned int _num_slots,
+                               unsigned int _max_payload_len)
+{
+    if (rx_running) {
+        fprintf(stderr,"warning: ofdmtxrx::async_rx_enable(), receiver must be stopped\n");
+        return;
+    }
+
+    async_rx_disable();
+    rx_queue = rxqueue_create(_num_slots, 8, _max_payload_len);
+}
+
+// disable asynchronous delivery, discarding queued frames
+void ofdmtxrx::async_rx_disable()
+{
+    if (rx_running) {
+        fprintf(stderr,"warning: ofdmtxrx::async_rx_disable(), receiver must be stopped\n");
+        return;
+    }
+
+    if (rx_queue == NULL)
+        return;
+
+    // detach queue so that new drain_rx() calls return at once, release
+    // consumers blocked in it, and wait for calls which loaded the
+    // queue before it was detached
+    rxqueue q = rx_queue;
+    __atomic_store_n(&rx_queue, (rxqueue)NULL, __ATOMIC_SEQ_CST);
+    rxqueue_close(q);
+    while (__atomic_load_n(&rx_num_draining, __ATOMIC_SEQ_CST) > 0)
+        usleep(1000);
+    rxqueue_destroy(q);
+}
+
+// deliver queued frames to the user callback
+unsigned int ofdmtxrx::drain_rx(unsigned int _max_frames,
+                                float        _timeout)
+{
+    // registered before loading the queue: async_rx_disable() waits
+    // for this call to leave before destroying it
+    __atomic_add_fetch(&rx_num_draining, 1, __ATOMIC_SEQ_CST);
+    rxqueue q = __atomic_load_n(&rx_queue, __ATOMIC_SEQ_CST);
+    unsigned int num_delivered = 0;
+    if (q == NULL)
+        fprintf(stderr,"warning: ofdmtxrx::drain_rx(), asynchronous delivery not enabled\n");
+    else
+        num_delivered = rxqueue_drain(q, callback, userdata, _max_frames, _timeout);
+    __atomic_sub_fetch(&rx_num_draining, 1, __ATOMIC_SEQ_CST);
+    return num_delivered;
+}
+
+// enable pooled delivery
+//  _num_buffers    :   number of buffers in pool
+//  _buffer_len     :   payload capacity of each buffer [bytes]
+//  _callback       :   buffer callback
+//  _userdata       :   user-defined data passed to callback
+void ofdmtxrx::pooled_rx_enable(unsigned int   _num_buffers,
+                                unsigned int   _buffer_len,
+                                rxbuf_callback _callback,
+                                void *         _userdata)
+{
+    if (rx_running) {
+        fprintf(stderr,"warning: ofdmtxrx::pooled_rx_enable(), receiver must be stopped\n");
+        return;
+    }
+
+    pooled_rx_disable();
+    rx_pool          = bufpool_create(_num_buffers, _buffer_len);
+    rx_pool_callback = _callback;
+    rx_pool_userdata = _userdata;
+}
+
+// disable pooled delivery; all handles must have been released
+void ofdmtxrx::pooled_rx_disable()
+{
+    if (rx_running) {
+        fprintf(stderr,"warning: ofdmtxrx::pooled_rx_disable(), receiver must be stopped\n");
+        return;
+    }
+
+    if (rx_pool != NULL) {
+        bufpool_destroy(rx_pool);
+        rx_pool = NULL;
+    }
+}
+
+// frame synchronizer callback
+int ofdmtxrx_rx_callback(unsigned char *  _header,
+                         int              _header_valid,
+                         unsigned char *  _payload,
+                         unsigned int     _payload_len,
+                         int              _payload_valid,
+                         framesyncstats_s _stats,
+                         void *           _userdata)
+{
+    ofdmtxrx * txcvr = (ofdmtxrx*) _userdata;
+
+    // the synchronizer reports a frame once its last sample has been
+    // pushed (within the current block); step back by the frame length
+    // to its first sample
+    unsigned long long int index = txcvr->rx_decoder != NULL ?
+        chunkdecoder_get_frame_index(txcvr->rx_decoder) :
+        rxclock_get_index(txcvr->rx_clock) + txcvr->rx_offset;
+    unsigned int frame_len = rxclock_ofdmflexframe_len(txcvr->M, txcvr->cp_len,
+                                                       txcvr->rx_M_data,
+                                                       txcvr->rx_frame_overhead,
+                                                       _stats, _payload_len);
+    double time = index >= frame_len ? rxclock_get_time(txcvr->rx_clock, index - frame_len) : -1.0;
+    ofdmtxrx_frame_time = time;
+
+    if (txcvr->rx_pool != NULL) {
+        // frame is dropped (and counted) if the pool is exhausted
+        rxbuf b = bufpool_acquire_frame(txcvr->rx_pool, _header, 8, _header_valid,
+                                        _payload, _payload_len, _payload_valid, _stats);
+        if (b == NULL)
+            return 0;
+        b->time = time;
+        if (txcvr->rx_pool_callback != NULL)
+            txcvr->rx_pool_callback(b, txcvr->rx_pool_userdata);
+        rxbuf_release(b);
+        return 0;
+    }
+
+    if (txcvr->rx_queue != NULL) {
+        rxqueue_push_time(txcvr->rx_queue, _header, _header_valid,
+                          _payload, _payload_len, _payload_valid, _stats, time);
+        return 0;
+    }
+
+    if (txcvr->callback == NULL)
+        return 0;
+    return txcvr->callback(_header, _header_valid, _payload, _payload_len,
+                           _payload_valid, _stats, txcvr->userdata);
+}
+
 //
 // private methods
 //
 
+// update frame generator properties if they differ from current ones
+// (setting them re-creates the payload encoder and modem)
+void ofdmtxrx::set_frame_props(int _mod,
+                               int _fec0,
+                               int _fec1)
+{
+    if (fgprops.mod_scheme == (unsigned int)_mod  &&
+        fgprops.fec0       == (unsigned int)_fec0 &&
+        fgprops.fec1       == (unsigned int)_fec1)
+    {
+        return;
+    }
+
+    fgprops.mod_scheme  = _mod;
+    fgprops.fec0        = _fec0;
+    fgprops.fec1        = _fec1;
+    ofdmflexframegen_setprops(fg, &fgprops);
+}
+
+// generate and send frames for a batch of packets
+void ofdmtxrx::transmit_frames(const struct ofdmtxrx_packet_s * _packets,
+                               unsigned int                     _num_packets,
+                               bool                             _shared_props,
+                               int                              _mod,
+                               int                              _fec0,
+                               int                              _fec1,
+                               double                           _time)
+{
+    if (_num_packets == 0)
+        return;
+
+    // set up the metadta flags; timed bursts carry the launch time on
+    // their first packet
+    metadata_tx.start_of_burst = _time >= 0.0;
+    metadata_tx.end_of_burst   = false; // 
+    metadata_tx.has_time_spec  = _time >= 0.0;
+    if (_time >= 0.0)
+        metadata_tx.time_spec  = uhd::time_spec_t(_time);
+    //TODO: flush buffers
+
+    // vector buffer to send data to device, holding several symbols
+    std::vector<std::complex<float> > usrp_buffer(OFDMTXRX_TX_SYMBOLS_PER_SEND*fgbuffer_len);
+    unsigned int n = 0; // number of samples in buffer
+    bool first_send = true;
+
+    unsigned int k;
+    unsigned int i;
+    for (k=0; k<_num_packets; k++) {
+        // set properties
+        if (_shared_props)
+            set_frame_props(_mod, _fec0, _fec1);
+        else
+            set_frame_props(_packets[k].mod, _packets[k].fec0, _packets[k].fec1);
+
+        // assemble frame
+        ofdmflexframegen_assemble(fg, _packets[k].header, _packets[k].payload, _packets[k].payload_len);
+
+        // generate a single OFDM frame, followed by an extra copy of the
+        // last symbol
+        // NOTE: the extra samples seem necessary to preserve last OFDM
+        //       symbol in frame from corruption
+        bool last_symbol=false;
+        bool extra_symbol=false;
+        while (!extra_symbol) {
+            // generate symbol
+            if (last_symbol)
+                extra_symbol = true;
+            else
+                last_symbol = ofdmflexframegen_writesymbol(fg, fgbuffer);
+
+            // copy symbol and apply gain
+            for (i=0; i<fgbuffer_len; i++)
+                usrp_buffer[n+i] = fgbuffer[i] * tx_gain;
+            n += fgbuffer_len;
+
+            // send samples to the device
+            if (n == usrp_buffer.size()) {
+                if (first_send) rx_to_tx();
+                first_send = false;
+                send_samples(&usrp_buffer.front(), n);
+                n = 0;
+            }
+        } // while loop
+    } // packet loop
+
+    // send remaining samples to the device
+    if (n > 0) {
+        if (first_send) rx_to_tx();
+        send_samples(&usrp_buffer.front(), n);
+    }
+    
+    // send a mini EOB packet
+    send_eob();
+
+    // start of tx-to-rx turnaround
+    pthread_mutex_lock(&rx_mutex);
+    tx_end_time = get_time();
+    pthread_mutex_unlock(&rx_mutex);
+}
+
+// record end of rx-to-tx turnaround, just before first samples are sent
+void ofdmtxrx::rx_to_tx()
+{
+    pthread_mutex_lock(&rx_mutex);
+    if (rx_stop_time > 0.0) {
+        update_turnaround(&turnaround.num_rx2tx, &turnaround.rx2tx_mean,
+                          &turnaround.rx2tx_max, (float)(get_time() - rx_stop_time));
+        rx_stop_time = 0.0;
+    }
+    pthread_mutex_unlock(&rx_mutex);
+}
+
+// send samples to device (or loopback file)
+void ofdmtxrx::send_samples(std::complex<float> * _x,
+                            unsigned int          _n)
+{
+    if (loop_tx_fd < 0) {
+        usrp_tx->get_device()->send(
+            _x, _n,
+            metadata_tx,
+            uhd::io_type_t::COMPLEX_FLOAT32,
+            uhd::device::SEND_MODE_FULL_BUFF
+        );
+
+        // only the first packet of a burst is timed
+        metadata_tx.start_of_burst = false;
+        metadata_tx.has_time_spec  = false;
+        return;
+    }
+
+    // loopback: hold timed burst until its launch time, preceded by the
+    // silence since the end of the previous timed burst
+    if (metadata_tx.has_time_spec) {
+        double t = metadata_tx.time_spec.get_real_secs();
+        wait_until(t);
+        if (loop_tx_time > 0.0 && t > loop_tx_time) {
+            std::complex<float> silence[256];
+            std::fill(silence, silence + 256, std::complex<float>(0.0f));
+            unsigned long long int num_zeros =
+                (unsigned long long int)((t - loop_tx_time)*loop_tx_rate + 0.5);
+            while (num_zeros > 0) {
+                unsigned int n = num_zeros < 256 ? num_zeros : 256;
+                loop_write(silence, n);
+                num_zeros -= n;
+            }
+        }
+        loop_tx_time = t;
+        metadata_tx.start_of_burst = false;
+        metadata_tx.has_time_spec  = false;
+    }
+
+    loop_write(_x, _n);
+    if (loop_tx_time > 0.0)
+        loop_tx_time += _n / loop_tx_rate;
+}
+
+// write samples to loopback file, blocking while a pipe is full
+void ofdmtxrx::loop_write(const std::complex<float> * _x,
+                          unsigned int                _n)
+{
+    const unsigned char * buf = (const unsigned char*) _x;
+    size_t num_bytes = _n * sizeof(std::complex<float>);
+    while (num_bytes > 0) {
+        ssize_t rc = write(loop_tx_fd, buf, num_bytes);
+        if (rc < 0) {
+            fprintf(stderr,"warning: ofdmtxrx::loop_write(), loopback write failed\n");
+            return;
+        }
+        buf       += rc;
+        num_bytes -= rc;
+    }
+}
+
+// signal end of burst to device (or pad loopback file)
+void ofdmtxrx::send_eob()
+{
+    if (loop_tx_fd < 0) {
+        metadata_tx.start_of_burst = false;
+        metadata_tx.end_of_burst   = true;
+
+        usrp_tx->get_device()->send("", 0, metadata_tx,
+            uhd::io_type_t::COMPLEX_FLOAT32,
+            uhd::device::SEND_MODE_FULL_BUFF
+        );
+        return;
+    }
+
+    // separate bursts in loopback file with a few silent symbols
+    unsigned int i;
+    for (i=0; i<fgbuffer_len; i++)
+        fgbuffer[i] = 0.0f;
+    for (i=0; i<4; i++)
+        send_samples(fgbuffer, fgbuffer_len);
+}
+
+// queue timed retune to hop-set entry
+void ofdmtxrx::hop_tune(unsigned int _index,
+                        double       _time)
+{
+    // no other command may be issued while the command time is set
+    if (usrp_tx) {
+        pthread_mutex_lock(&cmd_mutex);
+        usrp_tx->set_command_time(uhd::time_spec_t(_time));
+        usrp_tx->set_tx_freq(hop_table[_index].tx_tune);
+        usrp_tx->set_rx_freq(hop_table[_index].rx_tune);
+        usrp_tx->clear_command_time();
+        pthread_mutex_unlock(&cmd_mutex);
+    }
+    hop_num_retunes++;
+}
+
+// blank received samples within the settling time of each hop
+void ofdmtxrx::hop_blank(std::complex<float> * _x,
+                         unsigned int          _n,
+                         double                _time)
+{
+    double rate = rxclock_get_rate(rx_clock);
+    double t0   = _time - hop_epoch;    // time of first sample since hop 0
+
+    // walk block in runs which are either settling or usable; each run
+    // spans at least one sample
+    unsigned int i = 0;
+    while (i < _n) {
+        double t = t0 + i/rate;
+        unsigned int n;
+        if (t < 0.0) {
+            // before first hop
+            n = (unsigned int) ceil(-t*rate);
+        } else {
+            double offset = t - floor(t / hop_dwell)*hop_dwell;
+            if (offset < hop_settle) {
+                n = (unsigned int) ceil((hop_settle - offset)*rate);
+                if (n > _n - i) n = _n - i;
+                std::fill(&_x[i], &_x[i+n], std::complex<float>(0.0f));
+                hop_num_blanked += n;
+            } else {
+                n = (unsigned int) ceil((hop_dwell - offset)*rate);
+            }
+        }
+        i += n > 0 ? n : 1;
+    }
+}
+
+// issue stream command to device (serialized with timed commands)
+void ofdmtxrx::issue_stream_cmd(const uhd::stream_cmd_t & _cmd)
+{
+    if (usrp_rx) {
+        pthread_mutex_lock(&cmd_mutex);
+        usrp_rx->issue_stream_cmd(_cmd);
+        pthread_mutex_unlock(&cmd_mutex);
+    }
+}
+
+// receive samples from device (or loopback file)
+unsigned int ofdmtxrx::recv_samples(std::complex<float> * _x,
+                                    unsigned int          _n,
+                                    uhd::rx_metadata_t &  _md)
+{
+    if (loop_rx_fd < 0) {
+        return usrp_rx->get_device()->recv(
+            _x, _n, _md,
+            uhd::io_type_t::COMPLEX_FLOAT32,
+            uhd::device::RECV_MODE_ONE_PACKET
+        );
+    }
+
+    // loopback files carry no device errors or timestamps
+    _md.error_code    = uhd::rx_metadata_t::ERROR_CODE_NONE;
+    _md.has_time_spec = false;
+
+    // wait for data
+    struct pollfd pfd;
+    pfd.fd      = loop_rx_fd;
+    pfd.events  = POLLIN;
+    pfd.revents = 0;
+    if (poll(&pfd, 1, 100) <= 0)
+        return 0;
+
+    // read, prepending partial sample left over from last read
+    unsigned char * buf = (unsigned char*) _x;
+    memmove(buf, loop_rx_residual, loop_rx_residual_len);
+    ssize_t rc = read(loop_rx_fd, buf + loop_rx_residual_len,
+                      _n*sizeof(std::complex<float>) - loop_rx_residual_len);
+    if (rc <= 0) {
+        // end of file (or no writer): wait for more data
+        usleep(1000);
+        return 0;
+    }
+
+    size_t num_bytes = loop_rx_residual_len + rc;
+    unsigned int num_samples = num_bytes / sizeof(std::complex<float>);
+    loop_rx_residual_len = num_bytes % sizeof(std::complex<float>);
+    memmove(loop_rx_residual, buf + num_samples*sizeof(std::complex<float>), loop_rx_residual_len);
+    return num_samples;
+}
+
 // set timespec for timeout
 //  _ts         :   pointer to timespec structure
 //  _timeout    :   time before timeout
@@ -371,6 +1299,25 @@ void ofdmtxrx::set_timespec(struct timespec * _ts,
     }
 }
 
+// monotonic time [s]
+double ofdmtxrx::get_time()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + 1e-9*ts.tv_nsec;
+}
+
+// accumulate turnaround latency sample
+void ofdmtxrx::update_turnaround(unsigned int * _num,
+                                 float *        _mean,
+                                 float *        _max,
+                                 float          _latency)
+{
+    *_mean = (*_mean * (*_num) + _latency) / (*_num + 1);
+    if (_latency > *_max) *_max = _latency;
+    (*_num)++;
+}
+
 // receiver worker thread
 void * ofdmtxrx_rx_worker(void * _arg)
 {
@@ -378,84 +1325,180 @@ void * ofdmtxrx_rx_worker(void * _arg)
     ofdmtxrx * txcvr = (ofdmtxrx*) _arg;
 
     // set up receive buffer
-    const size_t max_samps_per_packet = txcvr->usrp_rx->get_device()->get_max_recv_samps_per_packet();
+    const size_t max_samps_per_packet = txcvr->usrp_rx ?
+        txcvr->usrp_rx->get_device()->get_max_recv_samps_per_packet() : 4096;
     std::vector<std::complex<float> > buffer(max_samps_per_packet);
 
     // receiver metadata object
     uhd::rx_metadata_t md;
 
+    // State machine, guarded by rx_mutex: the worker sleeps while the
+    // receiver is stopped and the device is not streaming, discards
+    // samples while stopped but streaming (turnaround mode), and
+    // processes them while running. Each change of rx_active is
+    // broadcast so that stop_rx() can wait for the worker to let go.
+    pthread_mutex_lock(&(txcvr->rx_mutex));
     while (txcvr->rx_thread_running) {
-        // wait for signal to start; lock mutex
-        pthread_mutex_lock(&(txcvr->rx_mutex));
-
-        // this function unlocks the mutex and waits for the condition;
-        // once the condition is set, the mutex is again locked
-        dprintf("rx_worker waiting for condition...\n");
-        //int status =
-        pthread_cond_wait(&(txcvr->rx_cond), &(txcvr->rx_mutex));
-        dprintf("rx_worker received condition\n");
+        bool process = txcvr->rx_running;
+
+        if (!process && txcvr->rx_active) {
+            // deliver frames of last segment, as the next run is
+            // discontinuous, then acknowledge stop; the flush waits for
+            // user callbacks, which may call into the transceiver (e.g.
+            // transmit_frames()), so it must not hold rx_mutex
+            dprintf("rx_worker finished running\n");
+            if (txcvr->rx_decoder != NULL) {
+                pthread_mutex_unlock(&(txcvr->rx_mutex));
+                chunkdecoder_reset(txcvr->rx_decoder);
+                pthread_mutex_lock(&(txcvr->rx_mutex));
+            }
+            txcvr->rx_active = false;
+            pthread_cond_broadcast(&(txcvr->rx_cond));
+
+            // state may have changed while unlocked
+            continue;
+        } else if (process && !txcvr->rx_active) {
+            // start; synchronizer state from before the gap is stale
+            dprintf("rx_worker running...\n");
+            if (txcvr->rx_turnaround && txcvr->rx_decoder == NULL)
+                ofdmflexframesync_reset(txcvr->fs);
+            txcvr->rx_active = true;
+            pthread_cond_broadcast(&(txcvr->rx_cond));
+        }
 
-        // unlock the mutex
-        dprintf("rx_worker unlocking mutex\n");
+        if (!process && !txcvr->rx_streaming) {
+            // nothing to read; wait for state change
+            dprintf("rx_worker waiting for condition...\n");
+            pthread_cond_wait(&(txcvr->rx_cond), &(txcvr->rx_mutex));
+            continue;
+        }
         pthread_mutex_unlock(&(txcvr->rx_mutex));
 
-        // condition given; check state: run or exit
-        dprintf("rx_worker running...\n");
-        if (!txcvr->rx_running) {
-            dprintf("rx_worker finished\n");
-            break;
-        }
+        // grab data from device
+        size_t num_rx_samps = txcvr->recv_samples(&buffer.front(), buffer.size(), md);
 
-        // run receiver
-        while (txcvr->rx_running) {
+        // ignore error codes for now
+#if 0
+        // 'handle' the error codes
+        switch(md.error_code){
+        case uhd::rx_metadata_t::ERROR_CODE_NONE:
+        case uhd::rx_metadata_t::ERROR_CODE_OVERFLOW:
+            break;
 
-            // grab data from device
-            //dprintf("rx_worker waiting for samples...\n");
-            size_t num_rx_samps = txcvr->usrp_rx->get_device()->recv(
-                &buffer.front(), buffer.size(), md,
-                uhd::io_type_t::COMPLEX_FLOAT32,
-                uhd::device::RECV_MODE_ONE_PACKET
-            );
-            //dprintf("rx_worker processing samples...\n");
+        default:
+            std::cerr << "Error code: " << md.error_code << std::endl;
+            std::cerr << "Unexpected error on recv, exit test..." << std::endl;
+        }
+#endif
 
-            // ignore error codes for now
-#if 0
-            // 'handle' the error codes
-            switch(md.error_code){
-            case uhd::rx_metadata_t::ERROR_CODE_NONE:
-            case uhd::rx_metadata_t::ERROR_CODE_OVERFLOW:
-                break;
-
-            default:
-                std::cerr << "Error code: " << md.error_code << std::endl;
-                std::cerr << "Unexpected error on recv, exit test..." << std::endl;
-                //return 1;
-                //std::cerr << "rx_worker exiting prematurely" << std::endl;
-                //pthread_exit(NULL);
+        if (process && num_rx_samps > 0) {
+            // end of tx-to-rx turnaround: first samples processed
+            pthread_mutex_lock(&(txcvr->rx_mutex));
+            if (txcvr->tx_end_time > 0.0) {
+                ofdmtxrx::update_turnaround(&txcvr->turnaround.num_tx2rx,
+                                            &txcvr->turnaround.tx2rx_mean,
+                                            &txcvr->turnaround.tx2rx_max,
+                                            (float)(ofdmtxrx::get_time() - txcvr->tx_end_time));
+                txcvr->tx_end_time = 0.0;
+            }
+            pthread_mutex_unlock(&(txcvr->rx_mutex));
+
+            // timestamp block (re-anchors only on discontinuities);
+            // loopback takes the host time at which the first block is
+            // read, as a burst is written out faster than real time
+            if (md.has_time_spec) {
+                rxclock_sync(txcvr->rx_clock, md.time_spec.get_real_secs());
+            } else if (!rxclock_is_synced(txcvr->rx_clock)) {
+                rxclock_sync(txcvr->rx_clock, txcvr->get_time_now());
             }
-#endif
 
-            // push data through frame synchronizer
-            // TODO : use arbitrary resampler?
-            unsigned int j;
-            for (j=0; j<num_rx_samps; j++) {
-                // grab sample from usrp buffer
-                std::complex<float> usrp_sample = buffer[j];
+            // drop samples received while the LO settles after a hop
+            if (txcvr->hop_is_running() && rxclock_is_synced(txcvr->rx_clock)) {
+                txcvr->hop_blank(&buffer.front(), num_rx_samps,
+                    rxclock_get_time(txcvr->rx_clock, rxclock_get_index(txcvr->rx_clock)));
+            }
 
-                // push resulting samples through synchronizer
-                ofdmflexframesync_execute(txcvr->fs, &usrp_sample, 1);
+            double t0 = ofdmtxrx::get_time();
+            if (txcvr->rx_decoder != NULL) {
+                // hand data to segmented receiver
+                chunkdecoder_execute(txcvr->rx_decoder, &buffer.front(), num_rx_samps);
+            } else {
+                // push data through frame synchronizer a block at a time;
+                // the callback locates the frame by the end of the block
+                // TODO : use arbitrary resampler?
+                unsigned int block_len = txcvr->rx_block_len;
+                unsigned int i;
+                for (i=0; i<num_rx_samps; i+=block_len) {
+                    unsigned int n = num_rx_samps - i < block_len ?
+                                     num_rx_samps - i : block_len;
+                    txcvr->rx_offset = i + n;
+                    ofdmflexframesync_execute(txcvr->fs, &buffer[i], n);
+                }
             }
+            rxclock_advance(txcvr->rx_clock, num_rx_samps);
+            txcvr->rx_processing_time += ofdmtxrx::get_time() - t0;
+            txcvr->rx_num_samples += num_rx_samps;
+        } else if (num_rx_samps > 0) {
+            // discarded while processing is gated off (fast turnaround);
+            // still count them, as loopback has no device timestamps to
+            // re-anchor the clock after the gap
+            rxclock_advance(txcvr->rx_clock, num_rx_samps);
+        }
 
-        } // while rx_running
-        dprintf("rx_worker finished running\n");
+        pthread_mutex_lock(&(txcvr->rx_mutex));
+    } // while rx_thread_running
 
-    } // while true
+    // release anyone waiting on a stop
+    txcvr->rx_active = false;
+    pthread_cond_broadcast(&(txcvr->rx_cond));
+    pthread_mutex_unlock(&(txcvr->rx_mutex));
     
     //
     dprintf("rx_worker exiting thread\n");
     pthread_exit(NULL);
 }
 
+// frequency hopping worker thread
+void * ofdmtxrx_hop_worker(void * _arg)
+{
+    ofdmtxrx * txcvr = (ofdmtxrx*) _arg;
+
+    // queue each retune shortly ahead of its hop
+    double lead = OFDMTXRX_HOP_MAX_PENDING * txcvr->hop_dwell;
+    if (lead > OFDMTXRX_HOP_LEAD)
+        lead = OFDMTXRX_HOP_LEAD;
+
+    // start with the first hop which can still be queued in time when
+    // the epoch lies in the past
+    unsigned long long int k = 0;
+    double k0 = ceil((txcvr->get_time_now() + lead - txcvr->hop_epoch) / txcvr->hop_dwell);
+    if (k0 > 0.0)
+        k = (unsigned long long int) k0;
+
+    pthread_mutex_lock(&(txcvr->hop_mutex));
+    while (txcvr->hop_running) {
+        double t_hop = txcvr->hop_epoch + k*txcvr->hop_dwell;
+        double dt = t_hop - lead - txcvr->get_time_now();
+        if (dt > 0.0) {
+            // wait (re-reading device time at least every 100 ms)
+            struct timespec ts;
+            txcvr->set_timespec(&ts, dt < 0.1 ? dt : 0.1);
+            pthread_cond_timedwait(&(txcvr->hop_cond), &(txcvr->hop_mutex), &ts);
+            continue;
+        }
+        pthread_mutex_unlock(&(txcvr->hop_mutex));
+
+        txcvr->hop_tune(k % txcvr->hop_len, t_hop);
+        k++;
+
+        pthread_mutex_lock(&(txcvr->hop_mutex));
+    }
+    pthread_mutex_unlock(&(txcvr->hop_mutex));
+
+    dprintf("hop_worker exiting thread\n");
+    pthread_exit(NULL);
+}
+
 #if 0
 // callback function
 int ofdmtxrx_callback(unsigned char *  _header,
@@ -0,0 +1,414 @@
+/*
+ * Copyright (c) 2013 Joseph Gaeddert
+ *
+ * This file is part of liquid.
+ *
+ * liquid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * liquid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with liquid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+//
+// packetlog.cc
+//
+// compact, indexed binary log of decoded frames
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <liquid/liquid.h>
+
+#include "asyncwriter.h"
+#include "packetlog.h"
+
+// size of each asyncwriter buffer [bytes]
+#define PACKETLOG_BUFFER_LEN    (4*1024*1024)
+
+// get current time [s since epoch]
+static double packetlog_gettime()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (double)tv.tv_sec + 1e-6*(double)tv.tv_usec;
+}
+
+// compute padded record length
+static unsigned int packetlog_record_len(unsigned int _header_len,
+                                         unsigned int _payload_len)
+{
+    unsigned int n = sizeof(struct packetlog_recordheader_s) + _header_len + _payload_len;
+    return (n + 7) & ~7u;
+}
+
+// 
+// packetlog (writer)
+//
+
+// packetlog data structure
+struct packetlog_s {
+    asyncwriter writer;         // background file writer
+    unsigned int header_len;    // frame header length [bytes]
+    int save_payloads;          // save payloads?
+    double time_start;          // log creation time
+
+    // record index
+    uint64_t * index;           // record offsets
+    unsigned int num_records;   // number of records written
+    unsigned int index_len;     // allocated length of index
+
+    // scratch buffer for assembling records
+    unsigned char * record;     // record buffer
+    unsigned int record_len;    // allocated length of record buffer
+
+    unsigned int num_dropped;   // number of records dropped
+    pthread_mutex_t mutex;      // callbacks may arrive from several threads
+};
+
+// create packetlog object
+//  _filename       :   output filename
+//  _header_len     :   frame header length [bytes], e.g. 8 for ofdmflexframe
+//  _save_payloads  :   save payload bytes with each record?
+packetlog packetlog_create(const char * _filename,
+                           unsigned int _header_len,
+                           int          _save_payloads)
+{
+    asyncwriter writer = asyncwriter_create(_filename, PACKETLOG_BUFFER_LEN);
+    if (writer == NULL) {
+        fprintf(stderr,"error: packetlog_create(), could not create log '%s'\n", _filename);
+        return NULL;
+    }
+
+    packetlog q = (packetlog) malloc(sizeof(struct packetlog_s));
+    q->writer        = writer;
+    q->header_len    = _header_len;
+    q->save_payloads = _save_payloads;
+    q->time_start    = packetlog_gettime();
+
+    // allocate index
+    q->num_records = 0;
+    q->index_len   = 4096;
+    q->index       = (uint64_t*) malloc(q->index_len * sizeof(uint64_t));
+
+    // allocate record buffer (enough for moderately-sized payloads)
+    q->record_len  = packetlog_record_len(q->header_len, 2048);
+    q->record      = (unsigned char*) malloc(q->record_len);
+
+    q->num_dropped = 0;
+    pthread_mutex_init(&q->mutex, NULL);
+
+    // write file header
+    struct packetlog_fileheader_s fh;
+    memset(&fh, 0x00, sizeof(fh));
+    memmove(fh.magic, PACKETLOG_MAGIC, 8);
+    fh.version       = PACKETLOG_VERSION;
+    fh.header_len    = q->header_len;
+    fh.save_payloads = q->save_payloads ? 1 : 0;
+    fh.time_start    = q->time_start;
+    asyncwriter_write_wait(q->writer, &fh, sizeof(fh));
+
+    return q;
+}
+
+// destroy packetlog object, writing index to file
+void packetlog_destroy(packetlog _q)
+{
+    // write index and trailer
+    struct packetlog_trailer_s trailer;
+    memset(&trailer, 0x00, sizeof(trailer));
+    trailer.index_offset = asyncwriter_get_offset(_q->writer);
+    trailer.num_records  = _q->num_records;
+    memmove(trailer.magic, PACKETLOG_TRAILER_MAGIC, 8);
+    if (_q->num_records > 0)
+        asyncwriter_write_wait(_q->writer, _q->index, _q->num_records*sizeof(uint64_t));
+    asyncwriter_write_wait(_q->writer, &trailer, sizeof(trailer));
+
+    // flush and close file
+    asyncwriter_destroy(_q->writer);
+
+    pthread_mutex_destroy(&_q->mutex);
+
+    // free memory
+    free(_q->index);
+    free(_q->record);
+    free(_q);
+}
+
+// print packetlog statistics
+void packetlog_print(packetlog _q)
+{
+    printf("packetlog: %u records, %u dropped, %lld bytes\n",
+            _q->num_records,
+            _q->num_dropped,
+            asyncwriter_get_offset(_q->writer));
+}
+
+// log decoded frame
+void packetlog_write(packetlog        _q,
+                     unsigned int     _channel,
+                     unsigned char *  _header,
+                     int              _header_valid,
+                     unsigned char *  _payload,
+                     unsigned int     _payload_len,
+                     int              _payload_valid,
+                     framesyncstats_s _stats)
+{
+    // save payload only if requested and available
+    int save_payload = _q->save_payloads && _payload != NULL;
+    unsigned int num_payload = save_payload ? _payload_len : 0;
+    unsigned int record_len  = packetlog_record_len(_q->header_len, num_payload);
+
+    pthread_mutex_lock(&_q->mutex);
+
+    // ensure record buffer is large enough
+    if (record_len > _q->record_len) {
+        _q->record_len = record_len;
+        _q->record = (unsigned char*) realloc(_q->record, _q->record_len);
+    }
+
+    // assemble record header
+    struct packetlog_recordheader_s * rh = (struct packetlog_recordheader_s*) _q->record;
+    memset(rh, 0x00, sizeof(struct packetlog_recordheader_s));
+    rh->timestamp     = packetlog_gettime() - _q->time_start;
+    rh->record_len    = record_len;
+    rh->channel       = _channel;
+    rh->flags         = (_header_valid  ? PACKETLOG_HEADER_VALID  : 0) |
+                        (_payload_valid ? PACKETLOG_PAYLOAD_VALID : 0) |
+                        (save_payload   ? PACKETLOG_PAYLOAD_SAVED : 0);
+    rh->payload_len   = _payload_len;
+    rh->evm           = _stats.evm;
+    rh->rssi          = _stats.rssi;
+    rh->cfo           = _stats.cfo;
+    rh->num_framesyms = _stats.num_framesyms;
+    rh->mod_scheme    = _stats.mod_scheme;
+    rh->mod_bps       = _stats.mod_bps;
+    rh->check         = _stats.check;
+    rh->fec0          = _stats.fec0;
+    rh->fec1          = _stats.fec1;
+
+    // append header, payload, and padding
+    unsigned char * p = _q->record + sizeof(struct packetlog_recordheader_s);
+    if (_header != NULL) memmove(p, _header, _q->header_len);
+    else                 memset (p, 0x00,    _q->header_len);
+    p += _q->header_len;
+    if (save_payload) {
+        memmove(p, _payload, num_payload);
+        p += num_payload;
+    }
+    memset(p, 0x00, (_q->record + record_len) - p);
+
+    // hand record to background writer
+    long long int offset = asyncwriter_write(_q->writer, _q->record, record_len);
+    if (offset < 0) {
+        _q->num_dropped++;
+    } else {
+        // append to index
+        if (_q->num_records == _q->index_len) {
+            _q->index_len *= 2;
+            _q->index = (uint64_t*) realloc(_q->index, _q->index_len*sizeof(uint64_t));
+        }
+        _q->index[_q->num_records++] = (uint64_t)offset;
+    }
+
+    pthread_mutex_unlock(&_q->mutex);
+}
+
+// get number of records logged
+unsigned int packetlog_get_num_records(packetlog _q)
+{
+    return _q->num_records;
+}
+
+// get number of records dropped
+unsigned int packetlog_get_num_dropped(packetlog _q)
+{
+    return _q->num_dropped;
+}
+
+// 
+// packetlogreader (memory-mapped reader)
+//
+
+// packetlogreader data structure
+struct packetlogreader_s {
+    unsigned char * map;            // memory-mapped file
+    size_t map_len;                 // length of file
+    struct packetlog_fileheader_s * fh;
+
+    const uint64_t * index;         // record index
+    uint64_t * index_scan;          // index re-built by scanning file
+    unsigned int num_records;       // number of records
+};
+
+// open log file for reading; returns NULL on error
+packetlogreader packetlogreader_open(const char * _filename)
+{
+    int fd = open(_filename, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr,"error: packetlogreader_open(), could not open '%s' for reading\n", _filename);
+        return NULL;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(struct packetlog_fileheader_s)) {
+        fprintf(stderr,"error: packetlogreader_open(), '%s' is not a packet log\n", _filename);
+        close(fd);
+        return NULL;
+    }
+
+    size_t map_len = st.st_size;
+    void * map = mmap(NULL, map_len, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        fprintf(stderr,"error: packetlogreader_open(), could not map '%s'\n", _filename);
+        return NULL;
+    }
+
+    // validate file header
+    struct packetlog_fileheader_s * fh = (struct packetlog_fileheader_s*) map;
+    if (memcmp(fh->magic, PACKETLOG_MAGIC, 8) != 0 || fh->version != PACKETLOG_VERSION) {
+        fprintf(stderr,"error: packetlogreader_open(), '%s' is not a packet log (or unsupported version)\n", _filename);
+        munmap(map, map_len);
+        return NULL;
+    }
+
+    packetlogreader q = (packetlogreader) malloc(sizeof(struct packetlogreader_s));
+    q->map        = (unsigned char*) map;
+    q->map_len    = map_len;
+    q->fh         = fh;
+    q->index      = NULL;
+    q->index_scan = NULL;
+    q->num_records= 0;
+
+    // look for trailer and index
+    if (map_len >= sizeof(struct packetlog_fileheader_s) + sizeof(struct packetlog_trailer_s)) {
+        struct packetlog_trailer_s * trailer =
+            (struct packetlog_trailer_s*) (q->map + map_len - sizeof(struct packetlog_trailer_s));
+        if (memcmp(trailer->magic, PACKETLOG_TRAILER_MAGIC, 8) == 0 &&
+            trailer->index_offset + trailer->num_records*sizeof(uint64_t) + sizeof(struct packetlog_trailer_s) == map_len)
+        {
+            q->index       = (const uint64_t*) (q->map + trailer->index_offset);
+            q->num_records = trailer->num_records;
+            return q;
+        }
+    }
+
+    // no valid trailer (e.g. log was not closed); re-build index by scanning
+    fprintf(stderr,"warning: packetlogreader_open(), '%s' has no index; scanning records\n", _filename);
+    unsigned int index_len = 4096;
+    q->index_scan = (uint64_t*) malloc(index_len*sizeof(uint64_t));
+    size_t offset = sizeof(struct packetlog_fileheader_s);
+    while (offset + sizeof(struct packetlog_recordheader_s) <= map_len) {
+        struct packetlog_recordheader_s * rh = (struct packetlog_recordheader_s*) (q->map + offset);
+        if (rh->record_len < sizeof(struct packetlog_recordheader_s) + fh->header_len ||
+            offset + rh->record_len > map_len)
+        {
+            // truncated record
+            break;
+        }
+
+        if (q->num_records == index_len) {
+            index_len *= 2;
+            q->index_scan = (uint64_t*) realloc(q->index_scan, index_len*sizeof(uint64_t));
+        }
+        q->index_scan[q->num_records++] = offset;
+        offset += rh->record_len;
+    }
+    q->index = q->index_scan;
+
+    return q;
+}
+
+// close log file
+void packetlogreader_close(packetlogreader _q)
+{
+    munmap(_q->map, _q->map_len);
+    if (_q->index_scan != NULL)
+        free(_q->index_scan);
+    free(_q);
+}
+
+// get number of records
+unsigned int packetlogreader_get_num_records(packetlogreader _q)
+{
+    return _q->num_records;
+}
+
+// get frame header length [bytes]
+unsigned int packetlogreader_get_header_len(packetlogreader _q)
+{
+    return _q->fh->header_len;
+}
+
+// get log creation time [s since epoch]
+double packetlogreader_get_time_start(packetlogreader _q)
+{
+    return _q->fh->time_start;
+}
+
+// read record at index _i (constant time)
+int packetlogreader_read(packetlogreader              _q,
+                         unsigned int                 _i,
+                         struct packetlog_record_s *  _record)
+{
+    if (_i >= _q->num_records)
+        return -1;
+
+    unsigned char * r = _q->map + _q->index[_i];
+    struct packetlog_recordheader_s * rh = (struct packetlog_recordheader_s*) r;
+
+    _record->timestamp     = rh->timestamp;
+    _record->channel       = rh->channel;
+    _record->header        = r + sizeof(struct packetlog_recordheader_s);
+    _record->header_valid  = (rh->flags & PACKETLOG_HEADER_VALID)  ? 1 : 0;
+    _record->payload       = (rh->flags & PACKETLOG_PAYLOAD_SAVED) ?
+                             _record->header + _q->fh->header_len : NULL;
+    _record->payload_len   = rh->payload_len;
+    _record->payload_valid = (rh->flags & PACKETLOG_PAYLOAD_VALID) ? 1 : 0;
+
+    _record->stats.evm           = rh->evm;
+    _record->stats.rssi          = rh->rssi;
+    _record->stats.cfo           = rh->cfo;
+    _record->stats.framesyms     = NULL;
+    _record->stats.num_framesyms = rh->num_framesyms;
+    _record->stats.mod_scheme    = rh->mod_scheme;
+    _record->stats.mod_bps       = rh->mod_bps;
+    _record->stats.check         = rh->check;
+    _record->stats.fec0          = rh->fec0;
+    _record->stats.fec1          = rh->fec1;
+
+    return 0;
+}
+
+// find index of first record with timestamp >= _t (binary search)
+unsigned int packetlogreader_find(packetlogreader _q,
+                                  double          _t)
+{
+    unsigned int lo = 0;
+    unsigned int hi = _q->num_records;
+    while (lo < hi) {
+        unsigned int mid = lo + (hi - lo)/2;
+        struct packetlog_recordheader_s * rh =
+            (struct packetlog_recordheader_s*) (_q->map + _q->index[mid]);
+        if (rh->timestamp < _t) lo = mid + 1;
+        else                    hi = mid;
+    }
+    return lo;
+}
+
@@ -0,0 +1,575 @@
+/*
+ * Copyright (c) 2013 Joseph Gaeddert
+ *
+ * This file is part of liquid.
+ *
+ * liquid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * liquid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with liquid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+//
+// rateplan.cc
+//
+// sample-rate planner
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+#include <pthread.h>
+#include <liquid/liquid.h>
+
+#include "rateplan.h"
+
+// cost of moving one sample off (or onto) the device [multiplies]
+#define RATEPLAN_DEVICE_COST        (2.0f)
+
+// fraction of the device rate over which the device's own (FPGA)
+// filters are taken to be flat and alias-free
+#define RATEPLAN_DEVICE_PASSBAND    (0.4f)
+
+// filter-bank branches evaluated per fractional-stage output
+#define RATEPLAN_FRAC_BRANCHES      (2)
+
+// filter-bank phases of the fractional stage
+#define RATEPLAN_FRAC_NPFB          (64)
+
+// largest halfband semi-length tried (filter length 4*m+1)
+#define RATEPLAN_HALFBAND_MAX_M     (64)
+
+// frequency grid for verifying halfband stop bands
+#define RATEPLAN_GRID_LEN           (256)
+
+// cache key resolution: attenuation rounded up to 0.1 dB, transition
+// width rounded down to 1e-4, so that a cached design meets every
+// spec that maps onto its key
+#define RATEPLAN_KEY_AS             (10.0f)
+#define RATEPLAN_KEY_DF             (10000.0f)
+
+// relative tolerance for a device rate to count as exact
+#define RATEPLAN_RATE_TOL           (1e-9)
+
+struct rateplan_s {
+    rateplan_type type;             // decimation/interpolation
+    double rate;                    // baseband rate [Hz]
+    float  fp;                      // passband edge (relative to rate)
+    float  As;                      // stop-band attenuation [dB]
+
+    // chosen decomposition
+    double device_rate;             // device rate [Hz]
+    unsigned int num_halfband;      // number of halfband stages
+    unsigned int hb_m[RATEPLAN_MAX_HALFBAND]; // semi-lengths (device side first)
+    int frac_device_side;           // fractional stage next to device?
+    unsigned int frac_m;            // fractional stage semi-length (0: none)
+    float cost;                     // estimated multiplies per second
+};
+
+// halfband design cache
+struct rateplan_cache_s {
+    int          As_key;            // attenuation [0.1 dB]
+    int          df_key;            // transition width [1e-4]
+    unsigned int m;                 // shortest semi-length meeting spec
+};
+
+static pthread_mutex_t           rateplan_cache_mutex  = PTHREAD_MUTEX_INITIALIZER;
+static struct rateplan_cache_s * rateplan_cache        = NULL;
+static unsigned int              rateplan_cache_len    = 0;
+static int                       rateplan_cache_loaded = 0;
+
+// internal methods
+static unsigned int rateplan_halfband_m(float _df, float _As);
+static void  rateplan_halfband_design(unsigned int _m, float _As, float * _h);
+static float rateplan_halfband_attenuation(unsigned int _m, float _As, float _df);
+static void  rateplan_fractional_design(double _fin, double _fout, double _p, float _As,
+                                        unsigned int * _m, float * _fc);
+static double rateplan_supported_rate(const struct rateplan_range_s * _ranges,
+                                      unsigned int _num_ranges, double _rate);
+static double rateplan_max_rate(const struct rateplan_range_s * _ranges,
+                                unsigned int _num_ranges);
+static float rateplan_evaluate(rateplan _q, double _device_rate, unsigned int _k,
+                               int _device_side, unsigned int * _hb_m,
+                               unsigned int * _frac_m);
+static int  rateplan_cache_path(char * _path, unsigned int _n);
+static void rateplan_cache_load();
+static void rateplan_cache_add(int _As_key, int _df_key, unsigned int _m);
+
+// create plan
+rateplan rateplan_create(rateplan_type                   _type,
+                         double                          _rate,
+                         float                           _fp,
+                         float                           _As,
+                         double                          _device_min,
+                         const struct rateplan_range_s * _ranges,
+                         unsigned int                    _num_ranges)
+{
+    if (_rate <= 0.0) {
+        fprintf(stderr,"error: rateplan_create(), rate must be greater than zero\n");
+        exit(1);
+    } else if (_fp <= 0.0f || _fp >= 0.5f) {
+        fprintf(stderr,"error: rateplan_create(), passband edge must be in (0,0.5)\n");
+        exit(1);
+    } else if (_As <= 0.0f) {
+        fprintf(stderr,"error: rateplan_create(), stop-band attenuation must be greater than zero\n");
+        exit(1);
+    }
+
+    rateplan q = (rateplan) malloc(sizeof(struct rateplan_s));
+    q->type = _type;
+    q->rate = _rate;
+    q->fp   = _fp;
+    q->As   = _As;
+    q->cost = -1.0f;
+
+    // try the lowest supported rate at or above rate*2^k for each k
+    // (and wide enough for the passband to lie within the flat part of
+    // the device filters), with the fractional stage (if any) on
+    // either side. The passband ratio is taken in single precision,
+    // as the passband itself, so that _fp == RATEPLAN_DEVICE_PASSBAND
+    // gives exactly the baseband rate.
+    double device_min = (double)(_fp / RATEPLAN_DEVICE_PASSBAND) * _rate;
+    if (_device_min > device_min) {
+        // requested minimum, limited to the highest supported rate
+        double device_max = rateplan_max_rate(_ranges, _num_ranges);
+        device_min = _device_min < device_max ? _device_min : device_max;
+    }
+    unsigned int k;
+    for (k=0; k<=RATEPLAN_MAX_HALFBAND; k++) {
+        double t = ldexp(_rate, k);
+        double device_rate = rateplan_supported_rate(_ranges, _num_ranges,
+                                                     t >= device_min*(1.0 - RATEPLAN_RATE_TOL) ? t : device_min);
+        if (device_rate <= 0.0)
+            continue;
+
+        int device_side;
+        for (device_side=1; device_side>=0; device_side--) {
+            unsigned int hb_m[RATEPLAN_MAX_HALFBAND];
+            unsigned int frac_m;
+            float cost = rateplan_evaluate(q, device_rate, k, device_side, hb_m, &frac_m);
+            if (cost < 0.0f || (q->cost >= 0.0f && cost >= q->cost))
+                continue;
+
+            q->device_rate      = device_rate;
+            q->num_halfband     = k;
+            q->frac_device_side = device_side;
+            q->frac_m           = frac_m;
+            q->cost             = cost;
+            memmove(q->hb_m, hb_m, k*sizeof(unsigned int));
+        }
+    }
+
+    if (q->cost < 0.0f) {
+        fprintf(stderr,"error: rateplan_create(), no supported device rate for %.3f kHz\n", _rate*1e-3);
+        free(q);
+        return NULL;
+    }
+
+    // a supported baseband rate within the flat part of the device
+    // filters costs device samples only, and nothing else can beat it
+    assert(_fp > RATEPLAN_DEVICE_PASSBAND || _device_min > _rate ||
+           rateplan_supported_rate(_ranges, _num_ranges, _rate) != _rate ||
+           q->num_halfband == 0);
+    return q;
+}
+
+// convert device rate ranges and create plan
+static rateplan rateplan_create_uhd(rateplan_type               _type,
+                                    const uhd::meta_range_t &   _range,
+                                    double                      _rate,
+                                    float                       _fp,
+                                    float                       _As,
+                                    double                      _device_min)
+{
+    unsigned int num_ranges = _range.size();
+    struct rateplan_range_s ranges[num_ranges > 0 ? num_ranges : 1];
+    unsigned int i;
+    for (i=0; i<num_ranges; i++) {
+        ranges[i].start = _range[i].start();
+        ranges[i].stop  = _range[i].stop();
+        ranges[i].step  = _range[i].step();
+    }
+    return rateplan_create(_type, _rate, _fp, _As, _device_min, ranges, num_ranges);
+}
+
+rateplan rateplan_create_rx(uhd::usrp::multi_usrp::sptr _usrp,
+                            double                      _rate,
+                            float                       _fp,
+                            float                       _As,
+                            double                      _device_min)
+{
+    return rateplan_create_uhd(RATEPLAN_DECIM, _usrp->get_rx_rates(), _rate, _fp, _As, _device_min);
+}
+
+rateplan rateplan_create_tx(uhd::usrp::multi_usrp::sptr _usrp,
+                            double                      _rate,
+                            float                       _fp,
+                            float                       _As,
+                            double                      _device_min)
+{
+    return rateplan_create_uhd(RATEPLAN_INTERP, _usrp->get_tx_rates(), _rate, _fp, _As, _device_min);
+}
+
+// destroy plan
+void rateplan_destroy(rateplan _q)
+{
+    free(_q);
+}
+
+// print plan
+void rateplan_print(rateplan _q)
+{
+    printf("rateplan:\n");
+    printf("    baseband rate       : %12.6f kHz\n", _q->rate*1e-3);
+    printf("    device rate         : %12.6f kHz (%s)\n", _q->device_rate*1e-3,
+            _q->type == RATEPLAN_DECIM ? "decimation" : "interpolation");
+    printf("    passband, As        : +/-%.3f kHz, %.1f dB\n", _q->fp*_q->rate*1e-3, _q->As);
+    if (_q->frac_m > 0) {
+        double r;
+        unsigned int m;
+        float fc;
+        rateplan_get_fractional(_q, _q->device_rate, &r, &m, &fc);
+        printf("    fractional stage    : r=%.8f, m=%u (%s side)\n", r, m,
+                _q->frac_device_side ? "device" : "baseband");
+    }
+    unsigned int i;
+    for (i=0; i<_q->num_halfband; i++)
+        printf("    halfband stage %u    : %u taps\n", i, 4*_q->hb_m[i]+1);
+    printf("    estimated cost      : %.3f M multiplies/s\n", _q->cost*1e-6f);
+}
+
+rateplan_type rateplan_get_type(rateplan _q)        { return _q->type;        }
+double rateplan_get_rate(rateplan _q)               { return _q->rate;        }
+double rateplan_get_device_rate(rateplan _q)        { return _q->device_rate; }
+float  rateplan_get_As(rateplan _q)                 { return _q->As;          }
+float  rateplan_get_cost(rateplan _q)               { return _q->cost;        }
+unsigned int rateplan_get_num_halfband(rateplan _q) { return _q->num_halfband; }
+
+// get halfband stage filter length
+unsigned int rateplan_get_halfband_len(rateplan     _q,
+                                       unsigned int _i)
+{
+    if (_i >= _q->num_halfband) {
+        fprintf(stderr,"error: rateplan_get_halfband_len(), stage index out of range\n");
+        exit(1);
+    }
+    return 4*_q->hb_m[_i] + 1;
+}
+
+// get halfband stage filter taps
+void rateplan_get_halfband(rateplan     _q,
+                           unsigned int _i,
+                           float *      _h)
+{
+    unsigned int h_len = rateplan_get_halfband_len(_q, _i);
+    unsigned int m = _q->hb_m[_i];
+    rateplan_halfband_design(m, _q->As, _h);
+
+    // the designed center tap is one; a decimator halves the sum of the
+    // two polyphase branches, an interpolator keeps the gain of two
+    // lost to zero stuffing
+    float g = _q->type == RATEPLAN_DECIM ? 0.5f : 1.0f;
+    unsigned int i;
+    for (i=0; i<h_len; i++)
+        _h[i] *= g;
+}
+
+// get fractional stage for the actual device rate
+int rateplan_get_fractional(rateplan       _q,
+                            double         _device_rate,
+                            double *       _r,
+                            unsigned int * _m,
+                            float *        _fc)
+{
+    double t = ldexp(_q->rate, _q->num_halfband);
+    if (fabs(_device_rate - t) <= RATEPLAN_RATE_TOL * _device_rate) {
+        *_r  = 1.0;
+        *_m  = 0;
+        *_fc = 0.5f;
+        return _q->frac_device_side;
+    }
+
+    // stage rates at the device and baseband side of the stage
+    double f_device   = _q->frac_device_side ? _device_rate : ldexp(_device_rate, -(int)_q->num_halfband);
+    double f_baseband = _q->frac_device_side ? t : _q->rate;
+    double p = _q->fp * _q->rate;
+    if (_q->type == RATEPLAN_DECIM) {
+        *_r = f_baseband / f_device;
+        rateplan_fractional_design(f_device, f_baseband, p, _q->As, _m, _fc);
+    } else {
+        *_r = f_device / f_baseband;
+        rateplan_fractional_design(f_baseband, f_device, p, _q->As, _m, _fc);
+    }
+    return _q->frac_device_side;
+}
+
+//
+// internal methods
+//
+
+// estimate cost of a decomposition; returns -1 if infeasible
+//  _q              :   plan (rate, passband and attenuation)
+//  _device_rate    :   candidate device rate (at least rate*2^_k)
+//  _k              :   number of halfband stages
+//  _device_side    :   fractional stage next to the device?
+//  _hb_m           :   halfband semi-lengths [size: _k x 1]
+//  _frac_m         :   fractional stage semi-length (0: none)
+float rateplan_evaluate(rateplan       _q,
+                        double         _device_rate,
+                        unsigned int   _k,
+                        int            _device_side,
+                        unsigned int * _hb_m,
+                        unsigned int * _frac_m)
+{
+    double t = ldexp(_q->rate, _k);
+    int exact = fabs(_device_rate - t) <= RATEPLAN_RATE_TOL * _device_rate;
+
+    // an exact rate has no fractional stage: evaluate it once
+    if (exact && !_device_side)
+        return -1.0f;
+
+    double p = _q->fp * _q->rate;
+    double cost = RATEPLAN_DEVICE_COST * _device_rate;
+
+    // halfband stages, from the device side
+    double f = (_device_side || exact) ? t : _device_rate;
+    unsigned int i;
+    for (i=0; i<_k; i++) {
+        float df = 0.5f - (float)(2.0*p / f);
+        _hb_m[i] = rateplan_halfband_m(df, _q->As);
+        if (_hb_m[i] == 0)
+            return -1.0f;
+        cost += (2*_hb_m[i] + 1) * 0.5 * f;
+        f *= 0.5;
+    }
+
+    // fractional stage
+    *_frac_m = 0;
+    if (!exact) {
+        double f_device   = _device_side ? _device_rate : f;
+        double f_baseband = _device_side ? t : _q->rate;
+        double fin  = _q->type == RATEPLAN_DECIM ? f_device   : f_baseband;
+        double fout = _q->type == RATEPLAN_DECIM ? f_baseband : f_device;
+        float fc;
+        rateplan_fractional_design(fin, fout, p, _q->As, _frac_m, &fc);
+        cost += RATEPLAN_FRAC_BRANCHES * 2 * (*_frac_m) * fout;
+    }
+    return (float)cost;
+}
+
+// lowest supported device rate at or above _rate (0 if none)
+double rateplan_supported_rate(const struct rateplan_range_s * _ranges,
+                               unsigned int                    _num_ranges,
+                               double                          _rate)
+{
+    double best = 0.0;
+    unsigned int i;
+    for (i=0; i<_num_ranges; i++) {
+        const struct rateplan_range_s * r = &_ranges[i];
+        double t = _rate * (1.0 - RATEPLAN_RATE_TOL);
+        double v;
+        if (t <= r->start) {
+            v = r->start;
+        } else if (r->step > 0.0) {
+            v = r->start + ceil((t - r->start) / r->step) * r->step;
+        } else {
+            v = _rate;
+        }
+        if (v > r->stop * (1.0 + RATEPLAN_RATE_TOL))
+            continue;
+        if (best == 0.0 || v < best)
+            best = v;
+    }
+    return best;
+}
+
+// highest supported device rate (0 if none)
+double rateplan_max_rate(const struct rateplan_range_s * _ranges,
+                         unsigned int                    _num_ranges)
+{
+    double best = 0.0;
+    unsigned int i;
+    for (i=0; i<_num_ranges; i++) {
+        const struct rateplan_range_s * r = &_ranges[i];
+        double v = r->stop;
+        if (r->step > 0.0)
+            v = r->start + floor((r->stop - r->start) / r->step * (1.0 + RATEPLAN_RATE_TOL)) * r->step;
+        if (v > best)
+            best = v;
+    }
+    return best;
+}
+
+// shortest halfband semi-length whose stop band [0.5-(0.5-df)/2, 0.5]
+// (normalized to the stage input rate) is at least As dB down; zero if
+// none up to RATEPLAN_HALFBAND_MAX_M
+unsigned int rateplan_halfband_m(float _df,
+                                 float _As)
+{
+    int As_key = (int)ceilf(_As * RATEPLAN_KEY_AS);
+    int df_key = (int)floorf(_df * RATEPLAN_KEY_DF);
+    if (df_key <= 0)
+        return 0;
+
+    pthread_mutex_lock(&rateplan_cache_mutex);
+    if (!rateplan_cache_loaded)
+        rateplan_cache_load();
+    unsigned int i;
+    for (i=0; i<rateplan_cache_len; i++) {
+        if (rateplan_cache[i].As_key == As_key && rateplan_cache[i].df_key == df_key) {
+            unsigned int m = rateplan_cache[i].m;
+            pthread_mutex_unlock(&rateplan_cache_mutex);
+            return m;
+        }
+    }
+
+    // design for the key itself (the worst case of its bin), starting
+    // somewhat below the length estimate
+    float As = As_key / RATEPLAN_KEY_AS;
+    float df = df_key / RATEPLAN_KEY_DF;
+    unsigned int h_len = estimate_req_filter_len(df < 0.45f ? df : 0.45f, As);
+    unsigned int m = h_len / 4 > 2 ? h_len / 4 - 2 : 1;
+    while (m <= RATEPLAN_HALFBAND_MAX_M && rateplan_halfband_attenuation(m, As, df) < As)
+        m++;
+    if (m > RATEPLAN_HALFBAND_MAX_M)
+        m = 0;
+
+    rateplan_cache_add(As_key, df_key, m);
+    pthread_mutex_unlock(&rateplan_cache_mutex);
+    return m;
+}
+
+// design halfband filter of length 4*_m+1 with a center tap of one;
+// taps an even distance from the center are exactly zero
+void rateplan_halfband_design(unsigned int _m,
+                              float        _As,
+                              float *      _h)
+{
+    unsigned int h_len = 4*_m + 1;
+    liquid_firdes_kaiser(h_len, 0.25f, _As, 0.0f, _h);
+
+    float g = 1.0f / _h[2*_m];
+    unsigned int i;
+    for (i=0; i<h_len; i++)
+        _h[i] = ((i % 2) == 0 && i != 2*_m) ? 0.0f : _h[i] * g;
+}
+
+// measured stop-band attenuation [dB] of halfband design
+float rateplan_halfband_attenuation(unsigned int _m,
+                                    float        _As,
+                                    float        _df)
+{
+    unsigned int h_len = 4*_m + 1;
+    float h[h_len];
+    rateplan_halfband_design(_m, _As, h);
+
+    // zero-phase response: center tap plus symmetric odd taps
+    float H0 = 1.0f;
+    unsigned int j;
+    for (j=0; j<_m; j++)
+        H0 += 2.0f * h[2*_m + 2*j + 1];
+
+    float fs = 0.5f - 0.5f*(0.5f - _df);
+    float peak = 0.0f;
+    unsigned int i;
+    for (i=0; i<RATEPLAN_GRID_LEN; i++) {
+        float f = fs + (0.5f - fs) * i / (float)(RATEPLAN_GRID_LEN - 1);
+        float H = 1.0f;
+        for (j=0; j<_m; j++) {
+            unsigned int n = 2*j + 1;
+            H += 2.0f * h[2*_m + n] * cosf(2.0f*M_PI*f*n);
+        }
+        if (fabsf(H) > peak)
+            peak = fabsf(H);
+    }
+    return -20.0f*log10f(peak / H0 + 1e-12f);
+}
+
+// fractional stage between input rate _fin and output rate _fout that
+// keeps aliases/images out of the passband [-_p,_p]: transition from
+// _p to (lower rate)-_p, normalized to the input rate
+void rateplan_fractional_design(double         _fin,
+                                double         _fout,
+                                double         _p,
+                                float          _As,
+                                unsigned int * _m,
+                                float *        _fc)
+{
+    double f_low = _fout < _fin ? _fout : _fin;
+    float df = (float)((f_low - 2.0*_p) / _fin);
+    if (df > 0.45f) df = 0.45f;
+    if (df < 1e-3f) df = 1e-3f;
+
+    unsigned int h_len = estimate_req_filter_len(df, _As);
+    *_m  = (h_len + 1) / 2 > 2 ? (h_len + 1) / 2 : 2;
+    *_fc = (float)(0.5 * f_low / _fin);
+}
+
+// cache file path ($HOME/RATEPLAN_CACHE_FILENAME); zero if unavailable
+int rateplan_cache_path(char *       _path,
+                        unsigned int _n)
+{
+    const char * home = getenv("HOME");
+    if (home == NULL || home[0] == '\0')
+        return 0;
+    return snprintf(_path, _n, "%s/%s", home, RATEPLAN_CACHE_FILENAME) < (int)_n;
+}
+
+// load cached designs (cache mutex held)
+void rateplan_cache_load()
+{
+    rateplan_cache_loaded = 1;
+
+    char path[1024];
+    if (!rateplan_cache_path(path, sizeof(path)))
+        return;
+    FILE * fid = fopen(path, "r");
+    if (fid == NULL)
+        return;
+
+    // one design per line: halfband <As key> <df key> <m>
+    int As_key, df_key;
+    unsigned int m;
+    while (fscanf(fid, " halfband %d %d %u", &As_key, &df_key, &m) == 3) {
+        rateplan_cache = (struct rateplan_cache_s*) realloc(rateplan_cache,
+                            (rateplan_cache_len+1)*sizeof(struct rateplan_cache_s));
+        rateplan_cache[rateplan_cache_len].As_key = As_key;
+        rateplan_cache[rateplan_cache_len].df_key = df_key;
+        rateplan_cache[rateplan_cache_len].m      = m;
+        rateplan_cache_len++;
+    }
+    fclose(fid);
+}
+
+// add design to cache and append it to the cache file (cache mutex held)
+void rateplan_cache_add(int          _As_key,
+                        int          _df_key,
+                        unsigned int _m)
+{
+    rateplan_cache = (struct rateplan_cache_s*) realloc(rateplan_cache,
+                        (rateplan_cache_len+1)*sizeof(struct rateplan_cache_s));
+    rateplan_cache[rateplan_cache_len].As_key = _As_key;
+    rateplan_cache[rateplan_cache_len].df_key = _df_key;
+    rateplan_cache[rateplan_cache_len].m      = _m;
+    rateplan_cache_len++;
+
+    // the cache is only an accelerator: failing to write it is silent
+    char path[1024];
+    if (!rateplan_cache_path(path, sizeof(path)))
+        return;
+    FILE * fid = fopen(path, "a");
+    if (fid == NULL)
+        return;
+    fprintf(fid, "halfband %d %d %u\n", _As_key, _df_key, _m);
+    fclose(fid);
+}
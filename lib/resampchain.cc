@@ -0,0 +1,688 @@
+/*
+ * Copyright (c) 2013 Joseph Gaeddert
+ *
+ * This file is part of liquid.
+ *
+ * liquid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * liquid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with liquid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+//
+// resampchain.cc
+//
+// multi-stage resampler built from a rate plan
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <complex>
+#include <algorithm>
+#include <liquid/liquid.h>
+
+#include "resampchain.h"
+
+// halfband stage buffer length [samples per polyphase branch]; the
+// filter history is moved to the front of the buffer when it fills
+#define RESAMPCHAIN_BUFFER_LEN      (2048)
+
+// input samples buffered per decimation thread before a threaded pass
+#define RESAMPCHAIN_BLOCK_LEN       (16384)
+
+// halfband stage; with the center tap at index 2m of the 4m+1 taps h,
+// the odd taps g[j] = h[2j+1] act on one polyphase branch and the
+// center tap c on the other (all other taps are zero):
+//  decimator   :   y[n]    = sum_j g[j] e[n-j] + c o[n-m]
+//                  (e/o: even/odd input samples)
+//  interpolator:   y[2n]   = c x[n-m]
+//                  y[2n+1] = sum_j g[j] x[n-j]
+struct resampchain_hb_s {
+    unsigned int m;                 // semi-length
+    float * g;                      // odd taps [size: 2m x 1]
+    float   c;                      // center tap
+    std::complex<float> * e;        // even/input branch [size: 2m-1+RESAMPCHAIN_BUFFER_LEN]
+    std::complex<float> * o;        // odd branch (decimator) [size: m+RESAMPCHAIN_BUFFER_LEN]
+    unsigned int ne;                // samples in e (including history)
+    unsigned int no;                // samples in o (including history)
+    int phase;                      // decimator: odd sample expected next?
+};
+
+// decimation thread: runs the leading halfband stages over one segment
+// of a threaded pass, first warming up its own stage copies on the
+// lead-in samples ahead of the segment (outputs discarded)
+struct resampchain_worker_s {
+    resampchain q;                  // parent object
+    pthread_t thread;               // thread (unused by worker 0)
+    struct resampchain_hb_s * hb;   // stages [size: num_par x 1]
+    std::complex<float> * x;        // lead-in followed by segment
+    unsigned int lead_len;          // lead-in length (0: continue stages)
+    unsigned int nx;                // segment length
+    std::complex<float> * y;        // output [size: block_len/2+1]
+    unsigned int ny;                // number of outputs
+};
+
+struct resampchain_s {
+    rateplan_type type;             // decimation/interpolation
+    double rate;                    // overall rate (output/input)
+
+    // halfband stages in execution order
+    unsigned int num_halfband;
+    struct resampchain_hb_s * hb;
+
+    // fractional stage, run before halfband stage frac_pos (in
+    // execution order; num_halfband: after the last)
+    resamp_crcf frac;               // NULL if not needed
+    double frac_rate;               // output/input
+    unsigned int frac_m;
+    unsigned int frac_pos;
+
+    // intermediate buffers
+    std::complex<float> * buf[2];
+    unsigned int buf_len;
+
+    // threaded decimation of the num_par halfband stages ahead of the
+    // fractional stage: num_threads blocks of input are buffered and
+    // decimated as one segment per thread. Worker 0 runs on the
+    // caller's thread and continues the stage states; the others start
+    // block_len*j samples in and warm up on lead_len samples, enough to
+    // fill every stage history exactly. The last worker's states are
+    // handed back to the parent at the end of each pass.
+    unsigned int num_threads;       // 1: not threaded
+    unsigned int num_par;
+    unsigned int block_len;
+    unsigned int lead_len;
+    std::complex<float> * in;       // buffered input [size: num_threads*block_len]
+    unsigned int num_in;
+    std::complex<float> * par;      // concatenated outputs of a pass
+    struct resampchain_worker_s * workers;
+    pthread_mutex_t mutex;
+    pthread_cond_t  cond_ready;     // pass ready for workers
+    pthread_cond_t  cond_done;      // all workers done
+    unsigned int pass;              // pass counter
+    unsigned int num_busy;          // workers still running this pass
+    int running;
+};
+
+// internal methods
+static void resampchain_hb_init(struct resampchain_hb_s * _s, rateplan _plan, unsigned int _i);
+static void resampchain_hb_reset(struct resampchain_hb_s * _s);
+static unsigned int resampchain_hb_decim(struct resampchain_hb_s * _s,
+                                         std::complex<float> *     _x,
+                                         unsigned int              _nx,
+                                         std::complex<float> *     _y);
+static unsigned int resampchain_hb_interp(struct resampchain_hb_s * _s,
+                                          std::complex<float> *     _x,
+                                          unsigned int              _nx,
+                                          std::complex<float> *     _y);
+static void resampchain_hb_copy(struct resampchain_hb_s * _dst,
+                                struct resampchain_hb_s * _src);
+static unsigned int resampchain_max_output(resampchain  _q,
+                                           unsigned int _first,
+                                           unsigned int _nx);
+static void resampchain_run(resampchain           _q,
+                            unsigned int          _first,
+                            std::complex<float> * _x,
+                            unsigned int          _nx,
+                            std::complex<float> * _y,
+                            unsigned int *        _ny);
+static void resampchain_run_pass(resampchain _q);
+static void resampchain_run_segment(struct resampchain_worker_s * _w);
+static void * resampchain_worker(void * _arg);
+
+// create resampler from plan
+resampchain resampchain_create(rateplan _plan,
+                               double   _device_rate)
+{
+    if (_device_rate <= 0.0) {
+        fprintf(stderr,"error: resampchain_create(), device rate must be greater than zero\n");
+        exit(1);
+    }
+
+    resampchain q = (resampchain) malloc(sizeof(struct resampchain_s));
+    q->type = rateplan_get_type(_plan);
+    q->rate = q->type == RATEPLAN_DECIM ? rateplan_get_rate(_plan) / _device_rate :
+                                          _device_rate / rateplan_get_rate(_plan);
+
+    // halfband stages: the plan counts from the device side
+    q->num_halfband = rateplan_get_num_halfband(_plan);
+    q->hb = (struct resampchain_hb_s*) malloc(q->num_halfband*sizeof(struct resampchain_hb_s));
+    unsigned int i;
+    for (i=0; i<q->num_halfband; i++) {
+        unsigned int k = q->type == RATEPLAN_DECIM ? i : q->num_halfband - 1 - i;
+        resampchain_hb_init(&q->hb[i], _plan, k);
+    }
+
+    // fractional stage for the rate the device actually runs at
+    float fc;
+    int device_side = rateplan_get_fractional(_plan, _device_rate, &q->frac_rate, &q->frac_m, &fc);
+    q->frac = q->frac_m == 0 ? NULL :
+              resamp_crcf_create(q->frac_rate, q->frac_m, fc, rateplan_get_As(_plan), 64);
+    q->frac_pos = (device_side == (q->type == RATEPLAN_DECIM)) ? 0 : q->num_halfband;
+
+    q->buf[0]  = NULL;
+    q->buf[1]  = NULL;
+    q->buf_len = 0;
+
+    q->num_threads = 1;
+    q->num_par     = q->type == RATEPLAN_DECIM && (q->frac == NULL || q->frac_pos > 0) ?
+                     q->num_halfband : 0;
+    return q;
+}
+
+// run halfband decimation on several threads
+void resampchain_set_num_threads(resampchain  _q,
+                                 unsigned int _num_threads)
+{
+    if (_q->num_threads > 1) {
+        fprintf(stderr,"error: resampchain_set_num_threads(), threads already set\n");
+        exit(1);
+    }
+
+    // number of threads defaults to number of cores
+    if (_num_threads == 0) {
+        long int num_cores = sysconf(_SC_NPROCESSORS_ONLN);
+        _num_threads = num_cores < 1 ? 1 : (unsigned int)num_cores;
+    }
+    if (_num_threads < 2 || _q->num_par == 0)
+        return;
+
+    // lead-in: each stage needs its last 4m inputs exact, and those of
+    // the following stages twice over; segments stay aligned to the
+    // overall decimation so that every stage starts on an even sample
+    unsigned int P = 1 << _q->num_par;
+    unsigned int n = 0;
+    unsigned int i;
+    for (i=_q->num_par; i>0; i--)
+        n = 2*n + 4*_q->hb[i-1].m;
+    _q->lead_len  = ((n + P - 1) / P) * P;
+    _q->block_len = ((RESAMPCHAIN_BLOCK_LEN + P - 1) / P) * P;
+    if (_q->block_len < _q->lead_len)
+        _q->block_len = _q->lead_len;
+
+    _q->num_threads = _num_threads;
+    _q->in     = (std::complex<float>*) malloc(_q->num_threads*_q->block_len*sizeof(std::complex<float>));
+    _q->num_in = 0;
+    _q->par    = (std::complex<float>*) malloc(_q->num_threads*(_q->block_len/P)*sizeof(std::complex<float>));
+
+    // worker 0 continues the parent's stages; the others own copies
+    // sharing the taps
+    _q->workers = (struct resampchain_worker_s*) malloc(_q->num_threads*sizeof(struct resampchain_worker_s));
+    for (i=0; i<_q->num_threads; i++) {
+        struct resampchain_worker_s * w = &_q->workers[i];
+        w->q  = _q;
+        w->y  = (std::complex<float>*) malloc((_q->block_len/2 + 1)*sizeof(std::complex<float>));
+        w->ny = 0;
+        if (i == 0) {
+            w->hb = _q->hb;
+            continue;
+        }
+        w->hb = (struct resampchain_hb_s*) malloc(_q->num_par*sizeof(struct resampchain_hb_s));
+        unsigned int k;
+        for (k=0; k<_q->num_par; k++) {
+            unsigned int m = _q->hb[k].m;
+            w->hb[k]   = _q->hb[k];
+            w->hb[k].e = (std::complex<float>*) malloc((2*m - 1 + RESAMPCHAIN_BUFFER_LEN)*sizeof(std::complex<float>));
+            w->hb[k].o = (std::complex<float>*) malloc((m + RESAMPCHAIN_BUFFER_LEN)*sizeof(std::complex<float>));
+        }
+    }
+
+    pthread_mutex_init(&_q->mutex, NULL);
+    pthread_cond_init(&_q->cond_ready, NULL);
+    pthread_cond_init(&_q->cond_done,  NULL);
+    _q->pass     = 0;
+    _q->num_busy = 0;
+    _q->running  = 1;
+    for (i=1; i<_q->num_threads; i++)
+        pthread_create(&_q->workers[i].thread, NULL, resampchain_worker, (void*)&_q->workers[i]);
+}
+
+// destroy resampler
+void resampchain_destroy(resampchain _q)
+{
+    unsigned int i;
+    if (_q->num_threads > 1) {
+        // stop worker threads
+        pthread_mutex_lock(&_q->mutex);
+        _q->running = 0;
+        pthread_cond_broadcast(&_q->cond_ready);
+        pthread_mutex_unlock(&_q->mutex);
+        for (i=1; i<_q->num_threads; i++)
+            pthread_join(_q->workers[i].thread, NULL);
+        pthread_mutex_destroy(&_q->mutex);
+        pthread_cond_destroy(&_q->cond_ready);
+        pthread_cond_destroy(&_q->cond_done);
+
+        for (i=0; i<_q->num_threads; i++) {
+            struct resampchain_worker_s * w = &_q->workers[i];
+            free(w->y);
+            if (i == 0)
+                continue;
+            unsigned int k;
+            for (k=0; k<_q->num_par; k++) {
+                free(w->hb[k].e);
+                free(w->hb[k].o);
+            }
+            free(w->hb);
+        }
+        free(_q->workers);
+        free(_q->in);
+        free(_q->par);
+    }
+
+    for (i=0; i<_q->num_halfband; i++) {
+        free(_q->hb[i].g);
+        free(_q->hb[i].e);
+        free(_q->hb[i].o);
+    }
+    free(_q->hb);
+    if (_q->frac != NULL)
+        resamp_crcf_destroy(_q->frac);
+    free(_q->buf[0]);
+    free(_q->buf[1]);
+    free(_q);
+}
+
+// print resampler stages
+void resampchain_print(resampchain _q)
+{
+    printf("resampchain: %s, rate %.8f\n",
+            _q->type == RATEPLAN_DECIM ? "decimation" : "interpolation", _q->rate);
+    unsigned int i;
+    for (i=0; i<=_q->num_halfband; i++) {
+        if (_q->frac != NULL && i == _q->frac_pos)
+            printf("    fractional          : r=%.8f, m=%u\n", _q->frac_rate, _q->frac_m);
+        if (i < _q->num_halfband)
+            printf("    halfband            : %u taps (%u multiplies)\n",
+                    4*_q->hb[i].m+1, 2*_q->hb[i].m+1);
+    }
+    if (_q->num_threads > 1)
+        printf("    threads             : %u (first %u stages, %u-sample blocks, %u lead-in)\n",
+                _q->num_threads, _q->num_par, _q->block_len, _q->lead_len);
+}
+
+// clear filter states
+void resampchain_reset(resampchain _q)
+{
+    unsigned int i;
+    for (i=0; i<_q->num_halfband; i++)
+        resampchain_hb_reset(&_q->hb[i]);
+    if (_q->frac != NULL)
+        resamp_crcf_reset(_q->frac);
+    _q->num_in = 0;
+}
+
+// get overall resampling rate (output/input)
+double resampchain_get_rate(resampchain _q)
+{
+    return _q->rate;
+}
+
+// get group delay [output samples]; a decimating halfband output is
+// centered 2m-1 inputs back, an interpolating one m inputs back, and
+// the fractional stage is m inputs long each side
+float resampchain_get_delay(resampchain _q)
+{
+    float delay = 0.0f;
+    unsigned int i;
+    for (i=0; i<=_q->num_halfband; i++) {
+        if (_q->frac != NULL && i == _q->frac_pos)
+            delay = (delay + _q->frac_m) * _q->frac_rate;
+        if (i < _q->num_halfband) {
+            float m = (float)_q->hb[i].m;
+            delay = _q->type == RATEPLAN_DECIM ? 0.5f*delay + (m - 0.5f) :
+                                                 2.0f*delay + 2.0f*m;
+        }
+    }
+    return delay;
+}
+
+// is a block of _nx input samples a whole period of every stage?
+int resampchain_is_periodic(resampchain  _q,
+                            unsigned int _nx)
+{
+    double n = (double)_nx;
+    unsigned int i;
+    for (i=0; i<=_q->num_halfband; i++) {
+        if (_q->frac != NULL && i == _q->frac_pos) {
+            double n_frac = n * _q->frac_rate;
+            if (fabs(n_frac - round(n_frac)) > 1e-6)
+                return 0;
+            n = round(n_frac);
+        }
+        if (i < _q->num_halfband) {
+            // decimators must consume whole pairs
+            if (_q->type == RATEPLAN_DECIM && fmod(n, 2.0) != 0.0)
+                return 0;
+            n = _q->type == RATEPLAN_DECIM ? 0.5*n : 2.0*n;
+        }
+    }
+    return 1;
+}
+
+// get shortest whole period of at least _nx input samples
+unsigned int resampchain_get_period(resampchain  _q,
+                                    unsigned int _nx)
+{
+    unsigned int nx_min = (unsigned int) ceil(2.0 * resampchain_get_delay(_q) / resampchain_get_rate(_q));
+    unsigned int nx = _nx > nx_min ? _nx : nx_min;
+    unsigned int nx_max = 2*nx;
+    for ( ; nx<=nx_max; nx++) {
+        if (resampchain_is_periodic(_q, nx))
+            return nx;
+    }
+    return 0;
+}
+
+// get maximum number of output samples for _nx input samples; a
+// threaded pass may complete up to one buffer's worth of samples more
+unsigned int resampchain_get_max_output(resampchain  _q,
+                                        unsigned int _nx)
+{
+    if (_q->num_threads == 1)
+        return resampchain_max_output(_q, 0, _nx);
+
+    unsigned int pass_len = _q->num_threads * _q->block_len;
+    unsigned int num_passes = (_nx + pass_len - 1) / pass_len + 1;
+    return num_passes * resampchain_max_output(_q, 0, pass_len);
+}
+
+// resample block of samples
+void resampchain_execute(resampchain           _q,
+                         std::complex<float> * _x,
+                         unsigned int          _nx,
+                         std::complex<float> * _y,
+                         unsigned int *        _ny)
+{
+    if (_q->num_threads == 1) {
+        resampchain_run(_q, 0, _x, _nx, _y, _ny);
+        return;
+    }
+
+    // buffer input and decimate whenever every thread has a block
+    unsigned int pass_len = _q->num_threads * _q->block_len;
+    unsigned int ny = 0;
+    unsigned int i = 0;
+    while (i < _nx) {
+        unsigned int n = pass_len - _q->num_in;
+        if (n > _nx - i)
+            n = _nx - i;
+        memmove(&_q->in[_q->num_in], &_x[i], n*sizeof(std::complex<float>));
+        _q->num_in += n;
+        i += n;
+        if (_q->num_in < pass_len)
+            break;
+
+        resampchain_run_pass(_q);
+        _q->num_in = 0;
+
+        // remaining stages on the concatenated outputs
+        unsigned int nw;
+        resampchain_run(_q, _q->num_par, _q->par, pass_len >> _q->num_par, &_y[ny], &nw);
+        ny += nw;
+    }
+    *_ny = ny;
+}
+
+//
+// internal methods
+//
+
+// maximum number of outputs for _nx inputs to stage _first onwards
+unsigned int resampchain_max_output(resampchain  _q,
+                                    unsigned int _first,
+                                    unsigned int _nx)
+{
+    unsigned int n = _nx;
+    unsigned int i;
+    for (i=_first; i<=_q->num_halfband; i++) {
+        if (_q->frac != NULL && i == _q->frac_pos)
+            n = (unsigned int)ceil(n*_q->frac_rate) + (unsigned int)ceil(_q->frac_rate) + 1;
+        if (i < _q->num_halfband)
+            n = _q->type == RATEPLAN_DECIM ? n/2 + 1 : 2*n;
+    }
+    return n;
+}
+
+// run stages _first onwards (fractional stage included) on one thread
+void resampchain_run(resampchain           _q,
+                     unsigned int          _first,
+                     std::complex<float> * _x,
+                     unsigned int          _nx,
+                     std::complex<float> * _y,
+                     unsigned int *        _ny)
+{
+    // intermediate results never exceed the larger of input and output
+    unsigned int n_max = resampchain_max_output(_q, _first, _nx);
+    if (n_max < _nx) n_max = _nx;
+    n_max += 2*(unsigned int)ceil(_q->frac_rate) + 2;
+    if (n_max > _q->buf_len) {
+        _q->buf_len = n_max;
+        _q->buf[0] = (std::complex<float>*) realloc(_q->buf[0], n_max*sizeof(std::complex<float>));
+        _q->buf[1] = (std::complex<float>*) realloc(_q->buf[1], n_max*sizeof(std::complex<float>));
+    }
+
+    std::complex<float> * x = _x;
+    unsigned int n = _nx;
+    unsigned int b = 0;
+    unsigned int i;
+    for (i=_first; i<=_q->num_halfband; i++) {
+        if (_q->frac != NULL && i == _q->frac_pos) {
+            std::complex<float> * y = _q->buf[b];
+            unsigned int j, ny = 0;
+            for (j=0; j<n; j++) {
+                unsigned int nw;
+                resamp_crcf_execute(_q->frac, x[j], &y[ny], &nw);
+                ny += nw;
+            }
+            x = y;
+            n = ny;
+            b = 1 - b;
+        }
+        if (i < _q->num_halfband) {
+            std::complex<float> * y = _q->buf[b];
+            n = _q->type == RATEPLAN_DECIM ? resampchain_hb_decim (&_q->hb[i], x, n, y) :
+                                             resampchain_hb_interp(&_q->hb[i], x, n, y);
+            x = y;
+            b = 1 - b;
+        }
+    }
+
+    memmove(_y, x, n*sizeof(std::complex<float>));
+    *_ny = n;
+}
+
+// decimate buffered input by the leading stages on all threads
+void resampchain_run_pass(resampchain _q)
+{
+    unsigned int i;
+    for (i=0; i<_q->num_threads; i++) {
+        struct resampchain_worker_s * w = &_q->workers[i];
+        w->lead_len = i == 0 ? 0 : _q->lead_len;
+        w->x        = &_q->in[i*_q->block_len - w->lead_len];
+        w->nx       = _q->block_len;
+    }
+
+    // start workers, run first segment here and wait for the others
+    pthread_mutex_lock(&_q->mutex);
+    _q->pass++;
+    _q->num_busy = _q->num_threads - 1;
+    pthread_cond_broadcast(&_q->cond_ready);
+    pthread_mutex_unlock(&_q->mutex);
+
+    resampchain_run_segment(&_q->workers[0]);
+
+    pthread_mutex_lock(&_q->mutex);
+    while (_q->num_busy > 0)
+        pthread_cond_wait(&_q->cond_done, &_q->mutex);
+    pthread_mutex_unlock(&_q->mutex);
+
+    // concatenate outputs and hand the last segment's states on
+    unsigned int n = 0;
+    for (i=0; i<_q->num_threads; i++) {
+        memmove(&_q->par[n], _q->workers[i].y, _q->workers[i].ny*sizeof(std::complex<float>));
+        n += _q->workers[i].ny;
+    }
+    for (i=0; i<_q->num_par; i++)
+        resampchain_hb_copy(&_q->hb[i], &_q->workers[_q->num_threads-1].hb[i]);
+}
+
+// run leading stages over lead-in (if any) and segment
+void resampchain_run_segment(struct resampchain_worker_s * _w)
+{
+    resampchain q = _w->q;
+    unsigned int i;
+    if (_w->lead_len > 0) {
+        unsigned int n = _w->lead_len;
+        for (i=0; i<q->num_par; i++) {
+            resampchain_hb_reset(&_w->hb[i]);
+            n = resampchain_hb_decim(&_w->hb[i], i == 0 ? _w->x : _w->y, n, _w->y);
+        }
+    }
+
+    unsigned int n = _w->nx;
+    for (i=0; i<q->num_par; i++)
+        n = resampchain_hb_decim(&_w->hb[i], i == 0 ? &_w->x[_w->lead_len] : _w->y, n, _w->y);
+    _w->ny = n;
+}
+
+// decimation thread
+void * resampchain_worker(void * _arg)
+{
+    struct resampchain_worker_s * w = (struct resampchain_worker_s*) _arg;
+    resampchain q = w->q;
+    unsigned int pass = 0;
+
+    while (1) {
+        // wait for next pass
+        pthread_mutex_lock(&q->mutex);
+        while (q->running && q->pass == pass)
+            pthread_cond_wait(&q->cond_ready, &q->mutex);
+        if (!q->running) {
+            pthread_mutex_unlock(&q->mutex);
+            break;
+        }
+        pass = q->pass;
+        pthread_mutex_unlock(&q->mutex);
+
+        resampchain_run_segment(w);
+
+        pthread_mutex_lock(&q->mutex);
+        q->num_busy--;
+        if (q->num_busy == 0)
+            pthread_cond_signal(&q->cond_done);
+        pthread_mutex_unlock(&q->mutex);
+    }
+    return NULL;
+}
+
+// initialize halfband stage _i (counted from the device side)
+void resampchain_hb_init(struct resampchain_hb_s * _s,
+                         rateplan                  _plan,
+                         unsigned int              _i)
+{
+    unsigned int h_len = rateplan_get_halfband_len(_plan, _i);
+    float h[h_len];
+    rateplan_get_halfband(_plan, _i, h);
+
+    _s->m = (h_len - 1) / 4;
+    _s->g = (float*) malloc(2*_s->m*sizeof(float));
+    unsigned int j;
+    for (j=0; j<2*_s->m; j++)
+        _s->g[j] = h[2*j+1];
+    _s->c = h[2*_s->m];
+
+    _s->e = (std::complex<float>*) malloc((2*_s->m - 1 + RESAMPCHAIN_BUFFER_LEN)*sizeof(std::complex<float>));
+    _s->o = (std::complex<float>*) malloc((_s->m + RESAMPCHAIN_BUFFER_LEN)*sizeof(std::complex<float>));
+    resampchain_hb_reset(_s);
+}
+
+// clear halfband stage history
+void resampchain_hb_reset(struct resampchain_hb_s * _s)
+{
+    _s->ne = 2*_s->m - 1;
+    _s->no = _s->m;
+    _s->phase = 0;
+    std::fill(_s->e, _s->e + _s->ne, std::complex<float>(0.0f));
+    std::fill(_s->o, _s->o + _s->no, std::complex<float>(0.0f));
+}
+
+// halfband decimator; returns number of outputs (_y may equal _x)
+unsigned int resampchain_hb_decim(struct resampchain_hb_s * _s,
+                                  std::complex<float> *     _x,
+                                  unsigned int              _nx,
+                                  std::complex<float> *     _y)
+{
+    unsigned int m = _s->m;
+    unsigned int ny = 0;
+    unsigned int i;
+    for (i=0; i<_nx; i++) {
+        if (_s->phase == 0) {
+            _s->e[_s->ne++] = _x[i];
+            _s->phase = 1;
+            continue;
+        }
+        _s->o[_s->no++] = _x[i];
+        _s->phase = 0;
+
+        std::complex<float> v;
+        dotprod_crcf_run(_s->g, &_s->e[_s->ne - 2*m], 2*m, &v);
+        _y[ny++] = v + _s->c * _s->o[_s->no - 1 - m];
+
+        // both branches fill together; keep the history
+        if (_s->ne == 2*m - 1 + RESAMPCHAIN_BUFFER_LEN) {
+            memmove(_s->e, &_s->e[_s->ne - (2*m-1)], (2*m-1)*sizeof(std::complex<float>));
+            memmove(_s->o, &_s->o[_s->no - m], m*sizeof(std::complex<float>));
+            _s->ne = 2*m - 1;
+            _s->no = m;
+        }
+    }
+    return ny;
+}
+
+// copy halfband stage history and phase (same semi-length); a
+// decimator waiting for an odd sample keeps one more even sample
+void resampchain_hb_copy(struct resampchain_hb_s * _dst,
+                         struct resampchain_hb_s * _src)
+{
+    unsigned int m  = _src->m;
+    unsigned int ne = 2*m - 1 + (_src->phase ? 1 : 0);
+    memmove(_dst->e, &_src->e[_src->ne - ne], ne*sizeof(std::complex<float>));
+    memmove(_dst->o, &_src->o[_src->no - m],  m *sizeof(std::complex<float>));
+    _dst->ne    = ne;
+    _dst->no    = m;
+    _dst->phase = _src->phase;
+}
+
+// halfband interpolator; returns number of outputs (2*_nx)
+unsigned int resampchain_hb_interp(struct resampchain_hb_s * _s,
+                                   std::complex<float> *     _x,
+                                   unsigned int              _nx,
+                                   std::complex<float> *     _y)
+{
+    unsigned int m = _s->m;
+    unsigned int i;
+    for (i=0; i<_nx; i++) {
+        _s->e[_s->ne++] = _x[i];
+        _y[2*i] = _s->c * _s->e[_s->ne - 1 - m];
+        dotprod_crcf_run(_s->g, &_s->e[_s->ne - 2*m], 2*m, &_y[2*i+1]);
+
+        if (_s->ne == 2*m - 1 + RESAMPCHAIN_BUFFER_LEN) {
+            memmove(_s->e, &_s->e[_s->ne - (2*m-1)], (2*m-1)*sizeof(std::complex<float>));
+            _s->ne = 2*m - 1;
+        }
+    }
+    return 2*_nx;
+}
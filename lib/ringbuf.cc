@@ -0,0 +1,166 @@
+/*
+ * Copyright (c) 2013 Joseph Gaeddert
+ *
+ * This file is part of liquid.
+ *
+ * liquid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * liquid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with liquid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+//
+// ringbuf.cc
+//
+// single-writer, multi-reader sample ring buffer
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <complex>
+
+#include "ringbuf.h"
+
+struct ringbuf_s {
+    // the writer writes at most guard samples before publishing, so a
+    // block is intact while it lies within ring_safe = ring_len - guard
+    // samples of the write position
+    std::complex<float> * ring;         // [size: ring_len x 1]
+    unsigned long long int ring_len;    // ring length (power of 2)
+    unsigned long long int ring_mask;   // ring_len - 1
+    unsigned long long int guard;       // largest unpublished write
+    unsigned long long int ring_safe;   // ring_len - guard
+    unsigned long long int write_pos __attribute__((aligned(64)));
+
+    // reader wakeup
+    unsigned int num_waiting __attribute__((aligned(64)));
+    pthread_mutex_t mutex;
+    pthread_cond_t  cond;
+};
+
+// create ring buffer
+ringbuf ringbuf_create(unsigned long long int _min_len)
+{
+    ringbuf q = (ringbuf) malloc(sizeof(struct ringbuf_s));
+
+    q->ring_len = 4;
+    while (q->ring_len < _min_len)
+        q->ring_len <<= 1;
+    q->ring_mask = q->ring_len - 1;
+    q->guard     = q->ring_len / 4;
+    q->ring_safe = q->ring_len - q->guard;
+    q->ring      = (std::complex<float>*) calloc(q->ring_len, sizeof(std::complex<float>));
+    q->write_pos = 0;
+
+    q->num_waiting = 0;
+    pthread_mutex_init(&q->mutex, NULL);
+    pthread_cond_init(&q->cond,   NULL);
+    return q;
+}
+
+// destroy ring buffer
+void ringbuf_destroy(ringbuf _q)
+{
+    pthread_mutex_destroy(&_q->mutex);
+    pthread_cond_destroy(&_q->cond);
+    free(_q->ring);
+    free(_q);
+}
+
+unsigned long long int ringbuf_get_len(ringbuf _q)
+{
+    return _q->ring_len;
+}
+
+// write samples
+void ringbuf_write(ringbuf               _q,
+                   std::complex<float> * _x,
+                   unsigned int          _n)
+{
+    while (_n > 0) {
+        // write at most guard samples before publishing
+        unsigned int k = _n < _q->guard ? _n : (unsigned int)_q->guard;
+        unsigned long long int pos = _q->write_pos;
+        unsigned long long int index = pos & _q->ring_mask;
+        unsigned long long int k0 = _q->ring_len - index < k ? _q->ring_len - index : k;
+        memmove(&_q->ring[index], _x, k0*sizeof(std::complex<float>));
+        memmove(&_q->ring[0], &_x[k0], (k-k0)*sizeof(std::complex<float>));
+        __atomic_store_n(&_q->write_pos, pos + k, __ATOMIC_RELEASE);
+        _x += k;
+        _n -= k;
+    }
+
+    // wake waiting readers (the fence orders the publish above against
+    // reading num_waiting, pairing with ringbuf_wait())
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&_q->num_waiting, __ATOMIC_RELAXED) > 0) {
+        pthread_mutex_lock(&_q->mutex);
+        pthread_cond_broadcast(&_q->cond);
+        pthread_mutex_unlock(&_q->mutex);
+    }
+}
+
+unsigned long long int ringbuf_get_write_pos(ringbuf _q)
+{
+    return __atomic_load_n(&_q->write_pos, __ATOMIC_ACQUIRE);
+}
+
+// oldest position safe to read
+unsigned long long int ringbuf_get_oldest(ringbuf                _q,
+                                          unsigned long long int _w)
+{
+    return _w > _q->ring_safe ? _w - _q->ring_safe : 0;
+}
+
+// copy samples out of the ring
+int ringbuf_read(ringbuf                _q,
+                 unsigned long long int _pos,
+                 std::complex<float> *  _y,
+                 unsigned int           _n)
+{
+    unsigned long long int index = _pos & _q->ring_mask;
+    unsigned long long int n0 = _q->ring_len - index < _n ? _q->ring_len - index : _n;
+    memmove(_y,      &_q->ring[index], n0*sizeof(std::complex<float>));
+    memmove(&_y[n0], &_q->ring[0],     (_n-n0)*sizeof(std::complex<float>));
+
+    // overwritten while copying?
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&_q->write_pos, __ATOMIC_RELAXED) > _pos + _q->ring_safe;
+}
+
+void ringbuf_lock(ringbuf _q)
+{
+    pthread_mutex_lock(&_q->mutex);
+}
+
+void ringbuf_unlock(ringbuf _q)
+{
+    pthread_mutex_unlock(&_q->mutex);
+}
+
+// wait for samples beyond _w (lock held)
+void ringbuf_wait(ringbuf                _q,
+                  unsigned long long int _w)
+{
+    __atomic_add_fetch(&_q->num_waiting, 1, __ATOMIC_SEQ_CST);
+    // re-check so that a concurrent write cannot be missed
+    if (__atomic_load_n(&_q->write_pos, __ATOMIC_SEQ_CST) == _w)
+        pthread_cond_wait(&_q->cond, &_q->mutex);
+    __atomic_sub_fetch(&_q->num_waiting, 1, __ATOMIC_SEQ_CST);
+}
+
+// wake all waiting readers (lock held)
+void ringbuf_wake(ringbuf _q)
+{
+    pthread_cond_broadcast(&_q->cond);
+}
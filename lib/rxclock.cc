@@ -0,0 +1,266 @@
+/*
+ * Copyright (c) 2013 Joseph Gaeddert
+ *
+ * This file is part of liquid.
+ *
+ * liquid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * liquid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with liquid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+//
+// rxclock.cc
+//
+// receive sample clock
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+
+#include "rxclock.h"
+
+// number of anchors retained for index-to-time conversion
+#define RXCLOCK_NUM_ANCHORS (8)
+
+// device time of a sample index
+struct rxclock_anchor_s {
+    unsigned long long int index;   // sample index
+    double time;                    // device time [s]
+};
+
+struct rxclock_s {
+    double rate;                    // sample rate [samples/s]
+    double delay;                   // processing delay [samples]
+    unsigned long long int index;   // next sample to be counted
+
+    // anchors, most recent at (num_anchors-1) % RXCLOCK_NUM_ANCHORS;
+    // written by the counting thread under the mutex
+    struct rxclock_anchor_s anchors[RXCLOCK_NUM_ANCHORS];
+    unsigned int num_anchors;       // anchors set since reset
+    pthread_mutex_t mutex;
+};
+
+// create receive clock
+rxclock rxclock_create(double _rate)
+{
+    if (_rate <= 0.0) {
+        fprintf(stderr,"error: rxclock_create(), sample rate must be greater than zero\n");
+        exit(1);
+    }
+
+    rxclock q = (rxclock) malloc(sizeof(struct rxclock_s));
+    q->rate  = _rate;
+    q->delay = 0.0;
+    pthread_mutex_init(&q->mutex, NULL);
+    rxclock_reset(q);
+    return q;
+}
+
+// destroy receive clock
+void rxclock_destroy(rxclock _q)
+{
+    pthread_mutex_destroy(&_q->mutex);
+    free(_q);
+}
+
+// print clock state
+void rxclock_print(rxclock _q)
+{
+    printf("rxclock:\n");
+    printf("    sample rate         : %12.3f samples/s\n", _q->rate);
+    printf("    delay               : %12.3f samples\n", _q->delay);
+    printf("    samples counted     : %12llu\n", _q->index);
+    printf("    gaps                : %12u\n", rxclock_get_num_gaps(_q));
+}
+
+// reset sample count and drop all anchors
+void rxclock_reset(rxclock _q)
+{
+    pthread_mutex_lock(&_q->mutex);
+    _q->index       = 0;
+    _q->num_anchors = 0;
+    memset(_q->anchors, 0, sizeof(_q->anchors));
+    pthread_mutex_unlock(&_q->mutex);
+}
+
+// set sample rate [samples/s]
+void rxclock_set_rate(rxclock _q,
+                      double  _rate)
+{
+    if (_rate <= 0.0) {
+        fprintf(stderr,"error: rxclock_set_rate(), sample rate must be greater than zero\n");
+        exit(1);
+    }
+
+    pthread_mutex_lock(&_q->mutex);
+    _q->rate        = _rate;
+    _q->num_anchors = 0;
+    pthread_mutex_unlock(&_q->mutex);
+}
+
+// set processing delay [samples]
+void rxclock_set_delay(rxclock _q,
+                       double  _delay)
+{
+    pthread_mutex_lock(&_q->mutex);
+    _q->delay = _delay;
+    pthread_mutex_unlock(&_q->mutex);
+}
+
+// synchronize to the device time of the next sample to be counted
+int rxclock_sync(rxclock _q,
+                 double  _time)
+{
+    // anchors are only written by this (the counting) thread, so the
+    // most recent one may be read without the lock
+    if (_q->num_anchors > 0) {
+        struct rxclock_anchor_s * a = &_q->anchors[(_q->num_anchors-1) % RXCLOCK_NUM_ANCHORS];
+        double t = a->time + (double)(_q->index - a->index) / _q->rate;
+        if (fabs(_time - t)*_q->rate < 0.5)
+            return 0;
+    }
+
+    pthread_mutex_lock(&_q->mutex);
+    struct rxclock_anchor_s * a = &_q->anchors[_q->num_anchors % RXCLOCK_NUM_ANCHORS];
+    a->index = _q->index;
+    a->time  = _time;
+    _q->num_anchors++;
+    pthread_mutex_unlock(&_q->mutex);
+    return 1;
+}
+
+// count block of samples
+void rxclock_advance(rxclock      _q,
+                     unsigned int _n)
+{
+    _q->index += _n;
+}
+
+// index of the next sample to be counted
+unsigned long long int rxclock_get_index(rxclock _q)
+{
+    return _q->index;
+}
+
+// device time of sample index minus processing delay
+double rxclock_get_time(rxclock                _q,
+                        unsigned long long int _index)
+{
+    pthread_mutex_lock(&_q->mutex);
+    if (_q->num_anchors == 0) {
+        pthread_mutex_unlock(&_q->mutex);
+        return -1.0;
+    }
+
+    // most recent anchor at or before the index (oldest retained if none)
+    unsigned int n = _q->num_anchors < RXCLOCK_NUM_ANCHORS ? _q->num_anchors : RXCLOCK_NUM_ANCHORS;
+    unsigned int i;
+    struct rxclock_anchor_s * a = NULL;
+    for (i=0; i<n; i++) {
+        a = &_q->anchors[(_q->num_anchors-1-i) % RXCLOCK_NUM_ANCHORS];
+        if (a->index <= _index)
+            break;
+    }
+
+    double t = a->time + ((double)_index - (double)a->index - _q->delay) / _q->rate;
+    pthread_mutex_unlock(&_q->mutex);
+    return t;
+}
+
+// has the clock been synchronized?
+int rxclock_is_synced(rxclock _q)
+{
+    return _q->num_anchors > 0;
+}
+
+// sample rate [samples/s]
+double rxclock_get_rate(rxclock _q)
+{
+    return _q->rate;
+}
+
+// re-anchors after the first
+unsigned int rxclock_get_num_gaps(rxclock _q)
+{
+    return _q->num_anchors > 0 ? _q->num_anchors - 1 : 0;
+}
+
+// number of OFDM symbols carrying an encoded payload
+static unsigned int rxclock_ofdmflexframe_payload_symbols(unsigned int _M_data,
+                                                          unsigned int _payload_len,
+                                                          unsigned int _check,
+                                                          unsigned int _fec0,
+                                                          unsigned int _fec1,
+                                                          unsigned int _bps)
+{
+    unsigned int enc_len = packetizer_compute_enc_msg_len(_payload_len, _check, _fec0, _fec1);
+    unsigned int num_mod = (8*enc_len + _bps - 1) / _bps;
+    return (num_mod + _M_data - 1) / _M_data;
+}
+
+// number of data subcarriers
+static unsigned int rxclock_ofdmflexframe_data_subcarriers(unsigned int    _M,
+                                                           unsigned char * _p)
+{
+    unsigned char * p = (unsigned char*) malloc(_M*sizeof(unsigned char));
+    if (_p == NULL) ofdmframe_init_default_sctype(_M, p);
+    else            memmove(p, _p, _M*sizeof(unsigned char));
+
+    unsigned int M_null, M_pilot, M_data;
+    ofdmframe_validate_sctype(p, _M, &M_null, &M_pilot, &M_data);
+    free(p);
+    return M_data;
+}
+
+// number of preamble and header symbols of an OFDM flexframe
+unsigned int rxclock_ofdmflexframe_overhead(unsigned int    _M,
+                                            unsigned int    _cp_len,
+                                            unsigned int    _taper_len,
+                                            unsigned char * _p,
+                                            unsigned int *  _M_data)
+{
+    ofdmflexframegenprops_s props;
+    ofdmflexframegenprops_init_default(&props);
+    ofdmflexframegen fg = ofdmflexframegen_create(_M, _cp_len, _taper_len, _p, &props);
+    ofdmflexframegen_getprops(fg, &props);
+
+    // assemble short frame and subtract its payload symbols
+    unsigned char header[8];
+    unsigned char payload[64];
+    memset(header,  0x00, sizeof(header));
+    memset(payload, 0x00, sizeof(payload));
+    ofdmflexframegen_assemble(fg, header, payload, sizeof(payload));
+    unsigned int num_symbols = ofdmflexframegen_getframelen(fg);
+    ofdmflexframegen_destroy(fg);
+
+    *_M_data = rxclock_ofdmflexframe_data_subcarriers(_M, _p);
+    unsigned int num_payload = rxclock_ofdmflexframe_payload_symbols(*_M_data, sizeof(payload),
+            props.check, props.fec0, props.fec1, modulation_types[props.mod_scheme].bps);
+    return num_symbols > num_payload ? num_symbols - num_payload : 0;
+}
+
+// length of received OFDM flexframe [samples]
+unsigned int rxclock_ofdmflexframe_len(unsigned int     _M,
+                                       unsigned int     _cp_len,
+                                       unsigned int     _M_data,
+                                       unsigned int     _overhead,
+                                       framesyncstats_s _stats,
+                                       unsigned int     _payload_len)
+{
+    unsigned int bps = _stats.mod_bps > 0 ? _stats.mod_bps : 1;
+    unsigned int num_payload = rxclock_ofdmflexframe_payload_symbols(_M_data, _payload_len,
+            _stats.check, _stats.fec0, _stats.fec1, bps);
+    return (_overhead + num_payload) * (_M + _cp_len);
+}
@@ -0,0 +1,378 @@
+/*
+ * Copyright (c) 2013 Joseph Gaeddert
+ *
+ * This file is part of liquid.
+ *
+ * liquid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * liquid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with liquid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+//
+// rxqueue.cc
+//
+// lock-free queue of received frames (bounded ring buffer with per-slot
+// sequence numbers; producers and consumers claim slots by advancing
+// their position with compare-and-swap)
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#include "rxqueue.h"
+
+struct rxqueue_slot_s {
+    unsigned long sequence;         // slot state (see rxqueue_push/drain)
+    unsigned char header[RXQUEUE_MAX_HEADER_LEN];
+    int header_valid;
+    unsigned char * payload;        // [size: max_payload_len x 1]
+    unsigned int payload_len;
+    int payload_valid;
+    framesyncstats_s stats;
+    double time;                    // device time of first sample [s]
+};
+
+struct rxqueue_s {
+    unsigned int num_slots;         // capacity (power of 2)
+    unsigned long mask;             // num_slots - 1
+    unsigned int header_len;
+    unsigned int max_payload_len;
+    struct rxqueue_slot_s * slots;
+
+    // producer and consumer positions, kept on separate cache lines
+    unsigned long enqueue_pos __attribute__((aligned(64)));
+    unsigned long dequeue_pos __attribute__((aligned(64)));
+
+    // counters
+    unsigned int num_pushed __attribute__((aligned(64)));
+    unsigned int num_dropped;
+    unsigned int max_queued;
+
+    // consumers inside rxqueue_drain() and closed flag (see rxqueue_close)
+    unsigned int num_consumers;
+    int closed;
+
+    // wake-up of blocked consumers (slow path only)
+    unsigned int num_waiting;
+    pthread_mutex_t mutex;
+    pthread_cond_t  cond;
+};
+
+// device time of the frame being delivered, per consumer thread
+static __thread double rxqueue_frame_time = -1.0;
+
+// create rxqueue object
+rxqueue rxqueue_create(unsigned int _num_slots,
+                       unsigned int _header_len,
+                       unsigned int _max_payload_len)
+{
+    if (_num_slots == 0) {
+        fprintf(stderr,"error: rxqueue_create(), number of slots must be greater than zero\n");
+        exit(1);
+    } else if (_header_len > RXQUEUE_MAX_HEADER_LEN) {
+        fprintf(stderr,"error: rxqueue_create(), header length cannot exceed %u\n", RXQUEUE_MAX_HEADER_LEN);
+        exit(1);
+    }
+
+    rxqueue q = (rxqueue) malloc(sizeof(struct rxqueue_s));
+    q->num_slots = 1;
+    while (q->num_slots < _num_slots)
+        q->num_slots <<= 1;
+    q->mask            = q->num_slots - 1;
+    q->header_len      = _header_len;
+    q->max_payload_len = _max_payload_len;
+
+    // allocate slots; sequence number equal to position marks a slot free
+    q->slots = (struct rxqueue_slot_s*) malloc(q->num_slots*sizeof(struct rxqueue_slot_s));
+    unsigned int i;
+    for (i=0; i<q->num_slots; i++) {
+        q->slots[i].sequence = i;
+        q->slots[i].payload  = (unsigned char*) malloc((q->max_payload_len > 0 ? q->max_payload_len : 1)*sizeof(unsigned char));
+    }
+
+    q->enqueue_pos = 0;
+    q->dequeue_pos = 0;
+    q->num_pushed  = 0;
+    q->num_dropped = 0;
+    q->max_queued  = 0;
+    q->num_consumers = 0;
+    q->closed      = 0;
+    q->num_waiting = 0;
+    pthread_mutex_init(&q->mutex, NULL);
+    pthread_cond_init(&q->cond,   NULL);
+    return q;
+}
+
+// destroy rxqueue object
+void rxqueue_destroy(rxqueue _q)
+{
+    unsigned int i;
+    for (i=0; i<_q->num_slots; i++)
+        free(_q->slots[i].payload);
+    free(_q->slots);
+
+    pthread_mutex_destroy(&_q->mutex);
+    pthread_cond_destroy(&_q->cond);
+    free(_q);
+}
+
+// print queue statistics
+void rxqueue_print(rxqueue _q)
+{
+    printf("rxqueue:\n");
+    printf("    slots               : %6u (max. %u occupied)\n", _q->num_slots, _q->max_queued);
+    printf("    frames queued       : %6u\n", _q->num_pushed);
+    printf("    frames dropped      : %6u\n", _q->num_dropped);
+}
+
+// push frame
+int rxqueue_push(rxqueue          _q,
+                 unsigned char *  _header,
+                 int              _header_valid,
+                 unsigned char *  _payload,
+                 unsigned int     _payload_len,
+                 int              _payload_valid,
+                 framesyncstats_s _stats)
+{
+    return rxqueue_push_time(_q, _header, _header_valid,
+                             _payload, _payload_len, _payload_valid, _stats, -1.0);
+}
+
+// push frame tagged with device time
+int rxqueue_push_time(rxqueue          _q,
+                      unsigned char *  _header,
+                      int              _header_valid,
+                      unsigned char *  _payload,
+                      unsigned int     _payload_len,
+                      int              _payload_valid,
+                      framesyncstats_s _stats,
+                      double           _time)
+{
+    if (_payload_len > _q->max_payload_len) {
+        __atomic_fetch_add(&_q->num_dropped, 1, __ATOMIC_RELAXED);
+        return -1;
+    }
+
+    // claim slot: free when its sequence equals our position
+    struct rxqueue_slot_s * slot;
+    unsigned long pos = __atomic_load_n(&_q->enqueue_pos, __ATOMIC_RELAXED);
+    for (;;) {
+        slot = &_q->slots[pos & _q->mask];
+        unsigned long seq = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+        long diff = (long)seq - (long)pos;
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&_q->enqueue_pos, &pos, pos+1, true,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                break;
+        } else if (diff < 0) {
+            // queue is full: drop rather than stall the synchronizer
+            __atomic_fetch_add(&_q->num_dropped, 1, __ATOMIC_RELAXED);
+            return -1;
+        } else {
+            pos = __atomic_load_n(&_q->enqueue_pos, __ATOMIC_RELAXED);
+        }
+    }
+
+    // copy frame into slot
+    if (_header != NULL)
+        memmove(slot->header, _header, _q->header_len);
+    slot->header_valid  = _header_valid;
+    if (_payload_len > 0)
+        memmove(slot->payload, _payload, _payload_len);
+    slot->payload_len   = _payload_len;
+    slot->payload_valid = _payload_valid;
+    slot->stats         = _stats;
+    slot->stats.framesyms     = NULL;
+    slot->stats.num_framesyms = 0;
+    slot->time          = _time;
+
+    // publish slot to consumers
+    __atomic_store_n(&slot->sequence, pos+1, __ATOMIC_RELEASE);
+    __atomic_fetch_add(&_q->num_pushed, 1, __ATOMIC_RELAXED);
+
+    // approximate high-water mark
+    unsigned int num_queued = pos + 1 - __atomic_load_n(&_q->dequeue_pos, __ATOMIC_RELAXED);
+    if (num_queued <= _q->num_slots && num_queued > __atomic_load_n(&_q->max_queued, __ATOMIC_RELAXED))
+        __atomic_store_n(&_q->max_queued, num_queued, __ATOMIC_RELAXED);
+
+    // wake blocked consumers (the fence orders the publish above against
+    // reading num_waiting, pairing with the re-check in rxqueue_wait)
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&_q->num_waiting, __ATOMIC_RELAXED) > 0) {
+        pthread_mutex_lock(&_q->mutex);
+        pthread_cond_broadcast(&_q->cond);
+        pthread_mutex_unlock(&_q->mutex);
+    }
+    return 0;
+}
+
+// framesync_callback adapter
+int rxqueue_callback(unsigned char *  _header,
+                     int              _header_valid,
+                     unsigned char *  _payload,
+                     unsigned int     _payload_len,
+                     int              _payload_valid,
+                     framesyncstats_s _stats,
+                     void *           _userdata)
+{
+    rxqueue_push((rxqueue)_userdata, _header, _header_valid,
+                 _payload, _payload_len, _payload_valid, _stats);
+    return 0;
+}
+
+// claim next published slot; returns NULL if the queue is empty
+static struct rxqueue_slot_s * rxqueue_claim(rxqueue         _q,
+                                             unsigned long * _pos)
+{
+    unsigned long pos = __atomic_load_n(&_q->dequeue_pos, __ATOMIC_RELAXED);
+    for (;;) {
+        struct rxqueue_slot_s * slot = &_q->slots[pos & _q->mask];
+        unsigned long seq = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+        long diff = (long)seq - (long)(pos+1);
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&_q->dequeue_pos, &pos, pos+1, true,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            {
+                *_pos = pos;
+                return slot;
+            }
+        } else if (diff < 0) {
+            return NULL;
+        } else {
+            pos = __atomic_load_n(&_q->dequeue_pos, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+// wait for a frame to be published (or wake-up/timeout)
+static void rxqueue_wait(rxqueue _q,
+                         float   _timeout)
+{
+    pthread_mutex_lock(&_q->mutex);
+    __atomic_add_fetch(&_q->num_waiting, 1, __ATOMIC_SEQ_CST);
+
+    // re-check under the mutex so that a concurrent push (or close)
+    // cannot be missed
+    unsigned long pos = __atomic_load_n(&_q->dequeue_pos, __ATOMIC_SEQ_CST);
+    unsigned long seq = __atomic_load_n(&_q->slots[pos & _q->mask].sequence, __ATOMIC_SEQ_CST);
+    if (seq != pos+1 && !__atomic_load_n(&_q->closed, __ATOMIC_SEQ_CST)) {
+        if (_timeout < 0) {
+            pthread_cond_wait(&_q->cond, &_q->mutex);
+        } else {
+            struct timeval tv;
+            gettimeofday(&tv, NULL);
+            struct timespec ts;
+            unsigned long long nsec = (unsigned long long)tv.tv_usec*1000ULL +
+                                      (unsigned long long)(_timeout*1e9f);
+            ts.tv_sec  = tv.tv_sec + nsec / 1000000000ULL;
+            ts.tv_nsec = nsec % 1000000000ULL;
+            pthread_cond_timedwait(&_q->cond, &_q->mutex, &ts);
+        }
+    }
+
+    __atomic_sub_fetch(&_q->num_waiting, 1, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&_q->mutex);
+}
+
+// drain up to _max_frames queued frames
+unsigned int rxqueue_drain(rxqueue            _q,
+                           framesync_callback _callback,
+                           void *             _userdata,
+                           unsigned int       _max_frames,
+                           float              _timeout)
+{
+    // register as consumer; rxqueue_close() waits for us to leave
+    __atomic_add_fetch(&_q->num_consumers, 1, __ATOMIC_SEQ_CST);
+
+    unsigned int num_delivered = 0;
+    while (num_delivered < _max_frames && !__atomic_load_n(&_q->closed, __ATOMIC_SEQ_CST)) {
+        unsigned long pos;
+        struct rxqueue_slot_s * slot = rxqueue_claim(_q, &pos);
+        if (slot == NULL) {
+            // wait only for the first frame of a batch
+            if (num_delivered > 0 || _timeout == 0.0f)
+                break;
+            rxqueue_wait(_q, _timeout);
+            slot = rxqueue_claim(_q, &pos);
+            if (slot == NULL)
+                break;
+        }
+
+        if (_callback != NULL) {
+            rxqueue_frame_time = slot->time;
+            _callback(slot->header,  slot->header_valid,
+                      slot->payload, slot->payload_len, slot->payload_valid,
+                      slot->stats, _userdata);
+        }
+
+        // release slot to producers for the next lap
+        __atomic_store_n(&slot->sequence, pos + _q->mask + 1, __ATOMIC_RELEASE);
+        num_delivered++;
+    }
+
+    // last access to the queue
+    __atomic_sub_fetch(&_q->num_consumers, 1, __ATOMIC_SEQ_CST);
+    return num_delivered;
+}
+
+// device time of the frame being delivered to the calling thread
+double rxqueue_get_frame_time(rxqueue _q)
+{
+    return rxqueue_frame_time;
+}
+
+// wake up consumers blocked in rxqueue_drain()
+void rxqueue_wakeup(rxqueue _q)
+{
+    pthread_mutex_lock(&_q->mutex);
+    pthread_cond_broadcast(&_q->cond);
+    pthread_mutex_unlock(&_q->mutex);
+}
+
+// close queue: wake blocked consumers and wait until every consumer has
+// left rxqueue_drain()
+void rxqueue_close(rxqueue _q)
+{
+    __atomic_store_n(&_q->closed, 1, __ATOMIC_SEQ_CST);
+    rxqueue_wakeup(_q);
+
+    // consumers touch nothing after leaving, so poll rather than signal
+    while (__atomic_load_n(&_q->num_consumers, __ATOMIC_SEQ_CST) > 0)
+        usleep(1000);
+}
+
+// frames currently queued
+unsigned int rxqueue_get_num_queued(rxqueue _q)
+{
+    unsigned long enqueue_pos = __atomic_load_n(&_q->enqueue_pos, __ATOMIC_ACQUIRE);
+    unsigned long dequeue_pos = __atomic_load_n(&_q->dequeue_pos, __ATOMIC_ACQUIRE);
+    return enqueue_pos > dequeue_pos ? enqueue_pos - dequeue_pos : 0;
+}
+
+// frames accepted
+unsigned int rxqueue_get_num_pushed(rxqueue _q)
+{
+    return __atomic_load_n(&_q->num_pushed, __ATOMIC_RELAXED);
+}
+
+// frames dropped
+unsigned int rxqueue_get_num_dropped(rxqueue _q)
+{
+    return __atomic_load_n(&_q->num_dropped, __ATOMIC_RELAXED);
+}
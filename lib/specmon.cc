@@ -0,0 +1,384 @@
+/*
+ * Copyright (c) 2013 Joseph Gaeddert
+ *
+ * This file is part of liquid.
+ *
+ * liquid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * liquid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with liquid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+//
+// specmon.cc
+//
+// multi-threaded spectrum monitor
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <complex>
+#include <liquid/liquid.h>
+
+#include "specmon.h"
+#include "ringbuf.h"
+
+// minimum ring buffer length [samples]
+#define SPECMON_MIN_RING_LEN    (1<<20)
+
+// number of segments transformed by a worker per claim
+#define SPECMON_BATCH           (16)
+
+// worker thread
+static void * specmon_worker(void * _arg);
+
+struct specmon_s {
+    unsigned int nfft;              // FFT size
+    unsigned int hop;               // samples between segment starts
+    unsigned int num_threads;       // number of worker threads
+    float * w;                      // window [size: nfft x 1]
+    float   w_energy;               // sum of squared window taps
+
+    ringbuf ring;                   // shared ring buffer
+
+    // work distribution (guarded by ring lock)
+    unsigned long long int next_segment __attribute__((aligned(64)));
+    int running;                    // are workers running?
+    pthread_t * threads;
+
+    // accumulators (guarded by acc_mutex)
+    float * acc_sum;                // sum of periodograms since readout
+    float * acc_max;                // maximum since readout
+    unsigned int acc_num;           // periodograms since readout
+    float * maxhold;                // maximum since reset
+    float * average;                // exponential average
+    int average_valid;              // has the average been initialized?
+    float alpha;                    // averaging factor
+    pthread_mutex_t acc_mutex;
+
+    // counters
+    unsigned long long int num_segments;
+    unsigned long long int num_dropped;
+};
+
+// create spectrum monitor
+specmon specmon_create(unsigned int _nfft,
+                       unsigned int _hop,
+                       unsigned int _num_threads)
+{
+    if (_nfft < 2) {
+        fprintf(stderr,"error: specmon_create(), FFT size must be at least 2\n");
+        exit(1);
+    } else if (_hop == 0 || _hop > _nfft) {
+        fprintf(stderr,"error: specmon_create(), hop size must be in [1,nfft]\n");
+        exit(1);
+    }
+
+    specmon q = (specmon) malloc(sizeof(struct specmon_s));
+    unsigned int i;
+
+    // number of threads defaults to number of cores
+    if (_num_threads == 0) {
+        long int num_cores = sysconf(_SC_NPROCESSORS_ONLN);
+        _num_threads = num_cores < 1 ? 1 : (unsigned int)num_cores;
+    }
+
+    q->nfft        = _nfft;
+    q->hop         = _hop;
+    q->num_threads = _num_threads;
+
+    // window, normalized so that white noise reads its power per sample
+    q->w = (float*) malloc(q->nfft*sizeof(float));
+    q->w_energy = 0.0f;
+    for (i=0; i<q->nfft; i++) {
+        q->w[i] = hamming(i, q->nfft);
+        q->w_energy += q->w[i]*q->w[i];
+    }
+
+    // ring buffer
+    q->ring = ringbuf_create(16ULL*q->nfft > SPECMON_MIN_RING_LEN ? 16ULL*q->nfft : SPECMON_MIN_RING_LEN);
+
+    // accumulators
+    q->acc_sum = (float*) malloc(q->nfft*sizeof(float));
+    q->acc_max = (float*) malloc(q->nfft*sizeof(float));
+    q->maxhold = (float*) malloc(q->nfft*sizeof(float));
+    q->average = (float*) malloc(q->nfft*sizeof(float));
+    q->alpha   = 0.1f;
+    pthread_mutex_init(&q->acc_mutex, NULL);
+    specmon_reset(q);
+
+    q->num_segments = 0;
+    q->num_dropped  = 0;
+
+    // start workers
+    q->next_segment = 0;
+    q->running      = 1;
+    q->threads = (pthread_t*) malloc(q->num_threads*sizeof(pthread_t));
+    for (i=0; i<q->num_threads; i++)
+        pthread_create(&q->threads[i], NULL, specmon_worker, (void*)q);
+
+    return q;
+}
+
+// destroy spectrum monitor
+void specmon_destroy(specmon _q)
+{
+    // stop workers
+    ringbuf_lock(_q->ring);
+    _q->running = 0;
+    ringbuf_wake(_q->ring);
+    ringbuf_unlock(_q->ring);
+
+    unsigned int i;
+    for (i=0; i<_q->num_threads; i++)
+        pthread_join(_q->threads[i], NULL);
+
+    pthread_mutex_destroy(&_q->acc_mutex);
+
+    free(_q->threads);
+    free(_q->w);
+    ringbuf_destroy(_q->ring);
+    free(_q->acc_sum);
+    free(_q->acc_max);
+    free(_q->maxhold);
+    free(_q->average);
+    free(_q);
+}
+
+// print spectrum monitor properties and counters
+void specmon_print(specmon _q)
+{
+    printf("specmon:\n");
+    printf("    FFT size            : %u\n", _q->nfft);
+    printf("    hop size            : %u\n", _q->hop);
+    printf("    threads             : %u\n", _q->num_threads);
+    printf("    ring buffer         : %llu samples\n", ringbuf_get_len(_q->ring));
+    printf("    samples             : %llu\n", specmon_get_num_samples(_q));
+    printf("    segments            : %llu\n", specmon_get_num_segments(_q));
+    printf("    segments dropped    : %llu\n", specmon_get_num_dropped(_q));
+}
+
+// clear accumulators, max-hold and average
+void specmon_reset(specmon _q)
+{
+    pthread_mutex_lock(&_q->acc_mutex);
+    memset(_q->acc_sum, 0x00, _q->nfft*sizeof(float));
+    memset(_q->acc_max, 0x00, _q->nfft*sizeof(float));
+    memset(_q->maxhold, 0x00, _q->nfft*sizeof(float));
+    memset(_q->average, 0x00, _q->nfft*sizeof(float));
+    _q->acc_num       = 0;
+    _q->average_valid = 0;
+    pthread_mutex_unlock(&_q->acc_mutex);
+}
+
+// set exponential averaging factor
+void specmon_set_alpha(specmon _q,
+                       float   _alpha)
+{
+    if (_alpha <= 0.0f || _alpha > 1.0f) {
+        fprintf(stderr,"error: specmon_set_alpha(), averaging factor must be in (0,1]\n");
+        exit(1);
+    }
+    _q->alpha = _alpha;
+}
+
+// push samples
+void specmon_write(specmon               _q,
+                   std::complex<float> * _x,
+                   unsigned int          _n)
+{
+    ringbuf_write(_q->ring, _x, _n);
+}
+
+// convert linear power spectrum to dB, moving DC to the center bin
+static void specmon_output(specmon _q,
+                           float * _psd,
+                           float * _y)
+{
+    unsigned int i;
+    float g = 1.0f / _q->w_energy;
+    for (i=0; i<_q->nfft; i++)
+        _y[(i + _q->nfft/2) % _q->nfft] = specmon_fast_db(g*_psd[i] + 1e-30f);
+}
+
+// compute spectrum estimates
+unsigned int specmon_execute(specmon _q,
+                             float * _welch,
+                             float * _maxhold,
+                             float * _average)
+{
+    pthread_mutex_lock(&_q->acc_mutex);
+    unsigned int num = _q->acc_num;
+    if (num == 0) {
+        pthread_mutex_unlock(&_q->acc_mutex);
+        return 0;
+    }
+
+    // Welch estimate (in place), max-hold and exponential average
+    unsigned int i;
+    for (i=0; i<_q->nfft; i++) {
+        _q->acc_sum[i] /= (float)num;
+        if (_q->acc_max[i] > _q->maxhold[i])
+            _q->maxhold[i] = _q->acc_max[i];
+        if (_q->average_valid)
+            _q->average[i] += _q->alpha*(_q->acc_sum[i] - _q->average[i]);
+        else
+            _q->average[i] = _q->acc_sum[i];
+    }
+    _q->average_valid = 1;
+
+    if (_welch   != NULL) specmon_output(_q, _q->acc_sum, _welch);
+    if (_maxhold != NULL) specmon_output(_q, _q->maxhold, _maxhold);
+    if (_average != NULL) specmon_output(_q, _q->average, _average);
+
+    // restart Welch accumulation
+    memset(_q->acc_sum, 0x00, _q->nfft*sizeof(float));
+    memset(_q->acc_max, 0x00, _q->nfft*sizeof(float));
+    _q->acc_num = 0;
+    pthread_mutex_unlock(&_q->acc_mutex);
+    return num;
+}
+
+unsigned int specmon_get_nfft(specmon _q)
+{
+    return _q->nfft;
+}
+
+// equivalent noise bandwidth of the window [bins]
+float specmon_get_enbw(specmon _q)
+{
+    float w_sum = 0.0f;
+    unsigned int i;
+    for (i=0; i<_q->nfft; i++)
+        w_sum += _q->w[i];
+    return _q->nfft * _q->w_energy / (w_sum*w_sum);
+}
+
+unsigned long long int specmon_get_num_samples(specmon _q)
+{
+    return ringbuf_get_write_pos(_q->ring);
+}
+
+unsigned long long int specmon_get_num_segments(specmon _q)
+{
+    return __atomic_load_n(&_q->num_segments, __ATOMIC_RELAXED);
+}
+
+unsigned long long int specmon_get_num_dropped(specmon _q)
+{
+    return __atomic_load_n(&_q->num_dropped, __ATOMIC_RELAXED);
+}
+
+// fast approximation of 10*log10(_x): the exponent gives the integer
+// part of log2, a quadratic in the mantissa the fractional part
+float specmon_fast_db(float _x)
+{
+    union { float f; unsigned int i; } u;
+    u.f = _x;
+    int e = (int)((u.i >> 23) & 0xff) - 128;
+    u.i = (u.i & 0x007fffff) | 0x3f800000;    // mantissa in [1,2)
+    float log2x = (float)e + ((-1.0f/3.0f)*u.f + 2.0f)*u.f - 2.0f/3.0f;
+    return 3.0103f * log2x;                     // 10*log10(2)
+}
+
+// worker thread
+static void * specmon_worker(void * _arg)
+{
+    specmon q = (specmon) _arg;
+    unsigned int nfft = q->nfft;
+    unsigned int i;
+
+    // per-worker transform and accumulators
+    std::complex<float> * x = (std::complex<float>*) malloc(nfft*sizeof(std::complex<float>));
+    std::complex<float> * X = (std::complex<float>*) malloc(nfft*sizeof(std::complex<float>));
+    float * sum  = (float*) malloc(nfft*sizeof(float));
+    float * peak = (float*) malloc(nfft*sizeof(float));
+    fftplan fft = fft_create_plan(nfft, x, X, LIQUID_FFT_FORWARD, 0);
+
+    ringbuf_lock(q->ring);
+    while (q->running) {
+        unsigned long long int w = ringbuf_get_write_pos(q->ring);
+        unsigned long long int k = q->next_segment;
+
+        // skip segments the producer may already be overwriting
+        unsigned long long int oldest = ringbuf_get_oldest(q->ring, w);
+        unsigned long long int k_oldest = (oldest + q->hop - 1) / q->hop;
+        if (k < k_oldest) {
+            __atomic_fetch_add(&q->num_dropped, k_oldest - k, __ATOMIC_RELAXED);
+            k = k_oldest;
+        }
+
+        // wait until a complete segment is available
+        unsigned long long int k_end = w >= nfft ? (w - nfft) / q->hop + 1 : 0;
+        if (k >= k_end) {
+            q->next_segment = k;
+            ringbuf_wait(q->ring, w);
+            continue;
+        }
+
+        // claim batch
+        unsigned int num = k_end - k > SPECMON_BATCH ? SPECMON_BATCH : (unsigned int)(k_end - k);
+        q->next_segment = k + num;
+        ringbuf_unlock(q->ring);
+
+        // transform batch, accumulating locally
+        unsigned int j;
+        unsigned int num_valid = 0;
+        for (j=0; j<num; j++) {
+            // copy segment, discarding it if it was overwritten while
+            // copying, and apply window
+            if (ringbuf_read(q->ring, (k+j)*q->hop, x, nfft)) {
+                __atomic_fetch_add(&q->num_dropped, 1, __ATOMIC_RELAXED);
+                continue;
+            }
+            for (i=0; i<nfft; i++)
+                x[i] *= q->w[i];
+
+            fft_execute(fft);
+            for (i=0; i<nfft; i++) {
+                float p = std::norm(X[i]);
+                if (num_valid == 0) {
+                    sum[i]  = p;
+                    peak[i] = p;
+                } else {
+                    sum[i] += p;
+                    if (p > peak[i]) peak[i] = p;
+                }
+            }
+            num_valid++;
+        }
+
+        // merge into shared accumulators once per batch
+        if (num_valid > 0) {
+            pthread_mutex_lock(&q->acc_mutex);
+            for (i=0; i<nfft; i++) {
+                q->acc_sum[i] += sum[i];
+                if (peak[i] > q->acc_max[i]) q->acc_max[i] = peak[i];
+            }
+            q->acc_num += num_valid;
+            pthread_mutex_unlock(&q->acc_mutex);
+            __atomic_fetch_add(&q->num_segments, num_valid, __ATOMIC_RELAXED);
+        }
+
+        ringbuf_lock(q->ring);
+    }
+    ringbuf_unlock(q->ring);
+
+    fft_destroy_plan(fft);
+    free(x);
+    free(X);
+    free(sum);
+    free(peak);
+    return NULL;
+}
@@ -0,0 +1,224 @@
+/*
+ * Copyright (c) 2013 Joseph Gaeddert
+ *
+ * This file is part of liquid.
+ *
+ * liquid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * liquid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with liquid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+//
+// tddsched.cc
+//
+// time-division duplex (TDD) slot scheduler
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "tddsched.h"
+
+// tolerance for comparing times [s]
+#define TDDSCHED_EPSILON    (1e-9)
+
+// slot within frame
+struct tddsched_slot_s {
+    int type;                       // TDDSCHED_SLOT_TX or TDDSCHED_SLOT_RX
+    double offset;                  // start relative to frame start [s]
+    double duration;                // duration [s]
+};
+
+struct tddsched_s {
+    double frame_len;               // frame length [s]
+    double guard;                   // minimum gap between slots [s]
+    double epoch;                   // device time of frame 0 [s]
+    struct tddsched_slot_s * slots; // slots, sorted by offset
+    unsigned int num_slots;         // number of slots
+};
+
+// create scheduler
+tddsched tddsched_create(double _frame_len,
+                         double _guard)
+{
+    if (_frame_len <= 0.0) {
+        fprintf(stderr,"error: tddsched_create(), frame length must be greater than zero\n");
+        exit(1);
+    } else if (_guard < 0.0 || _guard >= _frame_len) {
+        fprintf(stderr,"error: tddsched_create(), guard time must be in [0,frame length)\n");
+        exit(1);
+    }
+
+    tddsched q = (tddsched) malloc(sizeof(struct tddsched_s));
+    q->frame_len = _frame_len;
+    q->guard     = _guard;
+    q->epoch     = 0.0;
+    q->slots     = NULL;
+    q->num_slots = 0;
+    return q;
+}
+
+// destroy scheduler
+void tddsched_destroy(tddsched _q)
+{
+    free(_q->slots);
+    free(_q);
+}
+
+// print frame structure
+void tddsched_print(tddsched _q)
+{
+    printf("tddsched [frame: %.6f s, guard: %.6f s, epoch: %.6f s]:\n",
+            _q->frame_len, _q->guard, _q->epoch);
+    unsigned int i;
+    for (i=0; i<_q->num_slots; i++) {
+        printf("  slot %2u : %s [%12.6f, %12.6f) s\n", i,
+                _q->slots[i].type == TDDSCHED_SLOT_TX ? "tx" : "rx",
+                _q->slots[i].offset,
+                _q->slots[i].offset + _q->slots[i].duration);
+    }
+}
+
+// add slot to frame
+unsigned int tddsched_add_slot(tddsched _q,
+                               int      _type,
+                               double   _offset,
+                               double   _duration)
+{
+    if (_type != TDDSCHED_SLOT_TX && _type != TDDSCHED_SLOT_RX) {
+        fprintf(stderr,"error: tddsched_add_slot(), invalid slot type %d\n", _type);
+        exit(1);
+    } else if (_duration <= 0.0 || _offset < 0.0 ||
+               _offset + _duration > _q->frame_len + TDDSCHED_EPSILON)
+    {
+        fprintf(stderr,"error: tddsched_add_slot(), slot must lie within frame\n");
+        exit(1);
+    }
+
+    // find position keeping slots sorted by offset
+    unsigned int n = 0;
+    while (n < _q->num_slots && _q->slots[n].offset < _offset)
+        n++;
+
+    // check guard against neighbours (wrapping across frame boundary)
+    if (_q->num_slots > 0) {
+        struct tddsched_slot_s * prev = &_q->slots[(n + _q->num_slots - 1) % _q->num_slots];
+        struct tddsched_slot_s * next = &_q->slots[n % _q->num_slots];
+        double prev_end   = prev->offset + prev->duration - (n == 0 ? _q->frame_len : 0.0);
+        double next_start = next->offset + (n == _q->num_slots ? _q->frame_len : 0.0);
+        if (_offset - prev_end < _q->guard - TDDSCHED_EPSILON ||
+            next_start - (_offset + _duration) < _q->guard - TDDSCHED_EPSILON)
+        {
+            fprintf(stderr,"error: tddsched_add_slot(), slot overlaps neighbour or violates guard time\n");
+            exit(1);
+        }
+    } else if (_duration + _q->guard > _q->frame_len + TDDSCHED_EPSILON) {
+        fprintf(stderr,"error: tddsched_add_slot(), slot and guard exceed frame length\n");
+        exit(1);
+    }
+
+    // insert
+    _q->slots = (struct tddsched_slot_s*) realloc(_q->slots,
+                    (_q->num_slots+1)*sizeof(struct tddsched_slot_s));
+    unsigned int i;
+    for (i=_q->num_slots; i>n; i--)
+        _q->slots[i] = _q->slots[i-1];
+    _q->slots[n].type     = _type;
+    _q->slots[n].offset   = _offset;
+    _q->slots[n].duration = _duration;
+    _q->num_slots++;
+    return n;
+}
+
+// set device time of the start of frame 0
+void tddsched_set_epoch(tddsched _q,
+                        double   _epoch)
+{
+    _q->epoch = _epoch;
+}
+
+// find the next slot of a given type starting at or after _time
+int tddsched_next(tddsched _q,
+                  int      _type,
+                  double   _time,
+                  double * _start,
+                  double * _duration)
+{
+    int index = -1;
+    double start_min = 0.0;
+    unsigned int i;
+    for (i=0; i<_q->num_slots; i++) {
+        if (_q->slots[i].type != _type)
+            continue;
+
+        // first frame in which this slot starts at or after _time
+        double n = ceil((_time - _q->epoch - _q->slots[i].offset) / _q->frame_len - TDDSCHED_EPSILON);
+        if (n < 0.0) n = 0.0;
+        double start = _q->epoch + n*_q->frame_len + _q->slots[i].offset;
+        if (index < 0 || start < start_min) {
+            index     = i;
+            start_min = start;
+        }
+    }
+
+    if (index >= 0) {
+        *_start    = start_min;
+        *_duration = _q->slots[index].duration;
+    }
+    return index;
+}
+
+// number of samples fitting in a slot at a given sample rate
+unsigned int tddsched_slot_samples(tddsched     _q,
+                                   unsigned int _slot,
+                                   double       _rate)
+{
+    if (_slot >= _q->num_slots) {
+        fprintf(stderr,"error: tddsched_slot_samples(), invalid slot %u\n", _slot);
+        exit(1);
+    }
+    return (unsigned int) floor(_q->slots[_slot].duration * _rate + TDDSCHED_EPSILON);
+}
+
+// accessor methods
+double tddsched_get_frame_len(tddsched _q)
+{
+    return _q->frame_len;
+}
+
+double tddsched_get_guard(tddsched _q)
+{
+    return _q->guard;
+}
+
+double tddsched_get_epoch(tddsched _q)
+{
+    return _q->epoch;
+}
+
+unsigned int tddsched_get_num_slots(tddsched _q)
+{
+    return _q->num_slots;
+}
+
+double tddsched_get_duty_cycle(tddsched _q,
+                               int      _type)
+{
+    double t = 0.0;
+    unsigned int i;
+    for (i=0; i<_q->num_slots; i++) {
+        if (_q->slots[i].type == _type)
+            t += _q->slots[i].duration;
+    }
+    return t / _q->frame_len;
+}
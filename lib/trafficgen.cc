@@ -0,0 +1,403 @@
+/*
+ * Copyright (c) 2013 Joseph Gaeddert
+ *
+ * This file is part of liquid.
+ *
+ * liquid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * liquid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with liquid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+//
+// trafficgen.cc
+//
+// seeded pseudo-random packet generator and matching checker
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "trafficgen.h"
+
+// maximum number of channels tracked by checker (header[2])
+#define TRAFFICCHECK_MAX_CHANNELS (256)
+
+// received-packet window per channel [packets]; a packet this far or
+// further behind the highest sequence number marks a transmitter restart
+#define TRAFFICCHECK_WINDOW (1024)
+
+// splitmix64 step, used to derive independent generator states
+static inline uint64_t trafficgen_splitmix64(uint64_t * _s)
+{
+    uint64_t z = (*_s += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+// fill buffer with pseudo-random bytes keyed on seed, channel and
+// sequence number; four independent xorshift64 lanes are advanced
+// together so that the compiler can vectorize the inner loop
+void trafficgen_prbs(unsigned int    _seed,
+                     unsigned int    _channel,
+                     unsigned int    _seq,
+                     unsigned char * _buf,
+                     unsigned int    _n)
+{
+    uint64_t key = ((uint64_t)_seed << 32) ^ ((uint64_t)_channel << 24) ^ (uint64_t)_seq;
+    uint64_t s[4];
+    unsigned int k;
+    for (k=0; k<4; k++)
+        s[k] = trafficgen_splitmix64(&key) | 1ULL;  // state must be non-zero
+
+    unsigned int i = 0;
+    while (i < _n) {
+        for (k=0; k<4; k++) {
+            s[k] ^= s[k] << 13;
+            s[k] ^= s[k] >> 7;
+            s[k] ^= s[k] << 17;
+        }
+        unsigned int n = _n - i < sizeof(s) ? _n - i : sizeof(s);
+        memmove(&_buf[i], s, n);
+        i += n;
+    }
+}
+
+// assemble packet with given sequence number
+void trafficgen_assemble(unsigned int    _seed,
+                         unsigned int    _channel,
+                         unsigned int    _seq,
+                         unsigned char * _header,
+                         unsigned int    _header_len,
+                         unsigned char * _payload,
+                         unsigned int    _payload_len)
+{
+    _header[0] = (_seq >>  8) & 0xff;
+    _header[1] = (_seq      ) & 0xff;
+    _header[2] = _channel     & 0xff;
+    _header[3] = TRAFFICGEN_HEADER_ID;
+    _header[4] = (_seq >> 24) & 0xff;
+    _header[5] = (_seq >> 16) & 0xff;
+    _header[6] = (_seq >>  8) & 0xff;
+    _header[7] = (_seq      ) & 0xff;
+    if (_header_len > 8)
+        trafficgen_prbs(~_seed, _channel, _seq, &_header[8], _header_len-8);
+
+    trafficgen_prbs(_seed, _channel, _seq, _payload, _payload_len);
+}
+
+// 
+// trafficgen
+//
+
+struct trafficgen_s {
+    unsigned int seed;          // generator seed
+    unsigned int channel;       // channel index
+    unsigned int header_len;    // header length
+    unsigned int seq;           // sequence number of next packet
+};
+
+// create traffic generator
+trafficgen trafficgen_create(unsigned int _seed,
+                             unsigned int _channel,
+                             unsigned int _header_len)
+{
+    if (_header_len < 8) {
+        fprintf(stderr,"error: trafficgen_create(), header length must be at least 8\n");
+        exit(1);
+    }
+
+    trafficgen q = (trafficgen) malloc(sizeof(struct trafficgen_s));
+    q->seed       = _seed;
+    q->channel    = _channel;
+    q->header_len = _header_len;
+    trafficgen_reset(q);
+    return q;
+}
+
+// destroy traffic generator
+void trafficgen_destroy(trafficgen _q)
+{
+    free(_q);
+}
+
+// reset sequence number to zero
+void trafficgen_reset(trafficgen _q)
+{
+    _q->seq = 0;
+}
+
+// generate next packet; returns its sequence number
+unsigned int trafficgen_generate(trafficgen      _q,
+                                 unsigned char * _header,
+                                 unsigned char * _payload,
+                                 unsigned int    _payload_len)
+{
+    unsigned int seq = _q->seq++;
+    trafficgen_assemble(_q->seed, _q->channel, seq, _header, _q->header_len,
+                        _payload, _payload_len);
+    return seq;
+}
+
+// get sequence number of next packet
+unsigned int trafficgen_get_seq(trafficgen _q)
+{
+    return _q->seq;
+}
+
+// 
+// trafficcheck
+//
+
+struct trafficcheck_s {
+    unsigned int seed;          // generator seed
+    unsigned int header_len;    // header length
+
+    // per-channel sequence tracking (current run since last restart)
+    int          started[TRAFFICCHECK_MAX_CHANNELS];    // packet seen?
+    unsigned int seq_first[TRAFFICCHECK_MAX_CHANNELS];  // lowest sequence number
+    unsigned int seq_last[TRAFFICCHECK_MAX_CHANNELS];   // highest sequence number
+    unsigned int num_expected[TRAFFICCHECK_MAX_CHANNELS]; // expected in earlier runs
+    uint64_t     window[TRAFFICCHECK_MAX_CHANNELS][TRAFFICCHECK_WINDOW/64]; // received, bit seq % WINDOW
+
+    // expected payload
+    unsigned char * buffer;     // regenerated payload
+    unsigned int buffer_len;    // allocated length
+
+    // counters
+    unsigned int num_headers_invalid;   // frames with invalid/foreign header
+    unsigned int num_packets;           // packets with valid header (new)
+    unsigned int num_duplicates;        // repeated packets
+    unsigned int num_restarts;          // transmitter restarts detected
+    unsigned int num_valid;             // packets with valid payload
+    unsigned long long num_valid_bytes; // bytes in valid payloads
+    unsigned long long num_bits;        // payload bits checked
+    unsigned long long num_bit_errors;  // payload bit errors
+};
+
+// create traffic checker
+trafficcheck trafficcheck_create(unsigned int _seed,
+                                 unsigned int _header_len)
+{
+    if (_header_len < 8) {
+        fprintf(stderr,"error: trafficcheck_create(), header length must be at least 8\n");
+        exit(1);
+    }
+
+    trafficcheck q = (trafficcheck) malloc(sizeof(struct trafficcheck_s));
+    q->seed       = _seed;
+    q->header_len = _header_len;
+    q->buffer_len = 2048;
+    q->buffer     = (unsigned char*) malloc(q->buffer_len);
+    trafficcheck_reset(q);
+    return q;
+}
+
+// destroy traffic checker
+void trafficcheck_destroy(trafficcheck _q)
+{
+    free(_q->buffer);
+    free(_q);
+}
+
+// reset counters
+void trafficcheck_reset(trafficcheck _q)
+{
+    unsigned int i;
+    for (i=0; i<TRAFFICCHECK_MAX_CHANNELS; i++) {
+        _q->started[i]      = 0;
+        _q->seq_first[i]    = 0;
+        _q->seq_last[i]     = 0;
+        _q->num_expected[i] = 0;
+    }
+    _q->num_headers_invalid = 0;
+    _q->num_packets         = 0;
+    _q->num_duplicates      = 0;
+    _q->num_restarts        = 0;
+    _q->num_valid           = 0;
+    _q->num_valid_bytes     = 0;
+    _q->num_bits            = 0;
+    _q->num_bit_errors      = 0;
+}
+
+// print statistics
+void trafficcheck_print(trafficcheck _q,
+                        float        _runtime)
+{
+    float goodput = _runtime > 0 ? 8.0f * (float)_q->num_valid_bytes / _runtime : 0.0f;
+    printf("traffic check:\n");
+    printf("    packets expected    : %6u\n", _q->num_packets + trafficcheck_get_num_lost(_q));
+    printf("    packets received    : %6u\n", _q->num_packets);
+    printf("    packets lost        : %6u\n", trafficcheck_get_num_lost(_q));
+    printf("    packets valid       : %6u\n", _q->num_valid);
+    printf("    duplicates          : %6u\n", _q->num_duplicates);
+    printf("    tx restarts         : %6u\n", _q->num_restarts);
+    printf("    invalid headers     : %6u\n", _q->num_headers_invalid);
+    printf("    bits checked        : %llu\n", _q->num_bits);
+    printf("    bit errors          : %llu\n", _q->num_bit_errors);
+    printf("    bit error rate      : %12.4e\n", trafficcheck_get_ber(_q));
+    printf("    packet error rate   : %12.4e\n", trafficcheck_get_per(_q));
+    printf("    goodput             : %8.4f kbps\n", goodput*1e-3f);
+}
+
+// track sequence number on channel; returns non-zero if the packet was
+// already received
+static int trafficcheck_track(trafficcheck _q,
+                              unsigned int _channel,
+                              unsigned int _seq)
+{
+    uint64_t * w = _q->window[_channel];
+    unsigned int seq_last = _q->seq_last[_channel];
+
+    // a large backward jump means the transmitter restarted: close the
+    // current run and start a new one
+    if (_q->started[_channel] && _seq <= seq_last &&
+        seq_last - _seq >= TRAFFICCHECK_WINDOW)
+    {
+        _q->num_expected[_channel] += seq_last - _q->seq_first[_channel] + 1;
+        _q->started[_channel] = 0;
+        _q->num_restarts++;
+    }
+
+    if (!_q->started[_channel]) {
+        memset(w, 0x00, (TRAFFICCHECK_WINDOW/64)*sizeof(uint64_t));
+        _q->started[_channel]   = 1;
+        _q->seq_first[_channel] = _seq;
+        _q->seq_last[_channel]  = _seq;
+    } else if (_seq > seq_last) {
+        // advance window, clearing the slots of the skipped numbers
+        unsigned int s;
+        if (_seq - seq_last >= TRAFFICCHECK_WINDOW) {
+            memset(w, 0x00, (TRAFFICCHECK_WINDOW/64)*sizeof(uint64_t));
+        } else {
+            for (s=seq_last+1; s!=_seq+1; s++)
+                w[(s % TRAFFICCHECK_WINDOW)/64] &= ~(1ULL << (s % 64));
+        }
+        _q->seq_last[_channel] = _seq;
+    } else if (w[(_seq % TRAFFICCHECK_WINDOW)/64] & (1ULL << (_seq % 64))) {
+        return 1;
+    } else if (_seq < _q->seq_first[_channel]) {
+        // late packet from before the first one seen
+        _q->seq_first[_channel] = _seq;
+    }
+
+    w[(_seq % TRAFFICCHECK_WINDOW)/64] |= 1ULL << (_seq % 64);
+    return 0;
+}
+
+// check received frame
+int trafficcheck_execute(trafficcheck    _q,
+                         unsigned char * _header,
+                         int             _header_valid,
+                         unsigned char * _payload,
+                         unsigned int    _payload_len,
+                         int             _payload_valid)
+{
+    if (!_header_valid || _header[3] != TRAFFICGEN_HEADER_ID) {
+        _q->num_headers_invalid++;
+        return -1;
+    }
+
+    unsigned int channel = _header[2];
+    unsigned int seq = (_header[4] << 24) | (_header[5] << 16) |
+                       (_header[6] <<  8) | (_header[7]      );
+
+    // track sequence; packets missing from the sequence are lost, late
+    // (reordered) packets within the window fill their gap
+    if (trafficcheck_track(_q, channel, seq) != 0) {
+        _q->num_duplicates++;
+        return 0;
+    }
+    _q->num_packets++;
+
+    if (_payload_valid) {
+        _q->num_valid++;
+        _q->num_valid_bytes += _payload_len;
+    }
+
+    // regenerate expected payload
+    if (_payload_len > _q->buffer_len) {
+        _q->buffer_len = _payload_len;
+        _q->buffer = (unsigned char*) realloc(_q->buffer, _q->buffer_len);
+    }
+    trafficgen_prbs(_q->seed, channel, seq, _q->buffer, _payload_len);
+
+    // count bit errors eight bytes at a time
+    unsigned int num_errors = 0;
+    unsigned int i;
+    for (i=0; i+8<=_payload_len; i+=8) {
+        uint64_t a, b;
+        memmove(&a, &_payload[i],    8);
+        memmove(&b, &_q->buffer[i],  8);
+        num_errors += __builtin_popcountll(a ^ b);
+    }
+    for ( ; i<_payload_len; i++)
+        num_errors += __builtin_popcount(_payload[i] ^ _q->buffer[i]);
+
+    _q->num_bits       += 8*_payload_len;
+    _q->num_bit_errors += num_errors;
+    return (int)num_errors;
+}
+
+// packets with valid header
+unsigned int trafficcheck_get_num_packets(trafficcheck _q)
+{
+    return _q->num_packets;
+}
+
+// packets with valid payload
+unsigned int trafficcheck_get_num_valid(trafficcheck _q)
+{
+    return _q->num_valid;
+}
+
+// packets missing from sequence
+unsigned int trafficcheck_get_num_lost(trafficcheck _q)
+{
+    unsigned int num_expected = 0;
+    unsigned int i;
+    for (i=0; i<TRAFFICCHECK_MAX_CHANNELS; i++) {
+        num_expected += _q->num_expected[i];
+        if (_q->started[i])
+            num_expected += _q->seq_last[i] - _q->seq_first[i] + 1;
+    }
+    return num_expected - _q->num_packets;
+}
+
+// payload bits checked
+unsigned long long trafficcheck_get_num_bits(trafficcheck _q)
+{
+    return _q->num_bits;
+}
+
+// payload bit errors
+unsigned long long trafficcheck_get_num_bit_errors(trafficcheck _q)
+{
+    return _q->num_bit_errors;
+}
+
+// bit error rate
+float trafficcheck_get_ber(trafficcheck _q)
+{
+    return _q->num_bits == 0 ? 0.0f : (float)_q->num_bit_errors / (float)_q->num_bits;
+}
+
+// packet error rate (lost or invalid packets)
+float trafficcheck_get_per(trafficcheck _q)
+{
+    unsigned int num_expected = _q->num_packets + trafficcheck_get_num_lost(_q);
+    return num_expected == 0 ? 0.0f : 1.0f - (float)_q->num_valid / (float)num_expected;
+}
+
@@ -0,0 +1,455 @@
+/*
+ * Copyright (c) 2013 Joseph Gaeddert
+ *
+ * This file is part of liquid.
+ *
+ * liquid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * liquid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with liquid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+//
+// waterfall.cc
+//
+// compact binary waterfall (spectrogram) recording
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#include "asyncwriter.h"
+#include "waterfall.h"
+
+// size of each asyncwriter buffer [bytes]
+#define WATERFALL_BUFFER_LEN    (1024*1024)
+
+// get current time [s since epoch]
+static double waterfall_gettime()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (double)tv.tv_sec + 1e-6*(double)tv.tv_usec;
+}
+
+// compute padded row length
+static unsigned int waterfall_row_len(unsigned int _num_bins)
+{
+    unsigned int n = sizeof(struct waterfall_rowheader_s) + _num_bins;
+    return (n + 7) & ~7u;
+}
+
+// 
+// waterfall (writer)
+//
+
+// waterfall data structure
+struct waterfall_s {
+    asyncwriter writer;         // background file writer
+    unsigned int num_bins;      // number of bins in each row
+    float db_min;               // dB value of quantized 0
+    float db_step;              // dB per quantization step
+    double time_start;          // recording start time
+
+    // time index
+    double index_interval;      // time index resolution [s]
+    uint32_t * index;           // first row in each interval
+    unsigned int num_buckets;   // number of intervals indexed
+    unsigned int index_len;     // allocated length of index
+
+    unsigned char * row;        // row buffer
+    unsigned int row_len;       // padded row length [bytes]
+    unsigned int num_rows;      // number of rows written
+    unsigned int num_dropped;   // number of rows dropped
+
+    struct waterfall_fileheader_s fh;
+    int header_written;         // file header written?
+};
+
+// create waterfall recording
+waterfall waterfall_create(const char * _filename,
+                           unsigned int _num_bins,
+                           double       _frequency,
+                           double       _span,
+                           double       _rbw,
+                           float        _db_min,
+                           float        _db_step)
+{
+    // validate input
+    if (_num_bins == 0) {
+        fprintf(stderr,"error: waterfall_create(), number of bins must be greater than zero\n");
+        exit(1);
+    } else if (_db_step <= 0.0f) {
+        fprintf(stderr,"error: waterfall_create(), quantization step must be greater than zero\n");
+        exit(1);
+    }
+
+    asyncwriter writer = asyncwriter_create(_filename, WATERFALL_BUFFER_LEN);
+    if (writer == NULL) {
+        fprintf(stderr,"error: waterfall_create(), could not create waterfall '%s'\n", _filename);
+        return NULL;
+    }
+
+    waterfall q = (waterfall) malloc(sizeof(struct waterfall_s));
+    q->writer      = writer;
+    q->num_bins    = _num_bins;
+    q->db_min      = _db_min;
+    q->db_step     = _db_step;
+    q->time_start  = waterfall_gettime();
+
+    // allocate time index
+    q->index_interval = 1.0;
+    q->num_buckets = 0;
+    q->index_len   = 4096;
+    q->index       = (uint32_t*) malloc(q->index_len * sizeof(uint32_t));
+
+    // allocate row buffer
+    q->row_len     = waterfall_row_len(q->num_bins);
+    q->row         = (unsigned char*) malloc(q->row_len);
+    memset(q->row, 0x00, q->row_len);
+    q->num_rows    = 0;
+    q->num_dropped = 0;
+
+    // assemble file header (written with the first row so that the
+    // index interval may still be changed)
+    memset(&q->fh, 0x00, sizeof(q->fh));
+    memmove(q->fh.magic, WATERFALL_MAGIC, 8);
+    q->fh.version        = WATERFALL_VERSION;
+    q->fh.num_bins       = q->num_bins;
+    q->fh.row_len        = q->row_len;
+    q->fh.frequency      = _frequency;
+    q->fh.span           = _span;
+    q->fh.rbw            = _rbw;
+    q->fh.time_start     = q->time_start;
+    q->fh.index_interval = q->index_interval;
+    q->fh.db_min         = q->db_min;
+    q->fh.db_step        = q->db_step;
+    q->header_written    = 0;
+
+    return q;
+}
+
+// destroy waterfall, writing time index to file
+void waterfall_destroy(waterfall _q)
+{
+    if (!_q->header_written)
+        asyncwriter_write_wait(_q->writer, &_q->fh, sizeof(_q->fh));
+
+    // write time index and trailer
+    struct waterfall_trailer_s trailer;
+    memset(&trailer, 0x00, sizeof(trailer));
+    trailer.index_offset = asyncwriter_get_offset(_q->writer);
+    trailer.num_buckets  = _q->num_buckets;
+    trailer.num_rows     = _q->num_rows;
+    memmove(trailer.magic, WATERFALL_TRAILER_MAGIC, 8);
+    if (_q->num_buckets > 0)
+        asyncwriter_write_wait(_q->writer, _q->index, _q->num_buckets*sizeof(uint32_t));
+    asyncwriter_write_wait(_q->writer, &trailer, sizeof(trailer));
+
+    // flush and close file
+    asyncwriter_destroy(_q->writer);
+
+    // free memory
+    free(_q->index);
+    free(_q->row);
+    free(_q);
+}
+
+// print waterfall statistics
+void waterfall_print(waterfall _q)
+{
+    printf("waterfall: %u bins, %u rows, %u dropped, %lld bytes\n",
+            _q->num_bins,
+            _q->num_rows,
+            _q->num_dropped,
+            asyncwriter_get_offset(_q->writer));
+}
+
+// set time index resolution [s]
+void waterfall_set_index_interval(waterfall _q,
+                                  double    _interval)
+{
+    if (_interval <= 0.0) {
+        fprintf(stderr,"error: waterfall_set_index_interval(), interval must be greater than zero\n");
+        exit(1);
+    } else if (_q->header_written) {
+        fprintf(stderr,"warning: waterfall_set_index_interval(), rows already written\n");
+        return;
+    }
+    _q->index_interval    = _interval;
+    _q->fh.index_interval = _interval;
+}
+
+// append row, time-stamped with the current time
+void waterfall_write(waterfall     _q,
+                     const float * _psd,
+                     unsigned int  _num_averaged)
+{
+    if (!_q->header_written) {
+        asyncwriter_write_wait(_q->writer, &_q->fh, sizeof(_q->fh));
+        _q->header_written = 1;
+    }
+
+    // assemble row header
+    double timestamp = waterfall_gettime() - _q->time_start;
+    struct waterfall_rowheader_s * rh = (struct waterfall_rowheader_s*) _q->row;
+    rh->timestamp    = timestamp;
+    rh->num_averaged = _num_averaged;
+    rh->reserved     = 0;
+
+    // quantize
+    uint8_t * v = _q->row + sizeof(struct waterfall_rowheader_s);
+    float g = 1.0f / _q->db_step;
+    unsigned int i;
+    for (i=0; i<_q->num_bins; i++) {
+        float k = (_psd[i] - _q->db_min)*g + 0.5f;
+        v[i] = k <= 0.0f ? 0 : (k >= 255.0f ? 255 : (uint8_t)k);
+    }
+
+    // hand row to background writer (rows are contiguous, so a
+    // dropped row simply does not appear in the file)
+    if (asyncwriter_write(_q->writer, _q->row, _q->row_len) < 0) {
+        _q->num_dropped++;
+        return;
+    }
+
+    // extend time index up to and including this row's interval
+    while ((double)_q->num_buckets * _q->index_interval <= timestamp) {
+        if (_q->num_buckets == _q->index_len) {
+            _q->index_len *= 2;
+            _q->index = (uint32_t*) realloc(_q->index, _q->index_len*sizeof(uint32_t));
+        }
+        _q->index[_q->num_buckets++] = _q->num_rows;
+    }
+    _q->num_rows++;
+}
+
+// get number of rows recorded
+unsigned int waterfall_get_num_rows(waterfall _q)
+{
+    return _q->num_rows;
+}
+
+// get number of rows dropped
+unsigned int waterfall_get_num_dropped(waterfall _q)
+{
+    return _q->num_dropped;
+}
+
+// 
+// waterfallreader (memory-mapped reader)
+//
+
+// waterfallreader data structure
+struct waterfallreader_s {
+    unsigned char * map;            // memory-mapped file
+    size_t map_len;                 // length of file
+    struct waterfall_fileheader_s * fh;
+
+    unsigned char * rows;           // first row
+    unsigned int num_rows;          // number of rows
+
+    const uint32_t * index;         // time index
+    uint32_t * index_scan;          // time index re-built from rows
+    unsigned int num_buckets;       // number of entries in time index
+};
+
+// get row header at index _i
+static struct waterfall_rowheader_s * waterfallreader_rowheader(waterfallreader _q,
+                                                                unsigned int    _i)
+{
+    return (struct waterfall_rowheader_s*) (_q->rows + (size_t)_i*_q->fh->row_len);
+}
+
+// open waterfall file for reading
+waterfallreader waterfallreader_open(const char * _filename)
+{
+    int fd = open(_filename, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr,"error: waterfallreader_open(), could not open '%s' for reading\n", _filename);
+        return NULL;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(struct waterfall_fileheader_s)) {
+        fprintf(stderr,"error: waterfallreader_open(), '%s' is not a waterfall\n", _filename);
+        close(fd);
+        return NULL;
+    }
+
+    size_t map_len = st.st_size;
+    void * map = mmap(NULL, map_len, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        fprintf(stderr,"error: waterfallreader_open(), could not map '%s'\n", _filename);
+        return NULL;
+    }
+
+    // validate file header
+    struct waterfall_fileheader_s * fh = (struct waterfall_fileheader_s*) map;
+    if (memcmp(fh->magic, WATERFALL_MAGIC, 8) != 0 || fh->version != WATERFALL_VERSION ||
+        fh->row_len != waterfall_row_len(fh->num_bins) || fh->index_interval <= 0.0)
+    {
+        fprintf(stderr,"error: waterfallreader_open(), '%s' is not a waterfall (or unsupported version)\n", _filename);
+        munmap(map, map_len);
+        return NULL;
+    }
+
+    waterfallreader q = (waterfallreader) malloc(sizeof(struct waterfallreader_s));
+    q->map         = (unsigned char*) map;
+    q->map_len     = map_len;
+    q->fh          = fh;
+    q->rows        = q->map + sizeof(struct waterfall_fileheader_s);
+    q->num_rows    = 0;
+    q->index       = NULL;
+    q->index_scan  = NULL;
+    q->num_buckets = 0;
+
+    // look for trailer and time index
+    size_t rows_offset = sizeof(struct waterfall_fileheader_s);
+    if (map_len >= rows_offset + sizeof(struct waterfall_trailer_s)) {
+        struct waterfall_trailer_s * trailer =
+            (struct waterfall_trailer_s*) (q->map + map_len - sizeof(struct waterfall_trailer_s));
+        if (memcmp(trailer->magic, WATERFALL_TRAILER_MAGIC, 8) == 0 &&
+            trailer->index_offset == rows_offset + trailer->num_rows*fh->row_len &&
+            trailer->index_offset + trailer->num_buckets*sizeof(uint32_t) + sizeof(struct waterfall_trailer_s) == map_len)
+        {
+            q->num_rows    = trailer->num_rows;
+            q->index       = (const uint32_t*) (q->map + trailer->index_offset);
+            q->num_buckets = trailer->num_buckets;
+            return q;
+        }
+    }
+
+    // no valid trailer (e.g. recording was not closed); rows have fixed
+    // length so only the time index needs re-building
+    fprintf(stderr,"warning: waterfallreader_open(), '%s' has no index; scanning rows\n", _filename);
+    q->num_rows = (map_len - rows_offset) / fh->row_len;
+    unsigned int index_len = 4096;
+    q->index_scan = (uint32_t*) malloc(index_len*sizeof(uint32_t));
+    unsigned int i;
+    for (i=0; i<q->num_rows; i++) {
+        double timestamp = waterfallreader_rowheader(q,i)->timestamp;
+        while ((double)q->num_buckets * fh->index_interval <= timestamp) {
+            if (q->num_buckets == index_len) {
+                index_len *= 2;
+                q->index_scan = (uint32_t*) realloc(q->index_scan, index_len*sizeof(uint32_t));
+            }
+            q->index_scan[q->num_buckets++] = i;
+        }
+    }
+    q->index = q->index_scan;
+
+    return q;
+}
+
+// close waterfall file
+void waterfallreader_close(waterfallreader _q)
+{
+    munmap(_q->map, _q->map_len);
+    if (_q->index_scan != NULL)
+        free(_q->index_scan);
+    free(_q);
+}
+
+// get number of rows
+unsigned int waterfallreader_get_num_rows(waterfallreader _q)
+{
+    return _q->num_rows;
+}
+
+// get number of bins in each row
+unsigned int waterfallreader_get_num_bins(waterfallreader _q)
+{
+    return _q->fh->num_bins;
+}
+
+// get center frequency [Hz]
+double waterfallreader_get_frequency(waterfallreader _q)
+{
+    return _q->fh->frequency;
+}
+
+// get frequency span [Hz]
+double waterfallreader_get_span(waterfallreader _q)
+{
+    return _q->fh->span;
+}
+
+// get resolution bandwidth [Hz]
+double waterfallreader_get_rbw(waterfallreader _q)
+{
+    return _q->fh->rbw;
+}
+
+// get recording start time [s since epoch]
+double waterfallreader_get_time_start(waterfallreader _q)
+{
+    return _q->fh->time_start;
+}
+
+// get quantized row at index _i (constant time)
+const uint8_t * waterfallreader_get_row(waterfallreader _q,
+                                        unsigned int    _i,
+                                        double *        _timestamp)
+{
+    if (_i >= _q->num_rows)
+        return NULL;
+
+    struct waterfall_rowheader_s * rh = waterfallreader_rowheader(_q, _i);
+    if (_timestamp != NULL)
+        *_timestamp = rh->timestamp;
+    return (const uint8_t*) rh + sizeof(struct waterfall_rowheader_s);
+}
+
+// read row at index _i (constant time), converted to dB
+int waterfallreader_read(waterfallreader _q,
+                         unsigned int    _i,
+                         float *         _psd,
+                         double *        _timestamp)
+{
+    const uint8_t * v = waterfallreader_get_row(_q, _i, _timestamp);
+    if (v == NULL)
+        return -1;
+
+    unsigned int i;
+    for (i=0; i<_q->fh->num_bins; i++)
+        _psd[i] = _q->fh->db_min + _q->fh->db_step * (float)v[i];
+    return 0;
+}
+
+// find index of first row with timestamp >= _t
+unsigned int waterfallreader_find(waterfallreader _q,
+                                  double          _t)
+{
+    if (_t <= 0.0)
+        return 0;
+
+    // look up interval in time index; rows beyond the last interval
+    // do not exist
+    double k = floor(_t / _q->fh->index_interval);
+    if (k >= (double)_q->num_buckets)
+        return _q->num_rows;
+
+    // scan rows within interval
+    unsigned int i = _q->index[(unsigned int)k];
+    while (i < _q->num_rows && waterfallreader_rowheader(_q,i)->timestamp < _t)
+        i++;
+    return i;
+}
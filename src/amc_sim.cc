@@ -0,0 +1,258 @@
+/*
+ * Copyright (c) 2013 Joseph Gaeddert
+ *
+ * This file is part of liquid.
+ *
+ * liquid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * liquid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with liquid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// 
+// amc_sim.cc
+//
+// Exercise the adaptive modulation and coding controller (see
+// include/amc.h) without hardware: OFDM frames are passed through a
+// simulated channel whose SNR fades slowly over time. The receiving
+// end measures the frames and returns a report after each one, which
+// drives the transmitter's controller as it would over the air.
+// Compare the goodput with a fixed table entry using the -F option.
+//
+ 
+#include <math.h>
+#include <iostream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <complex>
+#include <getopt.h>
+#include <liquid/liquid.h>
+
+#include "amc.h"
+#include "trafficgen.h"
+
+void usage() {
+    printf("amc_sim [OPTION]\n");
+    printf("simulate adaptive modulation and coding over a fading channel\n");
+    printf("\n");
+    printf("  u,h   : usage/help\n");
+    printf("  q/v   : quiet/verbose\n");
+    printf("  N     : number of frames,       default: 2000\n");
+    printf("  s     : mean SNR [dB],          default:   15\n");
+    printf("  d     : SNR swing [dB],         default:   10\n");
+    printf("  p     : fading period [frames], default:  500\n");
+    printf("  P     : payload length [bytes], default:  400\n");
+    printf("  M     : number of subcarriers,  default:   64\n");
+    printf("  C     : cyclic prefix length,   default:   16\n");
+    printf("  T     : taper length,           default:    4\n");
+    printf("  H     : hysteresis [dB],        default:    1\n");
+    printf("  F     : fixed table entry (no adaptation)\n");
+}
+
+// simulation state shared with callback
+struct simstate_s {
+    amc controller;                 // AMC controller (transmitter)
+    amc receiver;                   // link-quality measurement (receiver)
+    bool adaptive;                  // update controller?
+    trafficcheck tcheck;            // payload checker
+    unsigned int num_callbacks;     // frames detected
+};
+
+// callback function
+int callback(unsigned char *  _header,
+             int              _header_valid,
+             unsigned char *  _payload,
+             unsigned int     _payload_len,
+             int              _payload_valid,
+             framesyncstats_s _stats,
+             void *           _userdata);
+
+static bool verbose = false;
+
+int main (int argc, char **argv)
+{
+    // command-line options
+    unsigned int num_frames = 2000;     // number of frames to simulate
+    float SNRdB_mean = 15.0f;           // mean SNR [dB]
+    float SNRdB_swing = 10.0f;          // SNR swing [dB]
+    unsigned int period = 500;          // fading period [frames]
+    unsigned int payload_len = 400;     // payload length [bytes]
+    float hysteresis = 1.0f;            // AMC hysteresis [dB]
+    int fixed_index = -1;               // fixed table entry (-1: adaptive)
+
+    // ofdm properties
+    unsigned int M = 64;                // number of subcarriers
+    unsigned int cp_len = 16;           // cyclic prefix length
+    unsigned int taper_len = 4;         // taper length
+
+    //
+    int d;
+    while ((d = getopt(argc,argv,"uhqvN:s:d:p:P:M:C:T:H:F:")) != EOF) {
+        switch (d) {
+        case 'u':
+        case 'h':   usage();                        return 0;
+        case 'q':   verbose     = false;            break;
+        case 'v':   verbose     = true;             break;
+        case 'N':   num_frames  = atoi(optarg);     break;
+        case 's':   SNRdB_mean  = atof(optarg);     break;
+        case 'd':   SNRdB_swing = atof(optarg);     break;
+        case 'p':   period      = atoi(optarg);     break;
+        case 'P':   payload_len = atoi(optarg);     break;
+        case 'M':   M           = atoi(optarg);     break;
+        case 'C':   cp_len      = atoi(optarg);     break;
+        case 'T':   taper_len   = atoi(optarg);     break;
+        case 'H':   hysteresis  = atof(optarg);     break;
+        case 'F':   fixed_index = atoi(optarg);     break;
+        default:    usage();                        return 0;
+        }
+    }
+
+    if (cp_len == 0 || cp_len > M) {
+        fprintf(stderr,"error: %s, cyclic prefix must be in (0,M]\n", argv[0]);
+        exit(1);
+    } else if (period == 0) {
+        fprintf(stderr,"error: %s, fading period must be greater than zero\n", argv[0]);
+        exit(1);
+    }
+
+    // create controller (default table)
+    struct simstate_s state;
+    state.controller    = amc_create(NULL, 0);
+    state.receiver      = amc_create(NULL, 0);
+    state.tcheck        = trafficcheck_create(TRAFFICGEN_DEFAULT_SEED, 8);
+    state.num_callbacks = 0;
+    amc_set_hysteresis(state.controller, hysteresis);
+
+    // fixed entry: select it once; the callback then leaves the
+    // controller untouched
+    if (fixed_index >= (int)amc_get_num_entries(state.controller)) {
+        fprintf(stderr,"error: %s, fixed entry %d out of range\n", argv[0], fixed_index);
+        exit(1);
+    } else if (fixed_index >= 0) {
+        amc_set_index(state.controller, fixed_index);
+    }
+    state.adaptive = fixed_index < 0;
+
+    // create frame generator and synchronizer
+    ofdmflexframegenprops_s fgprops;
+    ofdmflexframegenprops_init_default(&fgprops);
+    fgprops.check = LIQUID_CRC_32;
+    ofdmflexframegen fg = ofdmflexframegen_create(M, cp_len, taper_len, NULL, &fgprops);
+    ofdmflexframesync fs = ofdmflexframesync_create(M, cp_len, taper_len, NULL, callback, (void*)&state);
+
+    // buffers
+    unsigned int symbol_len = M + cp_len;
+    std::complex<float> buffer[symbol_len];
+    unsigned char header[8];
+    unsigned char payload[payload_len];
+    trafficgen tgen = trafficgen_create(TRAFFICGEN_DEFAULT_SEED, 0, 8);
+
+    float noise_floor = -40.0f;                         // noise floor [dB]
+    float nstd = powf(10.0f, noise_floor/20.0f);        // noise standard deviation
+    unsigned long long num_samples = 0;
+    unsigned int i;
+    unsigned int n;
+    for (n=0; n<num_frames; n++) {
+        // channel SNR for this frame
+        float SNRdB = SNRdB_mean + SNRdB_swing*sinf(2*M_PI*(float)n/(float)period);
+        float gamma = powf(10.0f, (SNRdB + noise_floor)/20.0f);
+
+        // select scheme
+        modulation_scheme ms;
+        fec_scheme fec0, fec1;
+        amc_get_scheme(state.controller, &ms, &fec0, &fec1);
+        fgprops.mod_scheme = ms;
+        fgprops.fec0       = fec0;
+        fgprops.fec1       = fec1;
+        ofdmflexframegen_setprops(fg, &fgprops);
+
+        // generate frame and pass through channel, followed by a few
+        // symbols of noise only
+        trafficgen_generate(tgen, header, payload, payload_len);
+        ofdmflexframegen_assemble(fg, header, payload, payload_len);
+        unsigned int num_callbacks = state.num_callbacks;
+        bool last_symbol = false;
+        unsigned int num_tail = 0;
+        while (num_tail < 4) {
+            if (!last_symbol) {
+                last_symbol = ofdmflexframegen_writesymbol(fg, buffer);
+                for (i=0; i<symbol_len; i++)
+                    buffer[i] *= gamma;
+            } else {
+                for (i=0; i<symbol_len; i++)
+                    buffer[i] = 0.0f;
+                num_tail++;
+            }
+            for (i=0; i<symbol_len; i++)
+                buffer[i] += nstd*std::complex<float>(randnf(), randnf())*(float)M_SQRT1_2;
+
+            ofdmflexframesync_execute(fs, buffer, symbol_len);
+            num_samples += symbol_len;
+        }
+
+        // return receiver's report; a frame missed altogether is
+        // noticed by the transmitter itself
+        if (state.adaptive) {
+            unsigned char report[AMC_REPORT_LEN];
+            amc_report_write(state.receiver, report);
+            amc_report_read(state.controller, report);
+            if (state.num_callbacks == num_callbacks)
+                amc_update_lost(state.controller);
+        }
+
+        if (verbose) {
+            printf("frame %5u: snr=%6.2f dB, entry %u, evm=%7.2f dB, per=%5.3f\n",
+                    n, SNRdB, amc_get_index(state.controller),
+                    amc_get_evm(state.controller), amc_get_per(state.controller));
+        }
+    }
+
+    // print results
+    amc_print(state.controller);
+    unsigned long long num_bits = 8ULL*payload_len*trafficcheck_get_num_valid(state.tcheck);
+    printf("    frames sent         : %6u\n", num_frames);
+    printf("    frames detected     : %6u\n", state.num_callbacks);
+    printf("    frames valid        : %6u\n", trafficcheck_get_num_valid(state.tcheck));
+    printf("    goodput             : %8.4f bits/sample\n",
+            num_samples == 0 ? 0.0f : (float)num_bits / (float)num_samples);
+
+    // destroy objects
+    ofdmflexframegen_destroy(fg);
+    ofdmflexframesync_destroy(fs);
+    trafficgen_destroy(tgen);
+    trafficcheck_destroy(state.tcheck);
+    amc_destroy(state.controller);
+    amc_destroy(state.receiver);
+
+    printf("done.\n");
+    return 0;
+}
+
+// callback function
+int callback(unsigned char *  _header,
+             int              _header_valid,
+             unsigned char *  _payload,
+             unsigned int     _payload_len,
+             int              _payload_valid,
+             framesyncstats_s _stats,
+             void *           _userdata)
+{
+    struct simstate_s * state = (struct simstate_s*) _userdata;
+    state->num_callbacks++;
+
+    // check content of generated traffic
+    trafficcheck_execute(state->tcheck, _header, _header_valid, _payload, _payload_len, _payload_valid);
+
+    // measure frame for the report
+    amc_observe(state->receiver, _header_valid, _payload_valid, _stats);
+
+    return 0;
+}
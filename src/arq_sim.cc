@@ -0,0 +1,251 @@
+/*
+ * Copyright (c) 2013 Joseph Gaeddert
+ *
+ * This file is part of liquid.
+ *
+ * liquid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * liquid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with liquid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+//
+// arq_sim.cc
+//
+// Exercise the selective-repeat ARQ (see include/arq.h) without
+// hardware. First a burst is sent with one frame lost in its middle;
+// the lost frame must be retransmitted as soon as the block ack
+// arrives rather than after a timeout. Then two endpoints exchange
+// bursts in turn, as halfduplex_txrx does, over a channel that drops
+// frames at random, and the payloads are checked for in-order
+// delivery. Returns non-zero on failure.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+
+#include "arq.h"
+
+void usage() {
+    printf("arq_sim [OPTION]\n");
+    printf("simulate selective-repeat ARQ over a lossy half-duplex link\n");
+    printf("\n");
+    printf("  u,h   : usage/help\n");
+    printf("  q/v   : quiet/verbose\n");
+    printf("  N     : number of payloads,      default: 2000\n");
+    printf("  w     : window size [frames],    default:    8\n");
+    printf("  p     : frame loss probability,  default:  0.1\n");
+    printf("  t     : turn duration [ms],      default:    5\n");
+    printf("  s     : random seed,             default:    1\n");
+}
+
+#define ARQ_SIM_PAYLOAD_LEN (16)
+
+// receiver state shared with callback
+struct simrx_s {
+    unsigned int num_expected;      // next payload id expected
+    unsigned int num_errors;        // payloads out of order or corrupt
+};
+
+// delivery callback: payloads carry an incrementing id
+void callback(unsigned char * _payload,
+              unsigned int    _payload_len,
+              void *          _userdata);
+
+// write payload with id
+void payload_init(unsigned char * _payload,
+                  unsigned int    _id);
+
+// send burst from one endpoint to another at a single time instant,
+// dropping frames with probability _p, or frame _drop if not negative
+unsigned int send_burst(arq    _tx,
+                        arq    _rx,
+                        double _now,
+                        float  _p,
+                        int    _drop);
+
+// check that a frame lost within a burst is resent on the next ack
+int hole_check(unsigned int _window);
+
+static bool verbose = false;
+
+int main (int argc, char **argv)
+{
+    // command-line options
+    unsigned int num_payloads = 2000;   // number of payloads to deliver
+    unsigned int window = 8;            // ARQ window size
+    float p = 0.1f;                     // frame loss probability
+    float turn = 5e-3f;                 // turn duration [s]
+    unsigned int seed = 1;              // random seed
+
+    //
+    int d;
+    while ((d = getopt(argc,argv,"uhqvN:w:p:t:s:")) != EOF) {
+        switch (d) {
+        case 'u':
+        case 'h':   usage();                            return 0;
+        case 'q':   verbose      = false;               break;
+        case 'v':   verbose      = true;                break;
+        case 'N':   num_payloads = atoi(optarg);        break;
+        case 'w':   window       = atoi(optarg);        break;
+        case 'p':   p            = atof(optarg);        break;
+        case 't':   turn         = 1e-3f*atof(optarg);  break;
+        case 's':   seed         = atoi(optarg);        break;
+        default:    usage();                            return 0;
+        }
+    }
+
+    if (window == 0 || window > ARQ_MAX_WINDOW) {
+        fprintf(stderr,"error: %s, window size must be in [1,%u]\n", argv[0], ARQ_MAX_WINDOW);
+        exit(1);
+    } else if (p < 0.0f || p >= 1.0f) {
+        fprintf(stderr,"error: %s, loss probability must be in [0,1)\n", argv[0]);
+        exit(1);
+    } else if (turn <= 0.0f) {
+        fprintf(stderr,"error: %s, turn duration must be greater than zero\n", argv[0]);
+        exit(1);
+    }
+    srand(seed);
+
+    // lost frame within a burst
+    int hole_ok = hole_check(window);
+    printf("hole check          : %s\n", hole_ok ? "passed" : "FAILED");
+
+    // endpoints: a sends data, b responds with acks
+    struct simrx_s rx = {0, 0};
+    arq a = arq_create(window, ARQ_SIM_PAYLOAD_LEN, NULL,     NULL);
+    arq b = arq_create(window, ARQ_SIM_PAYLOAD_LEN, callback, (void*)&rx);
+    arq_set_rto(a, 4*turn, turn, 100*turn);
+
+    unsigned char payload[ARQ_SIM_PAYLOAD_LEN];
+    unsigned int pid = 0;
+    unsigned int num_turns = 0;
+    unsigned int max_turns = 100*(num_payloads + 10);
+    double now = 0.0;
+    while (rx.num_expected < num_payloads && num_turns < max_turns) {
+        // a: fill window and send burst
+        while (pid < num_payloads && arq_tx_space(a) > 0) {
+            payload_init(payload, pid++);
+            arq_tx_push(a, payload, ARQ_SIM_PAYLOAD_LEN);
+        }
+        unsigned int n = send_burst(a, b, now, p, -1);
+        now += turn;
+
+        // b: respond with block ack
+        send_burst(b, a, now, p, -1);
+        now += turn;
+        num_turns++;
+
+        if (verbose)
+            printf("turn %6u: sent %2u, delivered %6u\n", num_turns, n, rx.num_expected);
+    }
+
+    // print results
+    printf("payloads            : %u\n", num_payloads);
+    printf("delivered in order  : %u\n", rx.num_expected);
+    printf("delivery errors     : %u\n", rx.num_errors);
+    printf("turns               : %u (%.2f per payload)\n", num_turns,
+            num_payloads == 0 ? 0.0f : (float)num_turns / (float)num_payloads);
+    arq_print(a);
+
+    int ok = hole_ok && rx.num_expected == num_payloads && rx.num_errors == 0;
+
+    arq_destroy(a);
+    arq_destroy(b);
+
+    printf("%s.\n", ok ? "done" : "failed");
+    return ok ? 0 : 1;
+}
+
+// delivery callback
+void callback(unsigned char * _payload,
+              unsigned int    _payload_len,
+              void *          _userdata)
+{
+    struct simrx_s * rx = (struct simrx_s*) _userdata;
+
+    unsigned char expected[ARQ_SIM_PAYLOAD_LEN];
+    payload_init(expected, rx->num_expected);
+    if (_payload_len != ARQ_SIM_PAYLOAD_LEN ||
+        memcmp(_payload, expected, ARQ_SIM_PAYLOAD_LEN) != 0)
+    {
+        rx->num_errors++;
+    }
+    rx->num_expected++;
+}
+
+// write payload with id
+void payload_init(unsigned char * _payload,
+                  unsigned int    _id)
+{
+    unsigned int i;
+    for (i=0; i<ARQ_SIM_PAYLOAD_LEN; i++)
+        _payload[i] = (_id >> (8*(i%4))) & 0xff;
+}
+
+// send burst at a single time instant
+unsigned int send_burst(arq    _tx,
+                        arq    _rx,
+                        double _now,
+                        float  _p,
+                        int    _drop)
+{
+    unsigned char header[8];
+    unsigned char payload[ARQ_SIM_PAYLOAD_LEN];
+    unsigned int payload_len;
+    unsigned int n = 0;
+    while (n <= ARQ_MAX_WINDOW &&
+           arq_tx_pop(_tx, _now, header, payload, &payload_len))
+    {
+        int lost = _drop >= 0 ? (int)n == _drop : (float)rand()/(float)RAND_MAX < _p;
+        if (!lost)
+            arq_rx_execute(_rx, _now, header, 1, payload, payload_len, 1);
+        n++;
+    }
+    return n;
+}
+
+// check that a frame lost within a burst is resent on the next ack
+int hole_check(unsigned int _window)
+{
+    if (_window < 3)
+        return 1;
+
+    struct simrx_s rx = {0, 0};
+    arq a = arq_create(_window, ARQ_SIM_PAYLOAD_LEN, NULL,     NULL);
+    arq b = arq_create(_window, ARQ_SIM_PAYLOAD_LEN, callback, (void*)&rx);
+
+    // fill the window and send it as one burst, losing a middle frame
+    unsigned char payload[ARQ_SIM_PAYLOAD_LEN];
+    unsigned int i;
+    for (i=0; i<_window; i++) {
+        payload_init(payload, i);
+        arq_tx_push(a, payload, ARQ_SIM_PAYLOAD_LEN);
+    }
+    unsigned int hole = _window / 2;
+    send_burst(a, b, 0.0, 0.0f, hole);
+
+    // ack arrives well before the timeout
+    double now = 0.1*arq_get_rto(a);
+    send_burst(b, a, now, 0.0f, -1);
+    int ok = rx.num_expected == hole &&
+             arq_tx_next_timeout(a, now) == 0.0f &&
+             send_burst(a, b, now, 0.0f, -1) == 1 &&
+             rx.num_expected == _window &&
+             rx.num_errors == 0 &&
+             arq_get_num_retransmissions(a) == 1;
+
+    arq_destroy(a);
+    arq_destroy(b);
+    return ok;
+}
@@ -28,7 +28,12 @@
 
 #include <uhd/usrp/multi_usrp.hpp>
 
+#include "iqlog.h"
+#include "rateplan.h"
+#include "resampchain.h"
+#include "specmon.h"
 #include "timer.h"
+#include "waterfall.h"
 
 void usage() {
     printf("Usage: asgram_rx [OPTION]\n");
@@ -38,12 +43,18 @@ void usage() {
     printf("  f     : center frequency [Hz], default: 462 MHz\n");
     printf("  b     : bandwidth [Hz],        default: 800 kHz\n");
     printf("  G     : uhd rx gain [dB],      default:  20 dB\n");
-    printf("  n     : FFT size,              default:  64\n");
+    printf("  n     : FFT size,              default: 1024\n");
+    printf("  w     : display width,         default:  64\n");
+    printf("  t     : FFT threads,           default: (number of cores)\n");
+    printf("  m     : display mode,          default: 'w'\n");
+    printf("          w: Welch average, x: max-hold, a: exponential average\n");
     printf("  o     : offset                 default: -65 dB\n");
     printf("  s     : scale                  default:   5 dB\n");
     printf("  r     : FFT rate [Hz],         default:   10 Hz\n");
-    printf("  L     : output file log size,  default: 4096 samples\n");
-    printf("  F     : output filename,       default: 'asgram_rx.dat'\n");
+    printf("  F     : record resampled samples to binary file (see iqlog2octave)\n");
+    printf("  L     : record length [samples], default: (entire run)\n");
+    printf("  R     : RSSI track decimation,  default: 0 (none)\n");
+    printf("  W     : record binary waterfall of Welch estimates to file\n");
 }
 
 // global running flag
@@ -67,27 +78,37 @@ int main (int argc, char **argv)
     float frequency      = 462.0e6;
     float bandwidth      = 800e3f;
     double uhd_rxgain    = 20.0;
-    unsigned int nfft    = 64;
+    unsigned int nfft    = 1024;
+    unsigned int width   = 64;
+    unsigned int num_threads = 0;
+    char mode            = 'w';
     float offset         = -65.0f;
     float scale          = 5.0f;
     float fft_rate       = 10.0f;
-    unsigned int logsize = 4096;
-    char filename[256]   = "asgram_rx.dat";
+    const char * filename = NULL;
+    unsigned long long int log_size = 0;
+    unsigned int rssi_decim = 0;
+    const char * waterfall_filename = NULL;
 
     //
     int d;
-    while ((d = getopt(argc,argv,"hf:b:G:n:s:o:r:L:F:")) != EOF) {
+    while ((d = getopt(argc,argv,"hf:b:G:n:w:t:m:s:o:r:F:L:R:W:")) != EOF) {
         switch (d) {
         case 'h':   usage();                    return 0;
         case 'f':   frequency   = atof(optarg); break;
         case 'b':   bandwidth   = atof(optarg); break;
         case 'G':   uhd_rxgain  = atof(optarg); break;
         case 'n':   nfft        = atoi(optarg); break;
+        case 'w':   width       = atoi(optarg); break;
+        case 't':   num_threads = atoi(optarg); break;
+        case 'm':   mode        = optarg[0];    break;
         case 'o':   offset      = atof(optarg); break;
         case 's':   scale       = atof(optarg); break;
         case 'r':   fft_rate    = atof(optarg); break;
-        case 'L':   logsize     = atoi(optarg); break;
-        case 'F':   strncpy(filename,optarg,255); break;
+        case 'F':   filename    = optarg;       break;
+        case 'L':   log_size    = atoll(optarg);break;
+        case 'R':   rssi_decim  = atoi(optarg); break;
+        case 'W':   waterfall_filename = optarg; break;
         default:    usage();                    return 1;
         }
     }
@@ -96,6 +117,12 @@ int main (int argc, char **argv)
     if (fft_rate <= 0.0f || fft_rate > 100.0f) {
         fprintf(stderr,"error: %s, fft rate must be in (0, 100) Hz\n", argv[0]);
         exit(1);
+    } else if (nfft < 2 || width < 8) {
+        fprintf(stderr,"error: %s, FFT size must be at least 2 and display width at least 8\n", argv[0]);
+        exit(1);
+    } else if (mode != 'w' && mode != 'x' && mode != 'a') {
+        fprintf(stderr,"error: %s, unknown display mode '%c'\n", argv[0], mode);
+        exit(1);
     }
 
     uhd::stream_cmd_t stream_cmd(uhd::stream_cmd_t::STREAM_MODE_START_CONTINUOUS);
@@ -105,14 +132,17 @@ int main (int argc, char **argv)
     uhd::device_addr_t dev_addr;
     uhd::usrp::multi_usrp::sptr usrp = uhd::usrp::multi_usrp::make(dev_addr);
 
-    // try to set rx rate (oversampled to compensate for CIC filter)
-    usrp->set_rx_rate(3.0f * bandwidth);
+    // plan device rate (wide enough that the displayed band lies within
+    // the flat part of the device filters) and resampling for the log
+    rateplan plan = rateplan_create_rx(usrp, bandwidth, 0.45f, 60.0f, 0.0);
+    if (plan == NULL)
+        exit(1);
 
-    // get actual rx rate
+    // try to set rx rate, then resample from the actual rate
+    usrp->set_rx_rate(rateplan_get_device_rate(plan));
     double usrp_rx_rate = usrp->get_rx_rate();
-
-    // compute arbitrary resampling rate (make up the difference in software)
-    double rx_resamp_rate = bandwidth / usrp_rx_rate;
+    resampchain resamp = resampchain_create(plan, usrp_rx_rate);
+    double rx_resamp_rate = resampchain_get_rate(resamp);
 
     usrp->set_rx_freq(frequency);
     usrp->set_rx_gain(uhd_rxgain);
@@ -124,47 +154,80 @@ int main (int argc, char **argv)
             usrp_rx_rate * 1e-3f,
             bandwidth    * 1e-3f,
             1.0f / rx_resamp_rate);
+    rateplan_print(plan);
 
     unsigned int i;
 
-    // add arbitrary resampling component
-    msresamp_crcf resamp = msresamp_crcf_create(rx_resamp_rate, 60.0f);
+    // create streaming sample log (written by background thread)
+    iqlog log = NULL;
+    if (filename != NULL) {
+        log = iqlog_create(filename, bandwidth, frequency, 1, rssi_decim);
+        if (log == NULL)
+            exit(1);
+    }
 
-    // create buffer for sample logging
-    windowcf log = windowcf_create(logsize);
+    // create spectrum monitor at the full usrp rate (50% overlap)
+    specmon q = specmon_create(nfft, nfft/2, num_threads);
+    std::vector<float> psd(nfft);
+    std::vector<float> welch(nfft);
+
+    // FFT bins within the bandwidth, mapped onto the display columns
+    unsigned int bin_min = (unsigned int)(nfft*(0.5 - 0.5*rx_resamp_rate));
+    unsigned int num_bins = (unsigned int)(nfft*rx_resamp_rate);
+    if (num_bins < 1) num_bins = 1;
+    if (bin_min + num_bins > nfft) num_bins = nfft - bin_min;
+
+    // waterfall recording of the bins within the bandwidth
+    waterfall wf = NULL;
+    if (waterfall_filename != NULL) {
+        double rbin = usrp_rx_rate / nfft;
+        wf = waterfall_create(waterfall_filename, num_bins,
+                frequency + (bin_min + 0.5*(num_bins-1) - 0.5*nfft)*rbin,
+                num_bins*rbin,
+                specmon_get_enbw(q)*rbin,
+                -140.0f, 0.5f);
+        if (wf == NULL)
+            exit(1);
+    }
 
-    // create ASCII spectrogram object
+    // ASCII spectrogram
+    const char levels[] = " .,-+*&NM#";
+    unsigned int num_levels = 10;
     float maxval;
     float maxfreq;
-    char ascii[nfft+1];
-    ascii[nfft] = '\0'; // append null character to end of string
-    asgramcf q = asgramcf_create(nfft);
-    asgramcf_set_scale(q, offset, scale);
+    char ascii[width+1];
+    ascii[width] = '\0'; // append null character to end of string
 
     // assemble footer
-    unsigned int footer_len = nfft + 16;
+    unsigned int footer_len = width + 16;
     char footer[footer_len+1];
     for (i=0; i<footer_len; i++)
         footer[i] = ' ';
     footer[1] = '[';
-    footer[nfft/2 + 3] = '+';
-    footer[nfft + 4] = ']';
-    sprintf(&footer[nfft+6], "%8.3f MHz", frequency*1e-6f);
+    footer[width/2 + 3] = '+';
+    footer[width + 4] = ']';
+    sprintf(&footer[width+6], "%8.3f MHz", frequency*1e-6f);
     unsigned int msdelay = 1000 / fft_rate;
     
-    // create/initialize Hamming window
     //allocate recv buffer and metatdata
     uhd::rx_metadata_t md;
     const size_t max_samps_per_packet = usrp->get_device()->get_max_recv_samps_per_packet();
     std::vector<std::complex<float> > buff(max_samps_per_packet);
 
-    // create buffer for arbitrary resamper output
-    std::complex<float> buffer_resamp[(int)(2.0f/rx_resamp_rate) + 64];
+    // create buffer for arbitrary resamper output (entire packet)
+    std::vector<std::complex<float> > buffer_resamp(resampchain_get_max_output(resamp, max_samps_per_packet));
  
     // timer to control asgram output
     timer t1 = timer_create();
     timer_tic(t1);
 
+    // processing throughput
+    unsigned long long int num_samples_rx = 0;  // samples received
+    float dsp_time = 0.0f;                      // time spent processing [s]
+    timer t0 = timer_create();
+    timer t2 = timer_create();
+    timer_tic(t0);
+
     // start data transfer
     usrp->issue_stream_cmd(uhd::stream_cmd_t::STREAM_MODE_START_CONTINUOUS);
     printf("usrp data transfer started\n");
@@ -193,29 +256,56 @@ int main (int argc, char **argv)
             return 1;
         }
 
-        // push data through arbitrary resampler and give to frame synchronizer
-        // TODO : apply bandwidth-dependent gain
-        for (i=0; i<num_rx_samps; i++) {
-            // grab sample from usrp buffer
-            std::complex<float> usrp_sample = buff[i];
+        // hand full-rate samples to the spectrum monitor (copy only)
+        timer_tic(t2);
+        specmon_write(q, &buff.front(), num_rx_samps);
 
-            // push through resampler (one at a time)
+        // resample packet for the sample log
+        if (log != NULL && (log_size == 0 || iqlog_get_num_samples(log) < log_size)) {
             unsigned int nw;
-            msresamp_crcf_execute(resamp, &usrp_sample, 1, buffer_resamp, &nw);
-
-            // push resulting samples into asgram object
-            asgramcf_write(q, buffer_resamp, nw);
-
-            // write samples to log
-            windowcf_write(log, buffer_resamp, nw);
+            resampchain_execute(resamp, &buff.front(), num_rx_samps, &buffer_resamp.front(), &nw);
+            unsigned long long int num_logged = iqlog_get_num_samples(log);
+            if (log_size > 0 && num_logged + nw > log_size)
+                nw = (unsigned int)(log_size - num_logged);
+            iqlog_write(log, &buffer_resamp.front(), nw);
         }
+        dsp_time += timer_toc(t2);
+        num_samples_rx += num_rx_samps;
 
         if (timer_toc(t1) > msdelay*1e-3f) {
             // reset timer
             timer_tic(t1);
 
-            // run the spectrogram
-            asgramcf_execute(q, ascii, &maxval, &maxfreq);
+            // read spectrum estimate (skip if no segment completed yet);
+            // the waterfall always records the Welch estimate
+            float * pw = mode == 'w' ? &psd.front() : (wf != NULL ? &welch.front() : NULL);
+            unsigned int num_averaged = specmon_execute(q, pw,
+                                               mode == 'x' ? &psd.front() : NULL,
+                                               mode == 'a' ? &psd.front() : NULL);
+            if (num_averaged == 0)
+                continue;
+
+            if (wf != NULL)
+                waterfall_write(wf, pw + bin_min, num_averaged);
+
+            // render columns: peak of the bins in each column
+            unsigned int b_max = bin_min;
+            for (i=0; i<width; i++) {
+                unsigned int b0 = bin_min + (i*num_bins)/width;
+                unsigned int b1 = bin_min + ((i+1)*num_bins)/width;
+                if (b1 <= b0) b1 = b0 + 1;
+                float v = psd[b0];
+                unsigned int b;
+                for (b=b0; b<b1; b++) {
+                    if (psd[b] > v) v = psd[b];
+                    if (psd[b] > psd[b_max]) b_max = b;
+                }
+                float level = (v - offset) / scale;
+                unsigned int k = level < 0.0f ? 0 : (unsigned int)level;
+                ascii[i] = levels[k < num_levels ? k : num_levels-1];
+            }
+            maxval  = psd[b_max];
+            maxfreq = ((float)b_max - 0.5f*nfft) / (nfft*rx_resamp_rate);
             
             // print the spectrogram
             printf(" > %s < pk%5.1fdB [%5.2f]\n", ascii, maxval, maxfreq);
@@ -229,34 +319,33 @@ int main (int argc, char **argv)
     printf("\n");
     printf("usrp data transfer complete\n");
 
-    // try to write samples to file
-    FILE * fid = fopen(filename,"w");
-    if (fid != NULL) {
-        // write header
-        fprintf(fid, "# %s : auto-generated file\n", filename);
-        fprintf(fid, "#\n");
-        fprintf(fid, "# num_samples :   %u\n", logsize);
-        fprintf(fid, "# frequency   :   %12.8f MHz\n", frequency*1e-6f);
-        fprintf(fid, "# bandwidth   :   %12.8f kHz\n", bandwidth*1e-3f);
-
-        // save results to file
-        std::complex<float> * rc;   // read pointer
-        windowcf_read(log, &rc);
-        for (i=0; i<logsize; i++)
-            fprintf(fid, "%12.4e %12.4e\n", rc[i].real(), rc[i].imag());
-
-        // close it up
-        fclose(fid);
-        printf("results written to '%s'\n", filename);
-    } else {
-        fprintf(stderr,"error: %s, could not open '%s' for writing\n", argv[0], filename);
+    float runtime = timer_toc(t0);
+    printf("    run time            : %f s\n", runtime);
+    printf("    samples received    : %llu (%.4f Msamples/s)\n", num_samples_rx, num_samples_rx / runtime * 1e-6f);
+    printf("    processing capacity : %.4f Msamples/s (%.1f%% load)\n",
+            dsp_time > 0.0f ? num_samples_rx / dsp_time * 1e-6f : 0.0f,
+            100.0f * dsp_time / runtime);
+
+    // flush and close sample log
+    if (log != NULL) {
+        iqlog_print(log);
+        iqlog_destroy(log);
+        printf("samples written to '%s'\n", filename);
     }
  
     // destroy objects
-    msresamp_crcf_destroy(resamp);
-    windowcf_destroy(log);
-    asgramcf_destroy(q);
+    specmon_print(q);
+    if (wf != NULL) {
+        waterfall_print(wf);
+        waterfall_destroy(wf);
+        printf("waterfall written to '%s'\n", waterfall_filename);
+    }
+    resampchain_destroy(resamp);
+    rateplan_destroy(plan);
+    specmon_destroy(q);
+    timer_destroy(t0);
     timer_destroy(t1);
+    timer_destroy(t2);
 
     return 0;
 }
@@ -21,12 +21,18 @@
 #include <iostream>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <complex>
 #include <getopt.h>
 #include <liquid/liquid.h>
 
 #include <uhd/usrp/multi_usrp.hpp>
 
+#include "trafficgen.h"
+#include "arbwave.h"
+#include "rateplan.h"
+#include "resampchain.h"
+
 void usage() {
     printf("flexframe_tx [OPTION]\n");
     printf("transmit single-carrier packets\n");
@@ -34,11 +40,16 @@ void usage() {
     printf("  u,h   : usage/help\n");
     printf("  q/v   : quiet/verbose\n");
     printf("  f     : center frequency [Hz], default: 462 MHz\n");
-    printf("  b     : bandwidth [Hz] (62.5kHz min, 8MHz max), default: 250 kHz\n");
+    printf("  b     : bandwidth [Hz], default: 250 kHz\n");
     printf("  g     : software tx gain [dB] (default: -6dB)\n");
     printf("  G     : uhd tx gain [dB] (default: 40dB)\n");
     printf("  N     : number of frames, default: 1000\n");
     printf("  P     : payload length [bytes], default: 256\n");
+    printf("  A     : arb mode: render this duration [s] of frames once and loop it\n");
+    printf("  I     : arb mode: load waveform (complex float I/Q at device rate), loop it N times\n");
+    printf("  O     : arb mode: save rendered waveform to file\n");
+    printf("  S     : arb mode: gain step per loop [dB], default: 0\n");
+    printf("  L     : arb mode: number of gain steps before repeating, default: 1\n");
     printf("  m     : modulation scheme (qpsk default)\n");
     liquid_print_modulation_schemes();
     printf("  c     : coding scheme (inner): h74 default\n");
@@ -51,10 +62,6 @@ int main (int argc, char **argv)
     // command-line options
     bool verbose = true;
 
-    unsigned long int DAC_RATE = 64e6;
-    double min_bandwidth = 0.25*(DAC_RATE / 512.0);
-    double max_bandwidth = 0.25*(DAC_RATE /   4.0);
-
     double frequency = 462.0e6;
     double bandwidth = 250e3f;
     unsigned int num_frames = 1000;     // number of frames to transmit
@@ -66,10 +73,17 @@ int main (int argc, char **argv)
     crc_scheme check = LIQUID_CRC_32;       // data validity check
     fec_scheme fec0 = LIQUID_FEC_NONE;      // fec (inner)
     fec_scheme fec1 = LIQUID_FEC_HAMMING128;// fec (outer)
+
+    // arbitrary waveform mode
+    float arb_seconds = 0.0f;           // rendered duration (0: off)
+    char arb_filename_in[256]  = "";    // waveform to load
+    char arb_filename_out[256] = "";    // rendered waveform to save
+    float arb_step_dB = 0.0f;           // gain step per loop
+    unsigned int arb_num_steps = 1;     // gain steps before repeating
     
     //
     int d;
-    while ((d = getopt(argc,argv,"uhqvf:b:g:G:N:P:m:c:k:")) != EOF) {
+    while ((d = getopt(argc,argv,"uhqvf:b:g:G:N:P:m:c:k:A:I:O:S:L:")) != EOF) {
         switch (d) {
         case 'u':
         case 'h':   usage();                        return 0;
@@ -81,6 +95,11 @@ int main (int argc, char **argv)
         case 'G':   uhd_txgain  = atof(optarg);     break;
         case 'N':   num_frames  = atoi(optarg);     break;
         case 'P':   payload_len = atoi(optarg);     break;
+        case 'A':   arb_seconds = atof(optarg);             break;
+        case 'I':   strncpy(arb_filename_in,optarg,255);    break;
+        case 'O':   strncpy(arb_filename_out,optarg,255);   break;
+        case 'S':   arb_step_dB = atof(optarg);             break;
+        case 'L':   arb_num_steps = atoi(optarg);           break;
         case 'm':
             ms = liquid_getopt_str2mod(optarg);
             if (ms == LIQUID_MODEM_UNKNOWN) {
@@ -110,11 +129,11 @@ int main (int argc, char **argv)
         }
     }
 
-    if (bandwidth > max_bandwidth) {
-        fprintf(stderr,"error: %s, maximum bandwidth exceeded (%8.4f MHz)\n", argv[0], max_bandwidth*1e-6);
-        return 0;
-    } else if (bandwidth < min_bandwidth) {
-        fprintf(stderr,"error: %s, minimum bandwidth exceeded (%8.4f kHz)\n", argv[0], min_bandwidth*1e-3);
+    if (bandwidth <= 0) {
+        fprintf(stderr,"error: %s, bandwidth must be greater than zero\n", argv[0]);
+        exit(1);
+    } else if (arb_num_steps < 1) {
+        fprintf(stderr,"error: %s, number of gain steps must be at least 1\n", argv[0]);
         exit(1);
     }
 
@@ -123,31 +142,17 @@ int main (int argc, char **argv)
     //dev_addr["addr1"] = "192.168.10.3";
     uhd::usrp::multi_usrp::sptr usrp = uhd::usrp::multi_usrp::make(dev_addr);
 
-    // set properties
-    double tx_rate = 4.0*bandwidth;
-
-    // NOTE : the sample rate computation MUST be in double precision so
-    //        that the UHD can compute its interpolation rate properly
-    unsigned int interp_rate = (unsigned int)(DAC_RATE / tx_rate);
-    // ensure multiple of 4
-    interp_rate = (interp_rate >> 2) << 2;
-    // NOTE : there seems to be a bug where if the interp rate is equal to
-    //        240 or 244 we get some weird warning saying that
-    //        "The hardware does not support the requested TX sample rate"
-    while (interp_rate == 240 || interp_rate == 244)
-        interp_rate -= 4;
-    // compute usrp sampling rate
-    double usrp_tx_rate = DAC_RATE / (double)interp_rate;
-    
-    // try to set tx rate
-    usrp->set_tx_rate(DAC_RATE / interp_rate);
-
-    // get actual tx rate
-    usrp_tx_rate = usrp->get_tx_rate();
+    // plan device rate (among those the device supports) and
+    // resampling up from two samples per symbol
+    double tx_rate = 2.0*bandwidth;
+    rateplan plan = rateplan_create_tx(usrp, tx_rate, RATEPLAN_PASSBAND, 60.0f, 0.0);
+    if (plan == NULL)
+        exit(1);
 
-    //usrp_tx_rate = 262295.081967213;
-    // compute arbitrary resampling rate
-    double tx_resamp_rate = usrp_tx_rate / tx_rate;
+    // try to set tx rate, then resample to the actual rate
+    usrp->set_tx_rate(rateplan_get_device_rate(plan));
+    double usrp_tx_rate = usrp->get_tx_rate();
+    resampchain resamp = resampchain_create(plan, usrp_tx_rate);
 
     usrp->set_tx_freq(frequency);
     usrp->set_tx_gain(uhd_txgain);
@@ -156,25 +161,22 @@ int main (int argc, char **argv)
     printf("bandwidth   :   %12.8f [kHz]\n", bandwidth*1e-3f);
     printf("verbosity   :   %s\n", (verbose?"enabled":"disabled"));
 
-    printf("sample rate :   %12.8f kHz = %12.8f * %8.6f (interp %u)\n",
+    printf("sample rate :   %12.8f kHz = %12.8f * %8.6f\n",
             tx_rate * 1e-3f,
             usrp_tx_rate * 1e-3f,
-            1.0 / tx_resamp_rate,
-            interp_rate);
+            1.0 / resampchain_get_rate(resamp));
+    rateplan_print(plan);
 
     // set the IF filter bandwidth
     //usrp->set_tx_bandwidth(2.0f*tx_rate);
 
-    // add arbitrary resampling component
-    // TODO : check that resampling rate does indeed correspond to proper bandwidth
-    msresamp_crcf resamp = msresamp_crcf_create(2.0*tx_resamp_rate, 60.0f);
-
     // transmitter gain (linear)
     float g = powf(10.0f, txgain_dB/20.0f);
 
     // data arrays
     unsigned char header[14];
     unsigned char payload[payload_len];
+    trafficgen tgen = trafficgen_create(TRAFFICGEN_DEFAULT_SEED, 0, 14);
     
     // create frame generator
     flexframegenprops_s fgprops;
@@ -191,7 +193,7 @@ int main (int argc, char **argv)
     std::complex<float> buf_frame[buf_len]; // frame buffer
 
     // create buffer for arbitrary resamper output
-    std::complex<float> buf_resamp[(int)(buf_len*tx_resamp_rate) + 64];
+    std::vector<std::complex<float> > buf_resamp(resampchain_get_max_output(resamp, buf_len));
 
     // vector buffer to send data to USRP
     std::vector<std::complex<float> > usrp_buffer(256);
@@ -203,24 +205,69 @@ int main (int argc, char **argv)
     md.end_of_burst   = false;  // 
     md.has_time_spec  = false;  // set to false to send immediately
 
-    unsigned int j;
+    // arbitrary waveform mode: render (or load) once, then loop; N
+    // counts frames rounded up to whole loops (loops for a loaded file)
+    arbwave arb = NULL;
+    unsigned int arb_frames = 0;    // frames per loop
+    if (arb_filename_in[0] != '\0') {
+        arb = arbwave_create_from_file(arb_filename_in);
+        if (arb == NULL)
+            exit(1);
+    } else if (arb_seconds > 0.0f) {
+        // whole frames at baseband make up one period
+        std::vector<std::complex<float> > arb_frame;
+        while (arb_frame.size() < arb_seconds * tx_rate) {
+            flexframegen_reset(fg);
+            trafficgen_generate(tgen, header, payload, payload_len);
+            flexframegen_assemble(fg, header, payload, payload_len);
+            int frame_complete = 0;
+            while (!frame_complete) {
+                frame_complete = flexframegen_write_samples(fg, buf_frame, buf_len);
+                arb_frame.insert(arb_frame.end(), buf_frame, buf_frame + buf_len);
+            }
+            arb_frames++;
+        }
+
+        // pad with zeros to a period which wraps exactly at the device rate
+        unsigned int arb_len = resampchain_get_period(resamp, arb_frame.size());
+        if (arb_len == 0) {
+            fprintf(stderr,"error: %s, no waveform period near %.6f s wraps exactly at %.4f kHz; try another duration or bandwidth\n",
+                    argv[0], arb_frame.size() / tx_rate, usrp_tx_rate*1e-3);
+            exit(1);
+        }
+        arb_frame.resize(arb_len, 0.0f);
+        arb = arbwave_create_periodic(resamp, &arb_frame.front(), arb_frame.size());
+    }
+    unsigned int arb_num_loops = 0;
+    if (arb != NULL) {
+        arbwave_set_gain(arb, txgain_dB, arb_step_dB, arb_num_steps);
+        if (arb_filename_out[0] != '\0' && arbwave_save(arb, arb_filename_out) == 0)
+            printf("waveform written to '%s'\n", arb_filename_out);
+        arbwave_print(arb);
+        arb_num_loops = arb_frames > 0 ? (num_frames + arb_frames - 1) / arb_frames : num_frames;
+    }
+
+    // arbitrary waveform mode: stream precomputed samples
+    std::vector<std::complex<float> > arb_buffer(arb == NULL ? 0 : 4096);
+    while (arb != NULL && arbwave_get_num_loops(arb) < arb_num_loops) {
+        unsigned int n = arbwave_read(arb, &arb_buffer.front(), arb_buffer.size());
+        usrp->get_device()->send(
+            &arb_buffer.front(), n, md,
+            uhd::io_type_t::COMPLEX_FLOAT32,
+            uhd::device::SEND_MODE_FULL_BUFF
+        );
+    }
+
     unsigned int pid;
-    for (pid=0; pid<num_frames; pid++) {
+    for (pid=0; arb == NULL && pid<num_frames; pid++) {
         // reset frame generator (resets pilot generator, etc.)
         flexframegen_reset(fg);
 
         if (verbose)
             printf("tx packet id: %6u\n", pid);
         
-        // write header (first two bytes packet ID, remaining are random)
-        header[0] = (pid >> 8) & 0xff;
-        header[1] = (pid     ) & 0xff;
-        for (j=2; j<14; j++)
-            header[j] = rand() & 0xff;
-
-        // initialize payload
-        for (j=0; j<payload_len; j++)
-            payload[j] = rand() & 0xff;
+        // write header (packet ID, sequence) and pseudo-random payload
+        trafficgen_generate(tgen, header, payload, payload_len);
 
         // assemble frame
         flexframegen_assemble(fg, header, payload, payload_len);
@@ -234,7 +281,7 @@ int main (int argc, char **argv)
 
             // run frame samples through resampler
             unsigned int nw;    // number of samples output from resampler
-            msresamp_crcf_execute(resamp, buf_frame, buf_len, buf_resamp, &nw);
+            resampchain_execute(resamp, buf_frame, buf_len, &buf_resamp.front(), &nw);
 
             // for each output sample, stuff into USRP buffer
             unsigned int n;
@@ -277,8 +324,14 @@ int main (int argc, char **argv)
     printf("usrp data transfer complete\n");
 
     // delete allocated objects
+    if (arb != NULL) {
+        arbwave_print(arb);
+        arbwave_destroy(arb);
+    }
     flexframegen_destroy(fg);
-    msresamp_crcf_destroy(resamp);
+    resampchain_destroy(resamp);
+    rateplan_destroy(plan);
+    trafficgen_destroy(tgen);
 
     return 0;
 }
@@ -28,7 +28,18 @@
 
 #include <uhd/usrp/multi_usrp.hpp>
 
+#include "amc.h"
+#include "rateplan.h"
+#include "resampchain.h"
+#include "rxclock.h"
 #include "timer.h"
+#include "trafficgen.h"
+
+// receiver block length [usrp samples]: samples are resampled and
+// synchronized a block at a time, and frame timestamps resolve to the
+// end of the block in which the frame was detected. Timestamps are
+// printed only when verbose, which processes one sample at a time.
+#define RX_BLOCK_LEN    (256)
 
 void usage() {
     printf("fullduplex_txrx [OPTION]\n");
@@ -52,6 +63,7 @@ void usage() {
     printf("  c     : coding scheme (inner),    default: h128\n");
     printf("  k     : coding scheme (outer),    default: none\n");
     liquid_print_fec_schemes();
+    printf("  a     : adaptive modulation and coding (ignores m,c,k; peer must also use -a)\n");
 }
 
 // threads
@@ -87,6 +99,21 @@ unsigned int num_valid_headers_received;
 unsigned int num_valid_packets_received;
 unsigned int num_valid_bytes_received;
 
+// generated traffic checker
+trafficcheck tcheck = NULL;
+
+// adaptive modulation and coding controller (NULL if disabled); the
+// receiver measures the peer's frames and reads the peer's reports on
+// ours, the transmitter appends our report to each payload
+amc controller = NULL;
+
+// receive timestamps: device time of samples at the usrp rate, and the
+// end of the block being synchronized within the current packet
+rxclock      rx_clock = NULL;
+unsigned int rx_offset;
+unsigned int rx_frame_overhead;     // preamble and header symbols per frame
+unsigned int rx_M_data;             // number of data subcarriers
+
 // receiver callback function
 int callback(unsigned char *  _header,
              int              _header_valid,
@@ -100,7 +127,7 @@ int main (int argc, char **argv)
 {
     //
     int d;
-    while ((d = getopt(argc,argv,"hvqf:o:Rb:g:G:N:M:C:T:P:m:c:k:")) != EOF) {
+    while ((d = getopt(argc,argv,"hvqf:o:Rb:g:G:N:M:C:T:P:m:c:k:a")) != EOF) {
         switch (d) {
         case 'h':   usage();                        return 0;
         case 'v':   verbose     = true;             break;
@@ -119,6 +146,7 @@ int main (int argc, char **argv)
         case 'm':   ms          = liquid_getopt_str2mod(optarg);    break;
         case 'c':   fec0        = liquid_getopt_str2fec(optarg);    break;
         case 'k':   fec1        = liquid_getopt_str2fec(optarg);    break;
+        case 'a':   controller  = amc_create(NULL, 0);              break;
         default:    usage();                        return 0;
         }
     }
@@ -158,6 +186,11 @@ int main (int argc, char **argv)
     pthread_join(tx_process, &status);
     pthread_join(rx_process, &status);
 
+    if (controller != NULL) {
+        amc_print(controller);
+        amc_destroy(controller);
+    }
+
     //
     printf("main process complete.\n");
 
@@ -175,14 +208,15 @@ void * tx_worker(void * _args)
     //dev_addr["addr1"] = "192.168.10.3";
     uhd::usrp::multi_usrp::sptr usrp = uhd::usrp::multi_usrp::make(dev_addr);
 
-    // try to set tx rate (oversampled to compensate for CIC filter)
-    usrp->set_tx_rate(3.0f * bandwidth);
+    // plan device rate and resampling up from the OFDM sample rate
+    rateplan plan = rateplan_create_tx(usrp, bandwidth, RATEPLAN_PASSBAND, 60.0f, 0.0);
+    if (plan == NULL)
+        exit(1);
 
-    // get actual tx rate
+    // try to set tx rate, then resample to the actual rate
+    usrp->set_tx_rate(rateplan_get_device_rate(plan));
     double usrp_tx_rate = usrp->get_tx_rate();
-
-    // compute arbitrary resampling rate (make up the difference in software)
-    double tx_resamp_rate = usrp_tx_rate / bandwidth;
+    resampchain resamp = resampchain_create(plan, usrp_tx_rate);
 
     usrp->set_tx_freq(tx_frequency);
     usrp->set_tx_gain(uhd_txgain);
@@ -194,20 +228,19 @@ void * tx_worker(void * _args)
     printf("usrp sample rate:   %10.4f kHz = %10.4f kHz * %8.6f\n",
             usrp_tx_rate * 1e-3f,
             bandwidth    * 1e-3f,
-            tx_resamp_rate);
+            resampchain_get_rate(resamp));
+    rateplan_print(plan);
 
     // set the IF filter bandwidth
     //usrp->set_tx_bandwidth(2.0f*bandwidth);
 
-    // add arbitrary resampling component
-    msresamp_crcf resamp = msresamp_crcf_create(tx_resamp_rate, 60.0f);
-
     // transmitter gain (linear)
     float g = powf(10.0f, txgain_dB/20.0f);
 
     // data arrays
     unsigned char header[8];
-    unsigned char payload[payload_len];
+    unsigned char payload[payload_len + AMC_REPORT_LEN];
+    trafficgen tgen = trafficgen_create(TRAFFICGEN_DEFAULT_SEED, 0, 8);
     
     // create frame generator (default subcarrier allocation)
     ofdmflexframegenprops_s fgprops;
@@ -224,7 +257,7 @@ void * tx_worker(void * _args)
     std::complex<float> ofdm_symbol[symbol_len]; // output time series of each symbol
 
     // create buffer for arbitrary resamper output
-    std::complex<float> buffer_resamp[(int)(2*tx_resamp_rate) + 64];
+    std::vector<std::complex<float> > buffer_resamp(resampchain_get_max_output(resamp, 1));
 
     // vector buffer to send data to USRP
     std::vector<std::complex<float> > usrp_buffer(256);
@@ -246,18 +279,31 @@ void * tx_worker(void * _args)
         if (verbose)
             printf("tx packet id: %6u\n", pid);
         
-        // write header (first two bytes packet ID, remaining are random)
-        header[0] = (pid >> 8) & 0xff;
-        header[1] = (pid     ) & 0xff;
-        for (j=2; j<8; j++)
-            header[j] = rand() & 0xff;
-
-        // initialize payload
-        for (j=0; j<payload_len; j++)
-            payload[j] = rand() & 0xff;
+        // write header (packet ID, sequence) and pseudo-random payload
+        trafficgen_generate(tgen, header, payload, payload_len);
+
+        // select scheme from the peer's last report and append ours
+        unsigned int frame_len = payload_len;
+        if (controller != NULL) {
+            amc_report_write(controller, payload + payload_len);
+            frame_len += AMC_REPORT_LEN;
+
+            modulation_scheme ms_amc;
+            fec_scheme fec0_amc, fec1_amc;
+            amc_get_scheme(controller, &ms_amc, &fec0_amc, &fec1_amc);
+            if (fgprops.mod_scheme != ms_amc   ||
+                fgprops.fec0       != fec0_amc ||
+                fgprops.fec1       != fec1_amc)
+            {
+                fgprops.mod_scheme = ms_amc;
+                fgprops.fec0       = fec0_amc;
+                fgprops.fec1       = fec1_amc;
+                ofdmflexframegen_setprops(fg, &fgprops);
+            }
+        }
 
         // assemble frame
-        ofdmflexframegen_assemble(fg, header, payload, payload_len);
+        ofdmflexframegen_assemble(fg, header, payload, frame_len);
 
         // generate a single OFDM frame
         int last_symbol=0;
@@ -278,7 +324,7 @@ void * tx_worker(void * _args)
             for (j=0; j<symbol_len; j++) {
                 // resample OFDM symbol one sample at a time
                 unsigned int nw;    // number of samples output from resampler
-                msresamp_crcf_execute(resamp, &ofdm_symbol[j], 1, buffer_resamp, &nw);
+                resampchain_execute(resamp, &ofdm_symbol[j], 1, &buffer_resamp.front(), &nw);
 
                 // for each output sample, stuff into USRP buffer
                 unsigned int n;
@@ -320,7 +366,9 @@ void * tx_worker(void * _args)
 
     // delete allocated objects
     ofdmflexframegen_destroy(fg);
-    msresamp_crcf_destroy(resamp);
+    resampchain_destroy(resamp);
+    rateplan_destroy(plan);
+    trafficgen_destroy(tgen);
     
     // finished
     printf("tx worker finished\n");
@@ -344,14 +392,16 @@ void * rx_worker(void * _args)
     uhd::device_addr_t dev_addr;
     uhd::usrp::multi_usrp::sptr usrp = uhd::usrp::multi_usrp::make(dev_addr);
 
-    // try to set rx rate (oversampled to compensate for CIC filter)
-    usrp->set_rx_rate(3.0f * bandwidth);
+    // plan device rate and resampling down to the OFDM sample rate
+    rateplan plan = rateplan_create_rx(usrp, bandwidth, RATEPLAN_PASSBAND, 60.0f, 0.0);
+    if (plan == NULL)
+        exit(1);
 
-    // get actual rx rate
+    // try to set rx rate, then resample from the actual rate
+    usrp->set_rx_rate(rateplan_get_device_rate(plan));
     double usrp_rx_rate = usrp->get_rx_rate();
-
-    // compute arbitrary resampling rate (make up the difference in software)
-    double rx_resamp_rate = bandwidth / usrp_rx_rate;
+    resampchain resamp = resampchain_create(plan, usrp_rx_rate);
+    double rx_resamp_rate = resampchain_get_rate(resamp);
 
     usrp->set_rx_freq(rx_frequency);
     usrp->set_rx_gain(uhd_rxgain);
@@ -364,6 +414,7 @@ void * rx_worker(void * _args)
             usrp_rx_rate * 1e-3f,
             bandwidth    * 1e-3f,
             1.0f / rx_resamp_rate);
+    rateplan_print(plan);
 
     // set run time appropriately
     if (num_seconds < 0) {
@@ -373,12 +424,6 @@ void * rx_worker(void * _args)
         printf("run time        :   %f seconds\n", num_seconds);
     }
 
-    // add arbitrary resampling component
-    msresamp_crcf resamp = msresamp_crcf_create(rx_resamp_rate, 60.0f);
-
-    unsigned int block_len = 64;
-    assert( (block_len % 2) == 0);  // ensure block length is even
-
     //allocate recv buffer and metatdata
     uhd::rx_metadata_t md;
     const size_t max_samps_per_packet = usrp->get_device()->get_max_recv_samps_per_packet();
@@ -394,9 +439,23 @@ void * rx_worker(void * _args)
     usrp->issue_stream_cmd(uhd::stream_cmd_t::STREAM_MODE_START_CONTINUOUS);
     printf("usrp data transfer started\n");
  
-    // create buffer for arbitrary resamper output
-    std::complex<float> buffer_resamp[(int)(2.0f/rx_resamp_rate) + 64];
+    // create buffer for arbitrary resamper output (one block)
+    std::vector<std::complex<float> > buffer_resamp(resampchain_get_max_output(resamp, RX_BLOCK_LEN));
+
+    // processing throughput
+    unsigned long long int num_samples_rx = 0;  // samples received
+    float dsp_time = 0.0f;                      // time spent processing [s]
+    timer t1 = timer_create();
+
+    // count samples at the usrp rate; the resampler delay is given in
+    // output samples
+    rx_clock = rxclock_create(usrp_rx_rate);
+    rxclock_set_delay(rx_clock, resampchain_get_delay(resamp) / rx_resamp_rate);
+    rx_frame_overhead = rxclock_ofdmflexframe_overhead(M, cp_len, taper_len, NULL, &rx_M_data);
  
+    // create traffic checker
+    tcheck = trafficcheck_create(TRAFFICGEN_DEFAULT_SEED, 8);
+
     // reset counters
     num_frames_detected=0;
     num_valid_headers_received=0;
@@ -428,20 +487,27 @@ void * rx_worker(void * _args)
             //return 1;
         }
 
-        // push data through arbitrary resampler and give to frame synchronizer
+        // timestamp block (re-anchors only on discontinuities)
+        if (md.has_time_spec)
+            rxclock_sync(rx_clock, md.time_spec.get_real_secs());
+
+        // push data through arbitrary resampler and give to frame
+        // synchronizer, a block at a time
         // TODO : apply bandwidth-dependent gain
-        unsigned int j;
-        for (j=0; j<num_rx_samps; j++) {
-            // grab sample from usrp buffer
-            std::complex<float> usrp_sample = buff[j];
+        timer_tic(t1);
+        unsigned int block_len = verbose ? 1 : RX_BLOCK_LEN;
+        unsigned int i;
+        for (i=0; i<num_rx_samps; i+=block_len) {
+            unsigned int n = num_rx_samps - i < block_len ? num_rx_samps - i : block_len;
+            rx_offset = i + n;
 
-            // push through resampler (one at a time)
             unsigned int nw;
-            msresamp_crcf_execute(resamp, &usrp_sample, 1, buffer_resamp, &nw);
-
-            // push resulting samples through synchronizer
-            ofdmflexframesync_execute(fs, buffer_resamp, nw);
+            resampchain_execute(resamp, &buff[i], n, &buffer_resamp.front(), &nw);
+            ofdmflexframesync_execute(fs, &buffer_resamp.front(), nw);
         }
+        rxclock_advance(rx_clock, num_rx_samps);
+        dsp_time += timer_toc(t1);
+        num_samples_rx += num_rx_samps;
 
         // check runtime
         if (timer_toc(t0) >= num_seconds)
@@ -470,15 +536,24 @@ void * rx_worker(void * _args)
     printf("    bytes received      : %6u\n", num_valid_bytes_received);
     printf("    run time            : %f s\n", runtime);
     printf("    data rate           : %8.4f kbps\n", data_rate*1e-3f);
+    printf("    samples received    : %llu (%.4f Msamples/s)\n", num_samples_rx, num_samples_rx / runtime * 1e-6f);
+    printf("    processing capacity : %.4f Msamples/s (%.1f%% load)\n",
+            dsp_time > 0.0f ? num_samples_rx / dsp_time * 1e-6f : 0.0f,
+            100.0f * dsp_time / runtime);
+    trafficcheck_print(tcheck, runtime);
 
     // export debugging file
     if (debug_enabled)
         ofdmflexframesync_debug_print(fs, "ofdmflexframesync_debug.m");
 
     // destroy objects
-    msresamp_crcf_destroy(resamp);
+    trafficcheck_destroy(tcheck);
+    resampchain_destroy(resamp);
+    rateplan_destroy(plan);
     ofdmflexframesync_destroy(fs);
+    rxclock_destroy(rx_clock);
     timer_destroy(t0);
+    timer_destroy(t1);
 
     // finished
     printf("rx worker finished\n");
@@ -500,7 +575,15 @@ int callback(unsigned char *  _header,
         // compute true carrier offset
         double samplerate = *((double*)_userdata);
         float cfo = _stats.cfo * samplerate / (2*M_PI);
-        printf("***** rssi=%7.2fdB evm=%7.2fdB, cfo=%7.3f kHz, ", _stats.rssi, _stats.evm, cfo*1e-3f);
+
+        // the frame ended within the current block; step back by its
+        // duration at the resampled rate
+        unsigned int frame_len = rxclock_ofdmflexframe_len(M, cp_len, rx_M_data, rx_frame_overhead,
+                                                           _stats, _payload_len);
+        double t = rxclock_get_time(rx_clock, rxclock_get_index(rx_clock) + rx_offset);
+        if (t >= 0.0) t -= frame_len / samplerate;
+
+        printf("***** t=%12.6f s, rssi=%7.2fdB evm=%7.2fdB, cfo=%7.3f kHz, ", t, _stats.rssi, _stats.evm, cfo*1e-3f);
 
         if (_header_valid) {
             unsigned int packet_id = (_header[0] << 8 | _header[1]);
@@ -513,6 +596,20 @@ int callback(unsigned char *  _header,
     } else {
     }
 
+    // measure frame for our report and strip the peer's report from
+    // the payload
+    if (controller != NULL) {
+        amc_observe(controller, _header_valid, _payload_valid, _stats);
+        if (_header_valid && _payload_len > AMC_REPORT_LEN) {
+            _payload_len -= AMC_REPORT_LEN;
+            if (_payload_valid)
+                amc_report_read(controller, _payload + _payload_len);
+        }
+    }
+
+    // check content of generated traffic
+    trafficcheck_execute(tcheck, _header, _header_valid, _payload, _payload_len, _payload_valid);
+
     // update global counters
     num_frames_detected++;
 
@@ -20,6 +20,7 @@
 
 #include <iostream>
 #include <complex>
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <sys/resource.h>
@@ -28,6 +29,11 @@
 #include <uhd/usrp/multi_usrp.hpp>
  
 #include "timer.h"
+#include "packetlog.h"
+#include "rateplan.h"
+#include "resampchain.h"
+#include "chunkdecoder.h"
+#include "trafficgen.h"
 
 static bool verbose;
 static unsigned int num_packets_received;
@@ -37,6 +43,12 @@ static unsigned int num_bytes_received;
 
 static float SNRdB_av;
 
+// binary packet log (optional)
+static packetlog plog = NULL;
+
+// generated traffic checker
+static trafficcheck tcheck = NULL;
+
 static int callback(unsigned char *  _header,
                     int              _header_valid,
                     unsigned char *  _payload,
@@ -46,6 +58,14 @@ static int callback(unsigned char *  _header,
                     void *           _userdata)
 {
     num_packets_received++;
+
+    // log frame
+    if (plog != NULL)
+        packetlog_write(plog, 0, _header, _header_valid, _payload, _payload_len, _payload_valid, _stats);
+
+    // check content of generated traffic
+    trafficcheck_execute(tcheck, _header, _header_valid, _payload, _payload_len, _payload_valid);
+
     if (verbose) {
         printf("********* callback invoked, ");
         printf("evm=%5.1fdB, ", _stats.evm);
@@ -76,12 +96,42 @@ static int callback(unsigned char *  _header,
     return 0;
 }
 
+// offline decoding: synchronizer hooks
+void * offline_create(framesync_callback _callback,
+                      void **            _userdata,
+                      void *             _context)
+{
+    return gmskframesync_create(_callback, _userdata[0]);
+}
+
+void offline_reset(void * _fs)
+{
+    gmskframesync_reset((gmskframesync)_fs);
+}
+
+void offline_execute(void * _fs, std::complex<float> * _x, unsigned int _n)
+{
+    gmskframesync_execute((gmskframesync)_fs, _x, _n);
+}
+
+void offline_destroy(void * _fs)
+{
+    gmskframesync_destroy((gmskframesync)_fs);
+}
+
 void usage() {
     printf("gmskframe_tx:\n");
     printf("  f     :   center frequency [Hz]\n");
     printf("  b     :   bandwidth [Hz]\n");
     printf("  t     :   run time [seconds]\n");
     printf("  G     :   uhd rx gain [dB] (default: 20dB)\n");
+    printf("  o     :   binary packet log filename, default: (none)\n");
+    printf("  p     :   save payloads in packet log\n");
+    printf("  i     :   decode complex float I/Q file (offline) instead of usrp\n");
+    printf("  P     :   offline decoding threads, default: (number of cores)\n");
+    printf("  D     :   decimation threads, default: 1 (0: number of cores)\n");
+    printf("  R     :   minimum device rate [Hz], or 'max' for the highest\n");
+    printf("            (e.g. -R max -D 0 decimates from the full device rate)\n");
     printf("  q     :   quiet\n");
     printf("  v     :   verbose\n");
     printf("  u,h   :   usage/help\n");
@@ -91,24 +141,31 @@ int main (int argc, char **argv)
 {
     // command-line options
     verbose = true;
-    unsigned long int ADC_RATE = 64e6;
-
-    float min_bandwidth = 0.25f*(ADC_RATE / 256.0);
-    float max_bandwidth = 0.25f*(ADC_RATE /   4.0);
-
     float frequency = 462.0e6;
     float bandwidth = 100e3;
     float num_seconds = 5.0f;
     double uhd_rxgain = 20.0;
+    char log_filename[256] = "";        // binary packet log filename
+    int log_payloads = 0;               // save payloads in packet log?
+    char input_filename[256] = "";      // offline input file (complex float)
+    unsigned int num_threads = 0;       // offline decoding threads
+    unsigned int num_decim_threads = 1; // front-end decimation threads
+    double device_min = 0.0;            // minimum device rate (0: lowest)
 
     //
     int d;
-    while ((d = getopt(argc,argv,"f:b:t:G:qvuh")) != EOF) {
+    while ((d = getopt(argc,argv,"f:b:t:G:o:pi:P:D:R:qvuh")) != EOF) {
         switch (d) {
         case 'f':   frequency = atof(optarg);       break;
         case 'b':   bandwidth = atof(optarg);       break;
         case 't':   num_seconds = atof(optarg);     break;
         case 'G':   uhd_rxgain = atof(optarg);      break;
+        case 'o':   strncpy(log_filename,optarg,255); break;
+        case 'p':   log_payloads = 1;               break;
+        case 'i':   strncpy(input_filename,optarg,255); break;
+        case 'P':   num_threads = atoi(optarg);     break;
+        case 'D':   num_decim_threads = atoi(optarg); break;
+        case 'R':   device_min = strcmp(optarg,"max") == 0 ? HUGE_VAL : atof(optarg); break;
         case 'q':   verbose = false;                break;
         case 'v':   verbose = true;                 break;
         case 'u':
@@ -119,11 +176,8 @@ int main (int argc, char **argv)
         }
     }
 
-    if (bandwidth > max_bandwidth) {
-        printf("error: maximum bandwidth exceeded (%8.4f MHz)\n", max_bandwidth*1e-6);
-        return 0;
-    } else if (bandwidth < min_bandwidth) {
-        printf("error: minimum bandwidth exceeded (%8.4f kHz)\n", min_bandwidth*1e-3);
+    if (bandwidth <= 0) {
+        printf("error: bandwidth must be greater than zero\n");
         return 0;
     }
 
@@ -131,6 +185,62 @@ int main (int argc, char **argv)
     printf("bandwidth   :   %12.8f [kHz]\n", bandwidth*1e-3f);
     printf("verbosity   :   %s\n", (verbose?"enabled":"disabled"));
 
+    num_packets_received = 0;
+    num_valid_packets_received = 0;
+    num_valid_headers_received = 0;
+    num_bytes_received = 0;
+    SNRdB_av = 0.0f;
+
+    // create traffic checker
+    tcheck = trafficcheck_create(TRAFFICGEN_DEFAULT_SEED, 8);
+
+    // create binary packet log
+    if (log_filename[0] != '\0') {
+        plog = packetlog_create(log_filename, 8, log_payloads);
+        if (plog == NULL)
+            exit(1);
+    }
+
+    // offline mode: decode recorded samples (taken at two samples per symbol)
+    // in overlapping chunks on all cores
+    if (input_filename[0] != '\0') {
+        void * userdata = NULL;
+        chunkdecoder q = chunkdecoder_create(num_threads, 1<<20, 1<<16, 8, 1,
+                                             offline_create, offline_reset,
+                                             offline_execute, offline_destroy,
+                                             NULL, callback, &userdata);
+
+        timer t0 = timer_create();
+        timer_tic(t0);
+        long long int num_samples = chunkdecoder_execute_file(q, input_filename);
+        float runtime = timer_toc(t0);
+        timer_destroy(t0);
+
+        chunkdecoder_print(q);
+        chunkdecoder_destroy(q);
+        if (num_samples < 0)
+            exit(1);
+
+        float duration = (float)num_samples / (2.0f*bandwidth);
+        printf("    packets received    : %6u\n", num_packets_received);
+        printf("    valid headers       : %6u\n", num_valid_headers_received);
+        printf("    valid packets       : %6u\n", num_valid_packets_received);
+        printf("    bytes received      : %6u\n", num_bytes_received);
+        printf("    capture duration    : %f s\n", duration);
+        printf("    decode time         : %f s (%.2f x real time)\n",
+                runtime, runtime > 0 ? duration / runtime : 0.0f);
+
+        trafficcheck_print(tcheck, duration);
+        trafficcheck_destroy(tcheck);
+
+        if (plog != NULL) {
+            packetlog_print(plog);
+            packetlog_destroy(plog);
+            printf("packet log written to '%s'\n", log_filename);
+        }
+        return 0;
+    }
+
     uhd::stream_cmd_t stream_cmd(uhd::stream_cmd_t::STREAM_MODE_START_CONTINUOUS);
 
     stream_cmd.stream_now = true;
@@ -138,61 +248,42 @@ int main (int argc, char **argv)
     uhd::device_addr_t dev_addr;
     uhd::usrp::multi_usrp::sptr usrp = uhd::usrp::multi_usrp::make(dev_addr);
 
-    // set properties
-    float rx_rate = 4.0f*bandwidth;
-#if 0
-    usrp->set_rx_rate(rx_rate);
-#else
-    // NOTE : the sample rate computation MUST be in double precision so
-    //        that the UHD can compute its decimation rate properly
-    unsigned int decim_rate = (unsigned int)(ADC_RATE / rx_rate);
-    // ensure multiple of 2
-    decim_rate = (decim_rate >> 1) << 1;
-    // compute usrp sampling rate
-    double usrp_rx_rate = ADC_RATE / decim_rate;
-    
-    // try to set rx rate
-    usrp->set_rx_rate(ADC_RATE / decim_rate);
-
-    // get actual rx rate
-    usrp_rx_rate = usrp->get_rx_rate();
-
-    // compute arbitrary resampling rate
-    double rx_resamp_rate = rx_rate / usrp_rx_rate;
-    printf("sample rate :   %12.8f kHz = %12.8f * %8.6f (decim %u)\n",
+    // plan device rate and resampling down to two samples per symbol
+    double rx_rate = 2.0*bandwidth;
+    rateplan plan = rateplan_create_rx(usrp, rx_rate, RATEPLAN_PASSBAND, 60.0f, device_min);
+    if (plan == NULL)
+        exit(1);
+
+    // try to set rx rate, then resample from the actual rate
+    usrp->set_rx_rate(rateplan_get_device_rate(plan));
+    double usrp_rx_rate = usrp->get_rx_rate();
+    resampchain resamp = resampchain_create(plan, usrp_rx_rate);
+    resampchain_set_num_threads(resamp, num_decim_threads);
+    printf("sample rate :   %12.8f kHz = %12.8f * %8.6f\n",
             rx_rate * 1e-3f,
             usrp_rx_rate * 1e-3f,
-            rx_resamp_rate,
-            decim_rate);
-#endif
+            resampchain_get_rate(resamp));
+    rateplan_print(plan);
+
     usrp->set_rx_freq(frequency);
     usrp->set_rx_gain(uhd_rxgain);
 
-    // add arbitrary resampling component
-    resamp_crcf resamp = resamp_crcf_create(rx_resamp_rate,7,0.4f,60.0f,64);
-    resamp_crcf_setrate(resamp, rx_resamp_rate);
-
-    // half-band resampler
-    resamp2_crcf decim = resamp2_crcf_create(7,0.0f,40.0f);
-
     const size_t max_samps_per_packet = usrp->get_device()->get_max_recv_samps_per_packet();
 
     //allocate recv buffer and metatdata
     uhd::rx_metadata_t md;
     std::vector<std::complex<float> > buff(max_samps_per_packet);
 
-    num_packets_received = 0;
-    num_valid_packets_received = 0;
-    num_valid_headers_received = 0;
-    num_bytes_received = 0;
-    SNRdB_av = 0.0f;
-
     // create frame synchronizer
     gmskframesync fs = gmskframesync_create(callback,NULL);
 
-    std::complex<float> data_rx[64];
-    std::complex<float> data_decim[32];
-    std::complex<float> data_resamp[64];
+    // create buffer for resampler output (entire packet)
+    std::vector<std::complex<float> > buffer_resamp(resampchain_get_max_output(resamp, max_samps_per_packet));
+
+    // processing throughput
+    unsigned long long int num_samples_rx = 0;  // samples received
+    float dsp_time = 0.0f;                      // time spent processing [s]
+    timer t1 = timer_create();
 
     // start data transfer
     usrp->issue_stream_cmd(uhd::stream_cmd_t::STREAM_MODE_START_CONTINUOUS);
@@ -203,7 +294,6 @@ int main (int argc, char **argv)
     timer t0 = timer_create();
     timer_tic(t0);
 
-    unsigned int n=0;
     while (continue_running) {
         // grab data from port
         size_t num_rx_samps = usrp->get_device()->recv(
@@ -229,37 +319,14 @@ int main (int argc, char **argv)
             return 1;
         }
 
-        // for now copy vector "buff" to array of complex float
+        // resample entire packet and push through synchronizer
         // TODO : apply bandwidth-dependent gain
-        unsigned int j;
-        unsigned int nw=0;
-        for (j=0; j<num_rx_samps; j++) {
-            // push 64 samples into buffer
-            data_rx[n++] = buff[j];
-
-            if (n==64) {
-                // reset counter
-                n=0;
-
-                // deimate to 32
-                unsigned int k;
-                for (k=0; k<32; k++)
-                    resamp2_crcf_decim_execute(decim, &data_rx[2*k], &data_decim[k]);
-
-                // apply resampler
-                for (k=0; k<32; k++) {
-                    resamp_crcf_execute(resamp, data_decim[k], &data_resamp[n], &nw);
-                    n += nw;
-                }
-
-                // push through synchronizer
-                gmskframesync_execute(fs, data_resamp, n);
-
-                // reset counter (again)
-                n = 0;
-            }
-
-        }
+        timer_tic(t1);
+        unsigned int nw;
+        resampchain_execute(resamp, &buff.front(), num_rx_samps, &buffer_resamp.front(), &nw);
+        gmskframesync_execute(fs, &buffer_resamp.front(), nw);
+        dsp_time += timer_toc(t1);
+        num_samples_rx += num_rx_samps;
 
         // check runtime
         if (timer_toc(t0) >= num_seconds)
@@ -293,14 +360,30 @@ int main (int argc, char **argv)
     printf("    average SNR [dB]    : %8.4f\n", SNRdB_av);
     printf("    bytes received      : %6u\n", num_bytes_received);
     printf("    run time            : %f s\n", runtime);
+    printf("    samples received    : %llu (%.4f Msamples/s)\n", num_samples_rx, num_samples_rx / runtime * 1e-6f);
+    printf("    processing capacity : %.4f Msamples/s (%.1f%% load)\n",
+            dsp_time > 0.0f ? num_samples_rx / dsp_time * 1e-6f : 0.0f,
+            100.0f * dsp_time / runtime);
     printf("    data rate           : %12.8f kbps\n", data_rate*1e-3f);
     printf("    spectral efficiency : %12.8f b/s/Hz\n", spectral_efficiency);
 
+    // print traffic check results
+    trafficcheck_print(tcheck, runtime);
+    trafficcheck_destroy(tcheck);
+
+    // close packet log
+    if (plog != NULL) {
+        packetlog_print(plog);
+        packetlog_destroy(plog);
+        printf("packet log written to '%s'\n", log_filename);
+    }
+
     // clean it up
     gmskframesync_destroy(fs);
-    resamp_crcf_destroy(resamp);
-    resamp2_crcf_destroy(decim);
+    resampchain_destroy(resamp);
+    rateplan_destroy(plan);
     timer_destroy(t0);
+    timer_destroy(t1);
 
     return 0;
 }
@@ -29,6 +29,9 @@
 #include <uhd/usrp/multi_usrp.hpp>
 
 #include "timer.h"
+#include "trafficgen.h"
+#include "rateplan.h"
+#include "resampchain.h"
 
 void usage() {
     printf("gmskframe_tx:\n");
@@ -50,10 +53,6 @@ int main (int argc, char **argv)
 {
     bool verbose = true;
 
-    unsigned long int DAC_RATE = 64e6;
-    float min_bandwidth = 0.25f*(DAC_RATE / 256.0);
-    float max_bandwidth = 0.25f*(DAC_RATE /   4.0);
-
     float frequency = 462.0e6;
     float bandwidth = 100e3;
     float num_seconds = 5.0f;
@@ -91,11 +90,8 @@ int main (int argc, char **argv)
         }
     }
 
-    if (bandwidth > max_bandwidth) {
-        fprintf(stderr,"error: maximum bandwidth exceeded (%8.4f MHz)\n", max_bandwidth*1e-6);
-        return 1;
-    } else if (bandwidth < min_bandwidth) {
-        fprintf(stderr,"error: minimum bandwidth exceeded (%8.4f kHz)\n", min_bandwidth*1e-3);
+    if (bandwidth <= 0) {
+        fprintf(stderr,"error: bandwidth must be greater than zero\n");
         return 1;
     } else if (payload_len > (1<<16)) {
         fprintf(stderr,"error: maximum payload length exceeded: %u > %u\n", payload_len, 1<<16);
@@ -118,47 +114,28 @@ int main (int argc, char **argv)
     //dev_addr["addr1"] = "192.168.10.3";
     uhd::usrp::multi_usrp::sptr usrp = uhd::usrp::multi_usrp::make(dev_addr);
 
-    // set properties
-    double tx_rate = 4.0*bandwidth;
-#if 0
-    usrp->set_tx_rate(tx_rate);
-#else
-    // NOTE : the sample rate computation MUST be in double precision so
-    //        that the UHD can compute its interpolation rate properly
-    unsigned int interp_rate = (unsigned int)(DAC_RATE / tx_rate);
-    // ensure multiple of 4
-    interp_rate = (interp_rate >> 2) << 2;
-    interp_rate += 4; // ensure tx_resamp_rate <= 1.0
-    // compute usrp sampling rate
-    double usrp_tx_rate = DAC_RATE / (double)interp_rate;
-    
-    // try to set tx rate
-    usrp->set_tx_rate(DAC_RATE / interp_rate);
-
-    // get actual tx rate
-    usrp_tx_rate = usrp->get_tx_rate();
-
-    //usrp_tx_rate = 262295.081967213;
-    // compute arbitrary resampling rate
-    double tx_resamp_rate = usrp_tx_rate / tx_rate;
-    printf("sample rate :   %12.8f kHz = %12.8f / %8.6f (interp %u)\n",
+    // plan device rate (among those the device supports) and
+    // resampling up from two samples per symbol
+    double tx_rate = 2.0*bandwidth;
+    rateplan plan = rateplan_create_tx(usrp, tx_rate, RATEPLAN_PASSBAND, 60.0f, 0.0);
+    if (plan == NULL)
+        exit(1);
+
+    // try to set tx rate, then resample to the actual rate
+    usrp->set_tx_rate(rateplan_get_device_rate(plan));
+    double usrp_tx_rate = usrp->get_tx_rate();
+    resampchain resamp = resampchain_create(plan, usrp_tx_rate);
+    printf("sample rate :   %12.8f kHz = %12.8f / %8.6f\n",
             tx_rate * 1e-3f,
             usrp_tx_rate * 1e-3f,
-            tx_resamp_rate,
-            interp_rate);
-#endif
+            resampchain_get_rate(resamp));
+    rateplan_print(plan);
+
     usrp->set_tx_freq(frequency);
     usrp->set_tx_gain(uhd_txgain);
     // set the IF filter bandwidth
     //usrp->set_tx_bandwidth(2.0f*tx_rate);
 
-    // add arbitrary resampling component
-    resamp_crcf resamp = resamp_crcf_create(tx_resamp_rate,7,0.4f,60.0f,64);
-    resamp_crcf_setrate(resamp, tx_resamp_rate);
-
-    // half-band resampler
-    resamp2_crcf interp = resamp2_crcf_create(7,0.0f,40.0f);
-
     // create gmskframegen object
     gmskframegen fg = gmskframegen_create();
     gmskframegen_print(fg);
@@ -172,14 +149,14 @@ int main (int argc, char **argv)
     // framing buffers
     unsigned int k = 2;
     std::complex<float> buffer[k];
-    std::complex<float> buffer_interp[2*k];
-    std::complex<float> buffer_resamp[8*k]; // resampler
+    std::vector<std::complex<float> > buffer_resamp(resampchain_get_max_output(resamp, k));
     std::vector<std::complex<float> > buff(256);
     unsigned int tx_buffer_samples = 0;
 
     // data buffers
     unsigned char header[8];
     unsigned char payload[payload_len];
+    trafficgen tgen = trafficgen_create(TRAFFICGEN_DEFAULT_SEED, 0, 8);
 
     // transmitter gain (linear)
     float g = powf(10.0f, txgain_dB/20.0f);
@@ -193,15 +170,8 @@ int main (int argc, char **argv)
     unsigned int pid=0;
     // start transmitter
     while (continue_running) {
-        // generate random data
-        for (j=0; j<payload_len; j++)
-            payload[j] = rand() & 0xff;
-
-        // write header (first two bytes packet ID, remaining are random)
-        header[0] = (pid >> 8) & 0xff;
-        header[1] = (pid     ) & 0xff;
-        for (j=2; j<8; j++)
-            header[j] = rand() & 0xff;
+        // write header (packet ID, sequence) and pseudo-random payload
+        trafficgen_generate(tgen, header, payload, payload_len);
 
         if (verbose)
             printf("packet id: %6u\n", pid);
@@ -224,18 +194,9 @@ int main (int argc, char **argv)
             // generate k samples
             frame_complete = gmskframegen_write_samples(fg, buffer);
 
-            // interpolate by 2
-            for (j=0; j<k; j++)
-                resamp2_crcf_interp_execute(interp, buffer[j], &buffer_interp[2*j]);
-
-            // resample
-            // resample
-            unsigned int nw;
-            unsigned int n=0;
-            for (j=0; j<2*k; j++) {
-                resamp_crcf_execute(resamp, buffer_interp[j], &buffer_resamp[n], &nw);
-                n += nw;
-            }
+            // resample to device rate
+            unsigned int n;
+            resampchain_execute(resamp, buffer, k, &buffer_resamp.front(), &n);
 
             // push samples into buffer
             for (j=0; j<n; j++) {
@@ -273,8 +234,9 @@ int main (int argc, char **argv)
 
     // clean it up
     gmskframegen_destroy(fg);
-    resamp2_crcf_destroy(interp);
-    resamp_crcf_destroy(resamp);
+    trafficgen_destroy(tgen);
+    resampchain_destroy(resamp);
+    rateplan_destroy(plan);
     timer_destroy(t0);
 
     return 0;
@@ -28,8 +28,11 @@
 #include <sys/time.h>
 #include <liquid/liquid.h>
 
+#include "amc.h"
+#include "arq.h"
 #include "ofdmtxrx.h"
 #include "timer.h"
+#include "trafficgen.h"
 
 void usage() {
     printf("halfduplex_txrx [OPTION]\n");
@@ -52,6 +55,10 @@ void usage() {
     printf("  k     : coding scheme (outer),  default: none\n");
     liquid_print_fec_schemes();
     printf("  t     : rx packet timeout [s],  default:  0.05 s\n");
+    printf("  a     : adaptive modulation and coding (ignores m,c,k; peer must also use -a)\n");
+    printf("  w     : selective-repeat ARQ window [frames], default: 0 (off)\n");
+    printf("  r     : ARQ responder (acknowledge peer's traffic)\n");
+    printf("  F     : fast turnaround (keep rx stream alive)\n");
 }
 
 // assemble packet
@@ -60,6 +67,9 @@ void assemble_packet(unsigned int    _pid,
                      unsigned char * _payload,
                      unsigned int    _payload_len);
 
+// current time [s]
+double time_now();
+
 // set timespec for timeout
 //  _ts         :   pointer to timespec structure
 //  _timeout    :   time before timeout
@@ -77,16 +87,44 @@ int callback(unsigned char *  _header,
 
 static bool verbose = true;
 
+// receiver synchronization shared with callback
+struct rxsync_s {
+    pthread_mutex_t mutex;      // receiver mutex (also guards link_arq)
+    pthread_cond_t  cond;       // receiver condition
+    int poll;                   // peer handed over the channel (ARQ)
+};
+
+// ARQ: bursts to linger after delivering everything (responder) and
+// consecutive unanswered bursts before giving up (originator)
+#define ARQ_LINGER_BURSTS   (10)
+#define ARQ_MAX_IDLE_BURSTS (100)
+
 // data counters
 unsigned int num_frames_detected;
 unsigned int num_valid_headers_received;
 unsigned int num_valid_packets_received;
 unsigned int num_valid_bytes_received;
 
+// generated traffic checker
+trafficcheck tcheck = NULL;
+
+// adaptive modulation and coding controller (NULL if disabled); each
+// frame's payload ends with a report on the frames received from the
+// peer, which drives the peer's controller
+amc controller = NULL;
+
+// selective-repeat ARQ endpoint (NULL if disabled)
+arq link_arq = NULL;
+
+// ARQ in-order delivery: payload carries the generated traffic header
+void arq_deliver(unsigned char * _payload,
+                 unsigned int    _payload_len,
+                 void *          _userdata);
+
 int main (int argc, char **argv)
 {
     // command-line options
-    float frequency = 462.0e6;          // carrier frequency
+    double frequency = 462.0e6;         // carrier frequency
     float bandwidth = 1000e3f;          // bandwidth
     unsigned int num_frames = 2000;     // number of frames to transmit
     float txgain_dB = -12.0f;           // software tx gain [dB]
@@ -105,10 +143,14 @@ int main (int argc, char **argv)
     fec_scheme fec1 = LIQUID_FEC_GOLAY2412; // fec (outer)
 
     float timeout   = 0.050;            // timeout (s)
+    bool adaptive   = false;            // adaptive modulation and coding?
+    unsigned int window = 0;            // ARQ window (0: disabled)
+    bool responder  = false;            // ARQ responder?
+    bool fast_turnaround = false;       // keep rx stream alive?
     
     //
     int d;
-    while ((d = getopt(argc,argv,"uhqvf:b:g:G:N:M:C:T:P:m:c:k:")) != EOF) {
+    while ((d = getopt(argc,argv,"uhqvf:b:g:G:N:M:C:T:P:m:c:k:t:aw:rF")) != EOF) {
         switch (d) {
         case 'u':
         case 'h':   usage();                        return 0;
@@ -127,6 +169,10 @@ int main (int argc, char **argv)
         case 'c':   fec0        = liquid_getopt_str2fec(optarg);    break;
         case 'k':   fec1        = liquid_getopt_str2fec(optarg);    break;
         case 't':   timeout     = atof(optarg);     break;
+        case 'a':   adaptive    = true;             break;
+        case 'w':   window      = atoi(optarg);     break;
+        case 'r':   responder   = true;             break;
+        case 'F':   fast_turnaround = true;         break;
         default:    usage();                        return 0;
         }
     }
@@ -146,17 +192,23 @@ int main (int argc, char **argv)
     } else if (timeout <= 0.0f) {
         fprintf(stderr,"error: %s, ACK timeout must be greater than zero\n", argv[0]);
         exit(-1);
+    } else if (window > ARQ_MAX_WINDOW) {
+        fprintf(stderr,"error: %s, ARQ window cannot exceed %u\n", argv[0], ARQ_MAX_WINDOW);
+        exit(-1);
+    } else if (responder && window == 0) {
+        fprintf(stderr,"error: %s, responder requires ARQ window\n", argv[0]);
+        exit(-1);
     }
 
     // thread handling
-    pthread_mutex_t rx_mutex;   // receiver mutex
-    pthread_cond_t  rx_cond;    // receiver condition
-    pthread_mutex_init(&rx_mutex, NULL);
-    pthread_cond_init(&rx_cond,   NULL);
+    struct rxsync_s sync;
+    pthread_mutex_init(&sync.mutex, NULL);
+    pthread_cond_init(&sync.cond,   NULL);
+    sync.poll = 0;
 
     // create transceiver object
     unsigned char * p = NULL;   // default subcarrier allocation
-    ofdmtxrx txcvr(M, cp_len, taper_len, p, callback, (void*)&rx_cond);
+    ofdmtxrx txcvr(M, cp_len, taper_len, p, callback, (void*)&sync);
 
     // set transmit properties
     txcvr.set_tx_freq(frequency);
@@ -168,11 +220,21 @@ int main (int argc, char **argv)
     txcvr.set_rx_freq(frequency);
     txcvr.set_rx_rate(bandwidth);
     txcvr.set_rx_gain_uhd(uhd_rxgain);
+    txcvr.set_rx_block_len(256);     // frame times are not used
+    if (fast_turnaround)
+        txcvr.turnaround_enable();
 
     // data arrays
     unsigned char header[8];
-    unsigned char payload[payload_len];
+    unsigned char payload[8+payload_len+AMC_REPORT_LEN];    // ARQ: traffic header + payload
     
+    // create traffic checker
+    tcheck = trafficcheck_create(TRAFFICGEN_DEFAULT_SEED, 8);
+
+    // create adaptive modulation and coding controller
+    if (adaptive)
+        controller = amc_create(NULL, 0);
+
     // reset counters
     num_frames_detected=0;
     num_valid_headers_received=0;
@@ -184,29 +246,135 @@ int main (int argc, char **argv)
     timer_tic(t0);
     unsigned int pid;
     //unsigned int i;
-    for (pid=0; pid<num_frames; pid++) {
-        if (verbose) printf("tx packet id: %6u\n", pid);
-
-        // assemble packet
-        assemble_packet(pid, header, payload, payload_len);
-        
-        // transmit frame
-        txcvr.transmit_packet(header, payload, payload_len, ms, fec0, fec1);
-
-        // wait for response or time out; lock mutex
-        pthread_mutex_lock(&rx_mutex);
-        struct timespec ts;
-        set_timespec(&ts, timeout);
-        txcvr.start_rx();
-        //int status = pthread_cond_wait(&rx_cond, &rx_mutex);
-        int status = pthread_cond_timedwait(&rx_cond, &rx_mutex, &ts);
-        if (status) printf("timeout\n");
-        // unlock the mutex
-        pthread_mutex_unlock(&rx_mutex);
-        txcvr.stop_rx();
-        //txcvr.reset_rx();
-
-    } // packet loop
+    if (window > 0) {
+        // selective-repeat ARQ: the originator sends generated traffic
+        // (its header leading the payload) and the responder acknowledges
+        // it; each side hands over the channel by setting ARQ_FLAG_POLL
+        // on the last frame of its burst
+        link_arq = arq_create(window, 8 + payload_len, arq_deliver, NULL);
+        arq_set_rto(link_arq, timeout, 0.1f*timeout, 40.0f*timeout);
+
+        // burst of up to one frame per window slot plus an ack
+        struct ofdmtxrx_packet_s burst[ARQ_MAX_WINDOW+1];
+        unsigned int burst_stride = 16 + payload_len + AMC_REPORT_LEN;
+        unsigned char * burst_buffer = (unsigned char*) malloc((window+1)*burst_stride);
+        unsigned int i;
+        for (i=0; i<=window; i++) {
+            burst[i].header  = burst_buffer + i*burst_stride;
+            burst[i].payload = burst[i].header + 8;
+        }
+
+        pid = 0;
+        unsigned int num_idle = 0;      // consecutive unanswered bursts
+        bool my_turn = !responder;
+        while (true) {
+            if (!responder && arq_get_num_acked(link_arq) == num_frames) {
+                break;
+            } else if (!responder && num_idle >= ARQ_MAX_IDLE_BURSTS) {
+                printf("no response from peer, giving up\n");
+                break;
+            } else if (responder && arq_get_num_delivered(link_arq) >= num_frames &&
+                       num_idle >= ARQ_LINGER_BURSTS) {
+                break;
+            }
+
+            if (my_turn) {
+                // fill window with new traffic and collect burst
+                pthread_mutex_lock(&sync.mutex);
+                while (!responder && pid < num_frames && arq_tx_space(link_arq) > 0) {
+                    assemble_packet(pid, payload, payload+8, payload_len);
+                    arq_tx_push(link_arq, payload, 8+payload_len);
+                    pid++;
+                }
+                double now = time_now();
+                unsigned int n = 0;
+                while (n <= window &&
+                       arq_tx_pop(link_arq, now, burst[n].header, burst[n].payload, &burst[n].payload_len))
+                {
+                    if (controller != NULL) {
+                        amc_report_write(controller, burst[n].payload + burst[n].payload_len);
+                        burst[n].payload_len += AMC_REPORT_LEN;
+                    }
+                    n++;
+                }
+                sync.poll = 0;
+                pthread_mutex_unlock(&sync.mutex);
+
+                // transmit burst, handing over the channel with the last frame
+                if (n > 0) {
+                    if (verbose) printf("tx burst: %u frames\n", n);
+                    burst[n-1].header[2] |= ARQ_FLAG_POLL;
+                    if (controller != NULL)
+                        amc_get_scheme(controller, &ms, &fec0, &fec1);
+                    txcvr.transmit_packets(burst, n, ms, fec0, fec1);
+                }
+            }
+
+            // listen until the peer hands over the channel or the
+            // earliest retransmission is due
+            pthread_mutex_lock(&sync.mutex);
+            float wait = responder ? timeout : arq_tx_next_timeout(link_arq, time_now());
+            if (wait <= 0.0f) wait = timeout;
+            struct timespec ts;
+            set_timespec(&ts, wait);
+            txcvr.start_rx();
+            int status = 0;
+            while (!sync.poll && status == 0)
+                status = pthread_cond_timedwait(&sync.cond, &sync.mutex, &ts);
+            bool polled = sync.poll;
+            bool ack_pending = arq_ack_pending(link_arq);
+            pthread_mutex_unlock(&sync.mutex);
+            txcvr.stop_rx();
+
+            if (polled) {
+                num_idle = 0;
+                my_turn = true;
+            } else {
+                if (verbose) printf("timeout\n");
+                num_idle++;
+                my_turn = !responder || ack_pending;
+                if (controller != NULL && !responder)
+                    amc_update_lost(controller);
+            }
+        }
+        free(burst_buffer);
+    } else {
+        for (pid=0; pid<num_frames; pid++) {
+            if (verbose) printf("tx packet id: %6u\n", pid);
+
+            // assemble packet
+            assemble_packet(pid, header, payload, payload_len);
+
+            // select scheme from the peer's last report and append ours
+            unsigned int frame_len = payload_len;
+            if (controller != NULL) {
+                amc_get_scheme(controller, &ms, &fec0, &fec1);
+                amc_report_write(controller, payload + payload_len);
+                frame_len += AMC_REPORT_LEN;
+            }
+
+            // transmit frame
+            txcvr.transmit_packet(header, payload, frame_len, ms, fec0, fec1);
+
+            // wait for response or time out; lock mutex
+            pthread_mutex_lock(&sync.mutex);
+            struct timespec ts;
+            set_timespec(&ts, timeout);
+            txcvr.start_rx();
+            //int status = pthread_cond_wait(&sync.cond, &sync.mutex);
+            int status = pthread_cond_timedwait(&sync.cond, &sync.mutex, &ts);
+            if (status) {
+                printf("timeout\n");
+                if (controller != NULL)
+                    amc_update_lost(controller);
+            }
+            // unlock the mutex
+            pthread_mutex_unlock(&sync.mutex);
+            txcvr.stop_rx();
+            //txcvr.reset_rx();
+
+        } // packet loop
+    }
  
     // sleep for a small amount of time to allow USRP buffers
     // to flush
@@ -232,11 +400,27 @@ int main (int argc, char **argv)
     printf("    bytes received      : %6u\n", num_valid_bytes_received);
     printf("    run time            : %f s\n", runtime);
     printf("    data rate           : %8.4f kbps\n", data_rate*1e-3f);
+    struct ofdmtxrx_turnaround_s turnaround;
+    txcvr.get_turnaround(&turnaround);
+    printf("    tx/rx turnaround    : %6u, mean %8.3f ms, max %8.3f ms\n",
+            turnaround.num_tx2rx, turnaround.tx2rx_mean*1e3f, turnaround.tx2rx_max*1e3f);
+    printf("    rx/tx turnaround    : %6u, mean %8.3f ms, max %8.3f ms\n",
+            turnaround.num_rx2tx, turnaround.rx2tx_mean*1e3f, turnaround.rx2tx_max*1e3f);
+    trafficcheck_print(tcheck, runtime);
+    if (controller != NULL)
+        amc_print(controller);
+    if (link_arq != NULL)
+        arq_print(link_arq);
 
     // destroy objects
+    trafficcheck_destroy(tcheck);
+    if (controller != NULL)
+        amc_destroy(controller);
+    if (link_arq != NULL)
+        arq_destroy(link_arq);
     timer_destroy(t0);
-    pthread_mutex_destroy(&rx_mutex);
-    pthread_cond_destroy(&rx_cond);
+    pthread_mutex_destroy(&sync.mutex);
+    pthread_cond_destroy(&sync.cond);
 
     printf("done.\n");
     return 0;
@@ -248,17 +432,17 @@ void assemble_packet(unsigned int    _pid,
                      unsigned char * _payload,
                      unsigned int    _payload_len)
 {
-    // write header (first two bytes packet ID, remaining are random)
-    _header[0] = (_pid >> 8) & 0xff;
-    _header[1] = (_pid     ) & 0xff;
-
-    unsigned int i;
-    for (i=2; i<8; i++)
-        _header[i] = rand() & 0xff;
+    // write header (packet ID, sequence) and pseudo-random payload
+    trafficgen_assemble(TRAFFICGEN_DEFAULT_SEED, 0, _pid, _header, 8,
+                        _payload, _payload_len);
+}
 
-    // initialize payload
-    for (i=0; i<_payload_len; i++)
-        _payload[i] = rand() & 0xff;
+// current time [s]
+double time_now()
+{
+    struct timeval tv_now;
+    gettimeofday(&tv_now, NULL);
+    return tv_now.tv_sec + 1e-6*tv_now.tv_usec;
 }
 
 // set timespec for timeout
@@ -300,6 +484,23 @@ int callback(unsigned char *  _header,
                 _payload_valid ? "pass" : "FAIL");
     }
 
+    struct rxsync_s * sync = (struct rxsync_s*) _userdata;
+
+    // measure frame for our report and strip the peer's report from
+    // the payload (lost frames are counted on response timeout)
+    if (controller != NULL) {
+        amc_observe(controller, _header_valid, _payload_valid, _stats);
+        if (_header_valid && _payload_len > AMC_REPORT_LEN) {
+            _payload_len -= AMC_REPORT_LEN;
+            if (_payload_valid)
+                amc_report_read(controller, _payload + _payload_len);
+        }
+    }
+
+    // check content of generated traffic (ARQ: checked on delivery)
+    if (link_arq == NULL)
+        trafficcheck_execute(tcheck, _header, _header_valid, _payload, _payload_len, _payload_valid);
+
     // update global counters
     num_frames_detected++;
 
@@ -311,12 +512,36 @@ int callback(unsigned char *  _header,
         num_valid_bytes_received += _payload_len;
     }
 
-    // if header was valid, signal condition
-    if (_header_valid) {
-        pthread_cond_t * rx_cond = (pthread_cond_t*) _userdata;
-        pthread_cond_signal(rx_cond);
+    // ARQ: process acks and data; wake main loop once the peer hands
+    // over the channel
+    if (link_arq != NULL) {
+        pthread_mutex_lock(&sync->mutex);
+        int flags = arq_rx_execute(link_arq, time_now(), _header, _header_valid,
+                                   _payload, _payload_len, _payload_valid);
+        if (flags >= 0 && (flags & ARQ_FLAG_POLL)) {
+            sync->poll = 1;
+            pthread_cond_signal(&sync->cond);
+        }
+        pthread_mutex_unlock(&sync->mutex);
+        return 0;
     }
 
+    // if header was valid, signal condition
+    if (_header_valid)
+        pthread_cond_signal(&sync->cond);
+
     return 0;
 }
 
+// ARQ in-order delivery
+void arq_deliver(unsigned char * _payload,
+                 unsigned int    _payload_len,
+                 void *          _userdata)
+{
+    if (_payload_len < 8)
+        return;
+
+    // check content of generated traffic
+    trafficcheck_execute(tcheck, _payload, 1, _payload+8, _payload_len-8, 1);
+}
+
@@ -0,0 +1,134 @@
+/*
+ * Copyright (c) 2013 Joseph Gaeddert
+ *
+ * This file is part of liquid.
+ *
+ * liquid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * liquid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with liquid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+//
+// iqlog2octave.cc
+//
+// convert binary sample/RSSI log (see include/iqlog.h), as written
+// by rssi and asgram_rx, to an Octave script which plots its contents
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <getopt.h>
+
+#include "iqlog.h"
+
+void usage() {
+    printf("iqlog2octave [OPTION] INPUT OUTPUT\n");
+    printf("convert binary sample/RSSI log to Octave script\n");
+    printf("\n");
+    printf("  u,h   : usage/help\n");
+    printf("  s     : first sample,                default: 0\n");
+    printf("  n     : maximum number of samples,   default: (all)\n");
+}
+
+int main (int argc, char **argv)
+{
+    // command-line options
+    unsigned long long int sample_start = 0;    // first sample to convert
+    unsigned long long int max_samples  = 0;    // maximum number of samples (0: all)
+
+    //
+    int d;
+    while ((d = getopt(argc,argv,"uhs:n:")) != EOF) {
+        switch (d) {
+        case 'u':
+        case 'h':   usage();                            return 0;
+        case 's':   sample_start = atoll(optarg);       break;
+        case 'n':   max_samples  = atoll(optarg);       break;
+        default:    usage();                            return 1;
+        }
+    }
+
+    if (optind + 2 > argc) {
+        fprintf(stderr,"error: %s, input and output files required\n", argv[0]);
+        usage();
+        return 1;
+    }
+    const char * filename = argv[optind+1];
+
+    // open log
+    iqlogreader q = iqlogreader_open(argv[optind]);
+    if (q == NULL)
+        return 1;
+    unsigned int rssi_decim = iqlogreader_get_rssi_decim(q);
+
+    FILE * fid = fopen(filename,"w");
+    if (!fid) {
+        fprintf(stderr,"error: %s, could not open '%s' for writing\n", argv[0], filename);
+        exit(1);
+    }
+    fprintf(fid,"%% %s : auto-generated file (from %s)\n", filename, argv[optind]);
+    fprintf(fid,"Fs = %e;\n", iqlogreader_get_sample_rate(q));
+    fprintf(fid,"fc = %e;\n", iqlogreader_get_frequency(q));
+    fprintf(fid,"rssi_decim = %u;\n", rssi_decim);
+    fprintf(fid,"x = [];\n");
+    fprintf(fid,"rssi = [];\n");
+
+    // write samples and RSSI track within range (gaps left by dropped
+    // blocks are filled with zeros by Octave)
+    unsigned long long int sample_end = max_samples > 0 ? sample_start + max_samples : 0;
+    unsigned long long int num_samples = 0;
+    unsigned long long int num_rssi    = 0;
+    unsigned int i;
+    struct iqlog_block_s b;
+    while (iqlogreader_next(q, &b) == 0) {
+        for (i=0; i<b.num_values; i++) {
+            // input sample index of value
+            unsigned long long int k = b.sample_index + (b.type == IQLOG_BLOCK_RSSI ? (unsigned long long int)i*rssi_decim : i);
+            if (k < sample_start || (sample_end > 0 && k >= sample_end))
+                continue;
+            k -= sample_start;
+
+            if (b.type == IQLOG_BLOCK_IQ) {
+                fprintf(fid,"x(%6llu) = %12.4e + %12.4ej;\n", k+1, b.iq[i].real(), b.iq[i].imag());
+                num_samples++;
+            } else {
+                // linear signal level, as plotted by the original script
+                fprintf(fid,"rssi(%6llu) = %12.4e;\n", k/rssi_decim+1, powf(10.0f, b.rssi[i]/20.0f));
+                num_rssi++;
+            }
+        }
+    }
+    iqlogreader_close(q);
+
+    fprintf(fid,"\n\n");
+    fprintf(fid,"figure;\n");
+    fprintf(fid,"if length(x) > 0,\n");
+    fprintf(fid,"  t = [0:(length(x)-1)]/Fs*1e3; %% time (ms)\n");
+    fprintf(fid,"  subplot(2,1,1);\n");
+    fprintf(fid,"    plot(t,real(x),t,imag(x));\n");
+    fprintf(fid,"    ylabel('r(t)');\n");
+    fprintf(fid,"  subplot(2,1,2);\n");
+    fprintf(fid,"end;\n");
+    fprintf(fid,"if length(rssi) > 0,\n");
+    fprintf(fid,"  t_rssi = [0:(length(rssi)-1)]*rssi_decim/Fs*1e3; %% time (ms)\n");
+    fprintf(fid,"  plot(t_rssi,20*log10(rssi));\n");
+    fprintf(fid,"  ylabel('RSSI [dB]');\n");
+    fprintf(fid,"end;\n");
+    fprintf(fid,"xlabel('time [ms]');\n");
+    fprintf(fid,"grid on\n");
+    fclose(fid);
+
+    printf("converted %llu samples and %llu RSSI values to '%s'\n", num_samples, num_rssi, filename);
+    return 0;
+}
@@ -30,9 +30,20 @@
  
 #include "timer.h"
 #include "multichannelrx.h"
+#include "packetlog.h"
+#include "chunkdecoder.h"
+#include "trafficgen.h"
+#include "rateplan.h"
+#include "resampchain.h"
 
 static bool verbose;
 
+// binary packet log (optional)
+static packetlog plog = NULL;
+
+// generated traffic checker
+static trafficcheck tcheck = NULL;
+
 // global callback function
 int callback(unsigned char *  _header,
              int              _header_valid,
@@ -42,6 +53,15 @@ int callback(unsigned char *  _header,
              framesyncstats_s _stats,
              void *           _userdata)
 {
+    // log frame (userdata points to channel index)
+    if (plog != NULL) {
+        unsigned int channel = *((unsigned int*)_userdata);
+        packetlog_write(plog, channel, _header, _header_valid, _payload, _payload_len, _payload_valid, _stats);
+    }
+
+    // check content of generated traffic
+    trafficcheck_execute(tcheck, _header, _header_valid, _payload, _payload_len, _payload_valid);
+
     if (verbose) {
         // compute true carrier offset
         printf("***** rssi=%7.2fdB evm=%7.2fdB, ", _stats.rssi, _stats.evm);
@@ -64,6 +84,42 @@ int callback(unsigned char *  _header,
 
     return 0;
 }
+// offline decoding: receiver properties and hooks
+struct mcrxprops_s {
+    unsigned int num_channels;      // number of channels
+    unsigned int M;                 // number of subcarriers
+    unsigned int cp_len;            // cyclic prefix length
+    unsigned int taper_len;         // taper length
+};
+
+void * offline_create(framesync_callback _callback,
+                      void **            _userdata,
+                      void *             _context)
+{
+    struct mcrxprops_s * props = (struct mcrxprops_s*) _context;
+    framesync_callback callbacks[props->num_channels];
+    unsigned int i;
+    for (i=0; i<props->num_channels; i++)
+        callbacks[i] = _callback;
+    return new multichannelrx(props->num_channels, props->M, props->cp_len,
+                              props->taper_len, NULL, _userdata, callbacks);
+}
+
+void offline_reset(void * _mcrx)
+{
+    ((multichannelrx*)_mcrx)->Reset();
+}
+
+void offline_execute(void * _mcrx, std::complex<float> * _x, unsigned int _n)
+{
+    ((multichannelrx*)_mcrx)->Execute(_x, _n);
+}
+
+void offline_destroy(void * _mcrx)
+{
+    delete (multichannelrx*)_mcrx;
+}
+
 void usage() {
     printf("ofdmflexframe_rx -- receive OFDM packets\n");
     printf("  u,h   : usage/help\n");
@@ -76,6 +132,13 @@ void usage() {
     printf("  n     : number of channels,    default: 1\n");
     printf("  G     : uhd rx gain [dB],      default: 20 dB\n");
     printf("  t     : run time [seconds],    default: 10\n");
+    printf("  o     : binary packet log filename, default: (none)\n");
+    printf("  p     : save payloads in packet log\n");
+    printf("  i     : decode complex float I/Q file (offline) instead of usrp\n");
+    printf("  P     : offline decoding threads, default: (number of cores)\n");
+    printf("  D     : decimation threads,    default: 1 (0: number of cores)\n");
+    printf("  R     : minimum device rate [Hz], or 'max' for the highest\n");
+    printf("          (e.g. -R max -D 0 decimates from the full device rate)\n");
 }
 
 int main (int argc, char **argv)
@@ -88,6 +151,12 @@ int main (int argc, char **argv)
     unsigned int num_channels = 1;      // number of channels
     double num_seconds = 10.0f;         // run time
     double uhd_rxgain = 20.0;           // uhd (hardware) rx gain
+    char log_filename[256] = "";        // binary packet log filename
+    int log_payloads = 0;               // save payloads in packet log?
+    char input_filename[256] = "";      // offline input file (complex float)
+    unsigned int num_threads = 0;       // offline decoding threads
+    unsigned int num_decim_threads = 1; // front-end decimation threads
+    double device_min = 0.0;            // minimum device rate (0: lowest)
 
     // ofdm properties
     unsigned int M          = 48;       // number of subcarriers
@@ -96,7 +165,7 @@ int main (int argc, char **argv)
 
     //
     int d;
-    while ((d = getopt(argc,argv,"uhqvf:b:M:C:T:n:G:t:")) != EOF) {
+    while ((d = getopt(argc,argv,"uhqvf:b:M:C:T:n:G:t:o:pi:P:D:R:")) != EOF) {
         switch (d) {
         case 'u':
         case 'h':   usage();                        return 0;
@@ -110,6 +179,12 @@ int main (int argc, char **argv)
         case 'n':   num_channels= atoi(optarg);     break;
         case 'G':   uhd_rxgain  = atof(optarg);     break;
         case 't':   num_seconds = atof(optarg);     break;
+        case 'o':   strncpy(log_filename,optarg,255); break;
+        case 'p':   log_payloads = 1;               break;
+        case 'i':   strncpy(input_filename,optarg,255); break;
+        case 'P':   num_threads = atoi(optarg);     break;
+        case 'D':   num_decim_threads = atoi(optarg); break;
+        case 'R':   device_min = strcmp(optarg,"max") == 0 ? HUGE_VAL : atof(optarg); break;
         default:
             usage();
             return 0;
@@ -118,6 +193,61 @@ int main (int argc, char **argv)
 
     unsigned int i;
 
+    // create traffic checker
+    tcheck = trafficcheck_create(TRAFFICGEN_DEFAULT_SEED, 8);
+
+    // create binary packet log
+    if (log_filename[0] != '\0') {
+        plog = packetlog_create(log_filename, 8, log_payloads);
+        if (plog == NULL)
+            exit(1);
+    }
+
+    // channel identifiers passed to callback as userdata
+    unsigned int channel_id[num_channels];
+    void * userdata[num_channels];
+    for (i=0; i<num_channels; i++) {
+        channel_id[i] = i;
+        userdata[i] = (void*)&channel_id[i];
+    }
+
+    // offline mode: decode recorded samples (taken at the usrp rate,
+    // 2*num_channels*bandwidth) in overlapping chunks on all cores
+    if (input_filename[0] != '\0') {
+        struct mcrxprops_s props = {num_channels, M, cp_len, taper_len};
+        unsigned int P = 2*num_channels;    // channelizer decimation
+        chunkdecoder q = chunkdecoder_create(num_threads, P<<17, P<<14, 8, num_channels,
+                                             offline_create, offline_reset,
+                                             offline_execute, offline_destroy,
+                                             (void*)&props, callback, userdata);
+
+        timer t0 = timer_create();
+        timer_tic(t0);
+        long long int num_samples = chunkdecoder_execute_file(q, input_filename);
+        float runtime = timer_toc(t0);
+        timer_destroy(t0);
+
+        chunkdecoder_print(q);
+        chunkdecoder_destroy(q);
+        if (num_samples < 0)
+            exit(1);
+
+        float duration = (float)num_samples / (P*bandwidth);
+        printf("    capture duration    : %f s\n", duration);
+        printf("    decode time         : %f s (%.2f x real time)\n",
+                runtime, runtime > 0 ? duration / runtime : 0.0f);
+
+        trafficcheck_print(tcheck, duration);
+        trafficcheck_destroy(tcheck);
+
+        if (plog != NULL) {
+            packetlog_print(plog);
+            packetlog_destroy(plog);
+            printf("packet log written to '%s'\n", log_filename);
+        }
+        return 0;
+    }
+
     uhd::stream_cmd_t stream_cmd(uhd::stream_cmd_t::STREAM_MODE_START_CONTINUOUS);
 
     stream_cmd.stream_now = true;
@@ -128,14 +258,18 @@ int main (int argc, char **argv)
     // set properties
     double rx_rate = num_channels*bandwidth;
 
-    // try to set rx rate (oversampled to compensate for CIC filter)
-    usrp->set_rx_rate(2.0f * rx_rate);
+    // plan device rate and resampling to exactly twice the channelized
+    // rate, which the channelizer assumes
+    rateplan plan = rateplan_create_rx(usrp, 2.0*rx_rate, 0.25f, 60.0f, device_min);
+    if (plan == NULL)
+        exit(1);
 
-    // get actual rx rate
+    // try to set rx rate, then resample from the actual rate
+    usrp->set_rx_rate(rateplan_get_device_rate(plan));
     double usrp_rx_rate = usrp->get_rx_rate();
-
-    // compute arbitrary resampling rate (make up the difference in software)
-    double rx_resamp_rate = rx_rate / usrp_rx_rate;
+    resampchain resamp = resampchain_create(plan, usrp_rx_rate);
+    resampchain_set_num_threads(resamp, num_decim_threads);
+    double rx_resamp_rate = 0.5*resampchain_get_rate(resamp);
 
     usrp->set_rx_freq(frequency);
     usrp->set_rx_gain(uhd_rxgain);
@@ -147,7 +281,7 @@ int main (int argc, char **argv)
             rx_rate      * 1e-3f,
             1.0f / rx_resamp_rate);
     printf("verbosity       :   %s\n", (verbose?"enabled":"disabled"));
-
+    rateplan_print(plan);
 
     if (num_seconds >= 0)
         printf("run time    :   %f seconds\n", num_seconds);
@@ -162,13 +296,13 @@ int main (int argc, char **argv)
     const size_t max_samps_per_packet = usrp->get_device()->get_max_recv_samps_per_packet();
     std::vector<std::complex<float> > buff(max_samps_per_packet);
 
+    // create buffer for resampler output (entire packet)
+    std::vector<std::complex<float> > buffer_resamp(resampchain_get_max_output(resamp, max_samps_per_packet));
+
     // create multi-channel receiver object
-    void * userdata[num_channels];
     framesync_callback callbacks[num_channels];
-    for (i=0; i<num_channels; i++) {
-        userdata[i] = NULL;
+    for (i=0; i<num_channels; i++)
         callbacks[i] = callback;
-    }
     unsigned char * p = NULL;   // default subcarrier allocation
     multichannelrx mcrx(num_channels, M, cp_len, taper_len, p, userdata, callbacks);
     
@@ -201,15 +335,10 @@ int main (int argc, char **argv)
             return 1;
         }
 
-        // push data through arbitrary resampler and give to frame synchronizer
-        unsigned int j;
-        for (j=0; j<num_rx_samps; j++) {
-            // grab sample from usrp buffer
-            std::complex<float> usrp_sample = buff[j];
-
-            // push resulting samples through receiver
-            mcrx.Execute(&usrp_sample, 1);
-        }
+        // push data through resampler and give to receiver
+        unsigned int nw;
+        resampchain_execute(resamp, &buff.front(), num_rx_samps, &buffer_resamp.front(), &nw);
+        mcrx.Execute(&buffer_resamp.front(), nw);
 
         // check runtime
         if (timer_toc(t0) >= num_seconds)
@@ -221,7 +350,20 @@ int main (int argc, char **argv)
     printf("\n");
     printf("usrp data transfer complete\n");
  
+    // print traffic check results
+    trafficcheck_print(tcheck, timer_toc(t0));
+    trafficcheck_destroy(tcheck);
+
+    // close packet log
+    if (plog != NULL) {
+        packetlog_print(plog);
+        packetlog_destroy(plog);
+        printf("packet log written to '%s'\n", log_filename);
+    }
+
     // destroy objects
+    resampchain_destroy(resamp);
+    rateplan_destroy(plan);
     timer_destroy(t0);
 
     return 0;
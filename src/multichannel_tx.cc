@@ -27,6 +27,9 @@
 #include <uhd/usrp/multi_usrp.hpp>
 
 #include "multichanneltx.h"
+#include "rateplan.h"
+#include "resampchain.h"
+#include "trafficgen.h"
 
 void usage() {
     printf("multichannel_tx [OPTION]\n");
@@ -104,16 +107,18 @@ int main (int argc, char **argv)
     uhd::usrp::multi_usrp::sptr usrp = uhd::usrp::multi_usrp::make(dev_addr);
 
     // set properties
-    // TODO: compensate for rate provided by multichanneltx
     double tx_rate = num_channels*bandwidth;
 
-    // try to set tx rate
-    usrp->set_tx_rate(2.0f*tx_rate);
+    // plan device rate and resampling up from the synthesizer output
+    // (twice the channelized rate)
+    rateplan plan = rateplan_create_tx(usrp, 2.0*tx_rate, 0.25f, 60.0f, 0.0);
+    if (plan == NULL)
+        exit(1);
 
-    // get actual tx rate
+    // try to set tx rate, then resample to the actual rate
+    usrp->set_tx_rate(rateplan_get_device_rate(plan));
     double usrp_tx_rate = usrp->get_tx_rate();
-
-    // compute arbitrary resampling rate
+    resampchain resamp = resampchain_create(plan, usrp_tx_rate);
     double tx_resamp_rate = usrp_tx_rate / tx_rate;
 
     usrp->set_tx_freq(frequency);
@@ -126,6 +131,7 @@ int main (int argc, char **argv)
             tx_rate      * 1e-3f,
             tx_resamp_rate);
     printf("verbosity       :   %s\n", (verbose?"enabled":"disabled"));
+    rateplan_print(plan);
 
     // set the IF filter bandwidth
     //usrp->set_tx_bandwidth(2.0f*tx_rate);
@@ -137,9 +143,9 @@ int main (int argc, char **argv)
     // data arrays
     unsigned char header[8];
     unsigned char payload[payload_len];
-    unsigned int pid[num_channels];
+    trafficgen tgen[num_channels];
     for (i=0; i<num_channels; i++)
-        pid[i] = 0;
+        tgen[i] = trafficgen_create(TRAFFICGEN_DEFAULT_SEED, i, 8);
     
     // create multichannel transmitter object
     unsigned char * p = NULL;   // default subcarrier allocation
@@ -149,6 +155,9 @@ int main (int argc, char **argv)
     unsigned int mctx_buffer_len = 2*num_channels;
     std::complex<float> mctx_buffer[mctx_buffer_len];
 
+    // create buffer for resampler output
+    std::vector<std::complex<float> > buf_resamp(resampchain_get_max_output(resamp, mctx_buffer_len));
+
     // vector buffer to send data to USRP
     std::vector<std::complex<float> > usrp_buffer(256);
     unsigned int usrp_sample_counter = 0;
@@ -165,19 +174,9 @@ int main (int argc, char **argv)
         unsigned int channel_id;
         for (channel_id=0; channel_id<num_channels; channel_id++) {
             if (mctx.IsChannelReadyForData(channel_id)) {
-                // increment id
-                pid[channel_id]++;
-
-                // write header (first two bytes packet ID, then channel id, then random)
-                header[0] = (pid[channel_id] >> 8) & 0xff;
-                header[1] = (pid[channel_id]     ) & 0xff;
-                header[2] = channel_id             & 0xff;
-                for (i=3; i<8; i++)
-                    header[i] = rand() & 0xff;
-
-                // initialize payload
-                for (i=0; i<payload_len; i++)
-                    payload[i] = rand() & 0xff;
+                // write header (packet ID, channel id, sequence) and
+                // pseudo-random payload
+                trafficgen_generate(tgen[channel_id], header, payload, payload_len);
 
 #if 0
                 // update payload data (random length)
@@ -189,15 +188,16 @@ int main (int argc, char **argv)
             }
         }
 
-        // generate samples
+        // generate samples and run them through resampler
         mctx.GenerateSamples(mctx_buffer);
-
+        unsigned int nw;    // number of samples output from resampler
+        resampchain_execute(resamp, mctx_buffer, mctx_buffer_len, &buf_resamp.front(), &nw);
 
         // push resulting samples to USRP
-        for (i=0; i<mctx_buffer_len; i++) {
+        for (i=0; i<nw; i++) {
 
             // append to USRP buffer, scaling by software
-            usrp_buffer[usrp_sample_counter++] = g*mctx_buffer[i];
+            usrp_buffer[usrp_sample_counter++] = g*buf_resamp[i];
 
             // once USRP buffer is full, reset counter and send to device
             if (usrp_sample_counter==256) {
@@ -230,6 +230,12 @@ int main (int argc, char **argv)
     //finished
     printf("usrp data transfer complete\n");
 
+    // destroy objects
+    for (i=0; i<num_channels; i++)
+        trafficgen_destroy(tgen[i]);
+    resampchain_destroy(resamp);
+    rateplan_destroy(plan);
+
     return 0;
 }
 
@@ -55,7 +55,9 @@
 #include <assert.h>
 
 #include "multichanneltxrx.h"
+#include "tddsched.h"
 #include "timer.h"
+#include "trafficgen.h"
 
 void usage() {
     printf("multichannel_txrx [OPTION]\n");
@@ -78,13 +80,21 @@ void usage() {
     printf("  k     : coding scheme (outer),  default: none\n");
     liquid_print_fec_schemes();
     printf("  t     : total runtime [s],      default:   30 s\n");
+    printf("  a     : adaptive modulation and coding per channel (ignores m,c,k; peer must also use -a)\n");
+    printf("  s     : slotted (TDD) operation on device time, guard time [s];\n");
+    printf("          peers must share device time (see -p)\n");
+    printf("  R     : slotted: receive first\n");
+    printf("  E     : slotted: TDD epoch (device time of frame 0) [s], default: 0\n");
+    printf("  p     : slotted: set device time from host UTC time at next PPS edge\n");
 }
 
-// assemble packet
-void assemble_packet(unsigned int    _pid,
-                     unsigned char * _header,
-                     unsigned char * _payload,
-                     unsigned int    _payload_len);
+// assemble packet _seq on channel _channel; returns its pseudo-random
+// length in [1,_max_len], reproducible from channel and sequence number
+unsigned int assemble_packet(unsigned int    _channel,
+                             unsigned int    _seq,
+                             unsigned char * _header,
+                             unsigned char * _payload,
+                             unsigned int    _max_len);
 
 // set timespec for timeout
 //  _ts         :   pointer to timespec structure
@@ -103,16 +113,26 @@ int callback(unsigned char *  _header,
 
 static bool verbose = true;
 
+// per-channel callback data
+struct channel_s {
+    unsigned int id;        // channel index
+    amc controller;         // AMC controller (NULL if disabled)
+    multichanneltxrx * txcvr; // transceiver (frame timestamps)
+};
+
 // data counters
 unsigned int num_frames_detected;
 unsigned int num_valid_headers_received;
 unsigned int num_valid_packets_received;
 unsigned int num_valid_bytes_received;
 
+// generated traffic checker
+trafficcheck tcheck = NULL;
+
 int main (int argc, char **argv)
 {
     // command-line options
-    float frequency = 462.0e6;          // carrier frequency
+    double frequency = 462.0e6;         // carrier frequency
     float bandwidth = 1000e3f;          // bandwidth
     float txgain_dB = -12.0f;           // software tx gain [dB]
     float uhd_txgain = 40.0;            // uhd (hardware) tx gain
@@ -135,10 +155,15 @@ int main (int argc, char **argv)
     float tx_burst_time = 0.250;        // time of transmit burst
     float rx_burst_time = 2.500;        // time of receive burst
     float runtime       = 30.00;        // total run time
+    bool adaptive       = false;        // adaptive modulation and coding?
+    float slot_guard    = -1.0f;        // TDD guard time (negative: not slotted)
+    bool rx_first       = false;        // TDD: receive slot first?
+    double epoch        = 0.0;          // TDD: device time of frame 0 [s]
+    bool time_pps       = false;        // TDD: set device time at PPS?
     
     //
     int d;
-    while ((d = getopt(argc,argv,"uhqvf:b:g:G:M:C:T:n:P:m:c:k:")) != EOF) {
+    while ((d = getopt(argc,argv,"uhqvf:b:g:G:M:C:T:n:P:m:c:k:t:as:RE:p")) != EOF) {
         switch (d) {
         case 'u':
         case 'h':   usage();                        return 0;
@@ -157,6 +182,11 @@ int main (int argc, char **argv)
         case 'c':   fec0        = liquid_getopt_str2fec(optarg);    break;
         case 'k':   fec1        = liquid_getopt_str2fec(optarg);    break;
         case 't':   runtime     = atof(optarg);     break;
+        case 'a':   adaptive    = true;             break;
+        case 's':   slot_guard  = atof(optarg);     break;
+        case 'R':   rx_first    = true;             break;
+        case 'E':   epoch       = atof(optarg);     break;
+        case 'p':   time_pps    = true;             break;
         default:    usage();                        return 0;
         }
     }
@@ -176,6 +206,9 @@ int main (int argc, char **argv)
     } else if (num_channels == 0) {
         fprintf(stderr,"error: %s, number of channels must be greater than zero\n", argv[0]);
         exit(-1);
+    } else if (payload_len == 0) {
+        fprintf(stderr,"error: %s, payload length must be greater than zero\n", argv[0]);
+        exit(-1);
     }
 
     unsigned int i;
@@ -187,14 +220,27 @@ int main (int argc, char **argv)
     pthread_cond_init(&rx_cond,   NULL);
 
     // create transceiver object
+    struct channel_s channels[num_channels];
     void * userdata[num_channels];
     framesync_callback callbacks[num_channels];
     for (i=0; i<num_channels; i++) {
-        userdata[i] = NULL;  //(void*)&rx_cond);
+        channels[i].id         = i;
+        channels[i].controller = NULL;
+        channels[i].txcvr      = NULL;
+        userdata[i] = (void*)&channels[i];
         callbacks[i] = callback;
     }
     unsigned char * p = NULL;   // default subcarrier allocation
     multichanneltxrx txcvr(num_channels, M, cp_len, taper_len, p, callbacks, userdata);
+    for (i=0; i<num_channels; i++)
+        channels[i].txcvr = &txcvr;
+
+    // enable per-channel adaptive modulation and coding
+    if (adaptive) {
+        txcvr.amc_enable(NULL, 0);
+        for (i=0; i<num_channels; i++)
+            channels[i].controller = txcvr.get_amc(i);
+    }
 
     // set transmit properties
     txcvr.set_tx_freq(frequency);
@@ -209,11 +255,17 @@ int main (int argc, char **argv)
 
     // data arrays
     unsigned char header[8];
-    unsigned char payload[payload_len];
+    unsigned char payload[payload_len + AMC_REPORT_LEN];
 
-    // packet counter
+    // packet counter, and sequence number per channel
     unsigned int pid=0;
+    unsigned int seq[num_channels];
+    for (i=0; i<num_channels; i++)
+        seq[i] = 0;
     
+    // create traffic checker
+    tcheck = trafficcheck_create(TRAFFICGEN_DEFAULT_SEED, 8);
+
     // reset counters
     num_frames_detected=0;
     num_valid_headers_received=0;
@@ -224,7 +276,64 @@ int main (int argc, char **argv)
     timer timer_runtime = timer_create();    timer_tic(timer_runtime);
     timer timer_tx      = timer_create();    timer_tic(timer_tx);
     //timer timer_rx      = timer_create();    timer_tic(timer_rx);
-    while ( timer_toc(timer_runtime) < runtime ) {
+
+    // slotted operation: tx and rx slots of a TDD frame are launched at
+    // device times, separated by the guard time; both peers count
+    // frames from the same epoch on a shared device time
+    tddsched sched = NULL;
+    if (slot_guard >= 0.0f) {
+        sched = tddsched_create(tx_burst_time + rx_burst_time + 2*slot_guard, slot_guard);
+        double tx_offset = rx_first ? rx_burst_time + slot_guard : 0.0;
+        double rx_offset = rx_first ? 0.0 : tx_burst_time + slot_guard;
+        tddsched_add_slot(sched, TDDSCHED_SLOT_TX, tx_offset, tx_burst_time);
+        tddsched_add_slot(sched, TDDSCHED_SLOT_RX, rx_offset, rx_burst_time);
+        tddsched_set_epoch(sched, epoch);
+        if (time_pps) {
+            printf("setting device time at next PPS edge...\n");
+            txcvr.set_time_pps();
+        }
+        printf("device time     :   %12.6f s\n", txcvr.get_time_now());
+        tddsched_print(sched);
+    }
+
+    while ( sched != NULL && timer_toc(timer_runtime) < runtime ) {
+        // next tx slot, leaving time to queue the burst
+        double tx_start, tx_len;
+        tddsched_next(sched, TDDSCHED_SLOT_TX, txcvr.get_time_now() + 0.010, &tx_start, &tx_len);
+
+        // transmit burst of exactly the slot length; stop submitting
+        // packets halfway through to leave time for frames in flight
+        txcvr.start_tx_at(tx_start, tx_len);
+        printf("transmitting burst at %12.6f s...\n", tx_start);
+        while (true) {
+            // wait for a channel, but no later than the submit deadline
+            double time_left = tx_start + 0.5*tx_len - txcvr.get_time_now();
+            if (time_left <= 0.0)
+                break;
+            int c = txcvr.get_available_channel((float)time_left);
+            if (c < 0)
+                break;
+            unsigned int this_packet_len = assemble_packet(c, seq[c]++, header, payload, payload_len);
+            if (adaptive) {
+                amc_report_write(channels[c].controller, payload + this_packet_len);
+                txcvr.transmit_packet(c, header, payload, this_packet_len + AMC_REPORT_LEN);
+            } else {
+                txcvr.transmit_packet(c, header, payload, this_packet_len, ms, fec0, fec1);
+            }
+            pid++;
+        }
+        txcvr.wait_until(tx_start + tx_len);
+        txcvr.stop_tx();
+
+        // receive over the following rx slot
+        double rx_start, rx_len;
+        tddsched_next(sched, TDDSCHED_SLOT_RX, tx_start + tx_len, &rx_start, &rx_len);
+        txcvr.start_rx_at(rx_start, rx_len);
+        txcvr.wait_until(rx_start + rx_len);
+        txcvr.stop_rx();
+    } // slotted runtime loop
+
+    while ( sched == NULL && timer_toc(timer_runtime) < runtime ) {
         //if (verbose) printf("tx packet id: %6u\n", pid);
 
         // reset tx burst timer
@@ -239,13 +348,21 @@ int main (int argc, char **argv)
             assert( c < num_channels);
 
             // assemble packet
-            unsigned int this_packet_len = rand() % payload_len;
-            assemble_packet(pid, header, payload, this_packet_len);
+            unsigned int this_packet_len = assemble_packet(c, seq[c]++, header, payload, payload_len);
+
+            // append this channel's report on frames received from the peer
+            if (adaptive) {
+                amc_report_write(channels[c].controller, payload + this_packet_len);
+                this_packet_len += AMC_REPORT_LEN;
+            }
             
             // transmit frame on channel 'c'
             printf("transmitting packet %6u (%6u bytes) on channel %6u\n", pid, this_packet_len, c);
             //int rc =
-            txcvr.transmit_packet(c, header, payload, this_packet_len, ms, fec0, fec1);
+            if (adaptive)
+                txcvr.transmit_packet(c, header, payload, this_packet_len);
+            else
+                txcvr.transmit_packet(c, header, payload, this_packet_len, ms, fec0, fec1);
 
             // update packet counter on channel 'c'
             pid++;
@@ -290,8 +407,16 @@ int main (int argc, char **argv)
     printf("    bytes received      : %6u\n", num_valid_bytes_received);
     printf("    run time            : %f s\n", runtime);
     printf("    data rate           : %8.4f kbps\n", data_rate*1e-3f);
+    trafficcheck_print(tcheck, runtime);
+    for (i=0; i<num_channels && adaptive; i++) {
+        printf("channel %u:\n", i);
+        amc_print(channels[i].controller);
+    }
 
     // destroy objects
+    if (sched != NULL)
+        tddsched_destroy(sched);
+    trafficcheck_destroy(tcheck);
     timer_destroy(timer_runtime);
     timer_destroy(timer_tx);
     //timer_destroy(timer_rx);
@@ -303,22 +428,21 @@ int main (int argc, char **argv)
 }
 
 // assemble packet
-void assemble_packet(unsigned int    _pid,
-                     unsigned char * _header,
-                     unsigned char * _payload,
-                     unsigned int    _payload_len)
+unsigned int assemble_packet(unsigned int    _channel,
+                             unsigned int    _seq,
+                             unsigned char * _header,
+                             unsigned char * _payload,
+                             unsigned int    _max_len)
 {
-    // write header (first two bytes packet ID, remaining are random)
-    _header[0] = (_pid >> 8) & 0xff;
-    _header[1] = (_pid     ) & 0xff;
-
-    unsigned int i;
-    for (i=2; i<8; i++)
-        _header[i] = rand() & 0xff;
-
-    // initialize payload
-    for (i=0; i<_payload_len; i++)
-        _payload[i] = rand() & 0xff;
+    // draw length from the generator (keyed apart from the payload)
+    unsigned char r[4];
+    trafficgen_prbs(~TRAFFICGEN_DEFAULT_SEED, _channel, _seq, r, 4);
+    unsigned int len = 1 + (((unsigned int)r[0] << 24) | (r[1] << 16) | (r[2] << 8) | r[3]) % _max_len;
+
+    // write header (packet ID, sequence) and pseudo-random payload
+    trafficgen_assemble(TRAFFICGEN_DEFAULT_SEED, _channel, _seq, _header, 8,
+                        _payload, len);
+    return len;
 }
 
 // set timespec for timeout
@@ -351,17 +475,34 @@ int callback(unsigned char *  _header,
              framesyncstats_s _stats,
              void *           _userdata)
 {
+    struct channel_s * channel = (struct channel_s*) _userdata;
+
     if (verbose) {
         int pid         = _header_valid ? (_header[0] << 8 | _header[1]) : -1;
         int payload_len = _header_valid ? _payload_len : -1;
-        printf("***** rssi=%7.2fdB evm=%7.2fdB, header:%4s, payload[%6d,%6d bytes]:%4s\n",
-                _stats.rssi, _stats.evm,
+        double t        = channel->txcvr != NULL ? channel->txcvr->get_frame_time() : -1.0;
+        printf("***** ch=%u t=%12.6f s, rssi=%7.2fdB evm=%7.2fdB, header:%4s, payload[%6d,%6d bytes]:%4s\n",
+                channel->id, t, _stats.rssi, _stats.evm,
                 _header_valid  ? "pass" : "FAIL",
                 pid,
                 payload_len,
                 _payload_valid ? "pass" : "FAIL");
     }
 
+    // measure frame for this channel's report and strip the peer's
+    // report from the payload
+    if (channel->controller != NULL) {
+        amc_observe(channel->controller, _header_valid, _payload_valid, _stats);
+        if (_header_valid && _payload_len > AMC_REPORT_LEN) {
+            _payload_len -= AMC_REPORT_LEN;
+            if (_payload_valid)
+                amc_report_read(channel->controller, _payload + _payload_len);
+        }
+    }
+
+    // check content of generated traffic
+    trafficcheck_execute(tcheck, _header, _header_valid, _payload, _payload_len, _payload_valid);
+
     // update global counters
     num_frames_detected++;
 
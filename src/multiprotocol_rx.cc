@@ -0,0 +1,358 @@
+/*
+ * Copyright (c) 2013 Joseph Gaeddert
+ *
+ * This file is part of liquid.
+ *
+ * liquid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * liquid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with liquid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+//
+// multiprotocol_rx.cc
+//
+// monitor one channel for several waveforms at once: the received
+// stream is fanned out to flexframesync, gmskframesync, framesync64 and
+// ofdmflexframesync, each with its own resampler running on its own
+// thread
+//
+
+#include <iostream>
+#include <complex>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <liquid/liquid.h>
+
+#include <uhd/usrp/multi_usrp.hpp>
+
+#include "fanout.h"
+#include "rateplan.h"
+#include "resampchain.h"
+#include "timer.h"
+#include "trafficgen.h"
+
+// supported protocols
+enum {
+    PROTOCOL_FLEXFRAME=0,   // flexframesync,     2 samples/symbol
+    PROTOCOL_GMSKFRAME,     // gmskframesync,     2 samples/symbol
+    PROTOCOL_FRAME64,       // framesync64,       2 samples/symbol
+    PROTOCOL_OFDMFLEXFRAME, // ofdmflexframesync, 1 sample/subcarrier spacing
+    NUM_PROTOCOLS
+};
+
+// protocol branch: rate adapter, synchronizer and statistics; all
+// fields are touched only by the branch's own thread while running
+struct protocol_s {
+    unsigned int type;                  // PROTOCOL_* type
+    const char * name;                  // protocol name
+    double bandwidth;                   // bandwidth [Hz] (0: disabled)
+    double sample_rate;                 // synchronizer input rate [Hz]
+    unsigned int header_len;            // frame header length [bytes]
+
+    rateplan plan;                      // rate adapter plan
+    resampchain resamp;                 // rate adapter
+    std::complex<float> * buffer;       // resampler output
+    void * fs;                          // frame synchronizer
+    trafficcheck tcheck;                // generated traffic checker
+
+    // counters
+    unsigned int num_frames_detected;
+    unsigned int num_valid_headers_received;
+    unsigned int num_valid_packets_received;
+    unsigned int num_valid_bytes_received;
+    unsigned long long int num_samples; // samples into synchronizer
+};
+
+static bool verbose;
+
+// frame callback (on the branch's thread)
+int callback(unsigned char *  _header,
+             int              _header_valid,
+             unsigned char *  _payload,
+             unsigned int     _payload_len,
+             int              _payload_valid,
+             framesyncstats_s _stats,
+             void *           _userdata)
+{
+    struct protocol_s * p = (struct protocol_s*) _userdata;
+
+    if (verbose) {
+        printf("***** %-9s rssi=%7.2fdB evm=%7.2fdB ", p->name, _stats.rssi, _stats.evm);
+        if (_header_valid) {
+            unsigned int packet_id = (_header[0] << 8 | _header[1]);
+            printf("rx packet id: %6u", packet_id);
+            if (_payload_valid) printf("\n");
+            else                printf(" PAYLOAD INVALID\n");
+        } else {
+            printf("HEADER INVALID\n");
+        }
+    }
+
+    // check content of generated traffic
+    trafficcheck_execute(p->tcheck, _header, _header_valid, _payload, _payload_len, _payload_valid);
+
+    // update counters
+    p->num_frames_detected++;
+    if (_header_valid)
+        p->num_valid_headers_received++;
+    if (_payload_valid) {
+        p->num_valid_packets_received++;
+        p->num_valid_bytes_received += _payload_len;
+    }
+
+    return 0;
+}
+
+// fanout branch: resample block and run synchronizer
+void branch_execute(std::complex<float> * _x,
+                    unsigned int          _n,
+                    void *                _userdata)
+{
+    struct protocol_s * p = (struct protocol_s*) _userdata;
+
+    unsigned int nw;
+    resampchain_execute(p->resamp, _x, _n, p->buffer, &nw);
+    p->num_samples += nw;
+
+    switch (p->type) {
+    case PROTOCOL_FLEXFRAME:     flexframesync_execute    ((flexframesync)    p->fs, p->buffer, nw); break;
+    case PROTOCOL_GMSKFRAME:     gmskframesync_execute    ((gmskframesync)    p->fs, p->buffer, nw); break;
+    case PROTOCOL_FRAME64:       framesync64_execute      ((framesync64)      p->fs, p->buffer, nw); break;
+    case PROTOCOL_OFDMFLEXFRAME: ofdmflexframesync_execute((ofdmflexframesync)p->fs, p->buffer, nw); break;
+    default:;
+    }
+}
+
+void usage() {
+    printf("multiprotocol_rx -- receive several waveforms on one channel at once\n");
+    printf("  u,h   :   usage/help\n");
+    printf("  q/v   :   quiet/verbose\n");
+    printf("  f     :   center frequency [Hz],       default:  462 MHz\n");
+    printf("  G     :   uhd rx gain [dB],            default:   20 dB\n");
+    printf("  t     :   run time [seconds],          default:    5 s\n");
+    printf("  F     :   flexframe bandwidth [Hz],    default:  250 kHz (0: disable)\n");
+    printf("  K     :   gmskframe bandwidth [Hz],    default:  100 kHz (0: disable)\n");
+    printf("  P     :   framesync64 bandwidth [Hz],  default:  250 kHz (0: disable)\n");
+    printf("  O     :   ofdmflexframe bandwidth [Hz],default: 1000 kHz (0: disable)\n");
+    printf("  M     :   ofdm: number of subcarriers, default:   48\n");
+    printf("  C     :   ofdm: cyclic prefix length,  default:    6\n");
+    printf("  T     :   ofdm: taper length,          default:    4\n");
+}
+
+int main (int argc, char **argv)
+{
+    // command-line options
+    verbose = true;
+
+    double frequency = 462.0e6;
+    float num_seconds = 5.0f;
+    double uhd_rxgain = 20.0;
+
+    // protocol bandwidths
+    double bandwidth[NUM_PROTOCOLS] = {250e3, 100e3, 250e3, 1000e3};
+
+    // ofdm properties
+    unsigned int M = 48;                // number of subcarriers
+    unsigned int cp_len = 6;            // cyclic prefix length
+    unsigned int taper_len = 4;         // taper length
+
+    //
+    int d;
+    while ((d = getopt(argc,argv,"uhqvf:G:t:F:K:P:O:M:C:T:")) != EOF) {
+        switch (d) {
+        case 'u':
+        case 'h':   usage();                                        return 0;
+        case 'q':   verbose = false;                                break;
+        case 'v':   verbose = true;                                 break;
+        case 'f':   frequency = atof(optarg);                       break;
+        case 'G':   uhd_rxgain = atof(optarg);                      break;
+        case 't':   num_seconds = atof(optarg);                     break;
+        case 'F':   bandwidth[PROTOCOL_FLEXFRAME]     = atof(optarg); break;
+        case 'K':   bandwidth[PROTOCOL_GMSKFRAME]     = atof(optarg); break;
+        case 'P':   bandwidth[PROTOCOL_FRAME64]       = atof(optarg); break;
+        case 'O':   bandwidth[PROTOCOL_OFDMFLEXFRAME] = atof(optarg); break;
+        case 'M':   M = atoi(optarg);                               break;
+        case 'C':   cp_len = atoi(optarg);                          break;
+        case 'T':   taper_len = atoi(optarg);                       break;
+        default:
+            usage();
+            return 1;
+        }
+    }
+
+    if (cp_len == 0 || cp_len > M) {
+        fprintf(stderr,"error: %s, cyclic prefix must be in (0,M]\n", argv[0]);
+        exit(1);
+    }
+
+    // set up protocol table; synchronizer rates follow the
+    // single-protocol receivers
+    const char * names[NUM_PROTOCOLS] = {"flexframe", "gmskframe", "frame64", "ofdmflex"};
+    unsigned int header_len[NUM_PROTOCOLS] = {14, 8, 8, 8};
+    struct protocol_s protocols[NUM_PROTOCOLS];
+    double max_rate = 0.0;
+    unsigned int i;
+    for (i=0; i<NUM_PROTOCOLS; i++) {
+        struct protocol_s * p = &protocols[i];
+        memset(p, 0x00, sizeof(struct protocol_s));
+        p->type        = i;
+        p->name        = names[i];
+        p->bandwidth   = bandwidth[i];
+        p->sample_rate = (i == PROTOCOL_OFDMFLEXFRAME ? 1.0 : 2.0) * bandwidth[i];
+        p->header_len  = header_len[i];
+        if (p->sample_rate > max_rate)
+            max_rate = p->sample_rate;
+    }
+    if (max_rate <= 0.0) {
+        fprintf(stderr,"error: %s, all protocols disabled\n", argv[0]);
+        exit(1);
+    }
+
+    uhd::device_addr_t dev_addr;
+    uhd::usrp::multi_usrp::sptr usrp = uhd::usrp::multi_usrp::make(dev_addr);
+
+    // one device rate for all branches, planned for the fastest one
+    rateplan plan = rateplan_create_rx(usrp, max_rate, RATEPLAN_PASSBAND, 60.0f, 0.0);
+    if (plan == NULL)
+        exit(1);
+    usrp->set_rx_rate(rateplan_get_device_rate(plan));
+    double usrp_rx_rate = usrp->get_rx_rate();
+    rateplan_destroy(plan);
+    usrp->set_rx_freq(frequency);
+    usrp->set_rx_gain(uhd_rxgain);
+
+    printf("frequency   :   %12.8f [MHz]\n", frequency*1e-6);
+    printf("usrp rate   :   %12.8f [kHz]\n", usrp_rx_rate*1e-3);
+    printf("verbosity   :   %s\n", (verbose?"enabled":"disabled"));
+
+    // create fanout and one branch per enabled protocol
+    fanout q = fanout_create(0);
+    for (i=0; i<NUM_PROTOCOLS; i++) {
+        struct protocol_s * p = &protocols[i];
+        if (p->bandwidth <= 0.0)
+            continue;
+
+        // plan resampling from the (fixed) actual device rate
+        struct rateplan_range_s device_range = {usrp_rx_rate, usrp_rx_rate, 0.0};
+        p->plan = rateplan_create(RATEPLAN_DECIM, p->sample_rate, RATEPLAN_PASSBAND, 60.0f, 0.0, &device_range, 1);
+        if (p->plan == NULL) {
+            fprintf(stderr,"error: %s, %s rate exceeds device rate\n", argv[0], p->name);
+            exit(1);
+        }
+        p->resamp = resampchain_create(p->plan, usrp_rx_rate);
+        double resamp_rate = resampchain_get_rate(p->resamp);
+        p->buffer = (std::complex<float>*) malloc(resampchain_get_max_output(p->resamp, FANOUT_MAX_BLOCK_LEN)*sizeof(std::complex<float>));
+        p->tcheck = trafficcheck_create(TRAFFICGEN_DEFAULT_SEED, p->header_len);
+        switch (p->type) {
+        case PROTOCOL_FLEXFRAME:     p->fs = flexframesync_create(callback, (void*)p);   break;
+        case PROTOCOL_GMSKFRAME:     p->fs = gmskframesync_create(callback, (void*)p);   break;
+        case PROTOCOL_FRAME64:       p->fs = framesync64_create  (callback, (void*)p);   break;
+        case PROTOCOL_OFDMFLEXFRAME:
+            p->fs = ofdmflexframesync_create(M, cp_len, taper_len, NULL, callback, (void*)p);
+            break;
+        default:;
+        }
+        fanout_add_branch(q, branch_execute, (void*)p);
+        printf("  %-9s :   %12.8f kHz (resamp %8.6f)\n", p->name, p->sample_rate*1e-3, resamp_rate);
+    }
+    fanout_start(q);
+
+    //allocate recv buffer and metatdata
+    uhd::rx_metadata_t md;
+    const size_t max_samps_per_packet = usrp->get_device()->get_max_recv_samps_per_packet();
+    std::vector<std::complex<float> > buff(max_samps_per_packet);
+
+    // start data transfer
+    usrp->issue_stream_cmd(uhd::stream_cmd_t::STREAM_MODE_START_CONTINUOUS);
+    printf("usrp data transfer started\n");
+
+    // run conditions
+    int continue_running = 1;
+    timer t0 = timer_create();
+    timer_tic(t0);
+
+    while (continue_running) {
+        // grab data from device
+        size_t num_rx_samps = usrp->get_device()->recv(
+            &buff.front(), buff.size(), md,
+            uhd::io_type_t::COMPLEX_FLOAT32,
+            uhd::device::RECV_MODE_ONE_PACKET
+        );
+
+        // 'handle' the error codes
+        switch(md.error_code){
+        case uhd::rx_metadata_t::ERROR_CODE_NONE:
+        case uhd::rx_metadata_t::ERROR_CODE_OVERFLOW:
+            break;
+
+        default:
+            std::cerr << "Error code: " << md.error_code << std::endl;
+            std::cerr << "Unexpected error on recv, exit test..." << std::endl;
+            return 1;
+        }
+
+        // hand packet to all branches (copy only)
+        fanout_write(q, &buff.front(), num_rx_samps);
+
+        // check runtime
+        if (timer_toc(t0) >= num_seconds)
+            continue_running = 0;
+    }
+
+    // compute actual run-time
+    float runtime = timer_toc(t0);
+
+    // stop data transfer
+    usrp->issue_stream_cmd(uhd::stream_cmd_t::STREAM_MODE_STOP_CONTINUOUS);
+    printf("\n");
+    printf("usrp data transfer complete\n");
+
+    // let branches finish and stop their threads
+    fanout_print(q);
+    fanout_destroy(q);
+
+    // print results for each protocol
+    for (i=0; i<NUM_PROTOCOLS; i++) {
+        struct protocol_s * p = &protocols[i];
+        if (p->bandwidth <= 0.0)
+            continue;
+
+        printf("%s:\n", p->name);
+        printf("    frames detected     : %6u\n", p->num_frames_detected);
+        printf("    valid headers       : %6u\n", p->num_valid_headers_received);
+        printf("    valid packets       : %6u\n", p->num_valid_packets_received);
+        printf("    bytes received      : %6u\n", p->num_valid_bytes_received);
+        printf("    samples processed   : %6llu\n", p->num_samples);
+        printf("    data rate           : %8.4f kbps\n", p->num_valid_bytes_received * 8.0f / runtime * 1e-3f);
+        trafficcheck_print(p->tcheck, runtime);
+
+        // destroy objects
+        switch (p->type) {
+        case PROTOCOL_FLEXFRAME:     flexframesync_destroy    ((flexframesync)    p->fs); break;
+        case PROTOCOL_GMSKFRAME:     gmskframesync_destroy    ((gmskframesync)    p->fs); break;
+        case PROTOCOL_FRAME64:       framesync64_destroy      ((framesync64)      p->fs); break;
+        case PROTOCOL_OFDMFLEXFRAME: ofdmflexframesync_destroy((ofdmflexframesync)p->fs); break;
+        default:;
+        }
+        resampchain_destroy(p->resamp);
+        rateplan_destroy(p->plan);
+        trafficcheck_destroy(p->tcheck);
+        free(p->buffer);
+    }
+    timer_destroy(t0);
+
+    return 0;
+}
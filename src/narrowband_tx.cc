@@ -28,6 +28,10 @@
 #include <uhd/usrp/multi_usrp.hpp>
 
 #include "timer.h"
+#include "arbwave.h"
+#include "rateplan.h"
+#include "resampchain.h"
+#include "trafficgen.h"
 
 void usage() {
     printf("narrowband_tx [OPTION]\n");
@@ -36,7 +40,7 @@ void usage() {
     printf("  h     : usage/help\n");
     printf("  q/v   : quiet/verbose\n");
     printf("  f     : center frequency [Hz]\n");
-    printf("  b     : symbol rate [Hz] (40kHz min, 8MHz max), default: 160kHz\n");
+    printf("  b     : symbol rate [Hz], default: 160kHz\n");
     printf("  g     : software tx gain [dB] (default: -10dB)\n");
     printf("  G     : uhd tx gain [dB] (default: 40dB)\n");
     printf("  t     : execute time [s], default: 10\n");
@@ -45,6 +49,11 @@ void usage() {
     printf("  K     : matched filter samples/symbol,  default: 2\n");
     printf("  M     : matched filter semi-length,     default: 9\n");
     printf("  B     : matchedfilter excess bandwidth, default: 0.2\n");
+    printf("  A     : arb mode: render waveform of this duration [s] once and loop it\n");
+    printf("  I     : arb mode: load waveform (complex float I/Q at device rate) and loop it\n");
+    printf("  O     : arb mode: save rendered waveform to file\n");
+    printf("  S     : arb mode: gain step per loop [dB], default: 0\n");
+    printf("  L     : arb mode: number of gain steps before repeating, default: 1\n");
 }
 
 int main (int argc, char **argv)
@@ -67,9 +76,16 @@ int main (int argc, char **argv)
     unsigned int m = 9;         // matched-filter semi-length
     float beta     = 0.2f;      // excess bandwidth factor
 
+    // arbitrary waveform mode
+    float arb_seconds = 0.0f;           // rendered duration (0: off)
+    char arb_filename_in[256]  = "";    // waveform to load
+    char arb_filename_out[256] = "";    // rendered waveform to save
+    float arb_step_dB = 0.0f;           // gain step per loop
+    unsigned int arb_num_steps = 1;     // gain steps before repeating
+
     //
     int d;
-    while ((d = getopt(argc,argv,"hqvf:b:g:G:t:m:F:K:M:B:")) != EOF) {
+    while ((d = getopt(argc,argv,"hqvf:b:g:G:t:m:F:K:M:B:A:I:O:S:L:")) != EOF) {
         switch (d) {
         case 'h':   usage();                        return 0;
         case 'q':   verbose = false;                break;
@@ -103,6 +119,11 @@ int main (int argc, char **argv)
         case 'K':   k    = atoi(optarg);    break;
         case 'M':   m    = atoi(optarg);    break;
         case 'B':   beta = atof(optarg);    break;
+        case 'A':   arb_seconds = atof(optarg);             break;
+        case 'I':   strncpy(arb_filename_in,optarg,255);    break;
+        case 'O':   strncpy(arb_filename_out,optarg,255);   break;
+        case 'S':   arb_step_dB = atof(optarg);             break;
+        case 'L':   arb_num_steps = atoi(optarg);           break;
         default:
             usage();
             return 0;
@@ -118,6 +139,9 @@ int main (int argc, char **argv)
     } else if (beta <= 0.0f || beta > 1.0f) {
         fprintf(stderr,"error: %s, filter excess bandwidth must be in (0, 1]\n", argv[0]);
         exit(1);
+    } else if (arb_num_steps < 1) {
+        fprintf(stderr,"error: %s, number of gain steps must be at least 1\n", argv[0]);
+        exit(1);
     }
 
     uhd::device_addr_t dev_addr;
@@ -125,14 +149,17 @@ int main (int argc, char **argv)
     //dev_addr["addr1"] = "192.168.10.3";
     uhd::usrp::multi_usrp::sptr usrp = uhd::usrp::multi_usrp::make(dev_addr);
 
-    // try to set tx rate (oversampled to compensate for CIC filter)
-    usrp->set_tx_rate(2.0f * k * bandwidth);
+    // plan device rate and resampling up from k samples/symbol; the
+    // passband is the occupied bandwidth of the matched filter
+    float fp = 0.5f*(1.0f + beta) / k;
+    rateplan plan = rateplan_create_tx(usrp, k * bandwidth, fp < 0.45f ? fp : 0.45f, 60.0f, 0.0);
+    if (plan == NULL)
+        exit(1);
 
-    // get actual tx rate
+    // try to set tx rate, then resample to the actual rate
+    usrp->set_tx_rate(rateplan_get_device_rate(plan));
     double usrp_tx_rate = usrp->get_tx_rate();
-
-    // compute arbitrary resampling rate (make up the difference in software)
-    double tx_resamp_rate = usrp_tx_rate / (k * bandwidth);
+    resampchain resamp = resampchain_create(plan, usrp_tx_rate);
 
     usrp->set_tx_freq(frequency);
     usrp->set_tx_gain(uhd_txgain);
@@ -144,7 +171,8 @@ int main (int argc, char **argv)
             usrp_tx_rate * 1e-3f,
             bandwidth    * 1e-3f,
             k,
-            tx_resamp_rate);
+            resampchain_get_rate(resamp));
+    rateplan_print(plan);
 
     // set the IF filter bandwidth
     //usrp->set_tx_bandwidth(2.0f*tx_rate);
@@ -156,22 +184,67 @@ int main (int argc, char **argv)
     // create matched filter interpolator
     firinterp_crcf mfinterp = firinterp_crcf_create_rnyquist(ftype, k, m, beta, 0);
 
-    // create arbitrary resampler
-    msresamp_crcf resamp = msresamp_crcf_create(tx_resamp_rate,60.0f);
-
     // transmitter gain (linear)
     float g = powf(10.0f, txgain_dB/20.0f);
 
     // buffer lengths
     unsigned int num_symbols = 40;  // number of symbols per buffer
-    unsigned int resamp_buffer_len = 64 + ceilf(2.2*k*num_symbols*tx_resamp_rate);
-    if (resamp_buffer_len < k*num_symbols)
-        resamp_buffer_len = k*num_symbols;
+    unsigned int resamp_buffer_len = resampchain_get_max_output(resamp, k*num_symbols);
 
     // buffers
+    unsigned char symbols[num_symbols];
     std::complex<float> buffer[num_symbols];
     std::complex<float> buffer_interp[k*num_symbols];
     std::complex<float> buffer_resamp[resamp_buffer_len];
+    unsigned int j;
+
+    // arbitrary waveform mode: render (or load) once, then loop
+    arbwave arb = NULL;
+    if (arb_filename_in[0] != '\0') {
+        arb = arbwave_create_from_file(arb_filename_in);
+        if (arb == NULL)
+            exit(1);
+    } else if (arb_seconds > 0.0f) {
+        // one period of random symbols through the matched filter; the
+        // second pass is kept so that the period wraps without a seam.
+        // The period spans at least the filter histories and is rounded
+        // up to a whole number of device samples.
+        unsigned int min_symbols = 2*m;
+        unsigned int resamp_symbols = (unsigned int) ceil(2.0*resampchain_get_delay(resamp) /
+                                                          (k*resampchain_get_rate(resamp)));
+        if (min_symbols < resamp_symbols)
+            min_symbols = resamp_symbols;
+        unsigned int num_arb_symbols = (unsigned int) ceil(arb_seconds * bandwidth);
+        if (num_arb_symbols < min_symbols)
+            num_arb_symbols = min_symbols;
+        unsigned int max_arb_symbols = 2*num_arb_symbols;
+        while (num_arb_symbols <= max_arb_symbols && !resampchain_is_periodic(resamp, k*num_arb_symbols))
+            num_arb_symbols++;
+        if (num_arb_symbols > max_arb_symbols) {
+            fprintf(stderr,"error: %s, no waveform period near %.6f s wraps exactly at %.4f kHz; try another duration or bandwidth\n",
+                    argv[0], arb_seconds, usrp_tx_rate*1e-3);
+            exit(1);
+        }
+
+        std::vector<unsigned char> arb_data(num_arb_symbols);
+        std::vector<std::complex<float> > arb_symbols(num_arb_symbols);
+        std::vector<std::complex<float> > arb_interp(k*num_arb_symbols);
+        trafficgen_prbs(TRAFFICGEN_DEFAULT_SEED, 0, 0, &arb_data.front(), num_arb_symbols);
+        for (j=0; j<num_arb_symbols; j++)
+            modem_modulate(mod, arb_data[j] % M, &arb_symbols[j]);
+        unsigned int pass;
+        for (pass=0; pass<2; pass++) {
+            for (j=0; j<num_arb_symbols; j++)
+                firinterp_crcf_execute(mfinterp, arb_symbols[j], &arb_interp[k*j]);
+        }
+        arb = arbwave_create_periodic(resamp, &arb_interp.front(), k*num_arb_symbols);
+    }
+    if (arb != NULL) {
+        arbwave_set_gain(arb, txgain_dB, arb_step_dB, arb_num_steps);
+        if (arb_filename_out[0] != '\0' && arbwave_save(arb, arb_filename_out) == 0)
+            printf("waveform written to '%s'\n", arb_filename_out);
+        arbwave_print(arb);
+    }
 
     // set up the metadata flags
     std::vector<std::complex<float> > buff(256);
@@ -182,27 +255,35 @@ int main (int argc, char **argv)
     md.has_time_spec  = false;  // set to false to send immediately
 
     // run conditions
-    int continue_running = 1;
+    int continue_running = arb == NULL;
     timer t0 = timer_create();
     timer_tic(t0);
-    
-    unsigned int j;
+
+    // arbitrary waveform mode: stream precomputed samples
+    std::vector<std::complex<float> > arb_buffer(arb == NULL ? 0 : 4096);
+    while (arb != NULL && timer_toc(t0) < num_seconds) {
+        unsigned int n = arbwave_read(arb, &arb_buffer.front(), arb_buffer.size());
+        usrp->get_device()->send(
+            &arb_buffer.front(), n, md,
+            uhd::io_type_t::COMPLEX_FLOAT32,
+            uhd::device::SEND_MODE_FULL_BUFF
+        );
+    }
+
+    unsigned int block = 0;
     while (continue_running) {
-        // generate random modem symbols
+        // generate pseudo-random modem symbols
+        trafficgen_prbs(TRAFFICGEN_DEFAULT_SEED, 0, block++, symbols, num_symbols);
         for (j=0; j<num_symbols; j++)
-            modem_modulate(mod, rand()%M, &buffer[j]);
+            modem_modulate(mod, symbols[j] % M, &buffer[j]);
 
         // interpolate by k
         for (j=0; j<num_symbols; j++)
             firinterp_crcf_execute(mfinterp, buffer[j], &buffer_interp[k*j]);
         
-        // resample
-        unsigned int nw;
-        unsigned int n=0;
-        for (j=0; j<k*num_symbols; j++) {
-            msresamp_crcf_execute(resamp, &buffer_interp[j], 1, &buffer_resamp[n], &nw);
-            n += nw;
-        }
+        // resample to device rate
+        unsigned int n;
+        resampchain_execute(resamp, buffer_interp, k*num_symbols, buffer_resamp, &n);
 
         // push samples into buffer
         for (j=0; j<n; j++) {
@@ -241,11 +322,12 @@ int main (int argc, char **argv)
     printf("usrp data transfer complete\n");
 
     // clean it up
-#if 0
-    resamp_crcf_destroy(resamp);
-#else
-    msresamp_crcf_destroy(resamp);
-#endif
+    if (arb != NULL) {
+        arbwave_print(arb);
+        arbwave_destroy(arb);
+    }
+    resampchain_destroy(resamp);
+    rateplan_destroy(plan);
     modem_destroy(mod);
     firinterp_crcf_destroy(mfinterp);
     timer_destroy(t0);
@@ -24,15 +24,26 @@
 #include <stdlib.h>
 #include <getopt.h>
 #include <assert.h>
+#include <pthread.h>
 #include <liquid/liquid.h>
 
 #include <uhd/usrp/multi_usrp.hpp>
  
 #include "ofdmtxrx.h"
+#include "bufpool.h"
 #include "timer.h"
+#include "packetlog.h"
+#include "chunkdecoder.h"
+#include "trafficgen.h"
 
 static bool verbose;
 
+// binary packet log (optional)
+static packetlog plog = NULL;
+
+// generated traffic checker
+static trafficcheck tcheck = NULL;
+
 // data counters
 unsigned int num_frames_detected;
 unsigned int num_valid_headers_received;
@@ -65,6 +76,13 @@ int callback(unsigned char *  _header,
     } else {
     }
 
+    // log frame
+    if (plog != NULL)
+        packetlog_write(plog, 0, _header, _header_valid, _payload, _payload_len, _payload_valid, _stats);
+
+    // check content of generated traffic
+    trafficcheck_execute(tcheck, _header, _header_valid, _payload, _payload_len, _payload_valid);
+
     // update global counters
     num_frames_detected++;
 
@@ -79,6 +97,98 @@ int callback(unsigned char *  _header,
     return 0;
 }
 
+// pooled delivery: buffers retained by the receiver thread and handled
+// by the main loop (each holds a pool buffer, so at most one entry per
+// buffer is pending)
+static pthread_mutex_t pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static rxbuf * pool_pending = NULL;     // [size: num_buffers x 1]
+static unsigned int pool_num_pending = 0;
+
+// pooled delivery callback (receiver thread)
+int pool_callback(rxbuf  _buf,
+                  void * _userdata)
+{
+    rxbuf_retain(_buf);
+    pthread_mutex_lock(&pool_mutex);
+    pool_pending[pool_num_pending++] = _buf;
+    pthread_mutex_unlock(&pool_mutex);
+    return 0;
+}
+
+// handle and release pending pool buffers; returns number handled
+//  _batch      :   scratch list [size: num_buffers x 1]
+//  _userdata   :   callback user data
+unsigned int pool_drain(rxbuf * _batch,
+                        void *  _userdata)
+{
+    pthread_mutex_lock(&pool_mutex);
+    unsigned int n = pool_num_pending;
+    memmove(_batch, pool_pending, n*sizeof(rxbuf));
+    pool_num_pending = 0;
+    pthread_mutex_unlock(&pool_mutex);
+
+    unsigned int i;
+    for (i=0; i<n; i++) {
+        rxbuf b = _batch[i];
+        callback(b->header, b->header_valid, b->payload, b->payload_len,
+                 b->payload_valid, b->stats, _userdata);
+        rxbuf_release(b);
+    }
+    return n;
+}
+
+// offline decoding: synchronizer properties and hooks
+struct ofdmprops_s {
+    unsigned int M;                 // number of subcarriers
+    unsigned int cp_len;            // cyclic prefix length
+    unsigned int taper_len;         // taper length
+    unsigned char * p;              // subcarrier allocation
+};
+
+void * offline_create(framesync_callback _callback,
+                      void **            _userdata,
+                      void *             _context)
+{
+    struct ofdmprops_s * props = (struct ofdmprops_s*) _context;
+    return ofdmflexframesync_create(props->M, props->cp_len, props->taper_len,
+                                    props->p, _callback, _userdata[0]);
+}
+
+void offline_reset(void * _fs)
+{
+    ofdmflexframesync_reset((ofdmflexframesync)_fs);
+}
+
+void offline_execute(void * _fs, std::complex<float> * _x, unsigned int _n)
+{
+    ofdmflexframesync_execute((ofdmflexframesync)_fs, _x, _n);
+}
+
+void offline_destroy(void * _fs)
+{
+    ofdmflexframesync_destroy((ofdmflexframesync)_fs);
+}
+
+// length of the longest expected frame [samples], used as the overlap
+// between decoded segments so that no frame is split across both ends
+unsigned int max_frame_len(struct ofdmprops_s * _props,
+                           ofdmflexframegenprops_s * _fgprops,
+                           unsigned int _payload_len)
+{
+    ofdmflexframegen fg = ofdmflexframegen_create(_props->M, _props->cp_len,
+                                                  _props->taper_len, _props->p,
+                                                  _fgprops);
+    unsigned char header[8] = {0};
+    unsigned char * payload = (unsigned char*) calloc(_payload_len, 1);
+    ofdmflexframegen_assemble(fg, header, payload, _payload_len);
+    unsigned int num_symbols = ofdmflexframegen_getframelen(fg);
+    ofdmflexframegen_destroy(fg);
+    free(payload);
+
+    // add a few symbols of slack for detection latency
+    return (num_symbols + 4) * (_props->M + _props->cp_len);
+}
+
 void usage() {
     printf("ofdmflexframe_rx -- receive OFDM packets\n");
     printf("  u,h   :   usage/help\n");
@@ -90,8 +200,29 @@ void usage() {
     printf("  M     :   number of subcarriers, default:   48\n");
     printf("  C     :   cyclic prefix length,  default:    6\n");
     printf("  T     :   taper length,          default:    4\n");
+    printf("  L     :   longest expected payload [bytes], default: 1200\n");
+    printf("  m     :   longest frame mod. scheme, default: qpsk\n");
+    printf("  c     :   longest frame inner fec,   default: none\n");
+    printf("  k     :   longest frame outer fec,   default: golay2412\n");
     printf("  t     :   run time [seconds],    default:    5\n");
     printf("  d     :   enable debugging mode\n");
+    printf("  o     :   binary packet log filename, default: (none)\n");
+    printf("  p     :   save payloads in packet log\n");
+    printf("  i     :   decode complex float I/Q file (offline) instead of usrp\n");
+    printf("  P     :   decoding threads; offline default: (number of cores),\n");
+    printf("            live: decode segments of the stream in parallel\n");
+    printf("  Q     :   deliver frames through queue of given length,\n");
+    printf("            decoupling the callback from the receiver thread\n");
+    printf("  B     :   deliver frames in pool of given number of buffers,\n");
+    printf("            handled every 100 ms; prints pool statistics at exit\n");
+    printf("  H     :   number of hop channels, default: 0 (fixed frequency)\n");
+    printf("  S     :   hop channel spacing [Hz], default: 2 x bandwidth\n");
+    printf("  D     :   hop dwell time [ms],   default:   50\n");
+    printf("  s     :   hop settling time [ms], default:   1\n");
+    printf("  F     :   loopback sample file (instead of usrp)\n");
+    printf("\n");
+    printf("  When hopping, channel k is at f + k*S; hop 0 starts at device\n");
+    printf("  time zero, as for ofdmflexframe_tx.\n");
 }
 
 int main (int argc, char **argv)
@@ -99,7 +230,7 @@ int main (int argc, char **argv)
     // command-line options
     verbose = true;
 
-    float frequency = 462.0e6;
+    double frequency = 462.0e6;
     float bandwidth = 1000e3f;
     float num_seconds = 5.0f;
     float uhd_rxgain = 20.0;
@@ -110,11 +241,31 @@ int main (int argc, char **argv)
     unsigned int cp_len = 6;            // cyclic prefix length
     unsigned int taper_len = 4;         // taper length
 
+    // longest expected frame (sets the segment overlap when decoding
+    // on multiple threads); defaults match ofdmflexframe_tx
+    unsigned int max_payload_len = 1200;
+    modulation_scheme ms = LIQUID_MODEM_QPSK;
+    fec_scheme fec0 = LIQUID_FEC_NONE;
+    fec_scheme fec1 = LIQUID_FEC_GOLAY2412;
+
     int debug_enabled =  0;             // enable debugging?
+    char log_filename[256] = "";        // binary packet log filename
+    int log_payloads = 0;               // save payloads in packet log?
+    char input_filename[256] = "";      // offline input file (complex float)
+    unsigned int num_threads = 0;       // decoding threads
+    unsigned int queue_len = 0;         // asynchronous delivery queue
+    unsigned int pool_len = 0;          // pooled delivery buffers
+
+    // frequency hopping
+    unsigned int num_hops = 0;          // number of hop channels (0: none)
+    double hop_spacing = 0.0;           // channel spacing [Hz] (0: 2 x bandwidth)
+    double dwell = 50e-3;               // dwell time [s]
+    double settle = 1e-3;               // settling time [s]
+    const char * loop_filename = NULL;  // loopback sample file
 
     //
     int d;
-    while ((d = getopt(argc,argv,"uhqvf:b:G:A:M:C:T:t:d")) != EOF) {
+    while ((d = getopt(argc,argv,"uhqvf:b:G:A:M:C:T:L:m:c:k:t:do:pi:P:Q:B:H:S:D:s:F:")) != EOF) {
         switch (d) {
         case 'u':
         case 'h':   usage();                            return 0;
@@ -127,8 +278,23 @@ int main (int argc, char **argv)
         case 'M':   M             = atoi(optarg);       break;
         case 'C':   cp_len        = atoi(optarg);       break;
         case 'T':   taper_len     = atoi(optarg);       break;
+        case 'L':   max_payload_len = atoi(optarg);     break;
+        case 'm':   ms            = liquid_getopt_str2mod(optarg);  break;
+        case 'c':   fec0          = liquid_getopt_str2fec(optarg);  break;
+        case 'k':   fec1          = liquid_getopt_str2fec(optarg);  break;
         case 't':   num_seconds   = atof(optarg);       break;
         case 'd':   debug_enabled = 1;                  break;
+        case 'o':   strncpy(log_filename,optarg,255);   break;
+        case 'p':   log_payloads  = 1;                  break;
+        case 'i':   strncpy(input_filename,optarg,255); break;
+        case 'P':   num_threads   = atoi(optarg);       break;
+        case 'Q':   queue_len     = atoi(optarg);       break;
+        case 'B':   pool_len      = atoi(optarg);       break;
+        case 'H':   num_hops      = atoi(optarg);       break;
+        case 'S':   hop_spacing   = atof(optarg);       break;
+        case 'D':   dwell         = 1e-3*atof(optarg);  break;
+        case 's':   settle        = 1e-3*atof(optarg);  break;
+        case 'F':   loop_filename = optarg;             break;
         default:
             usage();
             return 0;
@@ -138,20 +304,44 @@ int main (int argc, char **argv)
     if (cp_len == 0 || cp_len > M) {
         fprintf(stderr,"error: %s, cyclic prefix must be in (0,M]\n", argv[0]);
         exit(1);
+    } else if (max_payload_len == 0) {
+        fprintf(stderr,"error: %s, payload length must be greater than zero\n", argv[0]);
+        exit(1);
+    } else if (ms == LIQUID_MODEM_UNKNOWN) {
+        fprintf(stderr,"error: %s, unknown/unsupported mod. scheme\n", argv[0]);
+        exit(1);
+    } else if (fec0 == LIQUID_FEC_UNKNOWN || fec1 == LIQUID_FEC_UNKNOWN) {
+        fprintf(stderr,"error: %s, unknown/unsupported fec scheme\n", argv[0]);
+        exit(1);
+    } else if (num_hops > 0 && (settle < 0.0 || settle >= dwell)) {
+        fprintf(stderr,"error: %s, settling time must be in [0,dwell time)\n", argv[0]);
+        exit(1);
+    } else if (num_hops > 0 && input_filename[0] != '\0') {
+        fprintf(stderr,"error: %s, hopping requires live reception\n", argv[0]);
+        exit(1);
+    } else if (pool_len > 0 && queue_len > 0) {
+        fprintf(stderr,"error: %s, queued and pooled delivery are exclusive\n", argv[0]);
+        exit(1);
     }
 
-    // create transceiver object
-    unsigned char * p = NULL;   // default subcarrier allocation
-    ofdmtxrx txcvr(M, cp_len, taper_len, p, callback, (void*)&bandwidth);
+    // overlap between decoded segments (offline and live)
+    struct ofdmprops_s props = {M, cp_len, taper_len, NULL};
+    ofdmflexframegenprops_s fgprops;
+    ofdmflexframegenprops_init_default(&fgprops);
+    fgprops.mod_scheme = ms;
+    fgprops.fec0       = fec0;
+    fgprops.fec1       = fec1;
+    unsigned int overlap_len = max_frame_len(&props, &fgprops, max_payload_len);
 
-    // set properties
-    txcvr.set_rx_freq(frequency);
-    txcvr.set_rx_rate(bandwidth);
-    txcvr.set_rx_gain_uhd(uhd_rxgain);
+    // create traffic checker
+    tcheck = trafficcheck_create(TRAFFICGEN_DEFAULT_SEED, 8);
 
-    // enable debugging on request
-    if (debug_enabled)
-        txcvr.debug_enable();
+    // create binary packet log
+    if (log_filename[0] != '\0') {
+        plog = packetlog_create(log_filename, 8, log_payloads);
+        if (plog == NULL)
+            exit(1);
+    }
 
     // reset counters
     num_frames_detected=0;
@@ -159,17 +349,120 @@ int main (int argc, char **argv)
     num_valid_packets_received=0;
     num_valid_bytes_received=0;
 
+    // offline mode: decode recorded samples (taken at the bandwidth
+    // rate) in overlapping chunks on all cores
+    if (input_filename[0] != '\0') {
+        void * userdata = (void*)&bandwidth;
+        unsigned int chunk_len = 1<<20;
+        if (chunk_len < 4*overlap_len)
+            chunk_len = 4*overlap_len;
+        chunkdecoder q = chunkdecoder_create(num_threads, chunk_len, overlap_len, 8, 1,
+                                             offline_create, offline_reset,
+                                             offline_execute, offline_destroy,
+                                             (void*)&props, callback, &userdata);
+
+        timer t0 = timer_create();
+        timer_tic(t0);
+        long long int num_samples = chunkdecoder_execute_file(q, input_filename);
+        float runtime = timer_toc(t0);
+        timer_destroy(t0);
+
+        chunkdecoder_print(q);
+        chunkdecoder_destroy(q);
+        if (num_samples < 0)
+            exit(1);
+
+        float duration = (float)num_samples / bandwidth;
+        printf("    frames detected     : %6u\n", num_frames_detected);
+        printf("    valid headers       : %6u\n", num_valid_headers_received);
+        printf("    valid packets       : %6u\n", num_valid_packets_received);
+        printf("    bytes received      : %6u\n", num_valid_bytes_received);
+        printf("    capture duration    : %f s\n", duration);
+        printf("    decode time         : %f s (%.2f x real time)\n",
+                runtime, runtime > 0 ? duration / runtime : 0.0f);
+
+        trafficcheck_print(tcheck, duration);
+        trafficcheck_destroy(tcheck);
+
+        if (plog != NULL) {
+            packetlog_print(plog);
+            packetlog_destroy(plog);
+            printf("packet log written to '%s'\n", log_filename);
+        }
+        return 0;
+    }
+
+    // create transceiver object
+    unsigned char * p = NULL;   // default subcarrier allocation
+    ofdmtxrx * txcvr = NULL;
+    if (loop_filename == NULL)
+        txcvr = new ofdmtxrx(M, cp_len, taper_len, p, callback, (void*)&bandwidth);
+    else
+        txcvr = new ofdmtxrx(M, cp_len, taper_len, p, callback, (void*)&bandwidth,
+                             "/dev/null", loop_filename);
+
+    // set properties
+    txcvr->set_rx_freq(frequency);
+    txcvr->set_rx_rate(bandwidth);
+    txcvr->set_rx_gain_uhd(uhd_rxgain);
+    txcvr->set_rx_block_len(256);     // frame times are not used
+
+    // enable debugging on request
+    if (debug_enabled)
+        txcvr->debug_enable();
+
+    // decode overlapping segments of the stream on multiple cores; each
+    // segment is at least 50 ms long and four times the overlap
+    if (num_threads > 0) {
+        unsigned int segment_len = (unsigned int)(0.05f*bandwidth);
+        if (segment_len < 4*overlap_len)
+            segment_len = 4*overlap_len;
+        txcvr->segmented_rx_enable(num_threads, segment_len, overlap_len);
+    }
+
+    // queue frames so that printing/logging never stalls the receiver
+    if (queue_len > 0)
+        txcvr->async_rx_enable(queue_len, max_payload_len > 8192 ? max_payload_len : 8192);
+
+    // hand frames over in pool buffers, without allocating per frame
+    rxbuf * pool_batch = NULL;
+    if (pool_len > 0) {
+        pool_pending = (rxbuf*) malloc(pool_len*sizeof(rxbuf));
+        pool_batch   = (rxbuf*) malloc(pool_len*sizeof(rxbuf));
+        txcvr->pooled_rx_enable(pool_len, max_payload_len, pool_callback, NULL);
+    }
+
+    // load hop set and start hopping
+    if (num_hops > 0) {
+        if (hop_spacing == 0.0)
+            hop_spacing = 2.0*bandwidth;
+        double * freqs = (double*) malloc(num_hops*sizeof(double));
+        unsigned int i;
+        for (i=0; i<num_hops; i++)
+            freqs[i] = frequency + i*hop_spacing;
+        txcvr->hop_load(freqs, num_hops, dwell, settle);
+        txcvr->hop_start(0.0);
+        free(freqs);
+    }
+
     // run conditions
     int continue_running = 1;
     timer t0 = timer_create();
     timer_tic(t0);
 
     // start receiver
-    txcvr.start_rx();
+    txcvr->start_rx();
 
     while (continue_running) {
-        // sleep for 100 ms and check state
-        usleep(100000);
+        if (queue_len > 0) {
+            // handle queued frames, waiting up to 100 ms
+            txcvr->drain_rx(64, 0.1f);
+        } else {
+            // sleep for 100 ms and check state
+            usleep(100000);
+            if (pool_len > 0)
+                pool_drain(pool_batch, (void*)&bandwidth);
+        }
 
         // check runtime
         if (timer_toc(t0) >= num_seconds)
@@ -178,7 +471,12 @@ int main (int argc, char **argv)
 
     // stop receiver
     printf("ofdmflexframe_rx stopping receiver...\n");
-    txcvr.stop_rx();
+    txcvr->stop_rx();
+    if (queue_len > 0)
+        while (txcvr->drain_rx(64, 0.0f) > 0);
+    if (pool_len > 0)
+        pool_drain(pool_batch, (void*)&bandwidth);
+    txcvr->hop_stop();
  
     // compute actual run-time
     float runtime = timer_toc(t0);
@@ -197,8 +495,32 @@ int main (int argc, char **argv)
     printf("    bytes received      : %6u\n", num_valid_bytes_received);
     printf("    run time            : %f s\n", runtime);
     printf("    data rate           : %8.4f kbps\n", data_rate*1e-3f);
+    unsigned long long int num_samples_rx = txcvr->get_rx_num_samples();
+    double dsp_time = txcvr->get_rx_processing_time();
+    printf("    samples received    : %llu (%.4f Msamples/s)\n", num_samples_rx, num_samples_rx / runtime * 1e-6f);
+    printf("    processing capacity : %.4f Msamples/s (%.1f%% load)\n",
+            dsp_time > 0.0 ? num_samples_rx / dsp_time * 1e-6 : 0.0,
+            100.0 * dsp_time / runtime);
+    if (num_hops > 0) {
+        printf("    retunes issued      : %llu\n", txcvr->hop_get_num_retunes());
+        printf("    samples blanked     : %llu\n", txcvr->hop_get_num_blanked());
+    }
+
+    // print traffic check results
+    trafficcheck_print(tcheck, runtime);
+    trafficcheck_destroy(tcheck);
+
+    // close packet log
+    if (plog != NULL) {
+        packetlog_print(plog);
+        packetlog_destroy(plog);
+        printf("packet log written to '%s'\n", log_filename);
+    }
 
-    // destroy objects
+    // destroy objects (prints queue and pool statistics)
+    delete txcvr;
+    free(pool_pending);
+    free(pool_batch);
     timer_destroy(t0);
 
     return 0;
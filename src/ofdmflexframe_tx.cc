@@ -26,6 +26,7 @@
 #include <liquid/liquid.h>
 
 #include "ofdmtxrx.h"
+#include "trafficgen.h"
 
 void usage() {
     printf("ofdmflexframe_tx [OPTION]\n");
@@ -47,6 +48,41 @@ void usage() {
     printf("  c     : coding scheme (inner),  default: g2412\n");
     printf("  k     : coding scheme (outer),  default: none\n");
     liquid_print_fec_schemes();
+    printf("  H     : number of hop channels, default:    0 (fixed frequency)\n");
+    printf("  S     : hop channel spacing [Hz], default: 2 x bandwidth\n");
+    printf("  D     : hop dwell time [ms],    default:   50\n");
+    printf("  s     : hop settling time [ms], default:    1\n");
+    printf("  F     : loopback sample file (instead of usrp)\n");
+    printf("\n");
+    printf("  When hopping, channel k is at f + k*S; hop 0 starts at device\n");
+    printf("  time zero, so both ends need a common time reference. Each\n");
+    printf("  burst is sent within the usable part of a dwell.\n");
+}
+
+// length of a transmitted frame [samples], including the extra symbol
+// sent after each frame
+unsigned int frame_len(unsigned int      _M,
+                       unsigned int      _cp_len,
+                       unsigned int      _taper_len,
+                       modulation_scheme _ms,
+                       fec_scheme        _fec0,
+                       fec_scheme        _fec1,
+                       unsigned int      _payload_len)
+{
+    ofdmflexframegenprops_s fgprops;
+    ofdmflexframegenprops_init_default(&fgprops);
+    fgprops.mod_scheme = _ms;
+    fgprops.fec0       = _fec0;
+    fgprops.fec1       = _fec1;
+    ofdmflexframegen fg = ofdmflexframegen_create(_M, _cp_len, _taper_len, NULL, &fgprops);
+    unsigned char header[8] = {0};
+    unsigned char * payload = (unsigned char*) calloc(_payload_len, 1);
+    ofdmflexframegen_assemble(fg, header, payload, _payload_len);
+    unsigned int num_symbols = ofdmflexframegen_getframelen(fg);
+    ofdmflexframegen_destroy(fg);
+    free(payload);
+
+    return (num_symbols + 1) * (_M + _cp_len);
 }
 
 int main (int argc, char **argv)
@@ -70,10 +106,17 @@ int main (int argc, char **argv)
     //crc_scheme check = LIQUID_CRC_32;       // data validity check
     fec_scheme fec0 = LIQUID_FEC_NONE;      // fec (inner)
     fec_scheme fec1 = LIQUID_FEC_GOLAY2412; // fec (outer)
+
+    // frequency hopping
+    unsigned int num_hops = 0;          // number of hop channels (0: none)
+    double hop_spacing = 0.0;           // channel spacing [Hz] (0: 2 x bandwidth)
+    double dwell = 50e-3;               // dwell time [s]
+    double settle = 1e-3;               // settling time [s]
+    const char * loop_filename = NULL;  // loopback sample file
     
     //
     int d;
-    while ((d = getopt(argc,argv,"uhqvf:b:g:G:N:M:C:T:P:m:c:k:")) != EOF) {
+    while ((d = getopt(argc,argv,"uhqvf:b:g:G:N:M:C:T:P:m:c:k:H:S:D:s:F:")) != EOF) {
         switch (d) {
         case 'u':
         case 'h':   usage();                        return 0;
@@ -91,6 +134,11 @@ int main (int argc, char **argv)
         case 'm':   ms          = liquid_getopt_str2mod(optarg);    break;
         case 'c':   fec0        = liquid_getopt_str2fec(optarg);    break;
         case 'k':   fec1        = liquid_getopt_str2fec(optarg);    break;
+        case 'H':   num_hops    = atoi(optarg);     break;
+        case 'S':   hop_spacing = atof(optarg);     break;
+        case 'D':   dwell       = 1e-3*atof(optarg);break;
+        case 's':   settle      = 1e-3*atof(optarg);break;
+        case 'F':   loop_filename = optarg;         break;
         default:    usage();                        return 0;
         }
     }
@@ -107,49 +155,117 @@ int main (int argc, char **argv)
     } else if (fec1 == LIQUID_FEC_UNKNOWN) {
         fprintf(stderr,"error: %s, unknown/unsupported outer fec scheme\n", argv[0]);
         exit(-1);
+    } else if (num_hops > 0 && (settle < 0.0 || settle >= dwell)) {
+        fprintf(stderr,"error: %s, settling time must be in [0,dwell time)\n", argv[0]);
+        exit(1);
+    }
+
+    // number of packets per burst
+    unsigned int batch_size = 16;
+
+    // when hopping, each burst must fit within the usable part of a
+    // dwell (with a few symbols of margin)
+    if (num_hops > 0) {
+        unsigned int len = frame_len(M, cp_len, taper_len, ms, fec0, fec1, payload_len);
+        double usable = (dwell - settle)*bandwidth - 4*(M + cp_len);
+        unsigned int frames_per_hop = usable > 0.0 ? (unsigned int)(usable / len) : 0;
+        if (frames_per_hop == 0) {
+            fprintf(stderr,"error: %s, dwell time too short for a %u-sample frame\n", argv[0], len);
+            exit(1);
+        }
+        if (frames_per_hop < batch_size)
+            batch_size = frames_per_hop;
     }
 
     // create transceiver object
     unsigned char * p = NULL;   // default subcarrier allocation
-    ofdmtxrx txcvr(M, cp_len, taper_len, p, NULL, NULL);
+    ofdmtxrx * txcvr = NULL;
+    if (loop_filename == NULL)
+        txcvr = new ofdmtxrx(M, cp_len, taper_len, p, NULL, NULL);
+    else
+        txcvr = new ofdmtxrx(M, cp_len, taper_len, p, NULL, NULL, loop_filename, "/dev/null");
 
     // set properties
-    txcvr.set_tx_freq(frequency);
-    txcvr.set_tx_rate(bandwidth);
-    txcvr.set_tx_gain_soft(txgain_dB);
-    txcvr.set_tx_gain_uhd(uhd_txgain);
-
-    // data arrays
-    unsigned char header[8];
-    unsigned char payload[payload_len];
+    txcvr->set_tx_freq(frequency);
+    txcvr->set_tx_rate(bandwidth);
+    txcvr->set_tx_gain_soft(txgain_dB);
+    txcvr->set_tx_gain_uhd(uhd_txgain);
+
+    // load hop set and start hopping
+    if (num_hops > 0) {
+        if (hop_spacing == 0.0)
+            hop_spacing = 2.0*bandwidth;
+        double * freqs = (double*) malloc(num_hops*sizeof(double));
+        unsigned int i;
+        for (i=0; i<num_hops; i++)
+            freqs[i] = frequency + i*hop_spacing;
+        txcvr->hop_load(freqs, num_hops, dwell, settle);
+        txcvr->hop_start(0.0);
+        free(freqs);
+    }
+
+    // data arrays, holding a batch of packets
+    unsigned char header[batch_size][8];
+    unsigned char * payload = (unsigned char*) malloc(batch_size*payload_len*sizeof(unsigned char));
+    struct ofdmtxrx_packet_s packets[batch_size];
+    trafficgen tgen = trafficgen_create(TRAFFICGEN_DEFAULT_SEED, 0, 8);
     
-    unsigned int pid;
-    unsigned int i;
-    for (pid=0; pid<num_frames; pid++) {
-        if (verbose)
-            printf("tx packet id: %6u\n", pid);
+    // device time from which the next hop is scheduled, leaving time to
+    // queue its retune
+    double hop_time = txcvr->get_time_now() + 0.1;
+
+    unsigned int pid = 0;
+    while (pid < num_frames) {
+        unsigned int n;
+        for (n=0; n<batch_size && pid<num_frames; n++, pid++) {
+            if (verbose)
+                printf("tx packet id: %6u\n", pid);
         
-        // write header (first two bytes packet ID, remaining are random)
-        header[0] = (pid >> 8) & 0xff;
-        header[1] = (pid     ) & 0xff;
-        for (i=2; i<8; i++)
-            header[i] = rand() & 0xff;
+            // write header (packet ID, sequence) and pseudo-random payload
+            packets[n].header      = header[n];
+            packets[n].payload     = &payload[n*payload_len];
+            packets[n].payload_len = payload_len;
+            packets[n].mod         = ms;
+            packets[n].fec0        = fec0;
+            packets[n].fec1        = fec1;
+            trafficgen_generate(tgen, packets[n].header, packets[n].payload, payload_len);
+        }
 
-        // initialize payload
-        for (i=0; i<payload_len; i++)
-            payload[i] = rand() & 0xff;
+        if (num_hops == 0) {
+            // transmit frames in a single burst
+            txcvr->transmit_packets(packets, n, ms, fec0, fec1);
+            continue;
+        }
 
-        // transmit frame
-        txcvr.transmit_packet(header, payload, payload_len, ms, fec0, fec1);
+        // transmit burst at the start of the next usable dwell
+        double start, end;
+        if (hop_time < txcvr->get_time_now() + 0.01)
+            hop_time = txcvr->get_time_now() + 0.01;
+        unsigned long long int hop = txcvr->hop_next(hop_time, &start, &end);
+        if (verbose)
+            printf("hop %llu: %.3f MHz at t=%.6f s\n", hop, txcvr->hop_get_freq(hop)*1e-6, start);
+        txcvr->transmit_packets_at(packets, n, start);
+        hop_time = end;
 
     } // packet loop
  
     // sleep for a small amount of time to allow USRP buffers
     // to flush
+    if (num_hops > 0)
+        txcvr->wait_until(hop_time);
     usleep(200000);
 
     //finished
     printf("usrp data transfer complete\n");
+    if (num_hops > 0) {
+        txcvr->hop_stop();
+        printf("retunes issued: %llu\n", txcvr->hop_get_num_retunes());
+    }
+
+    // destroy objects
+    delete txcvr;
+    trafficgen_destroy(tgen);
+    free(payload);
 
     printf("done.\n");
     return 0;
@@ -23,15 +23,24 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <getopt.h>
-#include <assert.h>
 #include <liquid/liquid.h>
 
 #include <uhd/usrp/multi_usrp.hpp>
  
 #include "timer.h"
+#include "packetlog.h"
+#include "rateplan.h"
+#include "resampchain.h"
+#include "trafficgen.h"
 
 static bool verbose;
 
+// binary packet log (optional)
+static packetlog plog = NULL;
+
+// generated traffic checker
+static trafficcheck tcheck = NULL;
+
 // data counters
 unsigned int num_frames_detected;
 unsigned int num_valid_headers_received;
@@ -64,6 +73,13 @@ int callback(unsigned char *  _header,
     } else {
     }
 
+    // log frame
+    if (plog != NULL)
+        packetlog_write(plog, 0, _header, _header_valid, _payload, _payload_len, _payload_valid, _stats);
+
+    // check content of generated traffic
+    trafficcheck_execute(tcheck, _header, _header_valid, _payload, _payload_len, _payload_valid);
+
     // update global counters
     num_frames_detected++;
 
@@ -86,6 +102,11 @@ void usage() {
     printf("  b     :   bandwidth [Hz], default: 250 kHz\n");
     printf("  G     :   uhd rx gain [dB] (default: 20dB)\n");
     printf("  t     :   run time [seconds]\n");
+    printf("  o     :   binary packet log filename, default: (none)\n");
+    printf("  p     :   save payloads in packet log\n");
+    printf("  D     :   decimation threads, default: 1 (0: number of cores)\n");
+    printf("  R     :   minimum device rate [Hz], or 'max' for the highest\n");
+    printf("            (e.g. -R max -D 0 decimates from the full device rate)\n");
     printf("  z     :   number of subcarriers to notch in the center band, default: 0\n");
 }
 
@@ -93,19 +114,18 @@ int main (int argc, char **argv)
 {
     // command-line options
     verbose = true;
-    unsigned long int ADC_RATE = 64e6;
-
-    double min_bandwidth = 0.25*(ADC_RATE / 512.0);
-    double max_bandwidth = 0.25*(ADC_RATE /   4.0);
-
     double frequency = 462.0e6;
     double bandwidth = 250e3f;
     double num_seconds = 5.0f;
+    unsigned int num_decim_threads = 1; // front-end decimation threads
+    double device_min = 0.0;            // minimum device rate (0: lowest)
     double uhd_rxgain = 20.0;
+    char log_filename[256] = "";        // binary packet log filename
+    int log_payloads = 0;               // save payloads in packet log?
 
     //
     int d;
-    while ((d = getopt(argc,argv,"uhqvf:b:G:t:")) != EOF) {
+    while ((d = getopt(argc,argv,"uhqvf:b:G:t:o:pD:R:")) != EOF) {
         switch (d) {
         case 'u':
         case 'h':   usage();                        return 0;
@@ -115,17 +135,18 @@ int main (int argc, char **argv)
         case 'b':   bandwidth = atof(optarg);       break;
         case 'G':   uhd_rxgain = atof(optarg);      break;
         case 't':   num_seconds = atof(optarg);     break;
+        case 'o':   strncpy(log_filename,optarg,255); break;
+        case 'p':   log_payloads = 1;               break;
+        case 'D':   num_decim_threads = atoi(optarg); break;
+        case 'R':   device_min = strcmp(optarg,"max") == 0 ? HUGE_VAL : atof(optarg); break;
         default:
             usage();
             return 0;
         }
     }
 
-    if (bandwidth > max_bandwidth) {
-        fprintf(stderr,"error: %s, maximum symbol rate exceeded (%8.4f MHz)\n", argv[0], max_bandwidth*1e-6);
-        exit(1);
-    } else if (bandwidth < min_bandwidth) {
-        fprintf(stderr,"error: %s, minimum symbol rate exceeded (%8.4f kHz)\n", argv[0], min_bandwidth*1e-3);
+    if (bandwidth <= 0) {
+        fprintf(stderr,"error: %s, bandwidth must be greater than zero\n", argv[0]);
         exit(1);
     }
 
@@ -136,24 +157,17 @@ int main (int argc, char **argv)
     uhd::device_addr_t dev_addr;
     uhd::usrp::multi_usrp::sptr usrp = uhd::usrp::multi_usrp::make(dev_addr);
 
-    // set properties
-    double rx_rate = 4.0f*bandwidth;
-    // NOTE : the sample rate computation MUST be in double precision so
-    //        that the UHD can compute its decimation rate properly
-    unsigned int decim_rate = (unsigned int)(ADC_RATE / rx_rate);
-    // ensure multiple of 2
-    decim_rate = (decim_rate >> 1) << 1;
-    // compute usrp sampling rate
-    double usrp_rx_rate = ADC_RATE / (float)decim_rate;
-    
-    // try to set rx rate
-    usrp->set_rx_rate(ADC_RATE / decim_rate);
-
-    // get actual rx rate
-    usrp_rx_rate = usrp->get_rx_rate();
-
-    // compute arbitrary resampling rate
-    double rx_resamp_rate = rx_rate / usrp_rx_rate;
+    // plan device rate and resampling down to two samples per symbol
+    double rx_rate = 2.0*bandwidth;
+    rateplan plan = rateplan_create_rx(usrp, rx_rate, RATEPLAN_PASSBAND, 60.0f, device_min);
+    if (plan == NULL)
+        exit(1);
+
+    // try to set rx rate, then resample from the actual rate
+    usrp->set_rx_rate(rateplan_get_device_rate(plan));
+    double usrp_rx_rate = usrp->get_rx_rate();
+    resampchain resamp = resampchain_create(plan, usrp_rx_rate);
+    resampchain_set_num_threads(resamp, num_decim_threads);
 
     usrp->set_rx_freq(frequency);
     usrp->set_rx_gain(uhd_rxgain);
@@ -161,11 +175,11 @@ int main (int argc, char **argv)
     printf("frequency   :   %12.8f [MHz]\n", frequency*1e-6f);
     printf("bandwidth   :   %12.8f [kHz]\n", bandwidth*1e-3f);
     printf("verbosity   :   %s\n", (verbose?"enabled":"disabled"));
-    printf("sample rate :   %12.8f kHz = %12.8f * %8.6f (decim %u)\n",
+    printf("sample rate :   %12.8f kHz = %12.8f * %8.6f\n",
             rx_rate * 1e-3f,
             usrp_rx_rate * 1e-3f,
-            rx_resamp_rate,
-            decim_rate);
+            resampchain_get_rate(resamp));
+    rateplan_print(plan);
     // set run time appropriately
     if (num_seconds < 0) {
         num_seconds = 1e32; // set to really, really large number
@@ -174,13 +188,6 @@ int main (int argc, char **argv)
         printf("run time        :   %f seconds\n", num_seconds);
     }
 
-    // add arbitrary resampling component
-    // TODO : check that resampling rate does indeed correspond to proper bandwidth
-    msresamp_crcf resamp = msresamp_crcf_create(0.5*rx_resamp_rate, 60.0f);
-
-    unsigned int block_len = 64;
-    assert( (block_len % 2) == 0);  // ensure block length is even
-
     //allocate recv buffer and metatdata
     uhd::rx_metadata_t md;
     const size_t max_samps_per_packet = usrp->get_device()->get_max_recv_samps_per_packet();
@@ -194,9 +201,24 @@ int main (int argc, char **argv)
     usrp->issue_stream_cmd(uhd::stream_cmd_t::STREAM_MODE_START_CONTINUOUS);
     printf("usrp data transfer started\n");
  
-    // create buffer for arbitrary resamper output
-    std::complex<float> buffer_resamp[(int)(2*rx_resamp_rate) + 64];
+    // create buffer for arbitrary resamper output (entire packet)
+    std::vector<std::complex<float> > buffer_resamp(resampchain_get_max_output(resamp, max_samps_per_packet));
+
+    // processing throughput
+    unsigned long long int num_samples_rx = 0;  // samples received
+    float dsp_time = 0.0f;                      // time spent processing [s]
+    timer t1 = timer_create();
  
+    // create traffic checker
+    tcheck = trafficcheck_create(TRAFFICGEN_DEFAULT_SEED, 8);
+
+    // create binary packet log
+    if (log_filename[0] != '\0') {
+        plog = packetlog_create(log_filename, 8, log_payloads);
+        if (plog == NULL)
+            exit(1);
+    }
+
     // reset counters
     num_frames_detected=0;
     num_valid_headers_received=0;
@@ -228,20 +250,15 @@ int main (int argc, char **argv)
             return 1;
         }
 
-        // push data through arbitrary resampler and give to frame synchronizer
+        // push entire packet through arbitrary resampler and give to
+        // frame synchronizer
         // TODO : apply bandwidth-dependent gain
-        unsigned int j;
-        for (j=0; j<num_rx_samps; j++) {
-            // grab sample from usrp buffer
-            std::complex<float> usrp_sample = buff[j];
-
-            // push through resampler (one at a time)
-            unsigned int nw;
-            msresamp_crcf_execute(resamp, &usrp_sample, 1, buffer_resamp, &nw);
-
-            // push resulting samples through synchronizer
-            framesync64_execute(fs, buffer_resamp, nw);
-        }
+        timer_tic(t1);
+        unsigned int nw;
+        resampchain_execute(resamp, &buff.front(), num_rx_samps, &buffer_resamp.front(), &nw);
+        framesync64_execute(fs, &buffer_resamp.front(), nw);
+        dsp_time += timer_toc(t1);
+        num_samples_rx += num_rx_samps;
 
         // check runtime
         if (timer_toc(t0) >= num_seconds)
@@ -269,12 +286,29 @@ int main (int argc, char **argv)
     printf("    valid packets       : %6u (%6.2f%%)\n", num_valid_packets_received,percent_packets_valid);
     printf("    bytes received      : %6u\n", num_valid_bytes_received);
     printf("    run time            : %f s\n", runtime);
+    printf("    samples received    : %llu (%.4f Msamples/s)\n", num_samples_rx, num_samples_rx / runtime * 1e-6f);
+    printf("    processing capacity : %.4f Msamples/s (%.1f%% load)\n",
+            dsp_time > 0.0f ? num_samples_rx / dsp_time * 1e-6f : 0.0f,
+            100.0f * dsp_time / runtime);
     printf("    data rate           : %8.4f kbps\n", data_rate*1e-3f);
 
+    // print traffic check results
+    trafficcheck_print(tcheck, runtime);
+    trafficcheck_destroy(tcheck);
+
+    // close packet log
+    if (plog != NULL) {
+        packetlog_print(plog);
+        packetlog_destroy(plog);
+        printf("packet log written to '%s'\n", log_filename);
+    }
+
     // destroy objects
-    msresamp_crcf_destroy(resamp);
+    resampchain_destroy(resamp);
+    rateplan_destroy(plan);
     framesync64_destroy(fs);
     timer_destroy(t0);
+    timer_destroy(t1);
 
     return 0;
 }
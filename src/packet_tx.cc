@@ -21,22 +21,33 @@
 #include <iostream>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <complex>
 #include <getopt.h>
 #include <liquid/liquid.h>
 
 #include <uhd/usrp/multi_usrp.hpp>
 
+#include "trafficgen.h"
+#include "arbwave.h"
+#include "rateplan.h"
+#include "resampchain.h"
+
 void usage() {
     printf("packet_tx -- transmit simple packets\n");
     printf("\n");
     printf("  u,h   : usage/help\n");
     printf("  q/v   : quiet/verbose\n");
     printf("  f     : center frequency [Hz], default: 462 MHz\n");
-    printf("  b     : bandwidth [Hz] (62.5kHz min, 8MHz max), default: 250 kHz\n");
+    printf("  b     : bandwidth [Hz], default: 250 kHz\n");
     printf("  g     : software tx gain [dB] (default: -6dB)\n");
     printf("  G     : uhd tx gain [dB] (default: 40dB)\n");
     printf("  N     : number of frames, default: 2000\n");
+    printf("  A     : arb mode: render this duration [s] of frames once and loop it\n");
+    printf("  I     : arb mode: load waveform (complex float I/Q at device rate), loop it N times\n");
+    printf("  O     : arb mode: save rendered waveform to file\n");
+    printf("  S     : arb mode: gain step per loop [dB], default: 0\n");
+    printf("  L     : arb mode: number of gain steps before repeating, default: 1\n");
 }
 
 int main (int argc, char **argv)
@@ -44,19 +55,22 @@ int main (int argc, char **argv)
     // command-line options
     bool verbose = true;
 
-    unsigned long int DAC_RATE = 64e6;
-    double min_bandwidth = 0.25*(DAC_RATE / 512.0);
-    double max_bandwidth = 0.25*(DAC_RATE /   4.0);
-
     double frequency = 462.0e6;
     double bandwidth = 250e3f;
     unsigned int num_frames = 2000;     // number of frames to transmit
     double txgain_dB = -12.0f;          // software tx gain [dB]
     double uhd_txgain = 40.0;           // uhd (hardware) tx gain
 
+    // arbitrary waveform mode
+    float arb_seconds = 0.0f;           // rendered duration (0: off)
+    char arb_filename_in[256]  = "";    // waveform to load
+    char arb_filename_out[256] = "";    // rendered waveform to save
+    float arb_step_dB = 0.0f;           // gain step per loop
+    unsigned int arb_num_steps = 1;     // gain steps before repeating
+
     //
     int d;
-    while ((d = getopt(argc,argv,"uhqvf:b:g:G:N:")) != EOF) {
+    while ((d = getopt(argc,argv,"uhqvf:b:g:G:N:A:I:O:S:L:")) != EOF) {
         switch (d) {
         case 'u':
         case 'h':   usage();                        return 0;
@@ -67,17 +81,22 @@ int main (int argc, char **argv)
         case 'g':   txgain_dB   = atof(optarg);     break;
         case 'G':   uhd_txgain  = atof(optarg);     break;
         case 'N':   num_frames  = atoi(optarg);     break;
+        case 'A':   arb_seconds = atof(optarg);             break;
+        case 'I':   strncpy(arb_filename_in,optarg,255);    break;
+        case 'O':   strncpy(arb_filename_out,optarg,255);   break;
+        case 'S':   arb_step_dB = atof(optarg);             break;
+        case 'L':   arb_num_steps = atoi(optarg);           break;
         default:
             usage();
             return 0;
         }
     }
 
-    if (bandwidth > max_bandwidth) {
-        fprintf(stderr,"error: %s, maximum bandwidth exceeded (%8.4f MHz)\n", argv[0], max_bandwidth*1e-6);
-        return 0;
-    } else if (bandwidth < min_bandwidth) {
-        fprintf(stderr,"error: %s, minimum bandwidth exceeded (%8.4f kHz)\n", argv[0], min_bandwidth*1e-3);
+    if (bandwidth <= 0) {
+        fprintf(stderr,"error: %s, bandwidth must be greater than zero\n", argv[0]);
+        exit(1);
+    } else if (arb_num_steps < 1) {
+        fprintf(stderr,"error: %s, number of gain steps must be at least 1\n", argv[0]);
         exit(1);
     }
 
@@ -86,31 +105,17 @@ int main (int argc, char **argv)
     //dev_addr["addr1"] = "192.168.10.3";
     uhd::usrp::multi_usrp::sptr usrp = uhd::usrp::multi_usrp::make(dev_addr);
 
-    // set properties
-    double tx_rate = 4.0*bandwidth;
-
-    // NOTE : the sample rate computation MUST be in double precision so
-    //        that the UHD can compute its interpolation rate properly
-    unsigned int interp_rate = (unsigned int)(DAC_RATE / tx_rate);
-    // ensure multiple of 4
-    interp_rate = (interp_rate >> 2) << 2;
-    // NOTE : there seems to be a bug where if the interp rate is equal to
-    //        240 or 244 we get some weird warning saying that
-    //        "The hardware does not support the requested TX sample rate"
-    while (interp_rate == 240 || interp_rate == 244)
-        interp_rate -= 4;
-    // compute usrp sampling rate
-    double usrp_tx_rate = DAC_RATE / (double)interp_rate;
-    
-    // try to set tx rate
-    usrp->set_tx_rate(DAC_RATE / interp_rate);
-
-    // get actual tx rate
-    usrp_tx_rate = usrp->get_tx_rate();
+    // plan device rate (among those the device supports) and
+    // resampling up from two samples per symbol
+    double tx_rate = 2.0*bandwidth;
+    rateplan plan = rateplan_create_tx(usrp, tx_rate, RATEPLAN_PASSBAND, 60.0f, 0.0);
+    if (plan == NULL)
+        exit(1);
 
-    //usrp_tx_rate = 262295.081967213;
-    // compute arbitrary resampling rate
-    double tx_resamp_rate = usrp_tx_rate / tx_rate;
+    // try to set tx rate, then resample to the actual rate
+    usrp->set_tx_rate(rateplan_get_device_rate(plan));
+    double usrp_tx_rate = usrp->get_tx_rate();
+    resampchain resamp = resampchain_create(plan, usrp_tx_rate);
 
     usrp->set_tx_freq(frequency);
     usrp->set_tx_gain(uhd_txgain);
@@ -119,25 +124,22 @@ int main (int argc, char **argv)
     printf("bandwidth   :   %12.8f [kHz]\n", bandwidth*1e-3f);
     printf("verbosity   :   %s\n", (verbose?"enabled":"disabled"));
 
-    printf("sample rate :   %12.8f kHz = %12.8f * %8.6f (interp %u)\n",
+    printf("sample rate :   %12.8f kHz = %12.8f * %8.6f\n",
             tx_rate * 1e-3f,
             usrp_tx_rate * 1e-3f,
-            1.0 / tx_resamp_rate,
-            interp_rate);
+            1.0 / resampchain_get_rate(resamp));
+    rateplan_print(plan);
 
     // set the IF filter bandwidth
     //usrp->set_tx_bandwidth(2.0f*tx_rate);
 
-    // add arbitrary resampling component
-    // TODO : check that resampling rate does indeed correspond to proper bandwidth
-    msresamp_crcf resamp = msresamp_crcf_create(2.0*tx_resamp_rate, 60.0f);
-
     // transmitter gain (linear)
     float g = powf(10.0f, txgain_dB/20.0f);
 
     // data arrays
     unsigned char header[8];
     unsigned char payload[64];
+    trafficgen tgen = trafficgen_create(TRAFFICGEN_DEFAULT_SEED, 0, 8);
     
     // create frame generator
     framegen64 fg = framegen64_create();
@@ -148,7 +150,7 @@ int main (int argc, char **argv)
     std::complex<float> frame_samples[frame_len];
 
     // create buffer for arbitrary resamper output
-    std::complex<float> buffer_resamp[(int)(2*tx_resamp_rate) + 64];
+    std::vector<std::complex<float> > buffer_resamp(resampchain_get_max_output(resamp, 1));
 
     // vector buffer to send data to USRP
     std::vector<std::complex<float> > usrp_buffer(256);
@@ -160,22 +162,63 @@ int main (int argc, char **argv)
     md.end_of_burst   = false;  // 
     md.has_time_spec  = false;  // set to false to send immediately
 
+    // arbitrary waveform mode: render (or load) once, then loop; N
+    // counts frames rounded up to whole loops (loops for a loaded file)
+    arbwave arb = NULL;
+    unsigned int arb_frames = 0;    // frames per loop
+    if (arb_filename_in[0] != '\0') {
+        arb = arbwave_create_from_file(arb_filename_in);
+        if (arb == NULL)
+            exit(1);
+    } else if (arb_seconds > 0.0f) {
+        // whole frames at baseband make up one period
+        std::vector<std::complex<float> > arb_frame;
+        while (arb_frame.size() < arb_seconds * tx_rate) {
+            trafficgen_generate(tgen, header, payload, 64);
+            framegen64_execute(fg, header, payload, frame_samples);
+            arb_frame.insert(arb_frame.end(), frame_samples, frame_samples + frame_len);
+            arb_frames++;
+        }
+
+        // pad with zeros to a period which wraps exactly at the device rate
+        unsigned int arb_len = resampchain_get_period(resamp, arb_frame.size());
+        if (arb_len == 0) {
+            fprintf(stderr,"error: %s, no waveform period near %.6f s wraps exactly at %.4f kHz; try another duration or bandwidth\n",
+                    argv[0], arb_frame.size() / tx_rate, usrp_tx_rate*1e-3);
+            exit(1);
+        }
+        arb_frame.resize(arb_len, 0.0f);
+        arb = arbwave_create_periodic(resamp, &arb_frame.front(), arb_frame.size());
+    }
+    unsigned int arb_num_loops = 0;
+    if (arb != NULL) {
+        arbwave_set_gain(arb, txgain_dB, arb_step_dB, arb_num_steps);
+        if (arb_filename_out[0] != '\0' && arbwave_save(arb, arb_filename_out) == 0)
+            printf("waveform written to '%s'\n", arb_filename_out);
+        arbwave_print(arb);
+        arb_num_loops = arb_frames > 0 ? (num_frames + arb_frames - 1) / arb_frames : num_frames;
+    }
+
+    // arbitrary waveform mode: stream precomputed samples
+    std::vector<std::complex<float> > arb_buffer(arb == NULL ? 0 : 4096);
+    while (arb != NULL && arbwave_get_num_loops(arb) < arb_num_loops) {
+        unsigned int n = arbwave_read(arb, &arb_buffer.front(), arb_buffer.size());
+        usrp->get_device()->send(
+            &arb_buffer.front(), n, md,
+            uhd::io_type_t::COMPLEX_FLOAT32,
+            uhd::device::SEND_MODE_FULL_BUFF
+        );
+    }
+
     unsigned int j;
     unsigned int pid;
-    for (pid=0; pid<num_frames; pid++) {
+    for (pid=0; arb == NULL && pid<num_frames; pid++) {
 
         if (verbose)
             printf("tx packet id: %6u\n", pid);
         
-        // write header (first two bytes packet ID, remaining are random)
-        header[0] = (pid >> 8) & 0xff;
-        header[1] = (pid     ) & 0xff;
-        for (j=2; j<8; j++)
-            header[j] = rand() & 0xff;
-
-        // initialize payload
-        for (j=0; j<64; j++)
-            payload[j] = rand() & 0xff;
+        // write header (packet ID, sequence) and pseudo-random payload
+        trafficgen_generate(tgen, header, payload, 64);
 
         // generate the entire frame
         framegen64_execute(fg, header, payload, frame_samples);
@@ -184,7 +227,7 @@ int main (int argc, char **argv)
         for (j=0; j<frame_len; j++) {
             // resample one sample at a time
             unsigned int nw;    // number of samples output from resampler
-            msresamp_crcf_execute(resamp, &frame_samples[j], 1, buffer_resamp, &nw);
+            resampchain_execute(resamp, &frame_samples[j], 1, &buffer_resamp.front(), &nw);
 
             // for each output sample, stuff into USRP buffer
             unsigned int n;
@@ -226,8 +269,14 @@ int main (int argc, char **argv)
     printf("usrp data transfer complete\n");
 
     // delete allocated objects
+    if (arb != NULL) {
+        arbwave_print(arb);
+        arbwave_destroy(arb);
+    }
     framegen64_destroy(fg);
-    msresamp_crcf_destroy(resamp);
+    resampchain_destroy(resamp);
+    rateplan_destroy(plan);
+    trafficgen_destroy(tgen);
 
     return 0;
 }
@@ -0,0 +1,137 @@
+/*
+ * Copyright (c) 2013 Joseph Gaeddert
+ *
+ * This file is part of liquid.
+ *
+ * liquid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * liquid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with liquid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+//
+// packetlog_dump.cc
+//
+// print contents and summary of a binary packet log (see
+// include/packetlog.h) as written by the receiver programs
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <getopt.h>
+#include <liquid/liquid.h>
+
+#include "packetlog.h"
+
+void usage() {
+    printf("packetlog_dump [OPTION] FILE\n");
+    printf("print contents of binary packet log\n");
+    printf("\n");
+    printf("  u,h   : usage/help\n");
+    printf("  q/v   : quiet/verbose (print every record)\n");
+    printf("  s     : start time [s],           default: 0\n");
+    printf("  n     : maximum number of records, default: (all)\n");
+}
+
+int main (int argc, char **argv)
+{
+    // command-line options
+    bool verbose = false;
+    double time_start = 0.0;            // start time relative to log start [s]
+    unsigned int max_records = 0;       // maximum number of records (0: all)
+
+    //
+    int d;
+    while ((d = getopt(argc,argv,"uhqvs:n:")) != EOF) {
+        switch (d) {
+        case 'u':
+        case 'h':   usage();                        return 0;
+        case 'q':   verbose     = false;            break;
+        case 'v':   verbose     = true;             break;
+        case 's':   time_start  = atof(optarg);     break;
+        case 'n':   max_records = atoi(optarg);     break;
+        default:    usage();                        return 1;
+        }
+    }
+
+    if (optind >= argc) {
+        fprintf(stderr,"error: %s, input file required\n", argv[0]);
+        usage();
+        return 1;
+    }
+
+    // open log
+    packetlogreader q = packetlogreader_open(argv[optind]);
+    if (q == NULL)
+        return 1;
+
+    unsigned int num_records = packetlogreader_get_num_records(q);
+    unsigned int header_len  = packetlogreader_get_header_len(q);
+
+    // seek to start time
+    unsigned int i0 = packetlogreader_find(q, time_start);
+    unsigned int i1 = num_records;
+    if (max_records > 0 && i0 + max_records < i1)
+        i1 = i0 + max_records;
+
+    // counters
+    unsigned int num_valid_headers  = 0;
+    unsigned int num_valid_payloads = 0;
+    unsigned long int num_valid_bytes = 0;
+    float evm_sum  = 0.0f;
+    float rssi_sum = 0.0f;
+
+    unsigned int i;
+    unsigned int j;
+    struct packetlog_record_s r;
+    for (i=i0; i<i1; i++) {
+        packetlogreader_read(q, i, &r);
+
+        num_valid_headers  += r.header_valid  ? 1 : 0;
+        num_valid_payloads += r.payload_valid ? 1 : 0;
+        num_valid_bytes    += r.payload_valid ? r.payload_len : 0;
+        evm_sum  += r.stats.evm;
+        rssi_sum += r.stats.rssi;
+
+        if (verbose) {
+            printf("%8u t=%12.6f ch=%2u rssi=%7.2fdB evm=%7.2fdB cfo=%9.6f header:",
+                    i, r.timestamp, r.channel, r.stats.rssi, r.stats.evm, r.stats.cfo);
+            for (j=0; j<header_len; j++)
+                printf("%.2x", r.header[j]);
+            printf(" [%4s], payload[%6u bytes]:%4s\n",
+                    r.header_valid  ? "pass" : "FAIL",
+                    r.payload_len,
+                    r.payload_valid ? "pass" : "FAIL");
+        }
+    }
+
+    // print summary
+    unsigned int n = i1 - i0;
+    float duration = 0.0f;
+    if (n > 0) {
+        struct packetlog_record_s r0;
+        packetlogreader_read(q, i0,   &r0);
+        packetlogreader_read(q, i1-1, &r);
+        duration = r.timestamp - r0.timestamp;
+    }
+    printf("    records             : %6u (of %u)\n", n, num_records);
+    printf("    valid headers       : %6u\n", num_valid_headers);
+    printf("    valid payloads      : %6u\n", num_valid_payloads);
+    printf("    valid bytes         : %6lu\n", num_valid_bytes);
+    printf("    average rssi        : %8.2f dB\n", n == 0 ? 0.0f : rssi_sum / (float)n);
+    printf("    average evm         : %8.2f dB\n", n == 0 ? 0.0f : evm_sum  / (float)n);
+    printf("    duration            : %f s\n", duration);
+
+    packetlogreader_close(q);
+    return 0;
+}
+
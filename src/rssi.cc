@@ -22,14 +22,22 @@
 #include <complex>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <math.h>
 #include <sys/resource.h>
 #include <liquid/liquid.h>
 #include <assert.h>
 
 #include <uhd/usrp/multi_usrp.hpp>
 
+#include "iqlog.h"
+#include "rateplan.h"
+#include "resampchain.h"
 #include "timer.h"
 
+// maximum number of timed retunes queued ahead of the sweep receiver
+#define RSSI_SWEEP_MAX_PENDING  (4)
+
 void usage() {
     printf("Usage: rssi [OPTION]\n");
     printf("Run receiver, simply printing RSSI to screen periodically\n");
@@ -40,8 +48,167 @@ void usage() {
     printf("  b     : bandwidth [Hz],          default:  200 kHz\n");
     printf("  t     : run time [seconds],      default:    5 s\n");
     printf("  G     : uhd rx gain [dB],        default:   20 dB\n");
-    printf("  L     : record length [samples], default: 1200 samples\n");
-    printf("  o     : output filename,         default: rssi_results.m\n");
+    printf("  L     : record length [samples], default: (entire run)\n");
+    printf("  R     : RSSI decimation,         default:   10 samples\n");
+    printf("  N     : record RSSI track only (no samples)\n");
+    printf("  o     : output filename,         default: rssi_results.iq\n");
+    printf("          (binary, see iqlog2octave)\n");
+    printf(" sweep mode (enabled by S/E or l):\n");
+    printf("  S     : sweep start frequency [Hz]\n");
+    printf("  E     : sweep stop frequency [Hz]\n");
+    printf("  s     : sweep step [Hz],         default: bandwidth\n");
+    printf("  l     : sweep frequency list file (one frequency [Hz] per line)\n");
+    printf("  d     : dwell time [s],          default:   10 ms\n");
+    printf("  D     : settling time [s],       default:    2 ms\n");
+    printf("  n     : number of sweeps,        default:    1\n");
+    printf("  o     : output filename,         default: rssi_sweep.dat\n");
+}
+
+// sweep list of frequencies, measuring the average power over each
+// dwell; each dwell starts with a timed retune at a fixed device time
+// and its first settling samples are discarded, so the sweep runs
+// without gaps while the receiver streams continuously
+//  _usrp       :   device (rx rate and gain already set)
+//  _freqs      :   frequencies to sweep [Hz]
+//  _num_passes :   number of sweeps
+//  _dwell      :   measurement time per frequency [s]
+//  _settle     :   settling time per frequency [s]
+//  _filename   :   output table filename
+//  _verbose    :   print each measurement?
+int rssi_sweep(uhd::usrp::multi_usrp::sptr _usrp,
+               std::vector<double> &       _freqs,
+               unsigned int                _num_passes,
+               double                      _dwell,
+               double                      _settle,
+               const char *                _filename,
+               int                         _verbose)
+{
+    double rate = _usrp->get_rx_rate();
+    unsigned int num_freqs = _freqs.size();
+    unsigned int num_dwells = num_freqs * _num_passes;
+    unsigned long long int settle_len = (unsigned long long int)(_settle*rate + 0.5);
+    unsigned long long int dwell_len  = (unsigned long long int)((_settle + _dwell)*rate + 0.5);
+    if (num_dwells == 0 || dwell_len <= settle_len) {
+        fprintf(stderr,"error: rssi_sweep(), invalid sweep configuration\n");
+        return 1;
+    }
+
+    // validate frequency list before touching the device
+    unsigned int i;
+    uhd::freq_range_t range = _usrp->get_rx_freq_range();
+    for (i=0; i<num_freqs; i++) {
+        if (_freqs[i] < range.start() || _freqs[i] > range.stop()) {
+            fprintf(stderr,"error: rssi_sweep(), frequency %.3f MHz (entry %u) out of range\n",
+                    _freqs[i]*1e-6, i);
+            return 1;
+        }
+    }
+
+    // tune to each frequency once and record the resulting settings so
+    // that the timed retunes need not compute them
+    std::vector<uhd::tune_request_t> tune(num_freqs);
+    for (i=0; i<num_freqs; i++) {
+        tune[i] = uhd::tune_request_t(_freqs[i]);
+        uhd::tune_result_t result = _usrp->set_rx_freq(tune[i]);
+        tune[i].rf_freq_policy  = uhd::tune_request_t::POLICY_MANUAL;
+        tune[i].rf_freq         = result.actual_rf_freq;
+        tune[i].dsp_freq_policy = uhd::tune_request_t::POLICY_MANUAL;
+        tune[i].dsp_freq        = result.actual_dsp_freq;
+    }
+
+    FILE * fid = fopen(_filename,"w");
+    if (!fid) {
+        fprintf(stderr,"error: rssi_sweep(), could not open '%s' for writing\n", _filename);
+        return 1;
+    }
+    fprintf(fid,"%% %s : auto-generated file\n", _filename);
+    fprintf(fid,"%% sample rate : %e Hz\n", rate);
+    fprintf(fid,"%% dwell       : %e s (settling %e s)\n", _dwell, _settle);
+    fprintf(fid,"%% columns     : frequency [Hz], sweep, time [s], power [dB], samples\n");
+
+    // power accumulated over the measurement part of each dwell
+    std::vector<double> power(num_dwells, 0.0);
+    std::vector<unsigned long long int> num_samples(num_dwells, 0);
+
+    const size_t max_samps_per_packet = _usrp->get_device()->get_max_recv_samps_per_packet();
+    uhd::rx_metadata_t md;
+    std::vector<std::complex<float> > buff(max_samps_per_packet);
+
+    // start streaming; first dwell begins shortly after
+    double t0 = _usrp->get_time_now().get_real_secs() + 0.05;
+    _usrp->issue_stream_cmd(uhd::stream_cmd_t::STREAM_MODE_START_CONTINUOUS);
+    timer t1 = timer_create();
+    timer_tic(t1);
+
+    unsigned int num_tuned = 0;     // dwells with retune queued
+    unsigned int num_done  = 0;     // dwells completed
+    int rc = 0;
+    while (num_done < num_dwells) {
+        // keep a few timed retunes queued ahead of the receiver
+        while (num_tuned < num_dwells && num_tuned < num_done + RSSI_SWEEP_MAX_PENDING) {
+            _usrp->set_command_time(uhd::time_spec_t(t0 + (double)(num_tuned*dwell_len)/rate));
+            _usrp->set_rx_freq(tune[num_tuned % num_freqs]);
+            _usrp->clear_command_time();
+            num_tuned++;
+        }
+
+        size_t num_rx_samps = _usrp->get_device()->recv(
+            &buff.front(), buff.size(), md,
+            uhd::io_type_t::COMPLEX_FLOAT32,
+            uhd::device::RECV_MODE_ONE_PACKET
+        );
+
+        // overflows only cost samples; dwells are placed by time stamp
+        if (md.error_code != uhd::rx_metadata_t::ERROR_CODE_NONE &&
+            md.error_code != uhd::rx_metadata_t::ERROR_CODE_OVERFLOW)
+        {
+            std::cerr << "Error code: " << md.error_code << std::endl;
+            std::cerr << "Unexpected error on recv, exit test..." << std::endl;
+            rc = 1;
+            break;
+        } else if (!md.has_time_spec || num_rx_samps == 0) {
+            continue;
+        }
+
+        // sample index of packet relative to the start of the sweep
+        long long int s0 = (long long int) floor((md.time_spec.get_real_secs() - t0)*rate + 0.5);
+        long long int s1 = s0 + (long long int)num_rx_samps;
+        if (s1 <= 0)
+            continue;
+
+        // accumulate power of each dwell within this packet (block sums)
+        unsigned int k = s0 < 0 ? 0 : (unsigned int)(s0 / dwell_len);
+        for ( ; k < num_dwells && (long long int)(k*dwell_len) < s1; k++) {
+            long long int a = (long long int)(k*dwell_len + settle_len);
+            long long int b = (long long int)((k+1)*dwell_len);
+            if (a < s0) a = s0;
+            if (b > s1) b = s1;
+            if (b <= a)
+                continue;
+            power[k]       += liquid_sumsqcf(&buff[a - s0], b - a);
+            num_samples[k] += b - a;
+        }
+
+        // write completed dwells
+        while (num_done < num_dwells && (long long int)((num_done+1)*dwell_len) <= s1) {
+            unsigned int n = num_done;
+            float power_db = num_samples[n] > 0 ? 10*log10(power[n] / num_samples[n]) : NAN;
+            fprintf(fid,"%14.0f %4u %12.6f %8.2f %10llu\n",
+                    _freqs[n % num_freqs], n / num_freqs,
+                    (double)(n*dwell_len) / rate, power_db, num_samples[n]);
+            if (_verbose)
+                printf("  %12.6f MHz : %8.2f dB\n", _freqs[n % num_freqs]*1e-6, power_db);
+            num_done++;
+        }
+    }
+
+    _usrp->issue_stream_cmd(uhd::stream_cmd_t::STREAM_MODE_STOP_CONTINUOUS);
+    printf("swept %u frequencies x %u in %.3f s\n", num_freqs, _num_passes, timer_toc(t1));
+    timer_destroy(t1);
+
+    fclose(fid);
+    printf("output written to '%s'\n", _filename);
+    return rc;
 }
 
 int main (int argc, char **argv)
@@ -55,12 +222,24 @@ int main (int argc, char **argv)
     double uhd_rxgain = 20.0;
 
     // output log file
-    unsigned int log_size = 1200;
-    char filename[256] = "rssi_results.m";
+    unsigned long long int log_size = 0;
+    unsigned int rssi_decim = 10;
+    int save_iq = 1;
+    char filename[256] = "rssi_results.iq";
+    bool filename_set = false;
+
+    // sweep mode
+    double sweep_start = 0.0;
+    double sweep_stop  = -1.0;
+    double sweep_step  = 0.0;
+    const char * sweep_list = NULL;
+    double dwell  = 10e-3;
+    double settle = 2e-3;
+    unsigned int num_passes = 1;
 
     //
     int d;
-    while ((d = getopt(argc,argv,"hvqf:b:t:G:L:o:")) != EOF) {
+    while ((d = getopt(argc,argv,"hvqf:b:t:G:L:R:No:S:E:s:l:d:D:n:")) != EOF) {
         switch (d) {
         case 'h':   usage();                        return 0;
         case 'v':   verbose = true;                 break;
@@ -69,13 +248,49 @@ int main (int argc, char **argv)
         case 'b':   bandwidth = atof(optarg);       break;
         case 't':   num_seconds = atof(optarg);     break;
         case 'G':   uhd_rxgain = atof(optarg);      break;
-        case 'L':   log_size = atoi(optarg);        break;
-        case 'o':   strncpy(filename,optarg,255);   break;
+        case 'L':   log_size = atoll(optarg);       break;
+        case 'R':   rssi_decim = atoi(optarg);      break;
+        case 'N':   save_iq = 0;                    break;
+        case 'o':   strncpy(filename,optarg,255); filename_set = true; break;
+        case 'S':   sweep_start = atof(optarg);     break;
+        case 'E':   sweep_stop = atof(optarg);      break;
+        case 's':   sweep_step = atof(optarg);      break;
+        case 'l':   sweep_list = optarg;            break;
+        case 'd':   dwell = atof(optarg);           break;
+        case 'D':   settle = atof(optarg);          break;
+        case 'n':   num_passes = atoi(optarg);      break;
         default:
             return 1;
         }
     }
 
+    unsigned int i;
+
+    // assemble sweep frequency list
+    std::vector<double> sweep_freqs;
+    if (sweep_list != NULL) {
+        FILE * fid = fopen(sweep_list,"r");
+        if (!fid) {
+            fprintf(stderr,"error: %s, could not open '%s' for reading\n", argv[0], sweep_list);
+            exit(1);
+        }
+        double f;
+        while (fscanf(fid,"%lf",&f) == 1)
+            sweep_freqs.push_back(f);
+        fclose(fid);
+    } else if (sweep_stop >= sweep_start) {
+        if (sweep_step <= 0.0)
+            sweep_step = bandwidth;
+        unsigned int n = (unsigned int)((sweep_stop - sweep_start)/sweep_step + 1e-6) + 1;
+        for (i=0; i<n; i++)
+            sweep_freqs.push_back(sweep_start + i*sweep_step);
+    }
+    bool sweep = sweep_list != NULL || sweep_stop >= sweep_start;
+    if (sweep && (sweep_freqs.size() == 0 || dwell <= 0.0 || settle < 0.0 || num_passes == 0)) {
+        fprintf(stderr,"error: %s, invalid sweep (empty list or non-positive dwell)\n", argv[0]);
+        exit(1);
+    }
+
     printf("frequency   :   %12.8f [MHz]\n", frequency*1e-6f);
     printf("bandwidth   :   %12.8f [kHz]\n", bandwidth*1e-3f);
     printf("verbosity   :   %s\n", (verbose?"enabled":"disabled"));
@@ -87,14 +302,29 @@ int main (int argc, char **argv)
     uhd::device_addr_t dev_addr;
     uhd::usrp::multi_usrp::sptr usrp = uhd::usrp::multi_usrp::make(dev_addr);
 
-    // try to set hardware rx rate
-    usrp->set_rx_rate(2.0f*bandwidth);
+    // sweep mode: measure power over the full device bandwidth
+    if (sweep) {
+        usrp->set_rx_rate(bandwidth);
+        usrp->set_rx_gain(uhd_rxgain);
+        printf("sweep           :   %u frequencies, %.3f kHz, dwell %.1f ms\n",
+                (unsigned int)sweep_freqs.size(),
+                usrp->get_rx_rate()*1e-3,
+                dwell*1e3);
+        return rssi_sweep(usrp, sweep_freqs, num_passes, dwell, settle,
+                          filename_set ? filename : "rssi_sweep.dat", verbose);
+    }
 
-    // get actual rx rate
-    double usrp_rx_rate = usrp->get_rx_rate();
+    // plan device rate and resampling (measured band within the flat
+    // part of the device filters)
+    rateplan plan = rateplan_create_rx(usrp, bandwidth, 0.45f, 60.0f, 0.0);
+    if (plan == NULL)
+        exit(1);
 
-    // compute arbitrary resampling rate (make up the difference in software)
-    double rx_resamp_rate = bandwidth / usrp_rx_rate;
+    // try to set hardware rx rate, then resample from the actual rate
+    usrp->set_rx_rate(rateplan_get_device_rate(plan));
+    double usrp_rx_rate = usrp->get_rx_rate();
+    resampchain resamp = resampchain_create(plan, usrp_rx_rate);
+    double rx_resamp_rate = resampchain_get_rate(resamp);
 
     printf("frequency       :   %10.4f [MHz]\n", frequency*1e-6f);
     printf("bandwidth       :   %10.4f [kHz]\n", bandwidth*1e-3f);
@@ -104,20 +334,23 @@ int main (int argc, char **argv)
             usrp_rx_rate * 1e-3f,
             rx_resamp_rate);
     assert(rx_resamp_rate <= 1.0f);
+    rateplan_print(plan);
 
     usrp->set_rx_freq(frequency);
     usrp->set_rx_gain(uhd_rxgain);
 
-    // create and initialize arbitrary resampling component
-    msresamp_crcf resamp = msresamp_crcf_create(rx_resamp_rate,60.0f);
-
     // create automatic gain control object and set properties
     agc_crcf agc_rx = agc_crcf_create();
     agc_crcf_set_bandwidth(agc_rx, 0.01f);
 
-    // create window buffer to log samples/rssi
-    windowcf rx_log   = windowcf_create(log_size);
-    windowf  rssi_log = windowf_create(log_size);
+    // create streaming log of samples/rssi
+    if (!save_iq && rssi_decim == 0) {
+        fprintf(stderr,"error: %s, nothing to record\n", argv[0]);
+        exit(1);
+    }
+    iqlog log = iqlog_create(filename, bandwidth, frequency, save_iq, rssi_decim);
+    if (log == NULL)
+        exit(1);
 
     //
     const size_t max_samps_per_packet = usrp->get_device()->get_max_recv_samps_per_packet();
@@ -126,14 +359,13 @@ int main (int argc, char **argv)
     uhd::rx_metadata_t md;
     std::vector<std::complex<float> > buff(max_samps_per_packet);
 
-    // resampled data (should only be 0 or 1)
-    std::complex<float> buffer_resamp[64];
+    // resampled data (entire packet)
+    std::vector<std::complex<float> > buffer_resamp(resampchain_get_max_output(resamp, max_samps_per_packet));
 
     // start data transfer
     usrp->issue_stream_cmd(uhd::stream_cmd_t::STREAM_MODE_START_CONTINUOUS);
     printf("usrp data transfer started\n");
  
-    unsigned int i;
     std::complex<float> agc_out;
 
     // run conditions
@@ -167,29 +399,17 @@ int main (int argc, char **argv)
             return 1;
         }
 
-        // copy vector "buff" to array of complex float, run
-        // resampler, and push through AGC object
-        for (i=0; i<num_rx_samps; i++) {
-            // push 64 samples into buffer
-            std::complex<float> usrp_sample = buff[i];
-
-            // push through resampler (one at a time)
-            unsigned int nw;
-            msresamp_crcf_execute(resamp, &usrp_sample, 1, buffer_resamp, &nw);
-
-            // push through agc object, push to log buffer
-            unsigned int k;
-            for (k=0; k<nw; k++) {
-                // save time samples
-                windowcf_push(rx_log, buffer_resamp[k]);
+        // run resampler on entire packet, and push through AGC object
+        unsigned int nw;
+        resampchain_execute(resamp, &buff.front(), num_rx_samps, &buffer_resamp.front(), &nw);
+        for (i=0; i<nw; i++)
+            agc_crcf_execute(agc_rx, buffer_resamp[i], &agc_out);
 
-                // apply agc and get rssi
-                agc_crcf_execute(agc_rx, buffer_resamp[k], &agc_out);
-
-                // get linear signal level and push into buffer
-                windowf_push(rssi_log, agc_crcf_get_signal_level(agc_rx));
-            }
-        }
+        // stream to log (background thread writes to disk)
+        unsigned long long int num_logged = iqlog_get_num_samples(log);
+        if (log_size > 0 && num_logged + nw > log_size)
+            nw = num_logged < log_size ? (unsigned int)(log_size - num_logged) : 0;
+        iqlog_write(log, &buffer_resamp.front(), nw);
 
         // check runtime
         float runtime = timer_toc(t0);
@@ -209,46 +429,16 @@ int main (int argc, char **argv)
     printf("usrp data transfer complete\n");
 
     // clean object allocation
-    msresamp_crcf_destroy(resamp);
+    resampchain_destroy(resamp);
+    rateplan_destroy(plan);
     agc_crcf_destroy(agc_rx);
     timer_destroy(t0);
 
-    // save log file...
-    FILE * fid = fopen(filename,"w");
-    if (!fid) {
-        fprintf(stderr,"error: %s, could not open '%s' for writing\n", argv[0], filename);
-        exit(1);
-    }
-    fprintf(fid,"%% %s : auto-generated file\n", filename);
-    std::complex<float> * rc = NULL;    // complex buffer read pointer
-    float * r = NULL;                   // real buffer read pointer
-    windowcf_read(rx_log, &rc);
-    windowf_read(rssi_log,&r);
-    fprintf(fid,"Fs = %e;\n", bandwidth);
-    fprintf(fid,"n = %u;\n", log_size);
-    fprintf(fid,"rssi = zeros(1,n);\n");
-    for (i=0; i<log_size; i++) {
-        fprintf(fid,"rssi(%4u) = %12.4e; x(%4u) = %12.4e + %12.4ej;\n",
-                i+1, r[i],
-                i+1, rc[i].real(), rc[i].imag());
-    }
-    fprintf(fid,"\n\n");
-    fprintf(fid,"t = [0:(n-1)]/Fs*1e3; %% time (ms)\n");
-    fprintf(fid,"figure;\n");
-    fprintf(fid,"subplot(2,1,1);\n");
-    fprintf(fid,"  plot(t,real(x),t,imag(x));\n");
-    fprintf(fid,"  ylabel('r(t) [dB]');\n");
-    fprintf(fid,"subplot(2,1,2);\n");
-    fprintf(fid,"  plot(t,20*log10(rssi));\n");
-    fprintf(fid,"  ylabel('RSSI [dB]');\n");
-    fprintf(fid,"  xlabel('time [ms]');\n");
-    fprintf(fid,"grid on\n");
-    fclose(fid);
+    // flush and close log
+    iqlog_print(log);
+    iqlog_destroy(log);
     printf("output written to '%s'\n", filename);
 
-    windowf_destroy(rssi_log);
-    windowcf_destroy(rx_log);
-
     return 0;
 }
 
@@ -0,0 +1,494 @@
+/*
+ * Copyright (c) 2011, 2013 Joseph Gaeddert
+ *
+ * This file is part of liquid.
+ *
+ * liquid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * liquid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with liquid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+//
+// tunnel_txrx.cc
+//
+// Bridge a TUN/TAP network interface over the OFDM transceiver: each
+// packet read from the interface is transmitted as one frame, and each
+// valid frame received is written back to the interface. Two instances
+// can be connected without hardware through a pair of named pipes, e.g.
+//
+//   mkfifo /tmp/ab /tmp/ba
+//   tunnel_txrx -d tun0 -L /tmp/ab -R /tmp/ba &
+//   tunnel_txrx -d tun1 -L /tmp/ba -R /tmp/ab
+//
+
+#include <math.h>
+#include <iostream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <complex>
+#include <getopt.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <linux/if.h>
+#include <linux/if_tun.h>
+#include <liquid/liquid.h>
+
+#include "linklayer.h"
+#include "ofdmtxrx.h"
+#include "timer.h"
+
+// header identifiers for tunneled frames
+#define TUNNEL_HEADER_ID    (0xa5)  // one packet per frame
+#define TUNNEL_LINK_ID      (0xa6)  // aggregated/segmented packets
+
+// maximum size of a single tunneled packet [bytes]
+#define TUNNEL_MAX_PACKET   (2048)
+
+void usage() {
+    printf("tunnel_txrx [OPTION]\n");
+    printf("bridge a TUN/TAP network interface over OFDM frames\n");
+    printf("\n");
+    printf("  u,h   : usage/help\n");
+    printf("  q/v   : quiet/verbose\n");
+    printf("  d     : interface name,         default: liquid0\n");
+    printf("  a     : TAP (ethernet) mode,    default: TUN (ip)\n");
+    printf("  B     : tx batch size [packets],default:   16\n");
+    printf("  t     : run time [s],           default: until interrupted\n");
+    printf("  A     : aggregate/segment packets into frames of planned length\n");
+    printf("  E     : expected post-FEC BER for frame planning, default: 1e-6\n");
+    printf("  L     : loopback tx file (instead of usrp)\n");
+    printf("  R     : loopback rx file (instead of usrp)\n");
+    printf("  f     : center frequency [Hz],  default:  462 MHz\n");
+    printf("  F     : tx/rx frequency offset [Hz], default: 0\n");
+    printf("  b     : bandwidth [Hz],         default: 1000 kHz\n");
+    printf("  g     : software tx gain [dB],  default:  -12 dB \n");
+    printf("  G     : uhd tx gain [dB],       default:   40 dB\n");
+    printf("  r     : uhd rx gain [dB],       default:   20 dB\n");
+    printf("  M     : number of subcarriers,  default:   48\n");
+    printf("  C     : cyclic prefix length,   default:    6\n");
+    printf("  T     : taper length,           default:    4\n");
+    printf("  m     : modulation scheme,      default: qpsk\n");
+    liquid_print_modulation_schemes();
+    printf("  c     : coding scheme (inner),  default: none\n");
+    printf("  k     : coding scheme (outer),  default: v27\n");
+    liquid_print_fec_schemes();
+}
+
+// open TUN/TAP interface, returning non-blocking file descriptor
+//  _ifname     :   interface name (updated with name assigned by kernel)
+//  _flags      :   IFF_TUN or IFF_TAP
+int tun_open(char * _ifname,
+             int    _flags);
+
+// callback function
+int callback(unsigned char *  _header,
+             int              _header_valid,
+             unsigned char *  _payload,
+             unsigned int     _payload_len,
+             int              _payload_valid,
+             framesyncstats_s _stats,
+             void *           _userdata);
+
+static bool verbose = true;
+
+// write header of tunneled frame
+//  _header     :   output header [size: 8 x 1]
+//  _pid        :   frame id
+//  _id         :   TUNNEL_HEADER_ID or TUNNEL_LINK_ID
+//  _len        :   payload length [bytes]
+static void tunnel_header(unsigned char * _header,
+                          unsigned int    _pid,
+                          unsigned char   _id,
+                          unsigned int    _len)
+{
+    _header[0] = (_pid >> 8) & 0xff;
+    _header[1] = (_pid     ) & 0xff;
+    _header[2] = 0;
+    _header[3] = _id;
+    _header[4] = 0;
+    _header[5] = 0;
+    _header[6] = (_len >> 8) & 0xff;
+    _header[7] = (_len     ) & 0xff;
+}
+
+// stop on interrupt
+static volatile sig_atomic_t continue_running = 1;
+static void signal_handler(int _signum) { continue_running = 0; }
+
+// tunnel file descriptor (written to by receiver callback)
+static int tun_fd = -1;
+
+// link layer (aggregation mode only)
+static linklayer ll = NULL;
+
+// write received packet to interface
+void tun_write(unsigned char * _packet,
+               unsigned int    _packet_len,
+               void *          _userdata);
+
+// data counters
+unsigned int num_packets_sent;
+unsigned int num_bytes_sent;
+unsigned int num_batches_sent;
+unsigned int num_frames_detected;
+unsigned int num_packets_received;
+unsigned int num_bytes_received;
+unsigned int num_packets_dropped;
+
+int main (int argc, char **argv)
+{
+    // command-line options
+    char ifname[IFNAMSIZ] = "liquid0";  // interface name
+    int tun_flags = IFF_TUN;            // interface type
+    unsigned int batch_size = 16;       // max. packets read per batch
+    float runtime_max = 0.0f;           // run time (0: until interrupted)
+    const char * loop_tx = NULL;        // loopback transmit file
+    const char * loop_rx = NULL;        // loopback receive file
+    bool aggregate = false;             // use link layer
+    float ber = 1e-6f;                  // expected bit error rate
+
+    double frequency = 462.0e6;         // carrier frequency
+    double frequency_offset = 0.0;      // rx frequency offset
+    float bandwidth = 1000e3f;          // bandwidth
+    float txgain_dB = -12.0f;           // software tx gain [dB]
+    float uhd_txgain = 40.0;            // uhd (hardware) tx gain
+    float uhd_rxgain = 20.0;            // uhd (hardware) rx gain
+
+    // ofdm properties
+    unsigned int M = 48;                // number of subcarriers
+    unsigned int cp_len = 6;            // cyclic prefix length
+    unsigned int taper_len = 4;         // taper length
+
+    modulation_scheme ms = LIQUID_MODEM_QPSK;   // modulation scheme
+    fec_scheme fec0 = LIQUID_FEC_NONE;          // fec (inner)
+    fec_scheme fec1 = LIQUID_FEC_CONV_V27;      // fec (outer)
+
+    //
+    int d;
+    while ((d = getopt(argc,argv,"uhqvd:aB:t:AE:L:R:f:F:b:g:G:r:M:C:T:m:c:k:")) != EOF) {
+        switch (d) {
+        case 'u':
+        case 'h':   usage();                        return 0;
+        case 'q':   verbose     = false;            break;
+        case 'v':   verbose     = true;             break;
+        case 'd':
+            strncpy(ifname, optarg, IFNAMSIZ-1);
+            ifname[IFNAMSIZ-1] = '\0';
+            break;
+        case 'a':   tun_flags   = IFF_TAP;          break;
+        case 'B':   batch_size  = atoi(optarg);     break;
+        case 't':   runtime_max = atof(optarg);     break;
+        case 'A':   aggregate   = true;             break;
+        case 'E':   ber         = atof(optarg);     break;
+        case 'L':   loop_tx     = optarg;           break;
+        case 'R':   loop_rx     = optarg;           break;
+        case 'f':   frequency   = atof(optarg);     break;
+        case 'F':   frequency_offset = atof(optarg);break;
+        case 'b':   bandwidth   = atof(optarg);     break;
+        case 'g':   txgain_dB   = atof(optarg);     break;
+        case 'G':   uhd_txgain  = atof(optarg);     break;
+        case 'r':   uhd_rxgain  = atof(optarg);     break;
+        case 'M':   M           = atoi(optarg);     break;
+        case 'C':   cp_len      = atoi(optarg);     break;
+        case 'T':   taper_len   = atoi(optarg);     break;
+        case 'm':   ms          = liquid_getopt_str2mod(optarg);    break;
+        case 'c':   fec0        = liquid_getopt_str2fec(optarg);    break;
+        case 'k':   fec1        = liquid_getopt_str2fec(optarg);    break;
+        default:    usage();                        return 0;
+        }
+    }
+
+    if (cp_len == 0 || cp_len > M) {
+        fprintf(stderr,"error: %s, cyclic prefix must be in (0,M]\n", argv[0]);
+        exit(1);
+    } else if (batch_size == 0) {
+        fprintf(stderr,"error: %s, batch size must be greater than zero\n", argv[0]);
+        exit(1);
+    } else if ( (loop_tx == NULL) != (loop_rx == NULL) ) {
+        fprintf(stderr,"error: %s, loopback requires both tx and rx files\n", argv[0]);
+        exit(1);
+    } else if (ms == LIQUID_MODEM_UNKNOWN) {
+        fprintf(stderr,"error: %s, unknown/unsupported mod. scheme\n", argv[0]);
+        exit(-1);
+    } else if (fec0 == LIQUID_FEC_UNKNOWN) {
+        fprintf(stderr,"error: %s, unknown/unsupported inner fec scheme\n", argv[0]);
+        exit(-1);
+    } else if (fec1 == LIQUID_FEC_UNKNOWN) {
+        fprintf(stderr,"error: %s, unknown/unsupported outer fec scheme\n", argv[0]);
+        exit(-1);
+    }
+
+    // open network interface
+    tun_fd = tun_open(ifname, tun_flags);
+    if (tun_fd < 0)
+        exit(1);
+    printf("opened %s interface '%s'; configure with e.g.\n", tun_flags == IFF_TAP ? "TAP" : "TUN", ifname);
+    printf("  ip addr add 10.0.0.1/24 dev %s && ip link set %s up\n", ifname, ifname);
+
+    // create transceiver object
+    unsigned char * p = NULL;   // default subcarrier allocation
+    ofdmtxrx * txcvr = NULL;
+    if (loop_tx == NULL)
+        txcvr = new ofdmtxrx(M, cp_len, taper_len, p, callback, NULL);
+    else
+        txcvr = new ofdmtxrx(M, cp_len, taper_len, p, callback, NULL, loop_tx, loop_rx);
+
+    // set transmit properties
+    txcvr->set_tx_freq(frequency);
+    txcvr->set_tx_rate(bandwidth);
+    txcvr->set_tx_gain_soft(txgain_dB);
+    txcvr->set_tx_gain_uhd(uhd_txgain);
+
+    // set receive properties
+    txcvr->set_rx_freq(frequency + frequency_offset);
+    txcvr->set_rx_rate(bandwidth);
+    txcvr->set_rx_gain_uhd(uhd_rxgain);
+    txcvr->set_rx_block_len(256);     // frame times are not used
+
+    // pre-allocated packet batch
+    unsigned char * batch = (unsigned char*) malloc(batch_size*TUNNEL_MAX_PACKET*sizeof(unsigned char));
+    unsigned int    batch_len[batch_size];
+    unsigned char   headers[batch_size*8];
+    struct ofdmtxrx_packet_s packets[batch_size];
+
+    // link layer with frame length planned for the configured mod/fec;
+    // frames are popped and sent a batch at a time
+    unsigned char * frames = NULL;
+    unsigned int ll_frame_len = 0;
+    if (aggregate) {
+        ll_frame_len = linklayer_plan_frame_len(M, cp_len, taper_len, p,
+                                                ms, fec0, fec1, ber, TUNNEL_MAX_PACKET);
+        printf("aggregating packets into %u-byte frames\n", ll_frame_len);
+        ll  = linklayer_create(ll_frame_len, 4*batch_size, tun_write, NULL);
+        frames = (unsigned char*) malloc(batch_size*ll_frame_len*sizeof(unsigned char));
+    }
+
+    // reset counters
+    num_packets_sent=0;
+    num_bytes_sent=0;
+    num_batches_sent=0;
+    num_frames_detected=0;
+    num_packets_received=0;
+    num_bytes_received=0;
+    num_packets_dropped=0;
+
+    signal(SIGINT, signal_handler);
+    txcvr->start_rx();
+
+    timer t0 = timer_create();
+    timer_tic(t0);
+    unsigned int pid = 0;
+    unsigned int i;
+    while (continue_running) {
+        if (runtime_max > 0.0f && timer_toc(t0) >= runtime_max)
+            break;
+
+        // wait for traffic on the interface
+        struct pollfd pfd;
+        pfd.fd      = tun_fd;
+        pfd.events  = POLLIN;
+        pfd.revents = 0;
+        if (poll(&pfd, 1, 100) <= 0)
+            continue;
+
+        // drain up to a full batch of packets without blocking
+        unsigned int n = 0;
+        while (n < batch_size) {
+            ssize_t rc = read(tun_fd, batch + n*TUNNEL_MAX_PACKET, TUNNEL_MAX_PACKET);
+            if (rc <= 0) {
+                if (rc < 0 && errno != EAGAIN && errno != EINTR)
+                    fprintf(stderr,"warning: %s, interface read failed\n", argv[0]);
+                break;
+            }
+            batch_len[n++] = rc;
+        }
+        if (n == 0)
+            continue;
+
+        if (ll != NULL) {
+            // pack batch into as few frames as possible
+            for (i=0; i<n; i++) {
+                if (linklayer_tx_push(ll, batch + i*TUNNEL_MAX_PACKET, batch_len[i]) == 0) {
+                    num_packets_sent++;
+                    num_bytes_sent += batch_len[i];
+                }
+            }
+
+            // send frames back to back, up to a batch per burst
+            unsigned int num_frames;
+            do {
+                for (num_frames=0; num_frames<batch_size; num_frames++) {
+                    unsigned char * frame = frames + num_frames*ll_frame_len;
+                    unsigned int frame_len = linklayer_tx_pop(ll, frame, 1);
+                    if (frame_len == 0)
+                        break;
+
+                    tunnel_header(&headers[8*num_frames], pid, TUNNEL_LINK_ID, frame_len);
+                    packets[num_frames].header      = &headers[8*num_frames];
+                    packets[num_frames].payload     = frame;
+                    packets[num_frames].payload_len = frame_len;
+                    pid = (pid + 1) & 0xffff;
+                }
+                if (num_frames > 0)
+                    txcvr->transmit_packets(packets, num_frames, ms, fec0, fec1);
+            } while (num_frames == batch_size);
+            num_batches_sent++;
+
+            if (verbose)
+                printf("tx batch: %3u packet(s), total %8u\n", n, num_packets_sent);
+            continue;
+        }
+
+        // transmit each packet in its own frame, the whole batch in one
+        // burst
+        for (i=0; i<n; i++) {
+            tunnel_header(&headers[8*i], pid, TUNNEL_HEADER_ID, batch_len[i]);
+            packets[i].header      = &headers[8*i];
+            packets[i].payload     = batch + i*TUNNEL_MAX_PACKET;
+            packets[i].payload_len = batch_len[i];
+
+            pid = (pid + 1) & 0xffff;
+            num_packets_sent++;
+            num_bytes_sent += batch_len[i];
+        }
+        txcvr->transmit_packets(packets, n, ms, fec0, fec1);
+        num_batches_sent++;
+
+        if (verbose)
+            printf("tx batch: %3u packet(s), total %8u\n", n, num_packets_sent);
+    }
+
+    // compute actual run-time
+    float runtime = timer_toc(t0);
+
+    txcvr->stop_rx();
+
+    // print results
+    printf("    packets sent        : %8u (%u batches, %6.2f packets/batch)\n",
+            num_packets_sent, num_batches_sent,
+            num_batches_sent == 0 ? 0.0f : (float)num_packets_sent / (float)num_batches_sent);
+    printf("    bytes sent          : %8u\n", num_bytes_sent);
+    printf("    frames detected     : %8u\n", num_frames_detected);
+    printf("    packets received    : %8u\n", num_packets_received);
+    printf("    packets dropped     : %8u\n", num_packets_dropped);
+    printf("    bytes received      : %8u\n", num_bytes_received);
+    printf("    run time            : %f s\n", runtime);
+    printf("    tx data rate        : %8.4f kbps\n", 8e-3f*num_bytes_sent     / runtime);
+    printf("    rx data rate        : %8.4f kbps\n", 8e-3f*num_bytes_received / runtime);
+
+    // destroy objects
+    delete txcvr;
+    if (ll != NULL) {
+        linklayer_print(ll);
+        linklayer_destroy(ll);
+        free(frames);
+    }
+    timer_destroy(t0);
+    free(batch);
+    close(tun_fd);
+
+    printf("done.\n");
+    return 0;
+}
+
+// open TUN/TAP interface, returning non-blocking file descriptor
+//  _ifname     :   interface name (updated with name assigned by kernel)
+//  _flags      :   IFF_TUN or IFF_TAP
+int tun_open(char * _ifname,
+             int    _flags)
+{
+    int fd = open("/dev/net/tun", O_RDWR);
+    if (fd < 0) {
+        fprintf(stderr,"error: tun_open(), could not open /dev/net/tun\n");
+        return -1;
+    }
+
+    // attach to interface; packets carry no extra protocol information
+    struct ifreq ifr;
+    memset(&ifr, 0, sizeof(ifr));
+    ifr.ifr_flags = _flags | IFF_NO_PI;
+    strncpy(ifr.ifr_name, _ifname, IFNAMSIZ-1);
+    if (ioctl(fd, TUNSETIFF, (void*)&ifr) < 0) {
+        fprintf(stderr,"error: tun_open(), could not attach to interface '%s' (permissions?)\n", _ifname);
+        close(fd);
+        return -1;
+    }
+    strncpy(_ifname, ifr.ifr_name, IFNAMSIZ-1);
+    _ifname[IFNAMSIZ-1] = '\0';
+
+    // reads drain the interface in batches without blocking
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+    return fd;
+}
+
+// callback function
+int callback(unsigned char *  _header,
+             int              _header_valid,
+             unsigned char *  _payload,
+             unsigned int     _payload_len,
+             int              _payload_valid,
+             framesyncstats_s _stats,
+             void *           _userdata)
+{
+    num_frames_detected++;
+
+    // accept only tunneled frames
+    if (!_header_valid)
+        return 0;
+    unsigned int packet_len = (_header[6] << 8) | _header[7];
+
+    if (_header[3] == TUNNEL_LINK_ID && ll != NULL) {
+        // unpack aggregated/segmented packets
+        if (!_payload_valid || packet_len != _payload_len)
+            linklayer_rx_lost(ll);
+        else
+            linklayer_rx_execute(ll, _payload, _payload_len);
+        return 0;
+    } else if (_header[3] != TUNNEL_HEADER_ID) {
+        return 0;
+    }
+
+    if (!_payload_valid || packet_len != _payload_len) {
+        num_packets_dropped++;
+        return 0;
+    }
+
+    if (verbose) {
+        printf("***** rssi=%7.2fdB evm=%7.2fdB, rx packet[%5u] (%u bytes)\n",
+                _stats.rssi, _stats.evm,
+                (_header[0] << 8) | _header[1], _payload_len);
+    }
+
+    tun_write(_payload, _payload_len, NULL);
+    return 0;
+}
+
+// write received packet to interface
+void tun_write(unsigned char * _packet,
+               unsigned int    _packet_len,
+               void *          _userdata)
+{
+    // hand packet to network stack (drop if interface is congested)
+    if (write(tun_fd, _packet, _packet_len) != (ssize_t)_packet_len) {
+        num_packets_dropped++;
+        return;
+    }
+
+    num_packets_received++;
+    num_bytes_received += _packet_len;
+}
@@ -0,0 +1,139 @@
+/*
+ * Copyright (c) 2013 Joseph Gaeddert
+ *
+ * This file is part of liquid.
+ *
+ * liquid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * liquid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with liquid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+//
+// waterfall_dump.cc
+//
+// print summary, rows, and spectrum occupancy of a binary waterfall
+// (see include/waterfall.h) as recorded by asgram_rx
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <getopt.h>
+#include <vector>
+
+#include "waterfall.h"
+
+void usage() {
+    printf("waterfall_dump [OPTION] FILE\n");
+    printf("print contents of binary waterfall\n");
+    printf("\n");
+    printf("  u,h   : usage/help\n");
+    printf("  q/v   : quiet/verbose (print every row)\n");
+    printf("  s     : start time [s],           default: 0\n");
+    printf("  e     : end time [s],             default: (end of recording)\n");
+    printf("  t     : occupancy threshold [dB], default: -90 dB\n");
+}
+
+int main (int argc, char **argv)
+{
+    // command-line options
+    bool verbose = false;
+    double time_start = 0.0;            // start time relative to recording start [s]
+    double time_end   = -1.0;           // end time relative to recording start [s]
+    float threshold   = -90.0f;         // occupancy threshold [dB]
+
+    //
+    int d;
+    while ((d = getopt(argc,argv,"uhqvs:e:t:")) != EOF) {
+        switch (d) {
+        case 'u':
+        case 'h':   usage();                        return 0;
+        case 'q':   verbose     = false;            break;
+        case 'v':   verbose     = true;             break;
+        case 's':   time_start  = atof(optarg);     break;
+        case 'e':   time_end    = atof(optarg);     break;
+        case 't':   threshold   = atof(optarg);     break;
+        default:    usage();                        return 1;
+        }
+    }
+
+    if (optind >= argc) {
+        fprintf(stderr,"error: %s, input file required\n", argv[0]);
+        usage();
+        return 1;
+    }
+
+    // open waterfall
+    waterfallreader q = waterfallreader_open(argv[optind]);
+    if (q == NULL)
+        return 1;
+
+    unsigned int num_rows  = waterfallreader_get_num_rows(q);
+    unsigned int num_bins  = waterfallreader_get_num_bins(q);
+    double frequency       = waterfallreader_get_frequency(q);
+    double span            = waterfallreader_get_span(q);
+
+    // seek to time range
+    unsigned int i0 = waterfallreader_find(q, time_start);
+    unsigned int i1 = time_end < 0.0 ? num_rows : waterfallreader_find(q, time_end);
+
+    // per-bin occupancy counters and mean power
+    std::vector<unsigned int> num_occupied(num_bins, 0);
+    std::vector<double> power_sum(num_bins, 0.0);
+    std::vector<float> psd(num_bins);
+
+    unsigned int i;
+    unsigned int j;
+    double timestamp;
+    for (i=i0; i<i1; i++) {
+        waterfallreader_read(q, i, &psd.front(), &timestamp);
+        if (verbose)
+            printf("%8u t=%12.6f :", i, timestamp);
+        for (j=0; j<num_bins; j++) {
+            num_occupied[j] += psd[j] > threshold ? 1 : 0;
+            power_sum[j]    += psd[j];
+            if (verbose)
+                printf(" %6.1f", psd[j]);
+        }
+        if (verbose)
+            printf("\n");
+    }
+
+    // print occupancy
+    unsigned int n = i1 - i0;
+    if (n > 0) {
+        printf("  %14s %10s %10s\n", "frequency [Hz]", "mean [dB]", "occupancy");
+        for (j=0; j<num_bins; j++) {
+            printf("  %14.0f %10.2f %9.2f%%\n",
+                    frequency + ((double)j - 0.5*(num_bins-1))*span/num_bins,
+                    power_sum[j] / n,
+                    100.0f * num_occupied[j] / (float)n);
+        }
+    }
+
+    // print summary
+    double t0 = 0.0;
+    double t1 = 0.0;
+    if (n > 0) {
+        waterfallreader_get_row(q, i0,   &t0);
+        waterfallreader_get_row(q, i1-1, &t1);
+    }
+    printf("    rows                : %6u (of %u)\n", n, num_rows);
+    printf("    bins                : %6u\n", num_bins);
+    printf("    center frequency    : %12.4f MHz\n", frequency*1e-6);
+    printf("    span                : %12.4f kHz\n", span*1e-3);
+    printf("    resolution bandwidth: %12.4f Hz\n", waterfallreader_get_rbw(q));
+    printf("    duration            : %f s\n", t1 - t0);
+
+    waterfallreader_close(q);
+    return 0;
+}